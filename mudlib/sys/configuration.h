@@ -19,6 +19,10 @@
 #define IC_MAX_COMMANDS                 10
 #define IC_MODIFY_COMMAND               11
 #define IC_ENCODING                     12
+#define IC_MCCP_LEVEL                   13
+#define IC_MCCP_WINDOW_BITS             14
+#define IC_MCCP_MEM_LEVEL               15
+#define IC_MAX_COMMAND_BURST            16
 
 /* Possible options for configure_object().
  */
@@ -48,12 +52,19 @@
 #define DC_RESET_TIME                    13
 #define DC_DEBUG_FILE                    14
 #define DC_FILESYSTEM_ENCODING           15
+#define DC_PROFILE_SAMPLE_INTERVAL       16
+#define DC_FUNCTION_PROFILING            17
+#define DC_METRICS_FILE                  18
+#define DC_METRICS_INTERVAL              19
 
 #define DC_SIGACTION_SIGHUP              20
 #define DC_SIGACTION_SIGINT              21
 #define DC_SIGACTION_SIGUSR1             22
 #define DC_SIGACTION_SIGUSR2             23
 
+#define DC_JIT_THRESHOLD                 24
+#define DC_MAPPING_COMPACT_TIME          25
+
 /* Values for the DC_SIGACTION_SIG* options:
  */
 #define DCS_DEFAULT                      0
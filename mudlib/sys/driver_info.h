@@ -31,6 +31,9 @@
 #define DI_TRACE_LAST_UNCAUGHT_ERROR                         -45
 #define DI_TRACE_LAST_UNCAUGHT_ERROR_AS_STRING               -46
 
+/* Profiling */
+#define DI_PROFILE_SAMPLES_AS_STRING                         -50
+
 /* LPC Runtime statistics */
 #define DI_NUM_FUNCTION_NAME_CALLS                          -100
 #define DI_NUM_FUNCTION_NAME_CALL_HITS                      -101
@@ -57,12 +60,20 @@
 #define DI_NUM_REGEX_LOOKUP_MISSES                          -122
 #define DI_NUM_REGEX_LOOKUP_COLLISIONS                      -123
 
+#define DI_NUM_INCLUDE_CACHE_LOOKUPS                        -130
+#define DI_NUM_INCLUDE_CACHE_LOOKUP_HITS                    -131
+#define DI_NUM_INCLUDE_CACHE_LOOKUP_MISSES                  -132
+#define DI_NUM_INCLUDE_CACHE_LOOKUP_COLLISIONS              -133
+
+#define DI_NUM_PROFILE_SAMPLES                              -140
+
 /* Network statistics */
 #define DI_NUM_MESSAGES_OUT                                 -200
 #define DI_NUM_PACKETS_OUT                                  -201
 #define DI_NUM_PACKETS_IN                                   -202
 #define DI_SIZE_PACKETS_OUT                                 -203
 #define DI_SIZE_PACKETS_IN                                  -204
+#define DI_NUM_INPUT_CYCLES                                 -205
 
 /* Load */
 #define DI_LOAD_AVERAGE_COMMANDS                            -300
@@ -71,6 +82,15 @@
 #define DI_LOAD_AVERAGE_PROCESSED_OBJECTS_RELATIVE          -303
 #define DI_LOAD_AVERAGE_PROCESSED_HEARTBEATS_RELATIVE       -304
 
+/* Latencies */
+#define DI_LATENCY_MESSAGE                                  -350
+#define DI_LATENCY_COMMAND                                  -351
+#define DI_LATENCY_COMMAND_ROUND_TRIP                       -352
+#define DI_LATENCY_HEART_BEAT                               -353
+#define DI_LATENCY_CALL_OUT                                 -354
+#define DI_LATENCY_PROCESS_OBJECTS                          -355
+#define DI_LATENCY_CLEANUP                                  -356
+
 /* Memory use statistics */
 #define DI_NUM_ACTIONS                                      -400
 #define DI_NUM_CALLOUTS                                     -401
@@ -108,6 +128,12 @@
 #define DI_NUM_COROUTINES                                   -433
 #define DI_NUM_LPC_PYTHON_REFS                              -434
 #define DI_NUM_PYTHON_LPC_REFS                              -435
+#define DI_NUM_INCLUDE_CACHE                                -436
+#define DI_NUM_INCLUDE_CACHE_TABLE_SLOTS                    -437
+#define DI_NUM_MAPPING_COMPACTIONS                          -438
+#define DI_NUM_MAPPING_COMPACTIONS_DEFERRED                 -439
+#define DI_NUM_MAPPING_COMPACTION_ENTRIES                   -440
+#define DI_NUM_MAPPING_COMPACTION_STEPS                     -441
 
 #define DI_SIZE_ACTIONS                                     -450
 #define DI_SIZE_CALLOUTS                                    -451
@@ -134,6 +160,7 @@
 #define DI_SIZE_NAMED_OBJECT_TYPES_TABLE                    -472
 #define DI_SIZE_LWOBJECTS                                   -473
 #define DI_SIZE_COROUTINES                                  -474
+#define DI_SIZE_INCLUDE_CACHE                               -475
 
 /* Memory swapper statistics */
 #define DI_NUM_SWAP_BLOCKS                                  -500
@@ -146,6 +173,7 @@
 #define DI_SIZE_SWAP_BLOCKS_FREE                            -508
 #define DI_SIZE_SWAP_BLOCKS_REUSED                          -509
 #define DI_SWAP_RECYCLE_PHASE                               -510
+#define DI_NUM_SWAP_PREFETCHES                              -511
 
 /* Memory allocator statistics */
 #define DI_MEMORY_ALLOCATOR_NAME                            -600
@@ -214,6 +242,21 @@
 
 #define DIM_ES_MAX  9
 
+/* Indices into the arrays resulting from driver_info(DI_LATENCY_*),
+ * all times are given in microseconds.
+ */
+
+#define DIL_COUNT    0  /* Number of measurements */
+#define DIL_SUM      1  /* Sum of all measurements */
+#define DIL_HIGHEST  2  /* Highest measurement */
+#define DIL_P50      3  /* Median */
+#define DIL_P90      4  /* 90th percentile */
+#define DIL_P99      5  /* 99th percentile */
+#define DIL_P999     6  /* 99.9th percentile */
+#define DIL_BUCKETS  7  /* ({ ({ limit, count }), ... }) */
+
+#define DIL_MAX      8
+
 
 /* Definition of argument values for dump_driver_info()
  */
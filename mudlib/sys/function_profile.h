@@ -0,0 +1,17 @@
+#ifndef LPC_FUNCTION_PROFILE_H_
+#define LPC_FUNCTION_PROFILE_H_ 1
+
+/* Indices in the arrays returned from function_profile()
+ */
+
+#define FP_PROGRAM       0  /* Name of the program */
+#define FP_FUNCTION      1  /* Name of the function */
+#define FP_CALLS         2  /* Number of calls */
+#define FP_SELF_TICKS    3  /* Eval ticks spent in the function itself */
+#define FP_TOTAL_TICKS   4  /* Eval ticks including called functions */
+#define FP_SELF_TIME     5  /* Nanoseconds spent in the function itself */
+#define FP_TOTAL_TIME    6  /* Nanoseconds including called functions */
+
+#define FP_SIZE          7  /* Number of entries */
+
+#endif /* LPC_FUNCTION_PROFILE_H_ */
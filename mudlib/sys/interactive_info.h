@@ -15,6 +15,7 @@
 
 /* Telnet related information */
 #define II_MCCP_STATS                   -10
+#define II_MCCP_STREAM_LEVEL            -11
 
 /* Input handling */
 #define II_INPUT_PENDING                -20
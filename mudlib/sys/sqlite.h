@@ -0,0 +1,13 @@
+#ifndef _SQLITE_H
+#define _SQLITE_H
+
+/* Definitions for the SQLite efuns */
+
+/* Types of the calls to the callback of sl_exec_queued()
+ * and sl_exec_stream().
+ */
+#define SL_RESULT  0  /* The query has finished */
+#define SL_ROW     1  /* One row of a streamed query */
+#define SL_ERROR   2  /* The query failed */
+
+#endif
@@ -57,6 +57,7 @@
 #include "array.h"
 #include "backend.h"
 #include "closure.h"    /* closure_cmp(), closure_eq() */
+#include "instrs.h"     /* F_GT, F_LT */
 #include "interpret.h"
 #include "main.h"
 #include "mapping.h"
@@ -72,6 +73,7 @@
 
 #include "i-current_object.h"
 #include "i-svalue_cmp.h"
+#include "i-svalue_hash.h"
 
 /*-------------------------------------------------------------------------*/
 
@@ -86,6 +88,11 @@
  * TODO: Use SIZET_MAX instead of SSIZE_MAX, see port.h
  */
 
+#define MATCH_HASH_MIN_SIZE (32)
+  /* match_arrays() uses a hash table instead of ordering the arrays
+   * if both arrays together have at least this many elements.
+   */
+
 /*-------------------------------------------------------------------------*/
 
 int num_arrays;
@@ -1198,6 +1205,106 @@ lookup_key (svalue_t *key, vector_t *vec)
     return -1;
 } /* lookup_key() */
 
+/*-------------------------------------------------------------------------*/
+static Bool
+match_arrays_hashed (vector_t *vec1, vector_t *vec2, Bool *flags)
+
+/* Helper for match_arrays(): set the <flags> for <vec1> and <vec2>
+ * (initialized to FALSE) using a hash table over the elements of <vec2>.
+ * This takes linear time instead of ordering both arrays.
+ *
+ * Closures and ranges can't be hashed consistently with rvalue_eq().
+ * If the arrays contain any, FALSE is returned without touching the
+ * flags, and the caller has to order the arrays after all.
+ *
+ * When out of memory, an errorf() is thrown.
+ */
+
+{
+    size_t     len1, len2;  /* Length of vec1 and vec2 */
+    size_t     size;        /* Number of hash buckets */
+    int        bits;        /* log2(size) */
+    ptrdiff_t *table;       /* [size]: first vec2 index per bucket */
+    ptrdiff_t *chain;       /* [len2]: next distinct value in the bucket */
+    ptrdiff_t *same;        /* [len2]: next vec2 index with the same value */
+    Bool      *flag2;       /* The flags for vec2 */
+    size_t     i;
+
+    len1 = VEC_SIZE(vec1);
+    len2 = VEC_SIZE(vec2);
+    flag2 = flags + len1;
+
+    for (i = 0; i < len1 + len2; i++)
+    {
+        svalue_t *item = (i < len1) ? vec1->item + i : vec2->item + i - len1;
+        svalue_t *rv = get_rvalue(item, NULL);
+
+        if (rv == NULL || rv->type == T_CLOSURE)
+            return MY_FALSE;
+    }
+
+    for (bits = 1, size = 2; size < len2 && bits < 30; bits++, size <<= 1)
+        NOOP;
+
+    xallocate(table, (size + 2 * len2) * sizeof(*table), "hash table");
+    chain = table + size;
+    same = chain + len2;
+
+    for (i = 0; i < size; i++)
+        table[i] = -1;
+
+    /* Enter the distinct values of vec2 into the table, further elements
+     * with the same value are linked behind them through same[].
+     */
+    for (i = 0; i < len2; i++)
+    {
+        svalue_t  *rv = get_rvalue(vec2->item + i, NULL);
+        int        h = svalue_hash(rv, bits);
+        ptrdiff_t  j;
+
+        for (j = table[h]; j >= 0; j = chain[j])
+            if (svalue_eq(get_rvalue(vec2->item + j, NULL), rv))
+                break;
+
+        if (j >= 0)
+        {
+            same[i] = same[j];
+            same[j] = (ptrdiff_t)i;
+        }
+        else
+        {
+            chain[i] = table[h];
+            table[h] = (ptrdiff_t)i;
+            same[i] = -1;
+        }
+    }
+
+    /* Look up the elements of vec1. */
+    for (i = 0; i < len1; i++)
+    {
+        svalue_t  *rv = get_rvalue(vec1->item + i, NULL);
+        int        h = svalue_hash(rv, bits);
+        ptrdiff_t  j;
+
+        for (j = table[h]; j >= 0; j = chain[j])
+            if (svalue_eq(get_rvalue(vec2->item + j, NULL), rv))
+                break;
+
+        if (j < 0)
+            continue;
+
+        flags[i] = MY_TRUE;
+        if (!flag2[j])
+        {
+            for ( ; j >= 0; j = same[j])
+                flag2[j] = MY_TRUE;
+        }
+    }
+
+    xfree(table);
+    return MY_TRUE;
+} /* match_arrays_hashed() */
+
 /*-------------------------------------------------------------------------*/
 static Bool *
 match_arrays (vector_t *vec1, vector_t *vec2)
@@ -1289,6 +1396,16 @@ match_arrays (vector_t *vec1, vector_t *vec2)
         return flags;
     } /* if (one vector has only one element */
 
+    /* Larger arrays are matched through a hash table, if possible. */
+    if (len1 + len2 >= MATCH_HASH_MIN_SIZE)
+    {
+        sanitize_array(vec1);
+        sanitize_array(vec2);
+
+        if (match_arrays_hashed(vec1, vec2, flags))
+            return flags;
+    }
+
     /* The generic matching routine: first both arrays are ordered,
      * then compared side by side.
      */
@@ -2385,60 +2502,273 @@ x_map_array (svalue_t *sp, int num_arg)
 } /* x_map_array () */
 
 /*-------------------------------------------------------------------------*/
-svalue_t *
-v_sort_array (svalue_t * sp, int num_arg)
 
-/* EFUN sort_array()
- *
- *   mixed *sort_array(mixed *arr, string wrong_order
- *                               , object|string ob, mixed extra...)
- *   mixed *sort_array(mixed *arr, closure cl, mixed extra...)
- *
- * Create a shallow copy of array <arr> and sort that copy by the ordering
- * function ob->wrong_order(a, b), or by the closure expression 'cl'.
- * The sorted copy is returned as result.
- *
- * If the 'arr' argument equals 0, the result is also 0.
- * 'ob' is the object in which the ordering function is called
- * and may be given as object or by its filename.
- * If <ob> is omitted, or neither an object nor a string, then
- * this_object() is used.
- *
- * The elements from the array to be sorted are passed in pairs to
- * the function 'wrong_order' as arguments, followed by any <extra>
- * arguments.
- *
- * The function should return a positive number if the elements
- * are in the wrong order. It should return 0 or a negative
- * number if the elements are in the correct order.
- *
- * The sorting is implemented using Mergesort, which gives us a O(N*logN)
- * worst case behaviour and provides a stable sort.
+/* Kinds of values sort_native() can sort by.
+ */
+enum sort_key_kind
+{
+    SORT_KEYS_NONE = 0,  /* Can't be compared natively */
+    SORT_KEYS_INT,       /* All numbers */
+    SORT_KEYS_FLOAT,     /* All floats */
+    SORT_KEYS_NUMERIC,   /* Numbers and floats */
+    SORT_KEYS_STRING,    /* All strings, or all byte sequences */
+};
+
+/*-------------------------------------------------------------------------*/
+static enum sort_key_kind
+get_sort_key_kind (svalue_t *keys, mp_int size)
+
+/* Return which kind of values <keys>[0..<size>-1] are, and thus how
+ * sort_native() can compare them.
  */
 
 {
-    vector_t   *data;
-    svalue_t   *arg;
-    svalue_t   *items = NULL;
-    callback_t *cb;
-    int         error_index;
-    mp_int      step, halfstep, offset, size;
-    int         i, j, index1, index2, end1, end2;
-    svalue_t   *source, *dest, *temp;
-    Bool        inplace = MY_FALSE;
-    
-    arg = sp - num_arg + 1;
+    int   types = 0;  /* Bit 0: numbers, 1: floats, 2: strings, 3: bytes */
+    mp_int i;
 
-    error_index = setup_efun_callback(&cb, arg+1, num_arg-1);
-    if (error_index >= 0)
+    for (i = 0; i < size; i++)
     {
-        vefun_bad_arg(error_index+2, arg);
+        switch (keys[i].type)
+        {
+        case T_NUMBER:
+            types |= 1;
+            break;
+
+        case T_FLOAT:
+        {
+            double d = READ_DOUBLE(keys+i);
+
+            /* NaNs can't be ordered by the radix sort. */
+            types |= (d != d) ? 3 : 2;
+            break;
+        }
+
+        case T_STRING:
+            types |= 4;
+            break;
+
+        case T_BYTES:
+            types |= 8;
+            break;
+
+        default:
+            return SORT_KEYS_NONE;
+        }
+    }
+
+    switch (types)
+    {
+    case 1: return SORT_KEYS_INT;
+    case 2: return SORT_KEYS_FLOAT;
+    case 3: return SORT_KEYS_NUMERIC;
+    case 4:
+    case 8: return SORT_KEYS_STRING;
+    default: return SORT_KEYS_NONE;
+    }
+} /* get_sort_key_kind() */
+
+/*-------------------------------------------------------------------------*/
+static INLINE int
+compare_sort_keys (svalue_t *a, svalue_t *b)
+
+/* Compare the sort keys <a> and <b> of the same kind the way the
+ * operators < and > do, return a negative number, 0 or a positive number
+ * if <a> is less than, equal to or greater than <b>.
+ */
+
+{
+    double da, db;
+
+    if (a->type == T_STRING || a->type == T_BYTES)
+        return mstrcmp(a->u.str, b->u.str);
+
+    if (a->type == T_NUMBER && b->type == T_NUMBER)
+        return (a->u.number > b->u.number) - (a->u.number < b->u.number);
+
+    da = (a->type == T_NUMBER) ? (double)a->u.number : READ_DOUBLE(a);
+    db = (b->type == T_NUMBER) ? (double)b->u.number : READ_DOUBLE(b);
+    return (da > db) - (da < db);
+} /* compare_sort_keys() */
+
+/*-------------------------------------------------------------------------*/
+static INLINE uint64_t
+radix_sort_key (svalue_t *key)
+
+/* Return the number or float <key> as an unsigned number with the same
+ * ordering.
+ */
+
+{
+    const uint64_t sign = (uint64_t)1 << 63;
+    uint64_t bits;
+    double d;
+
+    if (key->type == T_NUMBER)
+        return (uint64_t)(int64_t)key->u.number ^ sign;
+
+    /* -0.0 and 0.0 compare equal, so they must get the same key. */
+    d = READ_DOUBLE(key);
+    if (d == 0.0)
+        d = 0.0;
+    memcpy(&bits, &d, sizeof(bits));
+
+    return (bits & sign) ? ~bits : (bits | sign);
+} /* radix_sort_key() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sort_native (svalue_t *items, svalue_t *keys, mp_int size
+            , enum sort_key_kind kind, bool descending)
+
+/* Sort the svalues <items>[0..<size>-1] by the values <keys>[0..<size>-1]
+ * of the given <kind> in ascending order, or in descending order if
+ * <descending> is true. The sort is stable. <keys> may be the same
+ * as <items>, other keys are not sorted.
+ *
+ * Numbers and floats are sorted by a LSD radix sort, strings (and
+ * numbers mixed with floats, which can't be mapped onto one radix key)
+ * by a mergesort. Both sort an index vector, the items are moved into
+ * their places in the end. No LPC code is called and no error can
+ * happen after the memory has been allocated, so the svalues can be
+ * moved without adjusting their refcounts.
+ */
+
+{
+    void     *block;
+    p_int    *order, *scratch, *temp;
+    uint64_t *radix = NULL;
+    svalue_t *sorted;
+    size_t    blocksize;
+    mp_int    i;
+
+    blocksize = size * (2 * sizeof(*order) + sizeof(*sorted));
+    if (kind == SORT_KEYS_INT || kind == SORT_KEYS_FLOAT)
+        blocksize += size * sizeof(*radix);
+
+    block = xalloc(blocksize);
+    if (!block)
+    {
+        errorf("Out of memory (%zu bytes) for sorting.\n", blocksize);
         /* NOTREACHED */
-        return arg;
+        return;
     }
-    inter_sp = sp = arg+1;
-    put_callback(sp, cb);
-    num_arg = 2;
+
+    sorted = (svalue_t *)block;
+    order = (p_int *)(sorted + size);
+    scratch = order + size;
+
+    for (i = 0; i < size; i++)
+        order[i] = i;
+
+    if (kind == SORT_KEYS_INT || kind == SORT_KEYS_FLOAT)
+    {
+        int shift;
+
+        radix = (uint64_t *)(scratch + size);
+        for (i = 0; i < size; i++)
+        {
+            radix[i] = radix_sort_key(keys+i);
+            if (descending)
+                radix[i] = ~radix[i];
+        }
+
+        for (shift = 0; shift < 64; shift += 8)
+        {
+            mp_int count[256];
+            mp_int pos;
+            int b;
+
+            memset(count, 0, sizeof(count));
+            for (i = 0; i < size; i++)
+                count[(radix[i] >> shift) & 0xff]++;
+
+            /* Skip the digits that are the same for all keys. */
+            if (count[(radix[0] >> shift) & 0xff] == size)
+                continue;
+
+            for (b = 0, pos = 0; b < 256; b++)
+            {
+                mp_int num = count[b];
+                count[b] = pos;
+                pos += num;
+            }
+
+            for (i = 0; i < size; i++)
+                scratch[count[(radix[order[i]] >> shift) & 0xff]++] = order[i];
+
+            temp = order;
+            order = scratch;
+            scratch = temp;
+        }
+    }
+    else
+    {
+        mp_int step, halfstep;
+
+        for (step = 2, halfstep = 1; halfstep < size; halfstep = step, step += step)
+        {
+            mp_int j;
+
+            for (i = j = 0; i < size; i += step)
+            {
+                mp_int index1 = i;
+                mp_int index2 = i + halfstep;
+                mp_int end1 = (index2 > size) ? size : index2;
+                mp_int end2 = (i + step > size) ? size : i + step;
+
+                while (index1 < end1 && index2 < end2)
+                {
+                    int cmp = compare_sort_keys(keys + order[index1]
+                                               , keys + order[index2]);
+
+                    if (descending ? (cmp < 0) : (cmp > 0))
+                        scratch[j++] = order[index2++];
+                    else
+                        scratch[j++] = order[index1++];
+                }
+
+                while (index1 < end1)
+                    scratch[j++] = order[index1++];
+                while (index2 < end2)
+                    scratch[j++] = order[index2++];
+            }
+
+            temp = order;
+            order = scratch;
+            scratch = temp;
+        }
+    }
+
+    for (i = 0; i < size; i++)
+        sorted[i] = items[order[i]];
+    memcpy(items, sorted, size * sizeof(*items));
+
+    xfree(block);
+} /* sort_native() */
+
+/*-------------------------------------------------------------------------*/
+static svalue_t *
+get_sort_items (svalue_t *arg, svalue_t *sp, const char *fname, mp_int *psize)
+
+/* Prepare the array argument <arg> of sort_array() or sort_array_by()
+ * (<fname> is used in error messages) for sorting, <sp> is the current
+ * stack pointer.
+ *
+ * If <arg> is given by reference, the referenced array, range or
+ * mapping range is sorted in place. If the reference is to a whole
+ * array, the array is put directly into <arg>. Otherwise a shallow copy
+ * of an array with more than one ref is made and put into <arg>.
+ * Destructed objects in the values to sort are replaced by 0.
+ *
+ * Return a pointer to the first value to sort and their number in
+ * *<psize>, or NULL if the values are all zero and thus sorted.
+ */
+
+{
+    vector_t *data;
+    svalue_t *items = NULL;
+    mp_int    offset, size, i;
+    Bool      inplace = MY_FALSE;
 
     /* If the argument is passed in by reference, make sure that it is
      * an array, place the argument vector directly into the stack and set
@@ -2460,11 +2790,11 @@ v_sort_array (svalue_t * sp, int num_arg)
                     if (r->vec.type != T_POINTER)
                     {
                         inter_sp = sp;
-                        errorf("Bad arg 1 to sort_array(): got '%s[..] &', "
+                        errorf("Bad arg 1 to %s(): got '%s[..] &', "
                                "expected 'mixed * / mixed *&'.\n"
-                               , sv_typename(&(r->vec)));
+                               , fname, sv_typename(&(r->vec)));
                         // NOTREACHED
-                        return sp;
+                        return NULL;
                     }
 
                     offset = r->index1;
@@ -2481,8 +2811,8 @@ v_sort_array (svalue_t * sp, int num_arg)
                     if (items == &const0)
                     {
                         /* Not existing entries are all zeroes, so they are sorted. */
-                        pop_stack();
-                        return arg;
+                        *psize = 0;
+                        return NULL;
                     }
 
                     data = NULL;
@@ -2508,11 +2838,11 @@ v_sort_array (svalue_t * sp, int num_arg)
         else
         {
             inter_sp = sp;
-            errorf("Bad arg 1 to sort_array(): got '%s &', "
+            errorf("Bad arg 1 to %s(): got '%s &', "
                    "expected 'mixed * / mixed *&'.\n"
-                   , sv_typename(svp));
+                   , fname, sv_typename(svp));
             // NOTREACHED
-            return sp;
+            return NULL;
         }
 
         inplace = MY_TRUE;
@@ -2558,6 +2888,68 @@ v_sort_array (svalue_t * sp, int num_arg)
      * (LVALUE_PROTECTED_MAP_RANGE case).
      */
 
+    *psize = size;
+    return items + offset;
+} /* get_sort_items() */
+
+/*-------------------------------------------------------------------------*/
+svalue_t *
+v_sort_array (svalue_t * sp, int num_arg)
+
+/* EFUN sort_array()
+ *
+ *   mixed *sort_array(mixed *arr, string wrong_order
+ *                               , object|string ob, mixed extra...)
+ *   mixed *sort_array(mixed *arr, closure cl, mixed extra...)
+ *
+ * Create a shallow copy of array <arr> and sort that copy by the ordering
+ * function ob->wrong_order(a, b), or by the closure expression 'cl'.
+ * The sorted copy is returned as result.
+ *
+ * If the 'arr' argument equals 0, the result is also 0.
+ * 'ob' is the object in which the ordering function is called
+ * and may be given as object or by its filename.
+ * If <ob> is omitted, or neither an object nor a string, then
+ * this_object() is used.
+ *
+ * The elements from the array to be sorted are passed in pairs to
+ * the function 'wrong_order' as arguments, followed by any <extra>
+ * arguments.
+ *
+ * The function should return a positive number if the elements
+ * are in the wrong order. It should return 0 or a negative
+ * number if the elements are in the correct order.
+ *
+ * The sorting is implemented using Mergesort, which gives us a O(N*logN)
+ * worst case behaviour and provides a stable sort. If the ordering is
+ * given by #'> or #'< and the values are all numbers or all strings,
+ * they are sorted natively without calling the closure.
+ */
+
+{
+    svalue_t   *arg;
+    svalue_t   *items;
+    callback_t *cb;
+    int         error_index;
+    mp_int      step, halfstep, size;
+    int         i, j, index1, index2, end1, end2;
+    svalue_t   *source, *dest, *temp;
+    
+    arg = sp - num_arg + 1;
+
+    error_index = setup_efun_callback(&cb, arg+1, num_arg-1);
+    if (error_index >= 0)
+    {
+        vefun_bad_arg(error_index+2, arg);
+        /* NOTREACHED */
+        return arg;
+    }
+    inter_sp = sp = arg+1;
+    put_callback(sp, cb);
+    num_arg = 2;
+
+    items = get_sort_items(arg, sp, "sort_array", &size);
+
     /* Easiest case: nothing to sort */
     if (size <= 1)
     {
@@ -2565,6 +2957,31 @@ v_sort_array (svalue_t * sp, int num_arg)
         return arg;
     }
 
+    /* The comparison operators as ordering function on numbers or
+     * strings don't need to be called.
+     */
+    if (cb->is_closure && cb->num_arg == 0
+     && valid_callback_object(cb))
+    {
+        int type = cb->function.closure.x.closure_type;
+
+        if (type < CLOSURE_LWO)
+            type -= CLOSURE_LWO;
+
+        if (type == CLOSURE_EFUN + F_GT || type == CLOSURE_EFUN + F_LT)
+        {
+            enum sort_key_kind kind = get_sort_key_kind(items, size);
+
+            if (kind == SORT_KEYS_INT || kind == SORT_KEYS_STRING)
+            {
+                sort_native(items, items, size, kind
+                           , type == CLOSURE_EFUN + F_LT);
+                pop_stack();
+                return arg;
+            }
+        }
+    }
+
     /* In order to provide clean error recovery, data must always hold
      * exactly one copy of each original content svalue when an error is
      * possible. Thus, it would be not a good idea to use it as scrap
@@ -2580,7 +2997,7 @@ v_sort_array (svalue_t * sp, int num_arg)
     }
 
     for (i = 0; i < size; i++)
-        source[i] = items[offset+i];
+        source[i] = items[i];
 
     step = 2;
     halfstep = 1;
@@ -2633,12 +3050,118 @@ v_sort_array (svalue_t * sp, int num_arg)
     }
 
     for (i = size; --i >= 0; )
-      items[offset+i] = source[i];
+      items[i] = source[i];
 
     pop_stack();
     return arg;
 } /* v_sort_array() */
 
+/*-------------------------------------------------------------------------*/
+svalue_t *
+v_sort_array_by (svalue_t * sp, int num_arg)
+
+/* EFUN sort_array_by()
+ *
+ *   mixed *sort_array_by(mixed *arr, string key_fun
+ *                                  , object|string ob, mixed extra...)
+ *   mixed *sort_array_by(mixed *arr, closure cl, mixed extra...)
+ *
+ * Sort array <arr> like sort_array() does, but in ascending order of
+ * the keys returned by ob->key_fun(elem) or the closure 'cl' for each
+ * element, again followed by any <extra> arguments. The key function
+ * is called just once per element, the keys are then compared natively.
+ * The keys must be all numbers and floats, or all strings, or all byte
+ * sequences.
+ *
+ * The sort is stable, numbers and floats are sorted by a radix sort.
+ */
+
+{
+    svalue_t   *arg;
+    svalue_t   *items;
+    vector_t   *keys;
+    callback_t *cb;
+    int         error_index;
+    mp_int      size, i;
+    enum sort_key_kind kind;
+
+    arg = sp - num_arg + 1;
+
+    error_index = setup_efun_callback(&cb, arg+1, num_arg-1);
+    if (error_index >= 0)
+    {
+        vefun_bad_arg(error_index+2, arg);
+        /* NOTREACHED */
+        return arg;
+    }
+    inter_sp = sp = arg+1;
+    put_callback(sp, cb);
+    num_arg = 2;
+
+    items = get_sort_items(arg, sp, "sort_array_by", &size);
+
+    if (size <= 1)
+    {
+        pop_stack();
+        return arg;
+    }
+
+    keys = allocate_array(size);
+    if (!keys)
+        errorf("(sort_array_by) Out of memory: array[%"PRIdMPINT
+            "] for the keys\n", size);
+    push_array(inter_sp, keys); /* In case of errors */
+
+    for (i = 0; i < size; i++)
+    {
+        svalue_t *v;
+
+        if (!valid_callback_object(cb))
+            errorf("object used by sort_array_by destructed");
+
+        /* The key function might have changed the mapping. */
+        if (arg->type == T_LVALUE
+         && arg->x.lvalue_type == LVALUE_PROTECTED_MAP_RANGE)
+        {
+            struct protected_map_range_lvalue *r = arg->u.protected_map_range_lvalue;
+            svalue_t *values = get_map_value(r->map, &(r->key));
+
+            if (values == &const0)
+            {
+                items = NULL;
+                break;
+            }
+            items = values + r->index1;
+        }
+
+        push_rvalue(items+i);
+        v = apply_callback(cb, 1);
+        if (v)
+        {
+            transfer_rvalue_no_free(keys->item+i, v);
+            v->type = T_INVALID;
+        }
+    }
+
+    if (items)
+    {
+        kind = get_sort_key_kind(keys->item, size);
+        if (kind == SORT_KEYS_NONE)
+        {
+            errorf("Bad keys for sort_array_by(): expected all ints and "
+                   "floats, all strings or all bytes.\n");
+            /* NOTREACHED */
+            return arg;
+        }
+
+        sort_native(items, keys->item, size, kind, false);
+    }
+
+    pop_stack(); /* The keys */
+    pop_stack(); /* The callback */
+    return arg;
+} /* v_sort_array_by() */
+
 /*-------------------------------------------------------------------------*/
 svalue_t *
 v_filter_objects (svalue_t *sp, int num_arg)
@@ -3179,15 +3702,21 @@ f_transpose_array (svalue_t *sp)
  *         |
  *         V
  *        ...
+ *
+ * The tooth heads are also entered into a hash table by their marker
+ * value, so that the tooth for a marker is found without walking the
+ * spine.
  */
 
 struct unique
 {
-    int count;            /* Number of structures in this tooth */
+    int count;            /* Number of structures in this tooth (head only) */
     svalue_t *val;        /* The object itself */
     svalue_t mark;        /* The marker value for this object */
     struct unique *same;  /* Next structure in this tooth */
     struct unique *next;  /* Next tooth head */
+    struct unique *last;  /* Last structure in this tooth (head only) */
+    struct unique *chain; /* Next tooth head in the same hash bucket */
 };
 
 /*-------------------------------------------------------------------------*/
@@ -3223,83 +3752,81 @@ sameval (svalue_t *arg1, svalue_t *arg2)
 
 
 /*-------------------------------------------------------------------------*/
-static int
-put_in (Mempool pool, struct unique **ulist
+static Bool
+put_in (Mempool pool, struct unique **ulist, struct unique **table, int bits
        , svalue_t *marker, svalue_t *elem)
 
 /* Insert the object <elem> according to its <marker> value into the comb
- * of unique structures. <ulist> points to the root pointer of this comb.
- * Return the (new) number of distinct markers.
+ * of unique structures. <ulist> points to the root pointer of this comb,
+ * <table> to the hash table of 1 << <bits> buckets for the tooth heads.
+ * Return TRUE if a new tooth was started.
  */
 
 {
-    struct unique *llink, *slink, *tlink;
-    int cnt;                      /* Number of distinct markers */
-    Bool fixed;                   /* True: <elem> was inserted */
-
-    llink = *ulist;
-    cnt = 0;
-    fixed = 0;
-
-    /* Loop through the comb's top level, counting the distinct marker
-     * and searching for the right teeth to insert <elem> into.
-     */
-    while (llink) {
-        if (!fixed && sameval(marker, &(llink->mark))) {
-
-            /* Insert the new <elem> here
-             */
-            for (tlink = llink; tlink->same; tlink = tlink->same) tlink->count++;
-            tlink->count++;
-            /* TODO: Is the above really necessary?
-             *   slink = new unique; llink->same = slink; llink->count++;
-             * should be sufficient.
-             */
-
-            slink = mempool_alloc(pool, sizeof(struct unique));
-            if (!slink)
-            {
-                errorf("(unique_array) Out of memory (%lu bytes pooled) "
-                      "for comb.\n", (unsigned long)sizeof(struct unique));
-                /* NOTREACHED */
-                return 0;
-            }
-            slink->count = 1;
-            assign_svalue_no_free(&slink->mark,marker);
-            slink->val = elem;
-            slink->same = NULL;
-            slink->next = NULL;
-            tlink->same = slink;
-
-            fixed = 1; /* ...just continue to count now */
-            /* TODO: Do not recount the comb size all the time! */
+    struct unique *llink, *slink;
+    int h = -1;                   /* The hash bucket for <marker> */
+
+    /* Markers sameval() can't match don't need to be searched for. */
+    switch (marker->type)
+    {
+    case T_NUMBER:
+    case T_POINTER:
+    case T_STRING:
+    case T_BYTES:
+    case T_OBJECT:
+    case T_LWOBJECT:
+    case T_COROUTINE:
+    case T_LPCTYPE:
+        h = svalue_hash(marker, bits);
+        for (llink = table[h]; llink; llink = llink->chain)
+        {
+            if (sameval(marker, &(llink->mark)))
+                break;
         }
+        break;
 
-        llink=llink->next;
-        cnt++;
+    default:
+        llink = NULL;
+        break;
     }
-    if (fixed)
-        return cnt;
 
-    /* It's a really new marker -> start a new tooth in the comb.
-     */
-    llink = mempool_alloc(pool, sizeof(struct unique));
-    if (!llink)
+    slink = mempool_alloc(pool, sizeof(struct unique));
+    if (!slink)
     {
         errorf("(unique_array) Out of memory (%lu bytes pooled) "
               "for comb.\n", (unsigned long)sizeof(struct unique));
         /* NOTREACHED */
-        return 0;
+        return MY_FALSE;
+    }
+    assign_svalue_no_free(&slink->mark,marker);
+    slink->val = elem;
+    slink->same = NULL;
+    slink->next = NULL;
+    slink->chain = NULL;
+
+    if (llink)
+    {
+        /* Append the new <elem> to this tooth. */
+        llink->last->same = slink;
+        llink->last = slink;
+        llink->count++;
+        return MY_FALSE;
     }
-    llink->count = 1;
-    assign_svalue_no_free(&llink->mark,marker);
-    llink->val = elem;
-    llink->same = NULL;
 
-    llink->next = *ulist;
-    *ulist = llink;
+    /* It's a really new marker -> start a new tooth in the comb.
+     */
+    slink->count = 1;
+    slink->last = slink;
+    slink->next = *ulist;
+    *ulist = slink;
 
-    return cnt+1;
+    if (h >= 0)
+    {
+        slink->chain = table[h];
+        table[h] = slink;
+    }
+
+    return MY_TRUE;
 } /* put_in() */
 
 
@@ -3310,9 +3837,10 @@ put_in (Mempool pool, struct unique **ulist
  */
 
 struct unique_cleanup_s {
-    error_handler_t head;  /* The link to the error handler function */
-    Mempool         pool;  /* Pool for the unique structures */
-    vector_t      * arr;   /* Protective reference to the array */
+    error_handler_t  head;   /* The link to the error handler function */
+    Mempool          pool;   /* Pool for the unique structures */
+    struct unique ** table;  /* Hash table for the tooth heads */
+    vector_t       * arr;    /* Protective reference to the array */
 };
 
 static void
@@ -3322,6 +3850,8 @@ make_unique_cleanup (error_handler_t * arg)
 
     if (data->pool)
         mempool_delete(data->pool);
+    if (data->table)
+        xfree(data->table);
     if (data->arr)
         deref_array(data->arr);
     xfree(arg);
@@ -3347,6 +3877,8 @@ make_unique (vector_t *arr, callback_t *cb, svalue_t *skipnum)
     mp_int ant;           /* Number of distinct markers */
     mp_int cnt, cnt2;
     struct unique_cleanup_s * ucp;
+    struct unique **table;   /* Hash table for the tooth heads */
+    int bits;                /* log2(size of the table) */
 
     head = NULL;
 
@@ -3374,10 +3906,22 @@ make_unique (vector_t *arr, callback_t *cb, svalue_t *skipnum)
     }
 
     ucp->pool = pool;
+    ucp->table = NULL;
     ucp->arr = ref_array(arr);  /* Prevent apply from freeing this */
 
     push_error_handler(make_unique_cleanup, &(ucp->head));
 
+    /* Get the hash table, with about one bucket per element. */
+    for (bits = 1; ((mp_int)1 << bits) < arr_size && bits < 30; bits++)
+        NOOP;
+
+    table = xalloc(sizeof(*table) << bits);
+    if (!table)
+        errorf("(unique_array) Out of memory: (%lu bytes) for hash table\n"
+             , (unsigned long)(sizeof(*table) << bits));
+    memset(table, 0, sizeof(*table) << bits);
+    ucp->table = table;
+
     /* Build the comb structure.
      */
     ant = 0;
@@ -3405,8 +3949,8 @@ make_unique (vector_t *arr, callback_t *cb, svalue_t *skipnum)
                 push_ref_object(inter_sp, item->u.ob, "unique_array");
 
             v = apply_callback(cb, cb->is_closure ? 1 : 0);
-            if (v && !sameval(v, skipnum))
-                ant = put_in(pool, &head, v, item);
+            if (v && !sameval(v, skipnum) && put_in(pool, &head, table, bits, v, item))
+                ant++;
         }
         else if (item->type == T_LWOBJECT)
         {
@@ -3416,8 +3960,8 @@ make_unique (vector_t *arr, callback_t *cb, svalue_t *skipnum)
                 push_ref_lwobject(inter_sp, item->u.lwob);
 
             v = apply_callback(cb, cb->is_closure ? 1 : 0);
-            if (v && !sameval(v, skipnum))
-                ant = put_in(pool, &head, v, item);
+            if (v && !sameval(v, skipnum) && put_in(pool, &head, table, bits, v, item))
+                ant++;
         }
     }
 
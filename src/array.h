@@ -90,6 +90,7 @@ extern vector_t * symmetric_diff_array (vector_t *vec1, vector_t *vec2);
 extern svalue_t *v_allocate(svalue_t *sp, int num_arg);
 extern svalue_t *x_filter_array(svalue_t *sp, int num_arg);
 extern svalue_t *v_sort_array(svalue_t *sp, int num_arg);
+extern svalue_t *v_sort_array_by(svalue_t *sp, int num_arg);
 extern svalue_t *x_map_array(svalue_t *sp, int num_arg);
 extern svalue_t *f_transpose_array(svalue_t *sp);
 
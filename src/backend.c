@@ -79,6 +79,7 @@
 #include "../mudlib/sys/configuration.h"
 #include "../mudlib/sys/driver_hook.h"
 #include "../mudlib/sys/debug_message.h"
+#include "../mudlib/sys/driver_info.h"
 #include "../mudlib/sys/signals.h"
 
 /*-------------------------------------------------------------------------*/
@@ -189,6 +190,61 @@ char sigaction_sighup  = DCS_DEFAULT,
  * They are evaluated immediately when the signal occurs.
  */
 
+/* --- Latency histograms ---
+ *
+ * The durations of the backend phases and the command round trips are
+ * collected in histograms with HDR-style buckets: values (in microseconds)
+ * below 2*LATENCY_SUB_BUCKETS have a bucket each, above that each power
+ * of two is divided into LATENCY_SUB_BUCKETS buckets of equal width. So
+ * the relative error of a bucket is less than 1/LATENCY_SUB_BUCKETS,
+ * for values up to 2^LATENCY_MAX_BITS microseconds.
+ */
+
+#define LATENCY_SUB_BUCKET_BITS  3
+#define LATENCY_SUB_BUCKETS      (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS         40
+#define LATENCY_NUM_BUCKETS      ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+enum latency_phase {
+    LP_MESSAGE = 0,       /* get_message(), including the wait for input */
+    LP_COMMAND,           /* Execution of a single command */
+    LP_COMMAND_ROUND_TRIP,/* From the reception of a command to its prompt */
+    LP_HEART_BEAT,        /* One round of heart beats */
+    LP_CALL_OUT,          /* One round of call outs */
+    LP_PROCESS_OBJECTS,   /* Resets, cleanups and swapping */
+    LP_CLEANUP,           /* Removal of destructed objects and extra jobs */
+    LP_NUM_PHASES
+};
+
+typedef struct latency_histogram_s
+{
+    const char    *name;      /* Name of the phase in the metrics file */
+    statcounter_t  count;     /* Number of measurements */
+    statcounter_t  sum;       /* Sum of all measurements */
+    statcounter_t  highest;   /* Highest measurement */
+    statcounter_t  buckets[LATENCY_NUM_BUCKETS];
+} latency_histogram_t;
+
+static latency_histogram_t latency_histograms[LP_NUM_PHASES]
+  = { { "message" }, { "command" }, { "command_round_trip" }
+    , { "heart_beat" }, { "call_out" }, { "process_objects" }
+    , { "cleanup" }
+    };
+  /* The histograms of all phases, indexed by enum latency_phase.
+   */
+
+static char *metrics_file = NULL;
+  /* The (native) name of the metrics file, or NULL if none is written.
+   */
+
+static mp_int metrics_interval = 60;
+  /* Seconds between two writes of the metrics file.
+   */
+
+static mp_int time_of_next_metrics = 0;
+  /* The time when the metrics file is written next.
+   */
+
 /*-------------------------------------------------------------------------*/
 
 /* --- Forward declarations --- */
@@ -266,6 +322,292 @@ update_compile_av (int lines)
     update_statistic(&stat_compile, lines);
 } /* update_compile_av() */
 
+/*-------------------------------------------------------------------------*/
+uint64_t
+get_latency_time (void)
+
+/* Return the current time in microseconds for the latency histograms.
+ * The time is monotonic, but has no fixed starting point.
+ */
+
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        return 0;
+
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+} /* get_latency_time() */
+
+/*-------------------------------------------------------------------------*/
+static int
+latency_bucket (uint64_t value)
+
+/* Return the index of the histogram bucket for <value>.
+ */
+
+{
+    int shift = 0;
+
+    if (value >= ((uint64_t)1 << LATENCY_MAX_BITS))
+        value = ((uint64_t)1 << LATENCY_MAX_BITS) - 1;
+
+    while ((value >> shift) >= 2 * LATENCY_SUB_BUCKETS)
+        shift++;
+
+    return shift * LATENCY_SUB_BUCKETS + (int)(value >> shift);
+} /* latency_bucket() */
+
+/*-------------------------------------------------------------------------*/
+static uint64_t
+latency_bucket_limit (int bucket)
+
+/* Return the lowest value that does not belong into <bucket> anymore.
+ */
+
+{
+    int shift;
+
+    if (bucket < 2 * LATENCY_SUB_BUCKETS)
+        return (uint64_t)bucket + 1;
+
+    shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return (uint64_t)(bucket - shift * LATENCY_SUB_BUCKETS + 1) << shift;
+} /* latency_bucket_limit() */
+
+/*-------------------------------------------------------------------------*/
+static void
+add_latency (enum latency_phase phase, uint64_t start)
+
+/* Add the time since <start> (as returned by get_latency_time())
+ * to the histogram of <phase>.
+ */
+
+{
+    latency_histogram_t *hist = latency_histograms + phase;
+    uint64_t now = get_latency_time();
+    uint64_t value = now > start ? now - start : 0;
+
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->highest)
+        hist->highest = value;
+    hist->buckets[latency_bucket(value)]++;
+} /* add_latency() */
+
+/*-------------------------------------------------------------------------*/
+static statcounter_t
+latency_percentile (latency_histogram_t *hist, int permille)
+
+/* Return the value below which <permille>/1000 of the measurements in
+ * <hist> lie, that is the limit of the bucket containing this percentile.
+ */
+
+{
+    statcounter_t target, seen = 0;
+
+    if (!hist->count)
+        return 0;
+
+    target = (hist->count * permille + 999) / 1000;
+    if (!target)
+        target = 1;
+
+    for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= target)
+        {
+            statcounter_t limit = latency_bucket_limit(i);
+            return limit > hist->highest ? hist->highest : limit;
+        }
+    }
+
+    return hist->highest;
+} /* latency_percentile() */
+
+/*-------------------------------------------------------------------------*/
+void
+backend_driver_info (svalue_t *svp, int value)
+
+/* Returns the latency histograms for driver_info(<what>).
+ * <svp> points to the svalue for the result.
+ */
+
+{
+    latency_histogram_t *hist;
+    vector_t *result, *buckets;
+    int num_buckets = 0;
+
+    switch (value)
+    {
+        case DI_LATENCY_MESSAGE:            hist = latency_histograms + LP_MESSAGE; break;
+        case DI_LATENCY_COMMAND:            hist = latency_histograms + LP_COMMAND; break;
+        case DI_LATENCY_COMMAND_ROUND_TRIP: hist = latency_histograms + LP_COMMAND_ROUND_TRIP; break;
+        case DI_LATENCY_HEART_BEAT:         hist = latency_histograms + LP_HEART_BEAT; break;
+        case DI_LATENCY_CALL_OUT:           hist = latency_histograms + LP_CALL_OUT; break;
+        case DI_LATENCY_PROCESS_OBJECTS:    hist = latency_histograms + LP_PROCESS_OBJECTS; break;
+        case DI_LATENCY_CLEANUP:            hist = latency_histograms + LP_CLEANUP; break;
+
+        default:
+            fatal("Unknown option for backend_driver_info(): %d\n", value);
+            return;
+    }
+
+    for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+    {
+        if (hist->buckets[i])
+            num_buckets++;
+    }
+
+    result = allocate_array(DIL_MAX);
+    put_array(svp, result);
+
+    put_number(result->item + DIL_COUNT, (p_int)hist->count);
+    put_number(result->item + DIL_SUM, (p_int)hist->sum);
+    put_number(result->item + DIL_HIGHEST, (p_int)hist->highest);
+    put_number(result->item + DIL_P50, (p_int)latency_percentile(hist, 500));
+    put_number(result->item + DIL_P90, (p_int)latency_percentile(hist, 900));
+    put_number(result->item + DIL_P99, (p_int)latency_percentile(hist, 990));
+    put_number(result->item + DIL_P999, (p_int)latency_percentile(hist, 999));
+
+    buckets = allocate_array(num_buckets);
+    put_array(result->item + DIL_BUCKETS, buckets);
+
+    for (int i = 0, j = 0; i < LATENCY_NUM_BUCKETS; i++)
+    {
+        vector_t *bucket;
+
+        if (!hist->buckets[i])
+            continue;
+
+        bucket = allocate_array(2);
+        put_number(bucket->item, (p_int)latency_bucket_limit(i));
+        put_number(bucket->item + 1, (p_int)hist->buckets[i]);
+        put_array(buckets->item + j, bucket);
+        j++;
+    }
+} /* backend_driver_info() */
+
+/*-------------------------------------------------------------------------*/
+static void
+write_metrics_file (void)
+
+/* Write the latency histograms into the metrics file in the text format
+ * of Prometheus. The file is written under a temporary name first and
+ * then renamed, so readers always see a complete file.
+ */
+
+{
+    size_t len = strlen(metrics_file);
+    char *tmpname;
+    FILE *f;
+
+    tmpname = alloca(len + 5);
+    memcpy(tmpname, metrics_file, len);
+    strcpy(tmpname + len, ".tmp");
+
+    f = fopen(tmpname, "w");
+    if (!f)
+    {
+        debug_message("%s Could not write metrics file '%s': %s\n"
+                     , time_stamp(), tmpname, strerror(errno));
+        return;
+    }
+
+    fprintf(f, "# HELP ldmud_latency_seconds Duration of backend phases and command round trips.\n"
+               "# TYPE ldmud_latency_seconds histogram\n");
+
+    for (int phase = 0; phase < LP_NUM_PHASES; phase++)
+    {
+        latency_histogram_t *hist = latency_histograms + phase;
+        statcounter_t seen = 0;
+
+        for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+        {
+            if (!hist->buckets[i])
+                continue;
+
+            seen += hist->buckets[i];
+            fprintf(f, "ldmud_latency_seconds_bucket{phase=\"%s\",le=\"%.6f\"} %"PRIu64"\n"
+                     , hist->name, latency_bucket_limit(i) / 1000000.0, seen);
+        }
+
+        fprintf(f, "ldmud_latency_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %"PRIu64"\n"
+                   "ldmud_latency_seconds_sum{phase=\"%s\"} %.6f\n"
+                   "ldmud_latency_seconds_count{phase=\"%s\"} %"PRIu64"\n"
+                 , hist->name, hist->count
+                 , hist->name, hist->sum / 1000000.0
+                 , hist->name, hist->count);
+    }
+
+    fprintf(f, "# HELP ldmud_commands_total Number of player commands.\n"
+               "# TYPE ldmud_commands_total counter\n"
+               "ldmud_commands_total %"PRIu32"\n"
+             , total_player_commands);
+
+    if (fclose(f) || rename(tmpname, metrics_file))
+    {
+        debug_message("%s Could not write metrics file '%s': %s\n"
+                     , time_stamp(), metrics_file, strerror(errno));
+        unlink(tmpname);
+    }
+} /* write_metrics_file() */
+
+/*-------------------------------------------------------------------------*/
+void
+set_metrics_file (const char *native)
+
+/* Write the metrics into the file <native> from now on, or stop writing
+ * them if <native> is NULL. The file is written the next time the
+ * heart beat is due.
+ */
+
+{
+    free(metrics_file);
+    metrics_file = native ? strdup(native) : NULL;
+    time_of_next_metrics = 0;
+} /* set_metrics_file() */
+
+/*-------------------------------------------------------------------------*/
+const char *
+get_metrics_file (void)
+
+/* Return the (native) name of the metrics file or NULL if none is written.
+ */
+
+{
+    return metrics_file;
+} /* get_metrics_file() */
+
+/*-------------------------------------------------------------------------*/
+bool
+set_metrics_interval (mp_int interval)
+
+/* Set the seconds between two writes of the metrics file.
+ * Return false if <interval> is not positive.
+ */
+
+{
+    if (interval <= 0)
+        return false;
+
+    metrics_interval = interval;
+    time_of_next_metrics = 0;
+    return true;
+} /* set_metrics_interval() */
+
+/*-------------------------------------------------------------------------*/
+mp_int
+get_metrics_interval (void)
+
+/* Return the seconds between two writes of the metrics file.
+ */
+
+{
+    return metrics_interval;
+} /* get_metrics_interval() */
+
 /*-------------------------------------------------------------------------*/
 void
 clear_state (void)
@@ -694,6 +1036,9 @@ backend (void)
          * cleanup_all_objects(), as it turns out that a single
          * cleanup doesn't always remove enough destructed objects.
          */
+
+    uint64_t phase_start;
+        /* Start of the current phase for the latency histograms. */
     
     /*
      * Set up.
@@ -765,6 +1110,8 @@ backend (void)
 
         mud_is_up = MY_TRUE;
 
+        phase_start = get_latency_time();
+
         /* Replace programs, remove destructed objects, and similar stuff */
         cleanup_stuff();
 
@@ -902,6 +1249,8 @@ backend (void)
         python_process_pending_jobs();
 #endif /* USE_PYTHON */
 
+        add_latency(LP_CLEANUP, phase_start);
+
         do_state_check(2, "before get_message()");
 
         /*
@@ -909,9 +1258,14 @@ backend (void)
          * heart beat is due.
          */
 
+        phase_start = get_latency_time();
+
         if (get_message(buff, &bufflength))
         {
             interactive_t *ip;
+            uint64_t input_time;
+
+            add_latency(LP_MESSAGE, phase_start);
 
             /* Create the new time_stamp string in the function's local
              * buffer.
@@ -950,6 +1304,8 @@ backend (void)
 
             tracedepth = 0;
 
+            input_time = ip->input_time;
+            phase_start = get_latency_time();
             mark_start_evaluation();
 
             if (bufflength > 1 && buff[0] == input_escape)
@@ -980,6 +1336,7 @@ backend (void)
             }
 
             mark_end_evaluation();
+            add_latency(LP_COMMAND, phase_start);
 
             /* ip might be invalid again here */
 
@@ -992,6 +1349,8 @@ backend (void)
                  && !ip->do_close)
                 {
                     print_prompt();
+                    if (input_time)
+                        add_latency(LP_COMMAND_ROUND_TRIP, input_time);
                 }
             }
 
@@ -999,6 +1358,8 @@ backend (void)
         }
         else
         {
+            add_latency(LP_MESSAGE, phase_start);
+
             /* No new message, just create the new time_stamp string in
              * the function's local buffer.
              */
@@ -1040,18 +1401,24 @@ backend (void)
                 || time_of_last_hb + heart_beat_interval <= current_time)
             {
                 do_state_check(2, "before heartbeat");
+                phase_start = get_latency_time();
                 call_heart_beat();
+                add_latency(LP_HEART_BEAT, phase_start);
                 time_of_last_hb = current_time;
             }
 
             do_state_check(2, "after heartbeat");
+            phase_start = get_latency_time();
             call_out();
+            add_latency(LP_CALL_OUT, phase_start);
             do_state_check(2, "after call_out");
 
             /* Reset/cleanup/swap objects.
              */
+            phase_start = get_latency_time();
             remove_destructed_objects(MY_FALSE);
             process_objects();
+            add_latency(LP_PROCESS_OBJECTS, phase_start);
             do_state_check(2, "after swap/cleanup/reset");
 
             /* Other periodic processing */
@@ -1064,6 +1431,12 @@ backend (void)
 #endif /* USE_PYTHON */
 
             mem_consolidate(MY_FALSE);
+
+            if (metrics_file && current_time >= time_of_next_metrics)
+            {
+                write_metrics_file();
+                time_of_next_metrics = current_time + metrics_interval;
+            }
         }
 
     } /* end of main loop */
@@ -62,6 +62,12 @@ extern void update_statistic (statistic_t * pStat, long number);
 extern void update_statistic_avg (statistic_t * pStat, long number);
 extern double relate_statistics (statistic_t sStat, statistic_t sRef);
 extern void update_compile_av (int lines);
+extern uint64_t get_latency_time(void);
+extern void backend_driver_info(svalue_t *svp, int value) __attribute__((nonnull(1)));
+extern void set_metrics_file(const char *native);
+extern const char *get_metrics_file(void);
+extern bool set_metrics_interval(mp_int interval);
+extern mp_int get_metrics_interval(void);
 extern svalue_t *v_garbage_collection(svalue_t *sp, int num_arg);
 
 /* --- Macros --- */
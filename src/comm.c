@@ -120,6 +120,7 @@
 #include "access_check.h"
 #include "actions.h"
 #include "array.h"
+#include "backend.h"
 #include "closure.h"
 #include "ed.h"
 #include "exec.h"
@@ -131,6 +132,7 @@
 #include "object.h"
 #include "pkg-mccp.h"
 #include "pkg-pgsql.h"
+#include "pkg-sqlite.h"
 #include "pkg-python.h"
 #ifdef USE_TLS
 #include "pkg-tls.h"
@@ -244,6 +246,10 @@ p_int write_buffer_max_size = WRITE_BUFFER_MAX_SIZE;
    *  -1: Infinite queue.
    */
 
+static int max_command_burst = MAX_COMMAND_BURST;
+  /* Number of commands a new interactive may give per backend cycle.
+   */
+
 char default_player_encoding[sizeof(((interactive_t*)0)->encoding)] = "ISO-8859-1//TRANSLIT";
   /* Default encoding for interactives. */
 
@@ -284,6 +290,11 @@ statcounter_t inet_volume_in = 0;
 
 #endif
 
+statcounter_t num_input_cycles = 0;
+  /* Number of cycles of get_message(), that is of scans over all users
+   * after a select().
+   */
+
 /*-------------------------------------------------------------------------*/
 
 #ifdef ERQ_DEMON
@@ -481,6 +492,12 @@ static interactive_t *first_player_for_flush = NULL;
 #define FLAG_PROTO_ERQ  0x2
 
 
+#define INPUT_BUFFER_IDLE_TIME  60
+  /* Seconds without a command after which an interactive with no pending
+   * input gives up its .text and .command buffers.
+   */
+
+
 /*-------------------------------------------------------------------------*/
 
 /* Outgoing connections in-progress */
@@ -811,6 +828,8 @@ comm_fatal (interactive_t *ip, char *fmt, ...)
     fprintf(stderr, "  .last_time:         %"PRIdMPINT"\n", ip->last_time);
     fprintf(stderr, "  .numCmds:           %ld\n", ip->numCmds);
     fprintf(stderr, "  .maxNumCmds:        %ld\n", ip->maxNumCmds);
+    fprintf(stderr, "  .maxCmdBurst:       %d\n", ip->maxCmdBurst);
+    fprintf(stderr, "  .input_time:        %"PRIu64"\n", ip->input_time);
     fprintf(stderr, "  .trace_level:       %d\n", ip->trace_level);
     fprintf(stderr, "  .trace_prefix:      %p", ip->trace_prefix);
       if (ip->trace_prefix) fprintf(stderr, " '%s'", get_txt(ip->trace_prefix));
@@ -832,9 +851,9 @@ comm_fatal (interactive_t *ip, char *fmt, ...)
     fprintf(stderr, "  .gobble_char:       %02hhx\n", (unsigned char)ip->gobble_char);
     fprintf(stderr, "  .syncing:           %02hhx\n", (unsigned char)ip->syncing);
     fprintf(stderr, "  .text:             ");
-      dump_bytes(&(ip->text), sizeof(ip->text), 21);
+      if (ip->text) dump_bytes(ip->text, MAX_TEXT, 21); else fprintf(stderr, "NULL\n");
     fprintf(stderr, "  .command:          ");
-      dump_bytes(&(ip->command), sizeof(ip->command), 21);
+      if (ip->command) dump_bytes(ip->command, MAX_TEXT, 21); else fprintf(stderr, "NULL\n");
     fprintf(stderr, "  .message_buf:      ");
       dump_bytes(&(ip->message_buf), sizeof(ip->message_buf), 21);
     fprintf(stderr, "------\n");
@@ -1594,6 +1613,8 @@ comm_socket_write (char *msg, size_t size, interactive_t *ip, write_buffer_flag_
         ip->out_compress->next_out = ip->out_compress_buf;
         ip->out_compress->avail_out = COMPRESS_BUF_SIZE;
 
+        mccp_adjust_level(ip);
+
         status = deflate(ip->out_compress, Z_SYNC_FLUSH);
 
         if (status != Z_OK)
@@ -2225,6 +2246,56 @@ clear_message_buf (interactive_t *ip)
         remove_flush_entry(ip);
 } /* clear_message_buf() */
 
+/*-------------------------------------------------------------------------*/
+static void
+alloc_input_buffers (interactive_t *ip)
+
+/* Allocate the .text and .command buffers of interactive <ip>.
+ */
+
+{
+    char *buf = xalloc(2 * MAX_TEXT);
+
+    if (!buf)
+        outofmem(2 * MAX_TEXT, "input buffers");
+
+    ip->text = buf;
+    ip->command = buf + MAX_TEXT;
+    ip->command[0] = '\0';
+} /* alloc_input_buffers() */
+
+/*-------------------------------------------------------------------------*/
+static void
+release_input_buffers (interactive_t *ip)
+
+/* Release the .text and .command buffers of interactive <ip>.
+ */
+
+{
+    xfree(ip->text);
+    ip->text = NULL;
+    ip->command = NULL;
+} /* release_input_buffers() */
+
+/*-------------------------------------------------------------------------*/
+static INLINE Bool
+input_buffers_idle (interactive_t *ip)
+
+/* Return TRUE if the .text and .command buffers of <ip> hold no data
+ * that is still needed, and the user didn't enter a command for
+ * a while.
+ */
+
+{
+    return ip->text_end == 0
+        && ip->text_prefix == 0
+        && ip->tn_state == TS_DATA
+        && ip->command_start == 0
+        && ip->command_end == 0
+        && ip->command_unprocessed_end == 0
+        && current_time - ip->last_time >= INPUT_BUFFER_IDLE_TIME;
+} /* input_buffers_idle() */
+
 /*-------------------------------------------------------------------------*/
 Bool
 get_message (char *buff, size_t *bufflength)
@@ -2254,8 +2325,13 @@ get_message (char *buff, size_t *bufflength)
  * set to 0 so that only the status of the sockets is recorded and
  * get_message returns (almost) immediately.
  *
- * Normally, users can give only one command per cycle. The exception
- * is when they are editing, then they can give up to ALLOWED_ED_CMDS.
+ * A user can give up to .maxCmdBurst complete commands per cycle (more
+ * if they are editing, then they can give up to ALLOWED_ED_CMDS) before
+ * the scan moves on to the next user, so that pasted input doesn't
+ * need a select() for every line. The burst ends early when a heart_beat
+ * is due. To be fair to all users, the scan starts with a different
+ * user each cycle. The per-second limit .maxNumCmds still applies to
+ * every single command.
  *
  * Heartbeats are detected by checking the backend variable comm_time_-
  * to_call_heart_beat, which is set by the SIGALRM handler. If it is
@@ -2285,9 +2361,14 @@ get_message (char *buff, size_t *bufflength)
       /* Index of current user to check */
     static int CmdsGiven = 0;
       /* Number of commands the current user gave in this cycle. */
+    static int CmdGiverCount = 0;
+      /* Number of all_players[] entries to scan in this cycle. */
+    static int CmdGiverOffset = 0;
+      /* Rotation of the scan order, advanced every cycle. */
 
 #   define StartCmdGiver       (max_player)
-#   define DecreaseCmdGiver    NextCmdGiver--
+#   define DecreaseCmdGiver    (NextCmdGiver--, CmdsGiven = 0)
+#   define CurrentCmdGiver     ((NextCmdGiver + CmdGiverOffset) % CmdGiverCount)
 
     int    i;
     interactive_t * ip = NULL;
@@ -2353,6 +2434,11 @@ get_message (char *buff, size_t *bufflength)
                     /* If telnet is ready for commands, react quickly. */
                     twait = 0;
                 }
+                else if (ip->text && input_buffers_idle(ip))
+                {
+                    /* Don't keep the buffers for idle users. */
+                    release_input_buffers(ip);
+                }
 
                 if (ip->tn_state != TS_READY)
                 {
@@ -2382,6 +2468,10 @@ get_message (char *buff, size_t *bufflength)
 #ifdef USE_PGSQL
             pg_setfds(&readfds, &writefds, &nfds);
 #endif
+#ifdef USE_SQLITE
+            if (sl_has_pending())
+                twait = 0;
+#endif
 #ifdef USE_PYTHON
            python_set_fds(&readfds, &writefds, &pexceptfds, &nfds);
 #endif
@@ -2466,13 +2556,32 @@ get_message (char *buff, size_t *bufflength)
 #ifdef USE_PGSQL
             pg_process_all();
 #endif
+#ifdef USE_SQLITE
+            sl_process_all();
+#endif
 #ifdef USE_PYTHON
             python_handle_fds(&readfds, &writefds, &exceptfds, nfds);
 #endif
 
             /* Initialise the user scan */
+            num_input_cycles++;
             CmdsGiven = 0;
             NextCmdGiver = StartCmdGiver;
+            CmdGiverCount = max_player + 1;
+            if (CmdGiverCount > 0)
+                CmdGiverOffset = (CmdGiverOffset + 1) % CmdGiverCount;
+
+            /* Users who sent data will give commands in this cycle,
+             * which are likely to use the objects around them. Announce
+             * the swapped ones now, so that reading them overlaps with
+             * the commands of the users scanned before.
+             */
+            for (i = max_player + 1; --i >= 0;)
+            {
+                ip = all_players[i];
+                if (ip && FD_ISSET(ip->socket, &readfds) && ip->ob->super)
+                    prefetch_swapped_objects(ip->ob->super);
+            }
 
 #ifdef ERQ_DEMON
 
@@ -2825,7 +2934,7 @@ get_message (char *buff, size_t *bufflength)
         {
             object_t *snooper;
 
-            ip = all_players[NextCmdGiver];
+            ip = all_players[CurrentCmdGiver];
 
             if (ip == 0)
                 continue;
@@ -2877,6 +2986,9 @@ get_message (char *buff, size_t *bufflength)
                     continue;
                 }
 
+                if (!ip->text)
+                    alloc_input_buffers(ip);
+
                 l = MAX_TEXT - ip->text_end;
 
                 /* In CHARMODE with combine-charset, the driver gets
@@ -2946,6 +3058,7 @@ get_message (char *buff, size_t *bufflength)
 #endif
 
                 ip->text_end += l;
+                ip->input_time = get_latency_time();
 
                 /* Here would be the place to send data through an
                  * outportal instead of returning it.
@@ -2956,11 +3069,22 @@ get_message (char *buff, size_t *bufflength)
                  */
                 telnet_neg(ip);
             } /* if (cmdgiver socket ready) */
+            else if (CmdsGiven && ip->text)
+            {
+                /* Continuing a burst: the next command may already
+                 * be in the received data.
+                 */
+                telnet_neg(ip);
+            }
 
             /* telnet_neg() might have destroyed this one. */
             if (ip->ob->flags & O_DESTRUCTED)
                 continue;
 
+            /* Without buffers there is no input to process. */
+            if (!ip->text)
+                continue;
+
             /* ----- CHARMODE -----
              * command_start is 0 at the beginning.
              * Received chars start at command[0]. After the first character
@@ -3064,7 +3188,6 @@ get_message (char *buff, size_t *bufflength)
                     command_giver = ip->ob;
                     trace_level = ip->trace_level;
                     DecreaseCmdGiver;
-                    CmdsGiven = 0;
 
                     if (ip->last_time != current_time)
                     {
@@ -3123,8 +3246,10 @@ get_message (char *buff, size_t *bufflength)
                 if (ip->ob->flags & O_DESTRUCTED)
                     continue;
 
-                /* If the user is not in ed, don't let him issue another command
-                 * before the poll comes again.
+                /* Let the user issue further commands from the already
+                 * received data until the burst budget is used up, then
+                 * move on to the next user. Only editing users may exceed
+                 * the budget while a heart_beat is due.
                  */
                 if (ip->input_handler
                  && ip->input_handler->type == INPUT_ED
@@ -3133,10 +3258,15 @@ get_message (char *buff, size_t *bufflength)
                     CmdsGiven++;
                     FD_CLR(ip->socket, &readfds);
                 }
+                else if (CmdsGiven + 1 < ip->maxCmdBurst
+                      && !comm_time_to_call_heart_beat)
+                {
+                    CmdsGiven++;
+                    FD_CLR(ip->socket, &readfds);
+                }
                 else
                 {
                     DecreaseCmdGiver;
-                    CmdsGiven = 0;
                 }
 
                 /* Manage snooping - should the snooper see type ahead?
@@ -3198,6 +3328,7 @@ get_message (char *buff, size_t *bufflength)
     /* NOTREACHED */
 #   undef StartCmdGiver
 #   undef DecreaseCmdGiver
+#   undef CurrentCmdGiver
 
 } /* get_message() */
 
@@ -3368,6 +3499,9 @@ remove_interactive (object_t *ob, Bool force)
 #endif
     free_svalue(&interactive->prompt);
 
+    if (interactive->text)
+        release_input_buffers(interactive);
+
     if (interactive->trace_prefix)
         free_mstring(interactive->trace_prefix);
 
@@ -3667,6 +3801,10 @@ new_player ( object_t *ob, SOCKET_T new_socket
     new_interactive->compressing = 0;
     new_interactive->out_compress = NULL;
     new_interactive->out_compress_buf=NULL;
+    new_interactive->mccp_level = (signed char)mccp_default_level;
+    new_interactive->mccp_stream_level = 0;
+    new_interactive->mccp_window_bits = (unsigned char)mccp_default_window_bits;
+    new_interactive->mccp_mem_level = (unsigned char)mccp_default_mem_level;
 #endif
 #ifdef USE_TLS
     new_interactive->tls_status = TLS_INACTIVE;
@@ -3698,13 +3836,16 @@ new_player ( object_t *ob, SOCKET_T new_socket
     new_interactive->last_time = current_time;
     new_interactive->numCmds = 0;
     new_interactive->maxNumCmds = -1;
+    new_interactive->maxCmdBurst = max_command_burst;
+    new_interactive->input_time = 0;
     new_interactive->trace_level = 0;
     new_interactive->trace_prefix = NULL;
     new_interactive->message_length = 0;
     new_interactive->quote_iac = MY_TRUE;
     set_default_conn_charset(new_interactive->charset);
     set_default_combine_charset(new_interactive->combine_cset);
-    new_interactive->command[0] = '\0';
+    new_interactive->text = NULL;
+    new_interactive->command = NULL;
     memcpy(&new_interactive->addr, addr, addrlen);
     new_interactive->access_class = class;
     new_interactive->socket = new_socket;
@@ -5028,7 +5169,8 @@ is_charmode (interactive_t * ip)
 
 {
     return (ip->noecho & CHARMODE_REQ)
-            && (   ip->command[0] != input_escape
+            && (   ip->command == NULL
+                || ip->command[0] != input_escape
                 || find_no_bang(ip) & IGNORE_BANG
                )
                
@@ -5047,6 +5189,64 @@ set_tn_state (interactive_t * ip, enum telnet_states state)
     DTN(("t_n: new state %d\n", state));
 } /* set_tn_state() */
 
+/*-------------------------------------------------------------------------*/
+static INLINE bool
+is_tn_special_char (unsigned char ch)
+
+/* Return true if telnet_neg() has to look at the converted character <ch>
+ * on its own (NUL, backspace, line endings and DEL), false if it is
+ * just copied.
+ */
+
+{
+    return ch == '\0' || ch == '\b' || ch == '\n' || ch == '\r' || ch == 0x7f;
+} /* is_tn_special_char() */
+
+/*-------------------------------------------------------------------------*/
+static INLINE const char *
+find_tn_special_char (const char *from, const char *end)
+
+/* Return a pointer to the first character in <from>..<end> for which
+ * is_tn_special_char() is true, or <end> if there is none.
+ *
+ * Bulk input consists mostly of plain text, so the search looks at
+ * eight bytes at once: a word has a byte equal to <c> if (word ^ c*ONES)
+ * has a zero byte, which the usual ((x - ONES) & ~x & HIGHS) detects.
+ * That test may report bytes above a true zero byte as well, therefore
+ * the exact position is determined bytewise.
+ */
+
+{
+#   define SWAR_ONES       (~(uint64_t)0 / 0xff)
+#   define SWAR_HIGHS      (SWAR_ONES * 0x80)
+#   define SWAR_HAS_ZERO(x) (((x) - SWAR_ONES) & ~(x) & SWAR_HIGHS)
+#   define SWAR_HAS(x, c)  SWAR_HAS_ZERO((x) ^ (SWAR_ONES * (c)))
+
+    while (end - from >= (ptrdiff_t)sizeof(uint64_t))
+    {
+        uint64_t word;
+
+        memcpy(&word, from, sizeof(word));
+        if (SWAR_HAS_ZERO(word)
+         || SWAR_HAS(word, '\b')
+         || SWAR_HAS(word, '\n')
+         || SWAR_HAS(word, '\r')
+         || SWAR_HAS(word, 0x7f))
+            break;
+        from += sizeof(word);
+    }
+
+    while (from != end && !is_tn_special_char(*(const unsigned char *)from))
+        from++;
+
+    return from;
+
+#   undef SWAR_ONES
+#   undef SWAR_HIGHS
+#   undef SWAR_HAS_ZERO
+#   undef SWAR_HAS
+} /* find_tn_special_char() */
+
 /*-------------------------------------------------------------------------*/
 static void
 telnet_neg (interactive_t *ip)
@@ -5128,8 +5328,14 @@ telnet_neg (interactive_t *ip)
  */
 
 {
-    char *source = ip->text + ip->tn_end;       /* Next char to process. */
-    char *last = ip->text + ip->text_end;       /* End of the data to process. */
+    char *source;   /* Next char to process. */
+    char *last;     /* End of the data to process. */
+
+    if (!ip->text)
+        return; /* Nothing received yet. */
+
+    source = ip->text + ip->tn_end;
+    last = ip->text + ip->text_end;
 
     DTN(("telnet_neg: state %hhd\n", ip->tn_state));
 
@@ -5177,8 +5383,24 @@ telnet_neg (interactive_t *ip)
 
                 while (command_from != command_end)
                 {
-                    char ch = *command_from;
+                    char ch;
+
+                    /* Copy runs of ordinary characters at once. */
+                    if (!is_tn_special_char(*(unsigned char *)command_from))
+                    {
+                        const char *special = find_tn_special_char(command_from, command_end);
+                        size_t len = special - command_from;
+
+                        if (command_to != command_from)
+                            memmove(command_to, command_from, len);
+                        command_to += len;
+                        command_from += len;
 
+                        if (command_from == command_end)
+                            break;
+                    }
+
+                    ch = *command_from;
                     switch (ch)
                     {
                         case '\b':              /* Backspace */
@@ -5346,7 +5568,7 @@ telnet_neg (interactive_t *ip)
                     }
 
                     sourceleftorig = sourceleft = next_tn - source;
-                    commandleft = ip->command + sizeof(ip->command) - command_end;
+                    commandleft = ip->command + MAX_TEXT - command_end;
 
                     iconv(ip->receive_cd, &source, &sourceleft, &command_end, &commandleft);
                     ip->tn_end = source - ip->text;
@@ -8760,6 +8982,50 @@ f_configure_interactive (svalue_t *sp)
             start_compress(ip, mccpver);
         }
         break;
+
+    case IC_MCCP_LEVEL:
+        if (sp->type != T_NUMBER)
+            efun_exp_arg_error(3, TF_NUMBER, sp, sp);
+
+        if (sp->u.number != MCCP_ADAPTIVE_LEVEL
+         && (sp->u.number < Z_NO_COMPRESSION || sp->u.number > Z_BEST_COMPRESSION))
+            errorf("Illegal value to arg 3 of configure_interactive with IC_MCCP_LEVEL: %"
+                   PRIdPINT", expected -1 or 0..9.\n", sp->u.number);
+
+        if (!ip)
+            mccp_default_level = sp->u.number;
+        else
+            ip->mccp_level = (signed char)sp->u.number;
+            /* An active compression will pick it up with the next write. */
+        break;
+
+    case IC_MCCP_WINDOW_BITS:
+        if (sp->type != T_NUMBER)
+            efun_exp_arg_error(3, TF_NUMBER, sp, sp);
+
+        if (sp->u.number < 9 || sp->u.number > MAX_WBITS)
+            errorf("Illegal value to arg 3 of configure_interactive with IC_MCCP_WINDOW_BITS: %"
+                   PRIdPINT", expected 9..%d.\n", sp->u.number, MAX_WBITS);
+
+        if (!ip)
+            mccp_default_window_bits = sp->u.number;
+        else
+            ip->mccp_window_bits = (unsigned char)sp->u.number;
+        break;
+
+    case IC_MCCP_MEM_LEVEL:
+        if (sp->type != T_NUMBER)
+            efun_exp_arg_error(3, TF_NUMBER, sp, sp);
+
+        if (sp->u.number < 1 || sp->u.number > MAX_MEM_LEVEL)
+            errorf("Illegal value to arg 3 of configure_interactive with IC_MCCP_MEM_LEVEL: %"
+                   PRIdPINT", expected 1..%d.\n", sp->u.number, MAX_MEM_LEVEL);
+
+        if (!ip)
+            mccp_default_mem_level = sp->u.number;
+        else
+            ip->mccp_mem_level = (unsigned char)sp->u.number;
+        break;
 #endif /* USE_MCCP*/
 
     case IC_PROMPT:
@@ -8802,6 +9068,20 @@ f_configure_interactive (svalue_t *sp)
             ip->maxNumCmds = sp->u.number;
         break;
 
+    case IC_MAX_COMMAND_BURST:
+        if (sp->type != T_NUMBER)
+            efun_exp_arg_error(3, TF_NUMBER, sp, sp);
+
+        if (sp->u.number < 1 || sp->u.number > INT_MAX)
+            errorf("Illegal value to arg 3 of configure_interactive with IC_MAX_COMMAND_BURST: %"
+                   PRIdPINT", expected a positive number.\n", sp->u.number);
+
+        if (!ip)
+            max_command_burst = (int)sp->u.number;
+        else
+            ip->maxCmdBurst = (int)sp->u.number;
+        break;
+
     case IC_MODIFY_COMMAND:
         if (!ip)
             errorf("Default value for IC_MODIFY_COMMAND is not supported.\n");
@@ -8997,6 +9277,18 @@ f_interactive_info (svalue_t *sp)
 
         put_number(&result, ip->compressing);
         break;
+
+    case IC_MCCP_LEVEL:
+        put_number(&result, ip ? ip->mccp_level : mccp_default_level);
+        break;
+
+    case IC_MCCP_WINDOW_BITS:
+        put_number(&result, ip ? ip->mccp_window_bits : mccp_default_window_bits);
+        break;
+
+    case IC_MCCP_MEM_LEVEL:
+        put_number(&result, ip ? ip->mccp_mem_level : mccp_default_mem_level);
+        break;
 #endif /* USE_MCCP*/
 
     case IC_PROMPT:
@@ -9013,6 +9305,10 @@ f_interactive_info (svalue_t *sp)
         put_number(&result, ip->maxNumCmds);
         break;
 
+    case IC_MAX_COMMAND_BURST:
+        put_number(&result, ip ? ip->maxCmdBurst : max_command_burst);
+        break;
+
     case IC_MODIFY_COMMAND:
         if (!ip)
             errorf("Default value for IC_MODIFY_COMMAND is not supported.\n");
@@ -9117,6 +9413,10 @@ f_interactive_info (svalue_t *sp)
             put_number(&result, 0);
         }
         break;
+
+    case II_MCCP_STREAM_LEVEL:
+        put_number(&result, ip->compressing > 0 ? ip->mccp_stream_level : 0);
+        break;
 #endif /* USE_MCCP*/
 
     /* Input handling */
@@ -226,6 +226,12 @@ struct interactive_s {
                                  * to execute per second. A value < 0
                                  * means 'unlimited'.
                                  */
+    int   maxCmdBurst;          /* Maximum number of complete commands
+                                 * to take from this interactive in one
+                                 * backend cycle (at least 1).
+                                 */
+    uint64_t input_time;        /* Time when the last input was received
+                                 * (see get_latency_time()) */
     int trace_level;            /* Trace flags. 0 means no tracing */
     string_t *trace_prefix;     /* Trace only objects which have this string
                                    as name prefix. NULL traces everything. */
@@ -259,15 +265,19 @@ struct interactive_s {
     bool syncing;               /* Received a TCP Urgend notification. */
     char gobble_char;           /* Char to ignore at the next telnet_neg() */
 
-    char text[MAX_TEXT];
-      /* The receive buffer. These are the raw bytes received from
-       * the network connection.
+    char *text;
+      /* The receive buffer of MAX_TEXT bytes. These are the raw bytes
+       * received from the network connection.
+       * The buffer is allocated together with .command when data
+       * arrives, and released again when the connection is idle.
+       * NULL if not allocated.
        */
 
-    char command[MAX_TEXT];
-      /* The command read from network. Contains the text from .text
-       * after having telnet data removed and being converted from
+    char *command;
+      /* The command read from network (MAX_TEXT bytes). Contains the text
+       * from .text after having telnet data removed and being converted from
        * the source encoding to UTF-8.
+       * Part of the .text allocation, NULL if not allocated.
        */
 
     char message_buf[MAX_SOCKET_PACKET_SIZE];
@@ -287,6 +297,13 @@ struct interactive_s {
     unsigned char   compressing;
     z_stream      * out_compress;
     unsigned char * out_compress_buf;
+    signed char     mccp_level;
+      /* Configured compression level, or MCCP_ADAPTIVE_LEVEL. */
+    signed char     mccp_stream_level;
+      /* Compression level currently used by .out_compress. */
+    unsigned char   mccp_window_bits;
+    unsigned char   mccp_mem_level;
+      /* zlib parameters for the next start of compression. */
 #endif
 
     struct write_buffer_s *write_first;  /* List of buffers to write */
@@ -410,6 +427,7 @@ extern statcounter_t inet_volume;
 extern statcounter_t inet_packets_in;
 extern statcounter_t inet_volume_in;
 #endif
+extern statcounter_t num_input_cycles;
 
 /* --- Prototypes --- */
 
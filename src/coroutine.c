@@ -221,6 +221,9 @@ suspend_coroutine (coroutine_t *cr, svalue_t *fp)
     assert(cr->num_variables == csp->num_local_variables);
 #endif
 
+    /* Mapping iterators in foreach() loops can't be saved. */
+    save_foreach_iterators(fp + cr->num_variables, inter_sp);
+
     /* Now save the pc and the stack. */
     num_values = inter_sp - fp + 1 - cr->num_variables;
     assert(num_values >= 0);
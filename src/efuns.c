@@ -112,6 +112,7 @@
 #include "heartbeat.h"
 #include "iconv_opt.h"
 #include "interpret.h"
+#include "jit.h"
 #include "lex.h"
 #include "main.h"
 #include "mapping.h"
@@ -9519,6 +9520,12 @@ f_configure_driver (svalue_t *sp)
  *        - DC_SWAP_VAR_TIME       (11): time to swap variables out
  *        - DC_CLEANUP_TIME        (12): time to call cleanup hook
  *        - DC_RESET_TIME          (13): time to call reset hook
+ *        - DC_PROFILE_SAMPLE_INTERVAL (16): interval of the sampling profiler
+ *        - DC_FUNCTION_PROFILING  (17): enable the function profiler
+ *        - DC_METRICS_FILE        (18): file for the latency metrics
+ *        - DC_METRICS_INTERVAL    (19): time between metrics writes
+ *        - DC_JIT_THRESHOLD       (24): calls before a function is compiled
+ *        - DC_MAPPING_COMPACT_TIME (25): time before a mapping is compacted
  * 
  * <data> is dependent on <what>:
  *   DC_MEMORY_LIMIT:        ({soft-limit, hard-limit}) both <int>, given in Bytes.
@@ -9531,6 +9538,12 @@ f_configure_driver (svalue_t *sp)
  *   DC_SWAP_VAR_TIME        (int) time (s) to swap variables >=0
  *   DC_CLEANUP_TIME         (int) time (s) for calling cleanup, >= 0
  *   DC_RESET_TIME           (int) time (s) for calling reset, >= 0
+ *   DC_PROFILE_SAMPLE_INTERVAL (int) CPU time (us) between samples, 0 to stop
+ *   DC_FUNCTION_PROFILING   0/1 (int), 1 also resets the profile
+ *   DC_METRICS_FILE         (string) filename, or 0 to stop writing
+ *   DC_METRICS_INTERVAL     (int) time (s) between writes, > 0
+ *   DC_JIT_THRESHOLD        (int) number of calls, >= 0, or -1 to disable
+ *   DC_MAPPING_COMPACT_TIME (int) time (s) after the last change, >= 0
  *
  */
 
@@ -9584,6 +9597,63 @@ f_configure_driver (svalue_t *sp)
                        sp->u.vec->item[0].u.number);
             break;
 
+        case DC_PROFILE_SAMPLE_INTERVAL:
+            if (sp->type != T_NUMBER)
+                efun_arg_error(2, T_NUMBER, sp, sp);
+            if (!set_profile_sample_interval(sp->u.number))
+                errorf("Could not set the profile sample interval "
+                       "(%"PRIdPINT") in configure_driver()\n",
+                       sp->u.number);
+            break;
+
+        case DC_FUNCTION_PROFILING:
+            if (sp->type != T_NUMBER)
+                efun_arg_error(2, T_NUMBER, sp, sp);
+            set_function_profiling(sp->u.number != 0);
+            break;
+
+        case DC_METRICS_FILE:
+            if (sp->type == T_NUMBER && sp->u.number == 0)
+                set_metrics_file(NULL);
+            else if (sp->type != T_STRING)
+                efun_arg_error(2, T_STRING, sp, sp);
+            else
+                set_metrics_file(convert_path_to_native_or_throw(get_txt(sp->u.str), mstrsize(sp->u.str)));
+            break;
+
+        case DC_METRICS_INTERVAL:
+            if (sp->type != T_NUMBER)
+                efun_arg_error(2, T_NUMBER, sp, sp);
+            if (!set_metrics_interval(sp->u.number))
+                errorf("DC_METRICS_INTERVAL must be > 0, but is (%"PRIdPINT
+                       ") in configure_driver()\n", sp->u.number);
+            break;
+
+        case DC_JIT_THRESHOLD:
+            if (sp->type != T_NUMBER)
+                efun_arg_error(2, T_NUMBER, sp, sp);
+            if (sp->u.number < JIT_THRESHOLD_OFF)
+                errorf("DC_JIT_THRESHOLD must be >= -1, but is (%"PRIdPINT
+                       ") in configure_driver()\n", sp->u.number);
+#ifdef USE_JIT
+            jit_set_threshold(sp->u.number);
+#else
+            if (sp->u.number != JIT_THRESHOLD_OFF)
+                errorf("configure_driver(DC_JIT_THRESHOLD) is not available: "
+                       "driver was compiled without the native code compiler.\n");
+#endif
+            break;
+
+        case DC_MAPPING_COMPACT_TIME:
+            if (sp->type != T_NUMBER)
+                efun_arg_error(2, T_NUMBER, sp, sp);
+            if (sp->u.number < 0 || sp->u.number > PINT_MAX/2)
+                errorf("DC_MAPPING_COMPACT_TIME must be >= 0 and <= %"PRIdPINT
+                       ", but is (%"PRIdPINT") in configure_driver()\n",
+                       PINT_MAX/2, sp->u.number);
+            time_to_compact_mappings = sp->u.number;
+            break;
+
         case DC_DATA_CLEAN_TIME:
             if (sp->type != T_NUMBER)
                 efun_arg_error(2, T_NUMBER, sp, sp);
@@ -9891,6 +9961,44 @@ f_driver_info (svalue_t *sp)
             put_number(&result, get_profiling_time_limit());
             break;
 
+        case DC_PROFILE_SAMPLE_INTERVAL:
+            put_number(&result, get_profile_sample_interval());
+            break;
+
+        case DC_FUNCTION_PROFILING:
+            put_number(&result, is_function_profiling() ? 1 : 0);
+            break;
+
+        case DC_METRICS_FILE:
+        {
+            const char *native = get_metrics_file();
+
+            if (!native)
+                put_number(&result, 0);
+            else
+            {
+                char *encoded = convert_path_from_native_or_throw(native, strlen(native));
+                put_c_string(&result, encoded);
+            }
+            break;
+        }
+
+        case DC_METRICS_INTERVAL:
+            put_number(&result, get_metrics_interval());
+            break;
+
+        case DC_JIT_THRESHOLD:
+#ifdef USE_JIT
+            put_number(&result, jit_threshold);
+#else
+            put_number(&result, JIT_THRESHOLD_OFF);
+#endif
+            break;
+
+        case DC_MAPPING_COMPACT_TIME:
+            put_number(&result, time_to_compact_mappings);
+            break;
+
         case DC_DATA_CLEAN_TIME:
             put_number(&result, time_to_data_cleanup);
             break;
@@ -10085,6 +10193,21 @@ f_driver_info (svalue_t *sp)
                 put_number(&result, 0);
             break;
 
+        /* Profiling */
+        case DI_PROFILE_SAMPLES_AS_STRING:
+        {
+            strbuf_t sbuf;
+
+            strbuf_zero(&sbuf);
+            collect_profile_samples(&sbuf);
+            if (strbuf_length(&sbuf))
+                put_string(&result, new_unicode_mstring(sbuf.buf));
+            else
+                put_ref_string(&result, STR_EMPTY);
+            strbuf_free(&sbuf);
+            break;
+        }
+
         /* LPC Runtime statistics */
 #ifdef APPLY_CACHE_STAT
         case DI_NUM_FUNCTION_NAME_CALLS:
@@ -10139,6 +10262,20 @@ f_driver_info (svalue_t *sp)
             rxcache_driver_info(&result, what);
             break;
 
+        case DI_NUM_INCLUDE_CACHE_LOOKUPS:
+            /* FALLTHROUGH */
+        case DI_NUM_INCLUDE_CACHE_LOOKUP_HITS:
+            /* FALLTHROUGH */
+        case DI_NUM_INCLUDE_CACHE_LOOKUP_MISSES:
+            /* FALLTHROUGH */
+        case DI_NUM_INCLUDE_CACHE_LOOKUP_COLLISIONS:
+            include_cache_driver_info(&result, what);
+            break;
+
+        case DI_NUM_PROFILE_SAMPLES:
+            put_number(&result, num_profile_samples);
+            break;
+
         /* Network statistics */
 #ifdef COMM_STAT
         case DI_NUM_MESSAGES_OUT:
@@ -10162,6 +10299,10 @@ f_driver_info (svalue_t *sp)
             break;
 #endif
 
+        case DI_NUM_INPUT_CYCLES:
+            put_number(&result, num_input_cycles);
+            break;
+
         /* Load */
         case DI_LOAD_AVERAGE_COMMANDS:
             put_float(&result, stat_load.weighted_avg);
@@ -10183,6 +10324,23 @@ f_driver_info (svalue_t *sp)
             hbeat_driver_info(&result, what);
             break;
 
+        /* Latencies */
+        case DI_LATENCY_MESSAGE:
+            /* FALLTHROUGH */
+        case DI_LATENCY_COMMAND:
+            /* FALLTHROUGH */
+        case DI_LATENCY_COMMAND_ROUND_TRIP:
+            /* FALLTHROUGH */
+        case DI_LATENCY_HEART_BEAT:
+            /* FALLTHROUGH */
+        case DI_LATENCY_CALL_OUT:
+            /* FALLTHROUGH */
+        case DI_LATENCY_PROCESS_OBJECTS:
+            /* FALLTHROUGH */
+        case DI_LATENCY_CLEANUP:
+            backend_driver_info(&result, what);
+            break;
+
         /* Memory use statistics */
         case DI_NUM_ACTIONS:
             simulate_driver_info(&result, what);
@@ -10262,6 +10420,22 @@ f_driver_info (svalue_t *sp)
             put_number(&result, num_dirty_mappings);
             break;
 
+        case DI_NUM_MAPPING_COMPACTIONS:
+            put_number(&result, num_mapping_compactions);
+            break;
+
+        case DI_NUM_MAPPING_COMPACTIONS_DEFERRED:
+            put_number(&result, num_mapping_compactions_deferred);
+            break;
+
+        case DI_NUM_MAPPING_COMPACTION_STEPS:
+            put_number(&result, num_mapping_compaction_steps);
+            break;
+
+        case DI_NUM_MAPPING_COMPACTION_ENTRIES:
+            put_number(&result, num_mapping_compaction_entries);
+            break;
+
         case DI_NUM_STRUCTS:
             /* FALLTHROUGH */
         case DI_NUM_STRUCT_TYPES:
@@ -10308,6 +10482,12 @@ f_driver_info (svalue_t *sp)
             put_number(&result, num_coroutines);
             break;
 
+        case DI_NUM_INCLUDE_CACHE:
+            /* FALLTHROUGH */
+        case DI_NUM_INCLUDE_CACHE_TABLE_SLOTS:
+            include_cache_driver_info(&result, what);
+            break;
+
 #ifdef USE_PYTHON
         case DI_NUM_LPC_PYTHON_REFS:
             put_number(&result, num_lpc_python_references);
@@ -10402,6 +10582,10 @@ f_driver_info (svalue_t *sp)
             put_number(&result, total_coroutine_size);
             break;
 
+        case DI_SIZE_INCLUDE_CACHE:
+            include_cache_driver_info(&result, what);
+            break;
+
 
         /* Memory swapper statistics */
         case DI_NUM_SWAP_BLOCKS:
@@ -10423,6 +10607,8 @@ f_driver_info (svalue_t *sp)
         case DI_SIZE_SWAP_BLOCKS_REUSED:
             /* FALLTHROUGH */
         case DI_SWAP_RECYCLE_PHASE:
+            /* FALLTHROUGH */
+        case DI_NUM_SWAP_PREFETCHES:
             swap_driver_info(&result, what);
             break;
 
@@ -686,6 +686,22 @@ struct program_s
        * It is set to -1 if it hasn't been swapped yet.
        */
 
+    function_profile_t *profile;
+      /* Array [.num_function_headers] with the statistics of the
+       * function profiler, or NULL if none were gathered yet.
+       * The data is only valid if .profile_generation equals
+       * the current function_profile_generation.
+       */
+    int32 profile_generation;
+      /* The generation of the function profiler of .profile */
+
+#ifdef USE_JIT
+    jit_program_t *jit;
+      /* The call counts and native code of the functions (see jit.c),
+       * or NULL if none of them were called with the compiler enabled.
+       */
+#endif
+
     /*
      * And now some general size information.
      */
@@ -766,6 +782,26 @@ struct linenumbers_s
 };
 
 
+/* --- struct function_profile_s: Profile of a single function
+ *
+ * When the function profiler is enabled, each program collects these
+ * statistics for all functions in its bytecode, indexed like its
+ * .function_headers. Eval ticks and times are measured from the call
+ * of the function to its return or the error that aborted it, the
+ * 'self' values exclude the ticks and times of other profiled functions
+ * called from it.
+ */
+
+struct function_profile_s
+{
+    statcounter_t calls;        /* Number of calls */
+    statcounter_t self_ticks;   /* Eval ticks in the function itself */
+    statcounter_t total_ticks;  /* Eval ticks including called functions */
+    statcounter_t self_ns;      /* Wall clock time in the function itself */
+    statcounter_t total_ns;     /* Wall clock time including called functions */
+};
+
+
 /* --- struct function_s: Function description
  *
  * Structures of this type hold various important pieces of
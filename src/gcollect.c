@@ -101,6 +101,7 @@
 #if defined(GC_SUPPORT) && defined(MALLOC_TRACE)
 #include "instrs.h" /* Need F_ALLOCATE for setting up print dispatcher */
 #endif
+#include "jit.h"
 #include "lex.h"
 #include "lwobject.h"
 #include "main.h"
@@ -112,6 +113,7 @@
 #include "otable.h"
 #include "parse.h"
 #include "pkg-pgsql.h"
+#include "pkg-sqlite.h"
 #include "pkg-python.h"
 #include "pkg-tls.h"
 #include "prolang.h"
@@ -1252,6 +1254,11 @@ gc_mark_program_ref (program_t *p)
 
         if (p->line_numbers)
             note_ref(p->line_numbers);
+        if (p->profile)
+            note_ref(p->profile);
+#ifdef USE_JIT
+        jit_note_program_refs(p);
+#endif
 
         /* Non-inherited functions */
 
@@ -2195,6 +2202,9 @@ garbage_collection(void)
 #ifdef USE_PGSQL
     pg_purge_connections();
 #endif /* USE_PGSQL */
+#ifdef USE_SQLITE
+    sl_purge_queries();
+#endif /* USE_SQLITE */
     remove_stale_player_data();
     remove_stale_call_outs();
     free_defines();
@@ -2378,6 +2388,9 @@ garbage_collection(void)
 #ifdef USE_PGSQL
     pg_clear_refs();
 #endif /* USE_PGSQL */
+#ifdef USE_SQLITE
+    sl_clear_refs();
+#endif /* USE_SQLITE */
 #ifdef USE_TLS
     tls_clear_refs();
 #endif /* USE_TLS */
@@ -2524,6 +2537,8 @@ garbage_collection(void)
                 tmp = tmp->next;
             } while (tmp != NULL);
         }
+        if (all_players[i]->text != NULL)
+            note_ref(all_players[i]->text);
 #ifdef USE_MCCP
         if (all_players[i]->out_compress != NULL)
             note_ref(all_players[i]->out_compress);
@@ -2594,11 +2609,15 @@ garbage_collection(void)
     count_comm_refs();
     count_interpreter_refs();
     count_heart_beat_refs();
+    count_swap_refs();
     count_std_struct_refs();
     count_rxcache_refs();
 #ifdef USE_PGSQL
     pg_count_refs();
 #endif /* USE_PGSQL */
+#ifdef USE_SQLITE
+    sl_count_refs();
+#endif /* USE_SQLITE */
 #ifdef USE_TLS
     tls_count_refs();
 #endif /* USE_TLS */
@@ -3392,6 +3411,9 @@ garbage_collection (void)
 #ifdef USE_PGSQL
     pg_purge_connections();
 #endif /* USE_PGSQL */
+#ifdef USE_SQLITE
+    sl_purge_queries();
+#endif /* USE_SQLITE */
     remove_stale_player_data();
     remove_stale_call_outs();
     mb_release();
@@ -216,8 +216,10 @@
 #include "efuns.h"
 #include "filestat.h"
 #include "gcollect.h"
+#include "hash.h"
 #include "heartbeat.h"
 #include "instrs.h"
+#include "jit.h"
 #include "lex.h"
 #include "lwobject.h"
 #include "mapping.h"
@@ -226,6 +228,7 @@
 #include "otable.h"
 #include "parse.h"
 #include "prolang.h"
+#include "ptrtable.h"
 #include "simulate.h"
 #include "simul_efun.h"
 #include "stdstrings.h"
@@ -246,6 +249,7 @@
 
 #include "../mudlib/sys/driver_hook.h"
 #include "../mudlib/sys/driver_info.h"
+#include "../mudlib/sys/function_profile.h"
 #include "../mudlib/sys/trace.h"
 
 /*-------------------------------------------------------------------------*/
@@ -757,6 +761,70 @@ struct timeval profiling_timevalue = {0, 0};
 
 static Bool received_prof_signal = MY_FALSE;
 
+static struct timeval profile_sample_interval = {0, 0};
+  /* CPU time between two samples of the sampling profiler,
+   * 0 if the profiler is disabled. While it is enabled, it uses the
+   * ITIMER_PROF timer, which is then no longer set per evaluation for
+   * the detection of long executions.
+   */
+
+#define PROFILE_SAMPLE_LENGTH  1024
+  /* Maximum length of one collapsed call stack.
+   */
+
+#define PROFILE_HASH_SIZE      1024
+#define PROFILE_MAX_STACKS     4096
+  /* Size of the hash table of the sampling profiler (a power of two),
+   * and the maximum number of distinct call stacks counted in it.
+   */
+
+typedef struct profile_stack_s profile_stack_t;
+
+struct profile_stack_s
+{
+    profile_stack_t *next;  /* Next stack in the hash chain. */
+    hash32_t         hash;  /* Hash of the stack. */
+    size_t           len;   /* Length of the stack. */
+    p_uint           count; /* Number of samples of this stack. */
+    char             text[]; /* The collapsed stack, '\0' terminated. */
+};
+
+static profile_stack_t **profile_stacks = NULL;
+  /* Hash table of the distinct call stacks sampled by the sampling
+   * profiler with their number of samples, so that identical stacks
+   * take up memory only once however long the profiler runs. Allocated
+   * when the profiler is first enabled.
+   */
+
+static int profile_num_stacks = 0;
+  /* Number of stacks in profile_stacks. */
+
+static p_uint profile_other_samples = 0;
+  /* Number of samples of stacks that didn't fit into profile_stacks. */
+
+static char profile_sample[PROFILE_SAMPLE_LENGTH];
+  /* The sample being taken. */
+
+statcounter_t num_profile_samples = 0;
+  /* Total number of samples taken. */
+
+static Bool long_exec_reported = MY_FALSE;
+  /* While sampling: the current evaluation was already reported as
+   * a long execution.
+   */
+
+static bool function_profiling = false;
+  /* TRUE if the function profiler is enabled: each call of an lfun
+   * is then accounted in the .profile of its program.
+   */
+
+int32 function_profile_generation = 0;
+  /* The generation of the function profiler, incremented each time
+   * it is enabled. Program profiles of an older generation are stale
+   * and will be cleared on their next use or freed when the program
+   * is swapped out.
+   */
+
 p_int used_memory_at_eval_start = 0;
   /* used memory (in bytes) at the beginning of the current execution,
    * set by mark_start_evaluation() (and v_limited()).
@@ -781,6 +849,7 @@ enum call_other_error_handling
 static svalue_t* int_call_other(bool b_use_default, enum call_other_error_handling error_handling, char* efunname, svalue_t *sp, int num_arg);
 static int expand_argument(svalue_t *sp);
 static void call_simul_efun(unsigned int code, object_t *ob, int num_arg);
+static void end_function_profile(struct control_stack *frame);
 #ifdef DEBUG
 static void check_extra_ref_in_vector(svalue_t *svp, size_t num);
 #endif
@@ -850,6 +919,223 @@ handle_profiling_signal(int ignored)
     received_prof_signal = MY_TRUE;
 } // handle_prof()
 
+/*-------------------------------------------------------------------------*/
+static INLINE Bool
+is_profile_sampling (void)
+
+/* Return TRUE if the sampling profiler is enabled.
+ */
+
+{
+    return profile_sample_interval.tv_sec || profile_sample_interval.tv_usec;
+} /* is_profile_sampling() */
+
+/*-------------------------------------------------------------------------*/
+static Bool
+is_long_execution (void)
+
+/* Called after a SIGPROF signal: return TRUE if the current evaluation
+ * shall be reported as a long execution. Without the sampling profiler
+ * the timer only runs for this purpose, otherwise the time since the
+ * begin of the evaluation is checked, and reported only once.
+ */
+
+{
+    struct timeval now;
+
+    if (!is_profile_sampling())
+        return MY_TRUE;
+
+    if ((!profiling_timevalue.tv_sec && !profiling_timevalue.tv_usec)
+     || long_exec_reported
+     || eval_begin.tv_sec == 0
+     || gettimeofday(&now, NULL))
+        return MY_FALSE;
+
+    now.tv_sec -= eval_begin.tv_sec;
+    now.tv_usec -= eval_begin.tv_usec;
+    if (now.tv_usec < 0)
+    {
+        now.tv_sec--;
+        now.tv_usec += 1000000;
+    }
+
+    if (now.tv_sec < profiling_timevalue.tv_sec
+     || (now.tv_sec == profiling_timevalue.tv_sec
+      && now.tv_usec < profiling_timevalue.tv_usec))
+        return MY_FALSE;
+
+    long_exec_reported = MY_TRUE;
+    return MY_TRUE;
+} /* is_long_execution() */
+
+/*-------------------------------------------------------------------------*/
+static char *
+profile_add_frame (char *dest, char *end, const char *str, size_t len, Bool *cut)
+
+/* Append <len> bytes of <str> to a sample at <dest>, but not beyond <end>.
+ * If it doesn't fit, *<cut> is set and the text is cut at an UTF-8
+ * character boundary. Return the new end of the sample.
+ */
+
+{
+    if (len > (size_t)(end - dest))
+    {
+        len = (size_t)(end - dest);
+        while (len > 0 && (str[len] & 0xc0) == 0x80)
+            len--;
+        *cut = MY_TRUE;
+    }
+
+    memcpy(dest, str, len);
+    return dest + len;
+} /* profile_add_frame() */
+
+/*-------------------------------------------------------------------------*/
+static void
+profile_count_stack (const char *stack, size_t len)
+
+/* Count a sample of the collapsed call <stack> of <len> bytes in the
+ * hash table of the sampling profiler. A new stack is added to the
+ * table, if it is full, the sample is counted as one of the others.
+ */
+
+{
+    hash32_t hash = hashmem32(stack, len);
+    profile_stack_t **chain = &profile_stacks[hash & (PROFILE_HASH_SIZE-1)];
+    profile_stack_t *entry;
+
+    for (entry = *chain; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && entry->len == len
+         && !memcmp(entry->text, stack, len))
+        {
+            entry->count++;
+            return;
+        }
+    }
+
+    if (profile_num_stacks >= PROFILE_MAX_STACKS
+     || !(entry = xalloc(sizeof(*entry) + len + 1)))
+    {
+        profile_other_samples++;
+        return;
+    }
+
+    entry->hash = hash;
+    entry->len = len;
+    entry->count = 1;
+    memcpy(entry->text, stack, len + 1);
+    entry->next = *chain;
+    *chain = entry;
+    profile_num_stacks++;
+} /* profile_count_stack() */
+
+/*-------------------------------------------------------------------------*/
+static void
+profile_take_sample (void)
+
+/* Record the current call stack as the next sample of the sampling
+ * profiler. The stack is stored as a collapsed stack as used by flamegraph
+ * tools: the frames, outermost first, separated by semicolons, each in
+ * the form "<program>:<function>". The pc of the topmost frame is taken
+ * from inter_pc.
+ */
+
+{
+    struct control_stack *p;
+    char *sample, *dest, *end;
+    Bool first = MY_TRUE;
+    Bool cut = MY_FALSE;
+
+    if (!current_prog || csp < &CONTROL_STACK[0])
+        return;
+
+    sample = profile_sample;
+    dest = sample;
+    end = sample + PROFILE_SAMPLE_LENGTH - 4; /* Room for "..." and '\0'. */
+
+    /* See collect_trace() for the organisation of the control stack. */
+    p = &CONTROL_STACK[0];
+    do {
+        program_t  *prog;
+        bytecode_p  frame_pc;
+        string_t   *progname = NULL;
+        const char *fun;
+
+        if (p == csp)
+        {
+            frame_pc = inter_pc;
+            prog = current_prog;
+        }
+        else
+        {
+            frame_pc = p[1].pc;
+            prog = p[1].prog;
+        }
+
+        if (!prog || !frame_pc)
+            continue;
+
+        if (p[0].funstart == SIMUL_EFUN_FUNSTART)
+            fun = "<simul_efun closure>";
+        else if (p[0].funstart == EFUN_FUNSTART)
+        {
+            fun = instrs[p[0].instruction].name;
+            if (!fun)
+                fun = "<efun closure>";
+        }
+#ifdef USE_PYTHON
+        else if (p[0].funstart == PYTHON_EFUN_FUNSTART)
+            fun = "<python efun>";
+#endif
+        else if (p[0].funstart < prog->program
+              || p[0].funstart > PROGRAM_END(*prog))
+        {
+            progname = prog->name;
+            fun = "<lambda>";
+        }
+        else
+        {
+            progname = prog->name;
+            fun = NULL;
+        }
+
+        if (!first)
+            dest = profile_add_frame(dest, end, ";", 1, &cut);
+        first = MY_FALSE;
+
+        if (progname)
+        {
+            dest = profile_add_frame(dest, end, get_txt(progname), mstrsize(progname), &cut);
+            dest = profile_add_frame(dest, end, ":", 1, &cut);
+        }
+
+        if (fun)
+            dest = profile_add_frame(dest, end, fun, strlen(fun), &cut);
+        else
+        {
+            string_t *name = prog->function_headers[FUNCTION_HEADER_INDEX(p[0].funstart)].name;
+            dest = profile_add_frame(dest, end, get_txt(name), mstrsize(name), &cut);
+        }
+
+        if (cut)
+        {
+            memcpy(dest, "...", 3);
+            dest += 3;
+            break;
+        }
+    } while (++p <= csp);
+
+    *dest = '\0';
+
+    if (dest == sample)
+        return;
+
+    num_profile_samples++;
+    profile_count_stack(sample, (size_t)(dest - sample));
+} /* profile_take_sample() */
+
 /*-------------------------------------------------------------------------*/
 void
 mark_start_evaluation (void)
@@ -864,12 +1150,16 @@ mark_start_evaluation (void)
     total_evalcost = 0;
     eval_number++;
 
-    // start the profiling timer if enabled
-    if (profiling_timevalue.tv_usec || profiling_timevalue.tv_sec)
+    // start the profiling timer if enabled (the sampling profiler
+    // keeps it running on its own)
+    if ((profiling_timevalue.tv_usec || profiling_timevalue.tv_sec)
+     && !is_profile_sampling())
     {
         prof_time_val.it_value = profiling_timevalue;
         setitimer(ITIMER_PROF, &prof_time_val, NULL);
     }
+    received_prof_signal = MY_FALSE;
+    long_exec_reported = MY_FALSE;
 
     if (gettimeofday(&eval_begin, NULL))
     {
@@ -894,7 +1184,8 @@ mark_end_evaluation (void)
     static struct itimerval prof_time_val = { {0,0}, {0,0} };
 
     // disable the profiling timer
-    if (profiling_timevalue.tv_usec || profiling_timevalue.tv_sec)
+    if ((profiling_timevalue.tv_usec || profiling_timevalue.tv_sec)
+     && !is_profile_sampling())
         setitimer(ITIMER_PROF, &prof_time_val, NULL);
 
     if (total_evalcost == 0)
@@ -4680,6 +4971,33 @@ push_error_handler(void (*errorhandler)(error_handler_t *), error_handler_t *arg
     return inter_sp;
 } /* push_error_handler() */
 
+/*-------------------------------------------------------------------------*/
+void
+save_foreach_iterators (svalue_t *bottom, svalue_t *top)
+
+/* The stack values <bottom> to <top> are about to be saved in a coroutine,
+ * where error handlers can't stay. Replace the mapping iterators of any
+ * foreach() loops there by arrays with the remaining indices, the loops
+ * then continue with them (see F_FOREACH).
+ */
+
+{
+    svalue_t *sv;
+
+    for (sv = bottom; sv <= top - 2; sv++)
+    {
+        if (is_mapping_iterator(sv))
+        {
+            vector_t *indices = mapping_iterator_keys(sv);
+
+            free_svalue(sv);
+            put_array(sv, indices);
+            sv[1].u.number = (p_int)VEC_SIZE(indices); /* count */
+            sv[2].u.number = 0;                        /* next index */
+        }
+    }
+} /* save_foreach_iterators() */
+
 /*-------------------------------------------------------------------------*/
 /* Fast version of several functions, must come last so to not disturb
  * the actual definitions:
@@ -8924,10 +9242,14 @@ pull_error_context (svalue_t *sp, svalue_t *msg)
     }
 
     /* If there was a lambda call, we have to restore current_lambda.
-     * Same for coroutines.
+     * Same for coroutines. The profiled functions are accounted
+     * up to the error.
      */
     for (csp2 = csp; csp2 >p->save_csp; csp2--)
     {
+        if (csp2->profile)
+            end_function_profile(csp2);
+
         if (current_lambda.type == T_CLOSURE)
             free_closure(&current_lambda);
         current_lambda = csp2->lambda;
@@ -8971,6 +9293,96 @@ transfer_error_message (svalue_t *v, rt_context_t *rt)
     transfer_svalue_no_free(&p->catch_value, v);
 }
 
+/*-------------------------------------------------------------------------*/
+static INLINE statcounter_t
+get_function_profile_time (void)
+
+/* Return the current time in nanoseconds for the function profiler.
+ */
+
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        return 0;
+
+    return (statcounter_t)ts.tv_sec * 1000000000 + (statcounter_t)ts.tv_nsec;
+} /* get_function_profile_time() */
+
+/*-------------------------------------------------------------------------*/
+static void
+start_function_profile (bytecode_p funstart)
+
+/* The function at <funstart> in the current program is called in the
+ * current control stack frame: remember the ticks and time of the call
+ * for the function profiler. The profile of the program is allocated
+ * resp. cleared if necessary.
+ */
+
+{
+    program_t *prog = current_prog;
+
+    if (!prog->profile || prog->profile_generation != function_profile_generation)
+    {
+        size_t size = sizeof(*prog->profile) * prog->num_function_headers;
+
+        if (!prog->profile)
+        {
+            prog->profile = xalloc(size);
+            if (!prog->profile)
+                return;
+        }
+
+        memset(prog->profile, 0, size);
+        prog->profile_generation = function_profile_generation;
+    }
+
+    csp->profile = prog->profile + FUNCTION_HEADER_INDEX(funstart);
+    csp->profile_ticks = total_evalcost;
+    csp->profile_ns = get_function_profile_time();
+    csp->profile_child_ticks = 0;
+    csp->profile_child_ns = 0;
+} /* start_function_profile() */
+
+/*-------------------------------------------------------------------------*/
+static void
+end_function_profile (struct control_stack *frame)
+
+/* The function of the control stack <frame> returns or is unwound by an
+ * error: add its call to its profile and its ticks and time to the next
+ * profiled caller.
+ */
+
+{
+    function_profile_t *profile = frame->profile;
+    statcounter_t ticks, ns;
+    struct control_stack *p;
+
+    ticks = total_evalcost > frame->profile_ticks ? total_evalcost - frame->profile_ticks : 0;
+    ns = get_function_profile_time();
+    ns = ns > frame->profile_ns ? ns - frame->profile_ns : 0;
+
+    profile->calls++;
+    profile->total_ticks += ticks;
+    profile->total_ns += ns;
+    if (ticks > frame->profile_child_ticks)
+        profile->self_ticks += ticks - frame->profile_child_ticks;
+    if (ns > frame->profile_child_ns)
+        profile->self_ns += ns - frame->profile_child_ns;
+
+    for (p = frame - 1; p >= CONTROL_STACK; p--)
+    {
+        if (p->profile)
+        {
+            p->profile_child_ticks += ticks;
+            p->profile_child_ns += ns;
+            break;
+        }
+    }
+
+    frame->profile = NULL;
+} /* end_function_profile() */
+
 /*-------------------------------------------------------------------------*/
 void
 push_control_stack ( svalue_t   *sp
@@ -9020,6 +9432,10 @@ push_control_stack ( svalue_t   *sp
     csp->ob = const0;
     csp->prev_ob = const0;
     csp->pretend_to_be = const0;
+    csp->profile = NULL;
+#ifdef USE_JIT
+    csp->jit = NULL;
+#endif
 } /* push_control_stack() */
 
 /*-------------------------------------------------------------------------*/
@@ -9037,6 +9453,9 @@ pop_control_stack (void)
         fatal("Popped out of the control stack");
 #endif
 
+    if (csp->profile)
+        end_function_profile(csp);
+
     if ( NULL != (current_prog = csp->prog) ) /* is 0 when we reach the bottom */
     {
         current_strings = current_prog->strings;
@@ -9468,6 +9887,14 @@ setup_new_frame2 (bytecode_p funstart, svalue_t *sp
       do_trace_call(funstart, is_lambda);
     }
 
+    if (function_profiling && !is_lambda)
+        start_function_profile(funstart);
+
+#ifdef USE_JIT
+    if (jit_threshold >= 0 && !is_lambda)
+        csp->jit = jit_get_function(current_prog, funstart);
+#endif
+
     /* Initialize the break stack, pointing to the entry above
      * the first available svalue.
      */
@@ -9619,6 +10046,8 @@ reset_machine (Bool first)
         }
         while (csp >= CONTROL_STACK)
         {
+            if (csp->profile)
+                end_function_profile(csp);
             if (csp->lambda.type == T_CLOSURE)
                 free_closure(&csp->lambda);
             if (csp->coroutine != NULL)
@@ -10050,6 +10479,21 @@ eval_instruction (bytecode_p first_instruction
     /* ------ The evaluation loop ------ */
 
 again:
+#ifdef USE_JIT
+    /* If the current function has native code for the next instruction,
+     * run it until it meets an instruction the interpreter has to
+     * execute. Tracing and argument frames always use the interpreter.
+     */
+    if (csp->jit != NULL && !use_ap && !trace_exec_active
+     && jit_has_entry(csp->jit, pc) && !is_sto_context())
+    {
+        bytecode_p next_pc = pc;
+
+        sp = jit_execute(csp->jit, &next_pc, sp, fp);
+        pc = next_pc;
+    }
+#endif
+
     /* Get the next instruction and increment the pc */
 
     full_instr = instruction = LOAD_CODE(pc);
@@ -10223,6 +10667,11 @@ again:
        * TODO:: the long run, we should do this only for efuns (which are by
        * TODO:: then hopefully all tabled).
        */
+
+dispatch:
+    /* The type-specialized instructions jump back here with <instruction>
+     * set to their generic counterpart if their operands don't fit.
+     */
     switch(instruction)
     {
     default:
@@ -14336,7 +14785,8 @@ again:
 
                 len = mstrsize(left) + mstrsize(right);
                 DYN_STRING_COST(len)
-                new_string = mstr_add(left, right);
+                new_string = mstr_extend(left, get_txt(right), mstrsize(right)
+                                        , right->info.unicode);
                 if (!new_string)
                     ERRORF(("Out of memory (%zu bytes)\n", len));
             }
@@ -14351,7 +14801,8 @@ again:
                     FATAL("Buffer overflow in F_ADD_EQ: int number too big.\n");
                 len = mstrsize(argp->u.str)+strlen(buff);
                 DYN_STRING_COST(len)
-                new_string = mstr_add_txt(argp->u.str, buff, strlen(buff));
+                new_string = mstr_extend(argp->u.str, buff, strlen(buff)
+                                        , STRING_ASCII);
                 if (!new_string)
                     ERRORF(("Out of memory (%lu bytes)\n"
                            , (unsigned long) len
@@ -14368,7 +14819,8 @@ again:
                     FATAL("Buffer overflow in F_ADD_EQ: float number too big.\n");
                 len = mstrsize(argp->u.str) + strlen(buff);
                 DYN_STRING_COST(len)
-                new_string = mstr_add_txt(argp->u.str, buff, strlen(buff));
+                new_string = mstr_extend(argp->u.str, buff, strlen(buff)
+                                        , STRING_ASCII);
                 if (!new_string)
                     ERRORF(("Out of memory (%zu bytes).\n", len));
             }
@@ -14378,8 +14830,7 @@ again:
                 /* NOTREACHED */
             }
 
-            /* Replace *argp by the new string */
-            free_string_svalue(argp);
+            /* *argp's string was extended or replaced by the new string */
             argp->u.str = new_string;
             break;
           }
@@ -17842,6 +18293,203 @@ again:
         break;
     }
 
+    CASE(F_INT_OP);                 /* --- int_op <op>         --- */
+    {
+        /* Operator F_INT_OP (int sp[-1], int sp[0])
+         *
+         * Compute sp[-1] <op> sp[0] for two numbers, <op> is one of
+         * F_ADD, F_SUBTRACT, F_LT, F_LE, F_GT and F_GE.
+         *
+         * The compiler uses this instruction when both operands were
+         * declared as int. If they aren't numbers at runtime, or the result
+         * would overflow, <op> itself is executed instead, so that the
+         * errors are raised by the generic code.
+         */
+
+        int op = LOAD_UINT8(pc);
+        p_int left, right;
+
+        if (sp[-1].type != T_NUMBER || sp->type != T_NUMBER)
+        {
+            instruction = op;
+            goto dispatch;
+        }
+
+        left = sp[-1].u.number;
+        right = sp->u.number;
+
+        switch (op)
+        {
+        case F_ADD:
+            if ((left >= 0 && right >= 0 && PINT_MAX - left < right)
+             || (left < 0 && right < 0 && PINT_MIN - left > right)
+               )
+            {
+                instruction = op;
+                goto dispatch;
+            }
+            left += right;
+            break;
+
+        case F_SUBTRACT:
+            if ((left >= 0 && right < 0 && PINT_MAX + right < left)
+             || (left < 0 && right >= 0 && PINT_MIN + right > left)
+               )
+            {
+                instruction = op;
+                goto dispatch;
+            }
+            left -= right;
+            break;
+
+        case F_LT: left = left <  right; break;
+        case F_LE: left = left <= right; break;
+        case F_GT: left = left >  right; break;
+        case F_GE: left = left >= right; break;
+
+        default:
+            fatal("Illegal operator for int_op: %d\n", op);
+            /* NOTREACHED */
+        }
+
+        sp--;
+        sp->u.number = left;
+        break;
+    }
+
+    CASE(F_FLOAT_OP);               /* --- float_op <op>       --- */
+    {
+        /* Operator F_FLOAT_OP (float sp[-1], float sp[0])
+         *
+         * Compute sp[-1] <op> sp[0] for two floats, <op> is one of
+         * F_ADD, F_SUBTRACT, F_MULTIPLY, F_DIVIDE, F_LT, F_LE, F_GT and F_GE.
+         *
+         * Like F_INT_OP the instruction falls back to <op> itself when
+         * the operands aren't floats or the result is out of range.
+         */
+
+        STORE_DOUBLE_USED
+        int op = LOAD_UINT8(pc);
+        double left, right, result;
+        bool is_compare = false;
+
+        if (sp[-1].type != T_FLOAT || sp->type != T_FLOAT)
+        {
+            instruction = op;
+            goto dispatch;
+        }
+
+        left = READ_DOUBLE(sp-1);
+        right = READ_DOUBLE(sp);
+
+        switch (op)
+        {
+        case F_ADD:      result = left + right; break;
+        case F_SUBTRACT: result = left - right; break;
+        case F_MULTIPLY: result = left * right; break;
+        case F_DIVIDE:
+            if (right == 0.)
+            {
+                instruction = op;
+                goto dispatch;
+            }
+            result = left / right;
+            break;
+
+        case F_LT: result = left <  right; is_compare = true; break;
+        case F_LE: result = left <= right; is_compare = true; break;
+        case F_GT: result = left >  right; is_compare = true; break;
+        case F_GE: result = left >= right; is_compare = true; break;
+
+        default:
+            fatal("Illegal operator for float_op: %d\n", op);
+            /* NOTREACHED */
+            result = 0.;
+        }
+
+        if (is_compare)
+        {
+            sp--;
+            put_number(sp, result != 0.);
+            break;
+        }
+
+        if (result < (-DBL_MAX) || result > DBL_MAX)
+        {
+            instruction = op;
+            goto dispatch;
+        }
+
+        sp--;
+        STORE_DOUBLE(sp, result);
+        break;
+    }
+
+    CASE(F_INDEX_ARRAY);            /* --- index_array         --- */
+    {
+        /* Operator F_INDEX_ARRAY (vector v=sp[-1], int i=sp[0])
+         *
+         * Compute the value (v[i]) and push it onto the stack, like F_INDEX
+         * does. The compiler uses this instruction when <v> was declared
+         * as an array and <i> as an int. Anything unusual (other types,
+         * lvalues, an index out of range) is left to F_INDEX.
+         */
+
+        vector_t *vec;
+        svalue_t *item;
+        svalue_t result;
+
+        if (sp[-1].type != T_POINTER || sp->type != T_NUMBER
+         || sp->u.number < 0 || sp->u.number >= VEC_SIZE(sp[-1].u.vec))
+        {
+            instruction = F_INDEX;
+            goto dispatch;
+        }
+
+        vec = sp[-1].u.vec;
+        item = vec->item + sp->u.number;
+        if (destructed_object_ref(item))
+        {
+            free_svalue(item);
+            put_number(item, 0);
+        }
+
+        assign_rvalue_no_free(&result, item);
+        sp--;
+        free_array(vec);
+        transfer_svalue_no_free(sp, &result);
+        break;
+    }
+
+    CASE(F_INDEX_MAPPING);          /* --- index_mapping       --- */
+    {
+        /* Operator F_INDEX_MAPPING (mapping m=sp[-1], string k=sp[0])
+         *
+         * Compute the value (m[k]) and push it onto the stack, like F_INDEX
+         * does. The compiler uses this instruction when <m> was declared
+         * as a mapping and <k> as a string. Other types, lvalues and
+         * mappings of width 0 are left to F_INDEX.
+         */
+
+        mapping_t *m;
+        svalue_t result;
+
+        if (sp[-1].type != T_MAPPING || sp->type != T_STRING
+         || !sp[-1].u.map->num_values)
+        {
+            instruction = F_INDEX;
+            goto dispatch;
+        }
+
+        m = sp[-1].u.map;
+        assign_rvalue_no_free(&result, get_map_value(m, sp));
+        free_string_svalue(sp);
+        sp--;
+        free_mapping(m);
+        transfer_svalue_no_free(sp, &result);
+        break;
+    }
+
     CASE(F_AGGREGATE);              /* --- aggregate <size>    --- */
     {
         /* Create an array ({ sp[<-size>+1], ..., sp[0] }), remove the
@@ -18274,8 +18922,12 @@ again:
          *   sp[-1] -> number 'count': number of values left to loop over.
          *             x.generic:      <nargs>, or -<nargs> if the value
          *                             is mapping or a string lvalue.
-         *   sp[-2] -> array 'm_indices': if the value is a mapping, this
-         *                             is the array with the indices.
+         *   sp[-2] -> iterator:       if the value is a mapping, this
+         *                             is the mapping iterator (see
+         *                             put_mapping_iterator()). If the
+         *                             loop was suspended in a coroutine,
+         *                             the iterator is replaced by an
+         *                             array with the remaining indices.
          *             string lvalue: if the value is a string used with
          *                            FOREACH_REF, this is a range lvalue.
          *
@@ -18522,19 +19174,17 @@ again:
         else
         {
             mapping_t *m;
-            vector_t  *indices;
 
             m = arg->u.map;
-            indices = m_indices(m);
 
-            /* after m_indices(), else we'd count destructed entries */
-            count = MAP_SIZE(m);
-
-            /* Push the indices array and remember the fact in nargs.
+            /* Push the iterator and remember the fact in nargs.
              */
+            put_mapping_iterator(sp+1, m);
             sp++;
-            put_array(sp, indices);
             nargs = -nargs;
+
+            /* after the iterator, else we'd count destructed entries */
+            count = MAP_SIZE(m);
         }
 
         /* If this is a range foreach, drop the upper bound svalue
@@ -18631,29 +19281,40 @@ again:
 
         gen_refs = sp->x.generic;
 
-        if (sp[-1].x.generic < 0 && sp[-2].type == T_POINTER)
+        if (sp[-1].x.generic < 0
+         && (sp[-2].type == T_ERROR_HANDLER || sp[-2].type == T_POINTER))
         {
             /* We loop over a mapping */
 
             mapping_t *m;
-            vector_t  *indices;
-            svalue_t  *values;
+            svalue_t  *key, *values;
             p_int      left;
 
             lvalue = sp + sp[-1].x.generic - 2;
 
             m = sp[-3].u.map;
-            indices = sp[-2].u.vec;
 
-            values = get_map_value(m, indices->item+ix);
-            if (values == &const0)
+            if (sp[-2].type == T_ERROR_HANDLER)
+            {
+                if (!next_mapping_iterator(sp-2, &key, &values))
+                    break; /* No entries left */
+            }
+            else
             {
-                /* Whoops, the entry has vanished.
-                 * Start over with this instruction again, the
-                 * index on the stack has been incremented already.
+                /* The loop was suspended in a coroutine, we have
+                 * the array of the remaining indices.
                  */
-                pc -= 5;
-                break;
+                key = sp[-2].u.vec->item+ix;
+                values = get_map_value(m, key);
+                if (values == &const0)
+                {
+                    /* Whoops, the entry has vanished.
+                     * Start over with this instruction again, the
+                     * index on the stack has been incremented already.
+                     */
+                    pc -= 5;
+                    break;
+                }
             }
 
             /* Get the number of values we have to assign (in addition to the key). */
@@ -18667,7 +19328,7 @@ again:
                 for (int i = 0; i <= left; i++)
                 {
                     lpctype_t* exptype = current_prog->types[current_prog->argument_types[typeidx + i]];
-                    svalue_t * val = i ? (values + i - 1) : (indices->item + ix);
+                    svalue_t * val = i ? (values + i - 1) : key;
                     if (!check_rtt_compatibility(exptype, val))
                     {
                         char buf[512];
@@ -18692,7 +19353,7 @@ again:
                     fatal("Bad argument to foreach(): not a lvalue\n");
                     /* TODO: Give type and value */
 #endif
-                assign_svalue(lvalue, indices->item+ix);
+                assign_svalue(lvalue, key);
 
                 lvalue++;
             }
@@ -19964,20 +20625,26 @@ again:
     }
 #endif /* DEBUG */
 
-    // Did we receive a SIGPROF signal and should dump a trace into the debuglog?
+    // Did we receive a SIGPROF signal and should take a sample
+    // or dump a trace into the debuglog?
     if (received_prof_signal)
     {
         received_prof_signal = MY_FALSE;
-        char     *ts = time_stamp();
-        debug_message("%s Received profiling signal, evaluation time > %ld.%06lds\n",
-                      ts, (long)profiling_timevalue.tv_sec, (long)profiling_timevalue.tv_usec);
-        printf("%s Received profiling signal, evaluation time > %ld.%06lds\n",
-                      ts, (long)profiling_timevalue.tv_sec, (long)profiling_timevalue.tv_usec);
-        // dump stack trace and continue execution
         inter_pc = pc;
-        dump_trace(MY_FALSE, NULL, NULL);
-        debug_message("%s ... execution continues.\n", ts);
-        printf("%s ... execution continues.\n", ts);
+        if (is_profile_sampling())
+            profile_take_sample();
+        if (is_long_execution())
+        {
+            char     *ts = time_stamp();
+            debug_message("%s Received profiling signal, evaluation time > %ld.%06lds\n",
+                          ts, (long)profiling_timevalue.tv_sec, (long)profiling_timevalue.tv_usec);
+            printf("%s Received profiling signal, evaluation time > %ld.%06lds\n",
+                          ts, (long)profiling_timevalue.tv_sec, (long)profiling_timevalue.tv_usec);
+            // dump stack trace and continue execution
+            dump_trace(MY_FALSE, NULL, NULL);
+            debug_message("%s ... execution continues.\n", ts);
+            printf("%s ... execution continues.\n", ts);
+        }
     }
     
     // Did we allocate too much memory in this execution/evaluation thread?
@@ -22995,6 +23662,16 @@ count_interpreter_refs (void)
         }
     }
 #endif
+
+    if (profile_stacks)
+    {
+        note_malloced_block_ref(profile_stacks);
+        for (i = 0; i < PROFILE_HASH_SIZE; i++)
+        {
+            for (profile_stack_t *entry = profile_stacks[i]; entry; entry = entry->next)
+                note_malloced_block_ref(entry);
+        }
+    }
 }
 /*-------------------------------------------------------------------------*/
 
@@ -25370,5 +26047,323 @@ get_profiling_time_limit()
 {
     return profiling_timevalue.tv_sec * 1000000 + profiling_timevalue.tv_usec;
 } /* get_memory_limit */
+
+/*-------------------------------------------------------------------------*/
+Bool
+set_profile_sample_interval (mp_int interval)
+
+/* Start the sampling profiler with a sample every <interval> us of CPU
+ * time, or stop it if <interval> is 0. Starting a stopped profiler
+ * discards the old samples.
+ * Return TRUE on success and FALSE otherwise.
+ */
+
+{
+    struct itimerval timer;
+
+    if (interval < 0)
+        return MY_FALSE;
+
+    if (interval && !is_profile_sampling())
+    {
+        if (!profile_stacks)
+        {
+            profile_stacks = xalloc(sizeof(*profile_stacks) * PROFILE_HASH_SIZE);
+            if (!profile_stacks)
+                return MY_FALSE;
+        }
+        else
+        {
+            for (int i = 0; i < PROFILE_HASH_SIZE; i++)
+            {
+                while (profile_stacks[i])
+                {
+                    profile_stack_t *entry = profile_stacks[i];
+
+                    profile_stacks[i] = entry->next;
+                    xfree(entry);
+                }
+            }
+        }
+
+        memset(profile_stacks, 0, sizeof(*profile_stacks) * PROFILE_HASH_SIZE);
+        profile_num_stacks = 0;
+        profile_other_samples = 0;
+    }
+
+    profile_sample_interval.tv_sec = interval / 1000000;
+    profile_sample_interval.tv_usec = interval % 1000000;
+
+    /* A zero interval stops the timer. A running evaluation then goes
+     * without the detection of long executions.
+     */
+    timer.it_interval = profile_sample_interval;
+    timer.it_value = profile_sample_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+
+    return MY_TRUE;
+} /* set_profile_sample_interval() */
+
+/*-------------------------------------------------------------------------*/
+mp_int
+get_profile_sample_interval (void)
+
+/* Return the interval of the sampling profiler in microseconds,
+ * 0 if it is disabled.
+ */
+
+{
+    return profile_sample_interval.tv_sec * 1000000 + profile_sample_interval.tv_usec;
+} /* get_profile_sample_interval() */
+
+/*-------------------------------------------------------------------------*/
+static int
+profile_stack_cmp (const void *a, const void *b)
+
+/* qsort() comparison function for the stacks in collect_profile_samples().
+ */
+
+{
+    return strcmp((*(const profile_stack_t * const *)a)->text
+                , (*(const profile_stack_t * const *)b)->text);
+} /* profile_stack_cmp() */
+
+/*-------------------------------------------------------------------------*/
+void
+collect_profile_samples (strbuf_t *sbuf)
+
+/* Write the samples of the sampling profiler into <sbuf> in the collapsed
+ * stack format read by flamegraph tools: one line per distinct call stack
+ * with the number of its samples appended, separated by a space. The
+ * samples of the stacks that didn't fit into the table are given
+ * as "<other stacks>".
+ */
+
+{
+    profile_stack_t **stacks;
+    int i, num;
+
+    if (!profile_num_stacks && !profile_other_samples)
+        return;
+
+    stacks = xalloc(sizeof(*stacks) * (profile_num_stacks + 1));
+    if (!stacks)
+        errorf("Out of memory (%zu bytes) for profile samples.\n"
+              , sizeof(*stacks) * (profile_num_stacks + 1));
+
+    num = 0;
+    for (i = 0; i < PROFILE_HASH_SIZE; i++)
+    {
+        for (profile_stack_t *entry = profile_stacks[i]; entry; entry = entry->next)
+            stacks[num++] = entry;
+    }
+
+    qsort(stacks, num, sizeof(*stacks), profile_stack_cmp);
+
+    for (i = 0; i < num; i++)
+        strbuf_addf(sbuf, "%s %"PRIuPINT"\n", stacks[i]->text, stacks[i]->count);
+
+    if (profile_other_samples)
+        strbuf_addf(sbuf, "<other stacks> %"PRIuPINT"\n", profile_other_samples);
+
+    xfree(stacks);
+} /* collect_profile_samples() */
+
+/*-------------------------------------------------------------------------*/
+void
+set_function_profiling (bool enable)
+
+/* Enable or disable the function profiler. Enabling it discards the
+ * statistics gathered so far, disabling it keeps them.
+ */
+
+{
+    struct control_stack *p;
+
+    /* The functions currently running are not accounted, they
+     * might refer to profiles that will be cleared or freed.
+     */
+    for (p = CONTROL_STACK; p <= csp; p++)
+        p->profile = NULL;
+
+    if (enable)
+    {
+        function_profile_generation++;
+        free_swapped_profiles();
+    }
+    function_profiling = enable;
+} /* set_function_profiling() */
+
+/*-------------------------------------------------------------------------*/
+bool
+is_function_profiling (void)
+
+/* Return TRUE if the function profiler is enabled.
+ */
+
+{
+    return function_profiling;
+} /* is_function_profiling() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+register_function_profile (program_t *prog, ptrtable_t *programs, program_t **list)
+
+/* Add <prog> and all its inherited programs with valid profiles to
+ * <list>, unless they are already registered in <programs>. The programs
+ * are chained through the .data of their pointer records.
+ * Return the number of profiled functions that were called.
+ */
+
+{
+    struct pointer_record *rec;
+    p_int num = 0;
+
+    rec = register_pointer(programs, prog);
+    if (!rec)
+        return 0;
+
+    if (prog->profile && prog->profile_generation == function_profile_generation)
+    {
+        rec->data = *list;
+        *list = prog;
+
+        for (int i = 0; i < prog->num_function_headers; i++)
+        {
+            if (prog->profile[i].calls)
+                num++;
+        }
+    }
+
+    for (int i = 0; i < prog->num_inherited; i++)
+        num += register_function_profile(prog->inherit[i].prog, programs, list);
+
+    return num;
+} /* register_function_profile() */
+
+/*-------------------------------------------------------------------------*/
+svalue_t *
+v_function_profile (svalue_t *sp, int num_arg)
+
+/* EFUN function_profile()
+ *
+ *   mixed * function_profile()
+ *   mixed * function_profile(object|lwobject ob)
+ *
+ * Return the statistics of the function profiler for all functions
+ * of <ob> and its inherited programs, resp. of all loaded programs.
+ * The result is an array with one entry per called function, each
+ * entry is an array with the program and function name, the number of
+ * calls, the ticks and the time in nanoseconds (see function_profile.h).
+ */
+
+{
+    ptrtable_t *programs;
+    program_t *list = NULL;
+    program_t *prog;
+    vector_t *result;
+    p_int num = 0;
+    svalue_t *item;
+
+    if (!num_arg)
+    {
+        /* Use a 0 as placeholder for the argument. */
+        sp++;
+        put_number(sp, 0);
+        inter_sp = sp;
+    }
+
+    programs = push_new_pointer_table();
+    if (!programs)
+        errorf("(function_profile) Out of memory for pointer table.\n");
+
+    if (sp->type == T_OBJECT)
+    {
+        object_t *ob = sp->u.ob;
+
+        if (O_PROG_SWAPPED(ob))
+        {
+            ob->time_of_ref = current_time;
+            if (load_ob_from_swap(ob) < 0)
+                errorf("Out of memory: unswap object '%s'\n", get_txt(ob->name));
+        }
+
+        num = register_function_profile(ob->prog, programs, &list);
+    }
+    else if (sp->type == T_LWOBJECT)
+    {
+        num = register_function_profile(sp->u.lwob->prog, programs, &list);
+    }
+    else if (!num_arg)
+    {
+        object_t *ob;
+
+        for (ob = obj_list; ob; ob = ob->next_all)
+        {
+            /* Swapped programs are only loaded for their profile. */
+            if (O_PROG_SWAPPED(ob))
+            {
+                if (!has_swapped_profile(ob))
+                    continue;
+
+                ob->time_of_ref = current_time;
+                if (load_ob_from_swap(ob) < 0)
+                    errorf("Out of memory: unswap object '%s'\n", get_txt(ob->name));
+            }
+
+            num += register_function_profile(ob->prog, programs, &list);
+        }
+    }
+    /* else: a destructed object, return an empty array. */
+
+    result = allocate_array(num);
+    push_array(inter_sp, result);
+    item = result->item;
+
+    for (prog = list; prog; prog = lookup_pointer(programs, prog)->data)
+    {
+        string_t *progname = NULL;
+
+        for (int i = 0; i < prog->num_function_headers; i++)
+        {
+            function_profile_t *profile = prog->profile + i;
+            vector_t *entry;
+
+            if (!profile->calls)
+                continue;
+
+            if (!progname)
+            {
+                progname = compat_mode ? ref_mstring(prog->name) : add_slash(prog->name);
+                if (!progname)
+                    errorf("Out of memory\n");
+            }
+
+            entry = allocate_array(FP_SIZE);
+            put_ref_string(entry->item + FP_PROGRAM, progname);
+            put_ref_string(entry->item + FP_FUNCTION, prog->function_headers[i].name);
+            put_number(entry->item + FP_CALLS, (p_int)profile->calls);
+            put_number(entry->item + FP_SELF_TICKS, (p_int)profile->self_ticks);
+            put_number(entry->item + FP_TOTAL_TICKS, (p_int)profile->total_ticks);
+            put_number(entry->item + FP_SELF_TIME, (p_int)profile->self_ns);
+            put_number(entry->item + FP_TOTAL_TIME, (p_int)profile->total_ns);
+            put_array(item, entry);
+            item++;
+        }
+
+        if (progname)
+            free_mstring(progname);
+    }
+
+    /* Remove the result and the pointer table from the stack
+     * and replace the argument with the result.
+     */
+    inter_sp--;
+    free_svalue(inter_sp--);
+    free_svalue(sp);
+    put_array(sp, result);
+
+    return sp;
+} /* v_function_profile() */
                             
 /***************************************************************************/
@@ -82,6 +82,23 @@ struct control_stack {
 #ifdef EVAL_COST_TRACE
     int32 eval_cost;
       /* The eval cost at that moment. */
+#endif
+    function_profile_t *profile;
+      /* The profile of the called function, NULL if it is not profiled.
+       */
+    statcounter_t profile_ticks;
+    statcounter_t profile_ns;
+      /* The total eval cost and the time in nanoseconds at the call.
+       */
+    statcounter_t profile_child_ticks;
+    statcounter_t profile_child_ns;
+      /* The eval ticks and time spent in profiled functions called
+       * from this one.
+       */
+#ifdef USE_JIT
+    jit_function_t *jit;
+      /* The native code of the called function, or NULL.
+       */
 #endif
 };
 
@@ -226,6 +243,8 @@ extern struct timeval last_eval_duration;
 extern statistic_t stat_total_evalcost;
 extern statistic_t stat_eval_duration;
 extern struct timeval profiling_timevalue;
+extern statcounter_t num_profile_samples;
+extern int32 function_profile_generation;
 extern p_int used_memory_at_eval_start;
 
 extern int num_protected_lvalues;
@@ -282,6 +301,7 @@ extern void push_apply_value(void);
 extern void pop_apply_value (void);
 extern void push_referenced_mapping(mapping_t *m);
 extern svalue_t *push_error_handler(void (*errorhandler)(error_handler_t *), error_handler_t *arg);
+extern void save_foreach_iterators(svalue_t *bottom, svalue_t *top);
 extern void *xalloc_with_error_handler(size_t size);
 
 extern void init_interpret(void);
@@ -356,6 +376,7 @@ extern svalue_t *v_call_direct_resolved (svalue_t *sp, int num_arg);
 extern svalue_t *v_call_resolved (svalue_t *sp, int num_arg);
 extern svalue_t *f_caller_stack_depth (svalue_t *sp);
 extern svalue_t *f_caller_stack (svalue_t *sp);
+extern svalue_t *v_function_profile (svalue_t *sp, int num_arg);
 extern svalue_t *f_get_eval_cost (svalue_t *sp);
 extern svalue_t *f_previous_object (svalue_t *sp);
 extern svalue_t *f_set_this_object (svalue_t *sp);
@@ -383,6 +404,11 @@ extern void check_a_lot_ref_counts(program_t *search_prog);
 extern void handle_profiling_signal(int ignored);
 extern Bool set_profiling_time_limit(mp_int limit);
 extern mp_int get_profiling_time_limit();
+extern Bool set_profile_sample_interval(mp_int interval);
+extern mp_int get_profile_sample_interval(void);
+extern void collect_profile_samples(strbuf_t *sbuf);
+extern void set_function_profiling(bool enable);
+extern bool is_function_profiling(void);
 
 extern size_t interpreter_overhead(void);
 
@@ -0,0 +1,1503 @@
+/*---------------------------------------------------------------------------
+ * Native code compiler for LPC functions (x86-64).
+ *
+ *---------------------------------------------------------------------------
+ * Functions which have been called more than <jit_threshold> times are
+ * translated into native x86-64 code. This is a simple template compiler:
+ * the bytecode of the function is decoded linearly and for each
+ * instruction a fixed piece of machine code is emitted.
+ *
+ * Only a small set of instructions is translated: pushing numbers and
+ * number variables, integer arithmetic and comparisons, the branches
+ * and the increment and assignment of number variables. Everything else
+ * (calls, efuns, returns, operations on other types) leaves the native
+ * code and is executed by the interpreter, which re-enters the native
+ * code at the next instruction it can execute. The same happens when
+ * a translated instruction meets an operand it can't handle (e.g. a
+ * string in an addition) or an overflow: the instruction is then
+ * executed by the interpreter, which also raises the proper error.
+ * So the native code never raises errors, never calls back into the
+ * driver and never has to free values.
+ *
+ * The interpreter enters the native code in eval_instruction() when the
+ * current control stack frame has native code for the next instruction,
+ * see jit_execute(). The eval cost is counted per instruction as in the
+ * interpreter; the native code executes only as many instructions as
+ * the remaining eval cost allows. Instruction tracing always uses the
+ * interpreter.
+ *
+ * Register usage in the native code:
+ *   rbx: the jit_regs_t of this run
+ *   r12: the stack pointer sp
+ *   r13: the frame pointer fp
+ *   r14: current_variables
+ *   r15: number of executed instructions
+ *
+ * The native code is entered through a stub at the beginning of the code
+ * block, which saves the registers, loads the state and jumps to the
+ * entry point. All exits jump with the bytecode offset to continue at
+ * in eax to a common exit stub.
+ *
+ * The compiler can be switched on and off at runtime with
+ * configure_driver(DC_JIT_THRESHOLD), it is off by default.
+ *---------------------------------------------------------------------------
+ */
+
+#include "driver.h"
+
+#ifdef USE_JIT
+
+#include "typedefs.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "jit.h"
+
+#include "exec.h"
+#include "gcollect.h"
+#include "instrs.h"
+#include "interpret.h"
+#include "prolang.h"
+#include "simulate.h"
+#include "svalue.h"
+#include "xalloc.h"
+
+#include "i-eval_cost.h"
+
+/*-------------------------------------------------------------------------*/
+
+#define JIT_MAX_SLICE  (1 << 20)
+  /* The most instructions executed in one run of native code without
+   * returning to the interpreter, so that signals and interrupts are
+   * handled even without an eval cost limit.
+   */
+
+#define JIT_FAILED  ((jit_function_t *)1)
+  /* Marker for functions that couldn't be compiled.
+   */
+
+#define JIT_CHUNK_SIZE  (256 * 1024)
+  /* The size of the executable memory chunks the code is allocated from.
+   */
+
+#define JIT_CODE_SIZE(len)  (((len) + 15) & ~(size_t)15)
+  /* The space allocated for <len> bytes of code, keeping the code
+   * of each function aligned to 16 bytes.
+   */
+
+/* --- struct jit_program_s: The native code of a program
+ */
+
+typedef struct jit_slot_s
+{
+    p_int           calls;     /* Calls so far */
+    jit_function_t *function;  /* The compiled function, JIT_FAILED or NULL */
+} jit_slot_t;
+
+struct jit_program_s
+{
+    unsigned short num_slots;
+    jit_slot_t     slots[];
+      /* [.num_slots] (=program->num_function_headers) */
+};
+
+/* --- struct jit_regs_s: The state passed to and from the native code
+ */
+
+typedef struct jit_regs_s
+{
+    svalue_t *sp;         /* Stack pointer */
+    svalue_t *fp;         /* Frame pointer */
+    svalue_t *variables;  /* current_variables */
+    p_int     count;      /* Executed instructions */
+    p_int     limit;
+      /* At a backward branch the native code returns to the interpreter
+       * if more than this number of instructions has been executed.
+       */
+} jit_regs_t;
+
+typedef int32 (*jit_code_t)(jit_regs_t *regs, unsigned char *entry);
+  /* The entry stub of the native code: run the code at <entry>
+   * and return the bytecode offset to continue at.
+   */
+
+/* --- The code arena ---
+ *
+ * The native code of all functions is allocated from a few large chunks
+ * of executable memory instead of one mapping per function. The chunks
+ * are mapped read and execute only; to copy new code in, the pages it
+ * covers are made writable for a moment. The native code never calls
+ * back into the driver, so no other native code runs meanwhile.
+ *
+ * The free space of each chunk is kept in a list of ranges sorted by
+ * their position, outside the executable memory. A chunk is unmapped
+ * again when all its code has been freed.
+ */
+
+typedef struct jit_range_s jit_range_t;
+typedef struct jit_chunk_s jit_chunk_t;
+
+struct jit_range_s
+{
+    jit_range_t *next;
+    size_t       start;  /* Offset in the chunk */
+    size_t       size;
+};
+
+struct jit_chunk_s
+{
+    jit_chunk_t   *next;
+    unsigned char *base;  /* The mapped memory */
+    size_t         size;
+    size_t         used;  /* Allocated bytes */
+    jit_range_t   *free;  /* The free ranges, sorted by .start */
+};
+
+static jit_chunk_t *jit_chunks = NULL;
+  /* List of all code chunks. */
+
+/* --- Forward declarations --- */
+
+static void free_code (unsigned char *code, size_t size);
+
+/* --- x86-64 code generation --- */
+
+enum jit_register {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+};
+
+enum jit_condition {
+    CC_O = 0x0, CC_E = 0x4, CC_NE = 0x5,
+    CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+    CC_ALWAYS = -1,
+};
+
+#define SV_SIZE   ((int32)sizeof(svalue_t))
+#define SV_NUMBER ((int32)offsetof(svalue_t, u.number))
+  /* Size of an svalue and offset of its number.
+   */
+
+#define REG_OFFSET(field) ((int32)offsetof(jit_regs_t, field))
+
+/* --- struct jit_fixup_s: A jump to be patched
+ */
+
+typedef struct jit_fixup_s
+{
+    size_t pos;     /* Position of the rel32 in the code */
+    p_int  target;  /* Bytecode offset of the jump target */
+    bool   exit;    /* true: leave the native code at <target> */
+} jit_fixup_t;
+
+/* --- struct jit_compiler_s: The state of the compiler
+ */
+
+typedef struct jit_compiler_s
+{
+    unsigned char *code;    /* The generated code */
+    size_t         used;
+    size_t         size;
+    bool           error;   /* Out of memory */
+
+    p_int          length;  /* Length of the translated bytecode */
+    char          *flags;   /* [.length]: JIT_* flags for each offset */
+    int32         *native;  /* [.length]: Native code of each instruction */
+
+    jit_fixup_t   *fixups;
+    size_t         num_fixups;
+    size_t         size_fixups;
+
+    size_t         exit_stub;  /* Position of the common exit stub */
+} jit_compiler_t;
+
+/* Flags for jit_compiler_t.flags */
+#define JIT_INSTRUCTION  0x01  /* An instruction starts here */
+#define JIT_LABEL        0x02  /* A branch target */
+
+/*-------------------------------------------------------------------------*/
+
+p_int jit_threshold = JIT_THRESHOLD_OFF;
+  /* Number of calls of a function before it is compiled,
+   * or JIT_THRESHOLD_OFF if the compiler is switched off.
+   */
+
+/*-------------------------------------------------------------------------*/
+static bool
+jit_layout_ok (void)
+
+/* Return true if the svalues have the layout the native code expects:
+ * a 32-Bit type, a 32-Bit secondary type and the 64-Bit value.
+ */
+
+{
+    return sizeof(svalue_t) == 16
+        && offsetof(svalue_t, type) == 0 && sizeof(ph_int) == 4
+        && offsetof(svalue_t, x) == 4
+        && offsetof(svalue_t, u.number) == 8 && sizeof(p_int) == 8;
+} /* jit_layout_ok() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_byte (jit_compiler_t *c, unsigned char b)
+
+/* Append <b> to the generated code.
+ */
+
+{
+    if (c->used == c->size)
+    {
+        unsigned char *code;
+
+        if (c->error)
+            return;
+
+        code = rexalloc(c->code, c->size * 2);
+        if (!code)
+        {
+            c->error = true;
+            return;
+        }
+        c->code = code;
+        c->size *= 2;
+    }
+
+    c->code[c->used++] = b;
+} /* emit_byte() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_int32 (jit_compiler_t *c, int32 v)
+
+/* Append the 32-Bit value <v> to the generated code.
+ */
+
+{
+    uint32 u = (uint32)v;
+
+    emit_byte(c, u & 0xff);
+    emit_byte(c, (u >> 8) & 0xff);
+    emit_byte(c, (u >> 16) & 0xff);
+    emit_byte(c, (u >> 24) & 0xff);
+} /* emit_int32() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_opcode (jit_compiler_t *c, bool w, int opcode, int reg, int rm)
+
+/* Emit the REX prefix (if needed) and the <opcode> (one byte or 0x0Fxx)
+ * for an instruction with the operands <reg> and <rm>. <w> selects
+ * 64-Bit operands.
+ */
+
+{
+    int rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+
+    if (rex != 0x40)
+        emit_byte(c, rex);
+    if (opcode > 0xff)
+        emit_byte(c, opcode >> 8);
+    emit_byte(c, opcode & 0xff);
+} /* emit_opcode() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_op_mem (jit_compiler_t *c, bool w, int opcode, int reg, int base, int32 disp)
+
+/* Emit the instruction <opcode> with the register (or opcode extension)
+ * <reg> and the memory operand [<base>+<disp>].
+ */
+
+{
+    int mod;
+
+    emit_opcode(c, w, opcode, reg, base);
+
+    if (disp == 0 && (base & 7) != RBP)
+        mod = 0;
+    else if (disp >= -128 && disp <= 127)
+        mod = 1;
+    else
+        mod = 2;
+
+    emit_byte(c, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP)
+        emit_byte(c, 0x24); /* SIB: no index */
+    if (mod == 1)
+        emit_byte(c, disp & 0xff);
+    else if (mod == 2)
+        emit_int32(c, disp);
+} /* emit_op_mem() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_op_reg (jit_compiler_t *c, bool w, int opcode, int reg, int rm)
+
+/* Emit the instruction <opcode> with the register (or opcode extension)
+ * <reg> and the register operand <rm>.
+ */
+
+{
+    emit_opcode(c, w, opcode, reg, rm);
+    emit_byte(c, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+} /* emit_op_reg() */
+
+/* Some instructions with their opcode and operand order */
+#define emit_load(c,reg,base,disp)      emit_op_mem(c, true, 0x8B, reg, base, disp)
+#define emit_store(c,base,disp,reg)     emit_op_mem(c, true, 0x89, reg, base, disp)
+#define emit_add_mem(c,reg,base,disp)   emit_op_mem(c, true, 0x03, reg, base, disp)
+#define emit_sub_mem(c,reg,base,disp)   emit_op_mem(c, true, 0x2B, reg, base, disp)
+#define emit_cmp_mem(c,reg,base,disp)   emit_op_mem(c, true, 0x3B, reg, base, disp)
+#define emit_imul_mem(c,reg,base,disp)  emit_op_mem(c, true, 0x0FAF, reg, base, disp)
+#define emit_mov_reg(c,dest,src)        emit_op_reg(c, true, 0x89, src, dest)
+#define emit_test_reg(c,reg)            emit_op_reg(c, true, 0x85, reg, reg)
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_add_imm (jit_compiler_t *c, int reg, int32 imm)
+
+/* Emit 'add <reg>, <imm>' (or 'sub' for negative <imm>).
+ */
+
+{
+    int ext = 0; /* add */
+
+    if (imm < 0)
+    {
+        ext = 5; /* sub */
+        imm = -imm;
+    }
+
+    if (imm <= 127)
+    {
+        emit_op_reg(c, true, 0x83, ext, reg);
+        emit_byte(c, imm);
+    }
+    else
+    {
+        emit_op_reg(c, true, 0x81, ext, reg);
+        emit_int32(c, imm);
+    }
+} /* emit_add_imm() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_set_condition (jit_compiler_t *c, enum jit_condition cc)
+
+/* Emit 'setcc al; movzx eax, al'.
+ */
+
+{
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0x90 | cc);
+    emit_byte(c, 0xC0);
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0xB6);
+    emit_byte(c, 0xC0);
+} /* emit_set_condition() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_jump (jit_compiler_t *c, enum jit_condition cc, p_int target, bool exit)
+
+/* Emit a jump to the native code of the instruction at <target> resp.
+ * with <exit> an exit to the interpreter at <target>. With <cc> other
+ * than CC_ALWAYS, the jump is conditional.
+ */
+
+{
+    if (c->num_fixups == c->size_fixups)
+    {
+        jit_fixup_t *fixups = NULL;
+
+        if (!c->error)
+            fixups = rexalloc(c->fixups, sizeof(*fixups) * c->size_fixups * 2);
+        if (!fixups)
+        {
+            c->error = true;
+            return;
+        }
+        c->fixups = fixups;
+        c->size_fixups *= 2;
+    }
+
+    if (cc == CC_ALWAYS)
+        emit_byte(c, 0xE9);
+    else
+    {
+        emit_byte(c, 0x0F);
+        emit_byte(c, 0x80 | cc);
+    }
+
+    c->fixups[c->num_fixups].pos = c->used;
+    c->fixups[c->num_fixups].target = target;
+    c->fixups[c->num_fixups].exit = exit;
+    c->num_fixups++;
+
+    emit_int32(c, 0);
+} /* emit_jump() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_exit (jit_compiler_t *c, p_int offset)
+
+/* Emit the code to leave the native code at bytecode <offset>.
+ */
+
+{
+    emit_byte(c, 0xB8); /* mov eax, <offset> */
+    emit_int32(c, (int32)offset);
+    emit_byte(c, 0xE9); /* jmp <exit_stub> */
+    emit_int32(c, (int32)(c->exit_stub - (c->used + 4)));
+} /* emit_exit() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_check_number (jit_compiler_t *c, int base, int32 disp, p_int offset)
+
+/* Emit the code to leave the native code at <offset> if the svalue
+ * at [<base>+<disp>] is not a number.
+ */
+
+{
+    emit_op_mem(c, false, 0x83, 7, base, disp); /* cmp dword [], T_NUMBER */
+    emit_byte(c, T_NUMBER);
+    emit_jump(c, CC_NE, offset, true);
+} /* emit_check_number() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_store_number (jit_compiler_t *c, int base, int32 disp)
+
+/* Emit the code to store the number in rax as svalue at [<base>+<disp>].
+ */
+
+{
+    emit_op_mem(c, true, 0xC7, 0, base, disp); /* mov qword [], T_NUMBER */
+    emit_int32(c, T_NUMBER);
+    emit_store(c, base, disp + SV_NUMBER, RAX);
+} /* emit_store_number() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_push_rax (jit_compiler_t *c)
+
+/* Emit the code to push the number in rax onto the stack.
+ */
+
+{
+    emit_add_imm(c, R12, SV_SIZE);
+    emit_store_number(c, R12, 0);
+} /* emit_push_rax() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_push_number (jit_compiler_t *c, p_int num)
+
+/* Emit the code to push the number <num> onto the stack.
+ */
+
+{
+    emit_add_imm(c, R12, SV_SIZE);
+    emit_op_mem(c, true, 0xC7, 0, R12, 0); /* mov qword [r12], T_NUMBER */
+    emit_int32(c, T_NUMBER);
+
+    if (num >= INT32_MIN && num <= INT32_MAX)
+    {
+        emit_op_mem(c, true, 0xC7, 0, R12, SV_NUMBER); /* mov qword [], imm32 */
+        emit_int32(c, (int32)num);
+    }
+    else
+    {
+        int i;
+
+        emit_byte(c, 0x48); /* mov rax, imm64 */
+        emit_byte(c, 0xB8);
+        for (i = 0; i < 8; i++)
+            emit_byte(c, ((uint64_t)num >> (8 * i)) & 0xff);
+        emit_store(c, R12, SV_NUMBER, RAX);
+    }
+} /* emit_push_number() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_push_variable (jit_compiler_t *c, int base, int32 disp, p_int offset)
+
+/* Emit the code to push the number variable at [<base>+<disp>] onto
+ * the stack. Other values leave the native code at <offset>.
+ */
+
+{
+    emit_check_number(c, base, disp, offset);
+    emit_load(c, RAX, base, disp);
+    emit_load(c, RCX, base, disp + SV_NUMBER);
+    emit_add_imm(c, R12, SV_SIZE);
+    emit_store(c, R12, 0, RAX);
+    emit_store(c, R12, SV_NUMBER, RCX);
+} /* emit_push_variable() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_count (jit_compiler_t *c, int num)
+
+/* Emit the code to count <num> executed instructions.
+ * This doesn't change the flags.
+ */
+
+{
+    emit_op_mem(c, true, 0x8D, R15, R15, num); /* lea r15, [r15+num] */
+} /* emit_count() */
+
+/*-------------------------------------------------------------------------*/
+static void
+emit_check_limit (jit_compiler_t *c, p_int offset)
+
+/* Emit the code to leave the native code at <offset> if the limit
+ * of executed instructions was reached. This is done before each
+ * backward branch.
+ */
+
+{
+    emit_cmp_mem(c, R15, RBX, REG_OFFSET(limit));
+    emit_jump(c, CC_G, offset, true);
+} /* emit_check_limit() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+emit_binary (jit_compiler_t *c, int instr, p_int offset)
+
+/* Emit the code for the binary operator <instr> on two numbers.
+ * Return false if the operator isn't supported.
+ */
+
+{
+    enum jit_condition cc = CC_ALWAYS;
+
+    switch (instr)
+    {
+    case F_ADD:
+    case F_SUBTRACT:
+    case F_MULTIPLY:
+        break;
+    case F_LT: cc = CC_L;  break;
+    case F_LE: cc = CC_LE; break;
+    case F_GT: cc = CC_G;  break;
+    case F_GE: cc = CC_GE; break;
+    case F_EQ: cc = CC_E;  break;
+    case F_NE: cc = CC_NE; break;
+    default:
+        return false;
+    }
+
+    emit_check_number(c, R12, -SV_SIZE, offset);
+    emit_check_number(c, R12, 0, offset);
+    emit_load(c, RAX, R12, SV_NUMBER - SV_SIZE);
+
+    switch (instr)
+    {
+    case F_ADD:
+        emit_add_mem(c, RAX, R12, SV_NUMBER);
+        emit_jump(c, CC_O, offset, true);
+        break;
+    case F_SUBTRACT:
+        emit_sub_mem(c, RAX, R12, SV_NUMBER);
+        emit_jump(c, CC_O, offset, true);
+        break;
+    case F_MULTIPLY:
+        emit_imul_mem(c, RAX, R12, SV_NUMBER);
+        emit_jump(c, CC_O, offset, true);
+        break;
+    default:
+        emit_cmp_mem(c, RAX, R12, SV_NUMBER);
+        emit_set_condition(c, cc);
+        break;
+    }
+
+    emit_add_imm(c, R12, -SV_SIZE);
+    emit_store_number(c, R12, 0);
+    return true;
+} /* emit_binary() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+emit_lvalue_op (jit_compiler_t *c, int instr, int base, int32 disp, p_int offset)
+
+/* Emit the code for the lvalue operator <instr> applied to the number
+ * variable at [<base>+<disp>]. The lvalue itself isn't pushed.
+ * Return false if the operator isn't supported.
+ */
+
+{
+    switch (instr)
+    {
+    case F_VOID_ASSIGN:
+        emit_check_number(c, base, disp, offset);
+        emit_check_number(c, R12, 0, offset);
+        emit_load(c, RAX, R12, 0);
+        emit_load(c, RCX, R12, SV_NUMBER);
+        emit_store(c, base, disp, RAX);
+        emit_store(c, base, disp + SV_NUMBER, RCX);
+        emit_add_imm(c, R12, -SV_SIZE);
+        return true;
+
+    case F_VOID_ADD_EQ:
+        emit_check_number(c, base, disp, offset);
+        emit_check_number(c, R12, 0, offset);
+        emit_load(c, RAX, base, disp + SV_NUMBER);
+        emit_add_mem(c, RAX, R12, SV_NUMBER);
+        emit_jump(c, CC_O, offset, true);
+        emit_store(c, base, disp + SV_NUMBER, RAX);
+        emit_add_imm(c, R12, -SV_SIZE);
+        return true;
+
+    case F_INC:
+    case F_DEC:
+    case F_PRE_INC:
+    case F_PRE_DEC:
+        emit_check_number(c, base, disp, offset);
+        emit_load(c, RAX, base, disp + SV_NUMBER);
+        emit_add_imm(c, RAX, (instr == F_INC || instr == F_PRE_INC) ? 1 : -1);
+        emit_jump(c, CC_O, offset, true);
+        emit_store(c, base, disp + SV_NUMBER, RAX);
+        if (instr == F_PRE_INC || instr == F_PRE_DEC)
+            emit_push_rax(c);
+        return true;
+
+    case F_POST_INC:
+    case F_POST_DEC:
+        emit_check_number(c, base, disp, offset);
+        emit_load(c, RAX, base, disp + SV_NUMBER);
+        emit_mov_reg(c, RCX, RAX);
+        emit_add_imm(c, RCX, instr == F_POST_INC ? 1 : -1);
+        emit_jump(c, CC_O, offset, true);
+        emit_store(c, base, disp + SV_NUMBER, RCX);
+        emit_push_rax(c);
+        return true;
+
+    default:
+        return false;
+    }
+} /* emit_lvalue_op() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+get_branch_target (bytecode_p p, p_int offset, p_int *target)
+
+/* If the instruction at <p> (at bytecode <offset>) may continue
+ * elsewhere than at the next instruction, store the offset of that
+ * destination in <target> and return true.
+ */
+
+{
+    switch (GET_CODE(p))
+    {
+    case F_BRANCH:
+    case F_BRANCH_WHEN_ZERO:
+    case F_BRANCH_WHEN_NON_ZERO:
+    case F_LAND:
+    case F_LOR:
+        *target = offset + 2 + GET_UINT8(p+1);
+        return true;
+
+    case F_BBRANCH_WHEN_ZERO:
+    case F_BBRANCH_WHEN_NON_ZERO:
+        *target = offset + 1 - GET_UINT8(p+1);
+        return true;
+
+    case F_LBRANCH:
+    case F_LBRANCH_WHEN_ZERO:
+    case F_LBRANCH_WHEN_NON_ZERO:
+        *target = offset + 1 + get_bc_shortoffset(p+1);
+        return true;
+
+    case F_FBRANCH:
+        *target = offset + 1 + get_bc_offset(p+1);
+        return true;
+
+    case F_CATCH:
+        *target = offset + 3 + GET_UINT8(p+2);
+        return true;
+
+    case F_FOREACH:
+    case F_FOREACH_REF:
+    case F_FOREACH_RANGE:
+        *target = offset + 4 + (unsigned short)get_short(p+2);
+        return true;
+
+    case F_FOREACH_NEXT:
+        *target = offset + 5 - (unsigned short)get_short(p+3);
+        return true;
+
+    default:
+        return false;
+    }
+} /* get_branch_target() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+decode_function (bytecode_p start, bytecode_p end, p_int *num_instructions)
+
+/* Determine the extent of the function code starting at <start>:
+ * decode the instructions linearly until a return or unconditional
+ * branch is reached that no branch skips, an instruction that can't
+ * be decoded (switch) or the program end <end>.
+ * Return the length of the code and put the number of instructions
+ * into <num_instructions>. An instruction that can't be decoded
+ * is counted with a length of 1.
+ */
+
+{
+    p_int offset = 0, max_target = 0;
+
+    *num_instructions = 0;
+
+    while (start + offset < end)
+    {
+        bytecode_p p = start + offset;
+        int len = instruction_length(p);
+        p_int target;
+
+        (*num_instructions)++;
+        if (len < 0 || p + len > end)
+            return offset + 1;
+
+        if (get_branch_target(p, offset, &target) && target > max_target)
+            max_target = target;
+        offset += len;
+
+        switch (GET_CODE(p))
+        {
+        case F_RETURN:
+        case F_RETURN0:
+        case F_DEFAULT_RETURN:
+        case F_BRANCH:
+        case F_LBRANCH:
+        case F_FBRANCH:
+            if (offset > max_target)
+                return offset;
+            break;
+        }
+    }
+
+    return offset;
+} /* decode_function() */
+
+/*-------------------------------------------------------------------------*/
+static int
+get_length (jit_compiler_t *c, bytecode_p start, p_int offset)
+
+/* Return the length of the instruction at <start>+<offset>, or -1 if
+ * it can't be decoded.
+ */
+
+{
+    int len = instruction_length(start + offset);
+
+    if (len < 0 || offset + len > c->length)
+        return -1;
+    return len;
+} /* get_length() */
+
+/*-------------------------------------------------------------------------*/
+static int
+translate_instruction (jit_compiler_t *c, bytecode_p p, p_int offset)
+
+/* Emit the native code for the instruction at <p> (at bytecode <offset>).
+ * Return the number of bytecode instructions translated (2 for combined
+ * instructions), or 0 if the instruction has to be left to the
+ * interpreter. In that case nothing has been emitted.
+ */
+
+{
+    int instr = GET_CODE(p);
+    p_int target = -1;
+    p_int num;
+
+    if (get_branch_target(p, offset, &target)
+     && (target < 0 || target >= c->length || !(c->flags[target] & JIT_INSTRUCTION)))
+        return 0;
+
+    switch (instr)
+    {
+    case F_CONST0:
+        emit_push_number(c, 0);
+        break;
+
+    case F_CONST1:
+        emit_push_number(c, 1);
+        break;
+
+    case F_NCONST1:
+        emit_push_number(c, -1);
+        break;
+
+    case F_CLIT:
+        emit_push_number(c, GET_UINT8(p+1));
+        break;
+
+    case F_NCLIT:
+        emit_push_number(c, -(p_int)GET_UINT8(p+1));
+        break;
+
+    case F_NUMBER:
+        memcpy(&num, p+1, sizeof(num));
+        emit_push_number(c, num);
+        break;
+
+    case F_LOCAL:
+        emit_push_variable(c, R13, SV_SIZE * GET_UINT8(p+1), offset);
+        break;
+
+    case F_IDENTIFIER:
+        emit_push_variable(c, R14, SV_SIZE * GET_UINT8(p+1), offset);
+        break;
+
+    case F_ADD:
+    case F_SUBTRACT:
+    case F_MULTIPLY:
+    case F_LT:
+    case F_LE:
+    case F_GT:
+    case F_GE:
+    case F_EQ:
+    case F_NE:
+        emit_binary(c, instr, offset);
+        break;
+
+    case F_INT_OP:
+        if (!emit_binary(c, GET_UINT8(p+1), offset))
+            return 0;
+        break;
+
+    case F_NOT:
+        emit_check_number(c, R12, 0, offset);
+        emit_load(c, RAX, R12, SV_NUMBER);
+        emit_test_reg(c, RAX);
+        emit_set_condition(c, CC_E);
+        emit_store_number(c, R12, 0);
+        break;
+
+    case F_POP_VALUE:
+        emit_check_number(c, R12, 0, offset);
+        emit_add_imm(c, R12, -SV_SIZE);
+        break;
+
+    case F_BRANCH:
+    case F_LBRANCH:
+        if (target <= offset)
+            emit_check_limit(c, offset);
+        emit_count(c, 1);
+        emit_jump(c, CC_ALWAYS, target, false);
+        return 1;
+
+    case F_BRANCH_WHEN_ZERO:
+    case F_BRANCH_WHEN_NON_ZERO:
+    case F_BBRANCH_WHEN_ZERO:
+    case F_BBRANCH_WHEN_NON_ZERO:
+    case F_LBRANCH_WHEN_ZERO:
+    case F_LBRANCH_WHEN_NON_ZERO:
+        if (target <= offset)
+            emit_check_limit(c, offset);
+        emit_check_number(c, R12, 0, offset);
+        emit_load(c, RAX, R12, SV_NUMBER);
+        emit_add_imm(c, R12, -SV_SIZE);
+        emit_count(c, 1);
+        emit_test_reg(c, RAX);
+        emit_jump(c, (instr == F_BRANCH_WHEN_ZERO
+                   || instr == F_BBRANCH_WHEN_ZERO
+                   || instr == F_LBRANCH_WHEN_ZERO) ? CC_E : CC_NE
+                 , target, false);
+        return 1;
+
+    case F_LAND:
+    case F_LOR:
+        /* The value is left on the stack when branching. */
+        emit_check_number(c, R12, 0, offset);
+        emit_load(c, RAX, R12, SV_NUMBER);
+        emit_count(c, 1);
+        emit_test_reg(c, RAX);
+        emit_jump(c, instr == F_LAND ? CC_E : CC_NE, target, false);
+        emit_add_imm(c, R12, -SV_SIZE);
+        return 1;
+
+    case F_PUSH_LOCAL_VARIABLE_LVALUE:
+    case F_PUSH_IDENTIFIER_LVALUE:
+    {
+        /* Only together with the following operator, the lvalue
+         * itself is not pushed.
+         */
+        bytecode_p next = p + 2;
+
+        if (offset + 2 >= c->length || (c->flags[offset + 2] & JIT_LABEL)
+         || !emit_lvalue_op(c, GET_CODE(next)
+                           , instr == F_PUSH_LOCAL_VARIABLE_LVALUE ? R13 : R14
+                           , SV_SIZE * GET_UINT8(p+1), offset))
+            return 0;
+
+        emit_count(c, 2);
+        return 2;
+    }
+
+    default:
+        return 0;
+    }
+
+    emit_count(c, 1);
+    return 1;
+} /* translate_instruction() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+set_code_protection (unsigned char *code, size_t size, int prot)
+
+/* Set the protection of the pages covering <size> bytes at <code>
+ * to <prot>. Return true on success.
+ */
+
+{
+    uintptr_t pagesize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)code & ~(pagesize - 1);
+    uintptr_t end = ((uintptr_t)code + size + pagesize - 1) & ~(pagesize - 1);
+
+    return mprotect((void *)start, end - start, prot) == 0;
+} /* set_code_protection() */
+
+/*-------------------------------------------------------------------------*/
+static unsigned char *
+alloc_code (const unsigned char *code, size_t len)
+
+/* Allocate JIT_CODE_SIZE(<len>) bytes in the code arena and copy the
+ * <len> bytes of <code> there. Return the executable copy, or NULL
+ * when out of memory.
+ */
+
+{
+    jit_chunk_t *chunk;
+    unsigned char *result = NULL;
+    size_t size = JIT_CODE_SIZE(len);
+
+    for (chunk = jit_chunks; chunk && !result; chunk = chunk->next)
+    {
+        jit_range_t **prev;
+
+        for (prev = &chunk->free; *prev; prev = &(*prev)->next)
+        {
+            jit_range_t *range = *prev;
+
+            if (range->size < size)
+                continue;
+
+            result = chunk->base + range->start;
+            chunk->used += size;
+            range->start += size;
+            range->size -= size;
+            if (!range->size)
+            {
+                *prev = range->next;
+                pfree(range);
+            }
+            break;
+        }
+    }
+
+    if (!result)
+    {
+        /* Map a new chunk, large enough for <size>. */
+        size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+        size_t chunk_size = JIT_CHUNK_SIZE;
+        void *base;
+
+        if (chunk_size < size)
+            chunk_size = (size + pagesize - 1) & ~(pagesize - 1);
+
+        chunk = pxalloc(sizeof(*chunk));
+        if (!chunk)
+            return NULL;
+
+        base = mmap(NULL, chunk_size, PROT_READ|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            pfree(chunk);
+            return NULL;
+        }
+
+        chunk->base = base;
+        chunk->size = chunk_size;
+        chunk->used = size;
+        chunk->free = NULL;
+        if (size < chunk_size)
+        {
+            jit_range_t *range = pxalloc(sizeof(*range));
+
+            if (!range)
+            {
+                munmap(base, chunk_size);
+                pfree(chunk);
+                return NULL;
+            }
+            range->next = NULL;
+            range->start = size;
+            range->size = chunk_size - size;
+            chunk->free = range;
+        }
+
+        chunk->next = jit_chunks;
+        jit_chunks = chunk;
+        result = chunk->base;
+    }
+
+    if (!set_code_protection(result, size, PROT_READ|PROT_WRITE))
+    {
+        free_code(result, size);
+        return NULL;
+    }
+    memcpy(result, code, len);
+    if (!set_code_protection(result, size, PROT_READ|PROT_EXEC))
+    {
+        /* The code can't be executed, but the pages stay usable. */
+        free_code(result, size);
+        return NULL;
+    }
+
+    return result;
+} /* alloc_code() */
+
+/*-------------------------------------------------------------------------*/
+static void
+free_code (unsigned char *code, size_t size)
+
+/* Return the <size> bytes of code at <code> to the code arena.
+ */
+
+{
+    jit_chunk_t **pchunk, *chunk;
+    jit_range_t **prev, *range, *next, *before;
+    size_t start;
+
+    for (pchunk = &jit_chunks; ; pchunk = &chunk->next)
+    {
+        chunk = *pchunk;
+        if (!chunk)
+            fatal("jit: Freeing unknown native code %p\n", code);
+        if (code >= chunk->base && code < chunk->base + chunk->size)
+            break;
+    }
+
+    chunk->used -= size;
+    if (!chunk->used)
+    {
+        /* The chunk is empty, unmap it. */
+        for (range = chunk->free; range; range = next)
+        {
+            next = range->next;
+            pfree(range);
+        }
+        munmap(chunk->base, chunk->size);
+        *pchunk = chunk->next;
+        pfree(chunk);
+        return;
+    }
+
+    /* Insert the range in order and merge it with its neighbours. */
+    start = (size_t)(code - chunk->base);
+    before = NULL;
+    for (prev = &chunk->free; *prev && (*prev)->start < start; prev = &(*prev)->next)
+        before = *prev;
+    next = *prev;
+
+    if (before && before->start + before->size == start)
+    {
+        before->size += size;
+        if (next && before->start + before->size == next->start)
+        {
+            before->size += next->size;
+            before->next = next->next;
+            pfree(next);
+        }
+        return;
+    }
+
+    if (next && start + size == next->start)
+    {
+        next->start = start;
+        next->size += size;
+        return;
+    }
+
+    range = pxalloc(sizeof(*range));
+    if (!range)
+    {
+        /* Just lose the space, it is reclaimed with the chunk. */
+        return;
+    }
+    range->start = start;
+    range->size = size;
+    range->next = next;
+    *prev = range;
+} /* free_code() */
+
+/*-------------------------------------------------------------------------*/
+static jit_function_t *
+compile_function (program_t *prog, bytecode_p funstart)
+
+/* Compile the function at <funstart> in <prog>.
+ * Return the compiled function, or NULL if it couldn't be compiled.
+ */
+
+{
+    function_t *header = prog->function_headers + FUNCTION_HEADER_INDEX(funstart);
+    bytecode_p start = funstart + header->num_opt_arg * sizeof(unsigned short);
+    jit_compiler_t c;
+    jit_function_t *fun = NULL;
+    p_int num_instructions, offset;
+    size_t i, code_size;
+    unsigned char *code;
+    int count;
+
+    memset(&c, 0, sizeof(c));
+
+    c.length = decode_function(start, PROGRAM_END(*prog), &num_instructions);
+    if (c.length <= 0 || c.length > INT32_MAX / 2)
+        return NULL;
+
+    c.size = 256;
+    c.size_fixups = 16;
+    c.code = xalloc(c.size);
+    c.fixups = xalloc(sizeof(*c.fixups) * c.size_fixups);
+    c.flags = xalloc(c.length);
+    c.native = xalloc(sizeof(*c.native) * c.length);
+    fun = xalloc(sizeof(*fun) + sizeof(*fun->entries) * c.length);
+    if (!c.code || !c.fixups || !c.flags || !c.native || !fun)
+        goto failed;
+
+    for (offset = 0; offset < c.length; offset++)
+    {
+        c.native[offset] = -1;
+        fun->entries[offset] = -1;
+    }
+    memset(c.flags, 0, c.length);
+
+    /* Find the instructions and the branch targets. */
+    c.flags[0] |= JIT_LABEL;
+    for (i = 0; i < header->num_opt_arg; i++)
+    {
+        offset = get_short(funstart + i * sizeof(unsigned short));
+        if (offset >= 0 && offset < c.length)
+            c.flags[offset] |= JIT_LABEL;
+    }
+
+    for (offset = 0; offset < c.length; )
+    {
+        p_int target;
+        int len = get_length(&c, start, offset);
+
+        c.flags[offset] |= JIT_INSTRUCTION;
+        if (len < 0)
+            break;
+        if (get_branch_target(start + offset, offset, &target)
+         && target >= 0 && target < c.length)
+            c.flags[target] |= JIT_LABEL;
+        offset += len;
+    }
+
+    /* The entry stub: save the registers, load the state and jump
+     * to the entry point given as second argument.
+     */
+    emit_byte(&c, 0x53);                    /* push rbx */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x54); /* push r12 */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x55); /* push r13 */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x56); /* push r14 */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x57); /* push r15 */
+    emit_mov_reg(&c, RBX, RDI);
+    emit_load(&c, R12, RBX, REG_OFFSET(sp));
+    emit_load(&c, R13, RBX, REG_OFFSET(fp));
+    emit_load(&c, R14, RBX, REG_OFFSET(variables));
+    emit_load(&c, R15, RBX, REG_OFFSET(count));
+    emit_op_reg(&c, false, 0xFF, 4, RSI);   /* jmp rsi */
+
+    /* The exit stub: store the state, restore the registers and
+     * return the bytecode offset in eax.
+     */
+    c.exit_stub = c.used;
+    emit_store(&c, RBX, REG_OFFSET(sp), R12);
+    emit_store(&c, RBX, REG_OFFSET(count), R15);
+    emit_byte(&c, 0x41); emit_byte(&c, 0x5F); /* pop r15 */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x5E); /* pop r14 */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x5D); /* pop r13 */
+    emit_byte(&c, 0x41); emit_byte(&c, 0x5C); /* pop r12 */
+    emit_byte(&c, 0x5B);                    /* pop rbx */
+    emit_byte(&c, 0xC3);                    /* ret */
+
+    /* The instructions. Those not translated just exit, the others
+     * become entry points (the second of a combined pair doesn't).
+     */
+    for (offset = 0; offset < c.length; )
+    {
+        int len = get_length(&c, start, offset);
+
+        c.native[offset] = (int32)c.used;
+        count = (len < 0) ? 0 : translate_instruction(&c, start + offset, offset);
+        if (count == 0)
+        {
+            emit_exit(&c, offset);
+            if (len < 0)
+                break;
+        }
+        else
+        {
+            fun->entries[offset] = c.native[offset];
+            if (count > 1)
+                len += get_length(&c, start, offset + len);
+        }
+        offset += len;
+    }
+    emit_exit(&c, c.length);
+
+    if (c.error)
+        goto failed;
+
+    /* Resolve the jumps. The exits share one stub per bytecode offset. */
+    {
+        int32 *stubs = xalloc(sizeof(*stubs) * (c.length + 1));
+
+        if (!stubs)
+            goto failed;
+        for (offset = 0; offset <= c.length; offset++)
+            stubs[offset] = -1;
+
+        for (i = 0; i < c.num_fixups; i++)
+        {
+            jit_fixup_t *fixup = c.fixups + i;
+            int32 dest;
+            uint32 rel;
+
+            if (fixup->exit)
+            {
+                if (stubs[fixup->target] < 0)
+                {
+                    stubs[fixup->target] = (int32)c.used;
+                    emit_exit(&c, fixup->target);
+                }
+                dest = stubs[fixup->target];
+            }
+            else
+                dest = c.native[fixup->target];
+
+            if (c.error || dest < 0)
+            {
+                xfree(stubs);
+                goto failed;
+            }
+
+            rel = (uint32)(dest - (int32)(fixup->pos + 4));
+            c.code[fixup->pos]   = rel & 0xff;
+            c.code[fixup->pos+1] = (rel >> 8) & 0xff;
+            c.code[fixup->pos+2] = (rel >> 16) & 0xff;
+            c.code[fixup->pos+3] = (rel >> 24) & 0xff;
+        }
+        xfree(stubs);
+    }
+
+    /* Copy the code into executable memory. */
+    code_size = JIT_CODE_SIZE(c.used);
+    code = alloc_code(c.code, c.used);
+    if (!code)
+        goto failed;
+
+    fun->start = start;
+    fun->length = c.length;
+    fun->num_instructions = num_instructions;
+    fun->code = code;
+    fun->code_size = code_size;
+
+    xfree(c.code);
+    xfree(c.fixups);
+    xfree(c.flags);
+    xfree(c.native);
+    return fun;
+
+failed:
+    if (c.code)
+        xfree(c.code);
+    if (c.fixups)
+        xfree(c.fixups);
+    if (c.flags)
+        xfree(c.flags);
+    if (c.native)
+        xfree(c.native);
+    if (fun)
+        xfree(fun);
+    return NULL;
+} /* compile_function() */
+
+/*-------------------------------------------------------------------------*/
+jit_function_t *
+jit_get_function (program_t *prog, bytecode_p funstart)
+
+/* The function at <funstart> in <prog> is called: count the call and
+ * return its native code, compiling it when the function becomes hot.
+ * Return NULL if there is no native code for the function.
+ */
+
+{
+    jit_program_t *jp = prog->jit;
+    jit_slot_t *slot;
+
+    if (jit_threshold < 0 || !jit_layout_ok())
+        return NULL;
+
+    if (!jp)
+    {
+        size_t size = sizeof(*jp) + sizeof(*jp->slots) * prog->num_function_headers;
+
+        jp = xalloc(size);
+        if (!jp)
+            return NULL;
+        memset(jp, 0, size);
+        jp->num_slots = prog->num_function_headers;
+        prog->jit = jp;
+    }
+
+    slot = jp->slots + FUNCTION_HEADER_INDEX(funstart);
+    if (slot->function)
+        return slot->function == JIT_FAILED ? NULL : slot->function;
+
+    if (slot->calls < jit_threshold)
+    {
+        slot->calls++;
+        return NULL;
+    }
+
+    slot->function = compile_function(prog, funstart);
+    if (!slot->function)
+    {
+        slot->function = JIT_FAILED;
+        return NULL;
+    }
+
+    return slot->function;
+} /* jit_get_function() */
+
+/*-------------------------------------------------------------------------*/
+svalue_t *
+jit_execute (jit_function_t *fun, bytecode_p *pc, svalue_t *sp, svalue_t *fp)
+
+/* Run the native code of <fun> from the instruction at *<pc> on, which
+ * must be an entry point (see jit_has_entry()), with the stack pointer
+ * <sp> and the frame pointer <fp>. Return the new stack pointer and set
+ * *<pc> to the next instruction to be interpreted. The executed
+ * instructions are added to the eval cost.
+ *
+ * The caller has to make sure that the current frame belongs to <fun>,
+ * and that there is no set_this_object() in effect.
+ */
+
+{
+    jit_regs_t regs;
+    p_int remaining;
+    int32 offset;
+
+    if (jit_threshold < 0)
+        return sp;
+
+    /* Since the eval cost is checked only at backward branches, there
+     * must be room for one run through the whole function.
+     */
+    remaining = GET_REMAINING_EVAL_COST();
+    if (remaining > JIT_MAX_SLICE)
+        remaining = JIT_MAX_SLICE;
+    if (remaining < fun->num_instructions)
+        return sp;
+
+    regs.sp = sp;
+    regs.fp = fp;
+    regs.variables = current_variables;
+    regs.count = 0;
+    regs.limit = remaining - fun->num_instructions;
+
+    offset = ((jit_code_t)fun->code)(&regs, fun->code + fun->entries[*pc - fun->start]);
+
+    eval_cost += regs.count;
+    total_evalcost += regs.count;
+    *pc = fun->start + offset;
+
+    return regs.sp;
+} /* jit_execute() */
+
+/*-------------------------------------------------------------------------*/
+void
+jit_set_threshold (p_int threshold)
+
+/* Set the number of calls after which a function is compiled, or switch
+ * the compiler off with a negative <threshold>. Compiled code is kept,
+ * but not executed while the compiler is off.
+ */
+
+{
+    jit_threshold = threshold < 0 ? JIT_THRESHOLD_OFF : threshold;
+} /* jit_set_threshold() */
+
+/*-------------------------------------------------------------------------*/
+void
+jit_free_program (program_t *prog)
+
+/* Free the native code of <prog>.
+ */
+
+{
+    jit_program_t *jp = prog->jit;
+    int i;
+
+    if (!jp)
+        return;
+
+    for (i = 0; i < jp->num_slots; i++)
+    {
+        jit_function_t *fun = jp->slots[i].function;
+
+        if (fun && fun != JIT_FAILED)
+        {
+            free_code(fun->code, fun->code_size);
+            xfree(fun);
+        }
+    }
+
+    xfree(jp);
+    prog->jit = NULL;
+} /* jit_free_program() */
+
+#ifdef GC_SUPPORT
+
+/*-------------------------------------------------------------------------*/
+void
+jit_note_program_refs (program_t *prog)
+
+/* GC support: Note the memory blocks of the native code of <prog>.
+ */
+
+{
+    jit_program_t *jp = prog->jit;
+    int i;
+
+    if (!jp)
+        return;
+
+    note_malloced_block_ref(jp);
+    for (i = 0; i < jp->num_slots; i++)
+    {
+        jit_function_t *fun = jp->slots[i].function;
+
+        if (fun && fun != JIT_FAILED)
+            note_malloced_block_ref(fun);
+    }
+} /* jit_note_program_refs() */
+
+#endif /* GC_SUPPORT */
+
+#endif /* USE_JIT */
+
+/***************************************************************************/
@@ -0,0 +1,75 @@
+#ifndef JIT_H__
+#define JIT_H__ 1
+
+#include "driver.h"
+
+/* --- Macros --- */
+
+#define JIT_THRESHOLD_OFF  (-1)
+  /* jit_threshold value: the native code compiler is switched off.
+   * This is also the value reported by drivers compiled without it.
+   */
+
+#ifdef USE_JIT
+
+#include "typedefs.h"
+
+#include "bytecode.h"
+
+/* --- struct jit_function_s: The native code of one function
+ *
+ * The code is generated for the instructions from .start on. Each
+ * instruction the native code can execute itself has an entry point,
+ * other instructions leave the native code and are executed by the
+ * interpreter.
+ */
+
+struct jit_function_s
+{
+    bytecode_p     start;   /* The first instruction of the function */
+    p_int          length;  /* Length of the translated bytecode */
+    p_int          num_instructions;
+      /* Number of translated instructions, the most that can be executed
+       * without a backward branch.
+       */
+    unsigned char *code;    /* The native code (in the code arena) */
+    size_t         code_size;  /* Its allocated size */
+    int32          entries[];
+      /* [.length]: For each bytecode offset the offset of its native
+       * code, or -1 if the instruction there must be interpreted.
+       */
+};
+
+/* --- Variables --- */
+
+extern p_int jit_threshold;
+
+/* --- Prototypes --- */
+
+extern jit_function_t *jit_get_function (program_t *prog, bytecode_p funstart);
+extern svalue_t *jit_execute (jit_function_t *fun, bytecode_p *pc, svalue_t *sp, svalue_t *fp);
+extern void jit_set_threshold (p_int threshold);
+extern void jit_free_program (program_t *prog);
+
+#ifdef GC_SUPPORT
+extern void jit_note_program_refs (program_t *prog);
+#endif
+
+/* --- Inline functions --- */
+
+/*-------------------------------------------------------------------------*/
+static INLINE bool
+jit_has_entry (jit_function_t *fun, bytecode_p pc)
+
+/* Return true if the instruction at <pc> can be executed by the native
+ * code of <fun>.
+ */
+
+{
+    return pc >= fun->start && pc < fun->start + fun->length
+        && fun->entries[pc - fun->start] >= 0;
+} /* jit_has_entry() */
+
+#endif /* USE_JIT */
+
+#endif /* JIT_H__ */
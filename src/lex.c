@@ -71,6 +71,7 @@
 #include "i-eval_cost.h"
 
 #include "../mudlib/sys/driver_hook.h"
+#include "../mudlib/sys/driver_info.h"
 
 /* TODO: Implement the # and ## operators. With this, #define X(a) (a + "a")
  * TODO:: can be made sane (X(b) -> 'b + "a"' instead of 'b + "b"').
@@ -302,6 +303,13 @@ typedef struct source_s
     char       convbytes[4]; /* Bytes that didn't fit into the destination buffer. */
     string_t * str;          /* The source string (referenced), or NULL */
     size_t     current;      /* Current position in .str */
+#ifdef INCLUDE_CACHE_TABLE
+    bool       cached;       /* True: .str holds cached file contents */
+    struct inc_capture_s * capture;
+      /* If not NULL, the text read from .fd is collected here
+       * to be entered into the include cache.
+       */
+#endif
 } source_t;
 
 static source_t yyin;
@@ -513,6 +521,79 @@ typedef struct lpc_ifstate_s
 
 static lpc_ifstate_t *iftop = NULL;
 
+/*-------------------------------------------------------------------------*/
+#ifdef INCLUDE_CACHE_TABLE
+
+/* The include cache keeps the contents of recently included files, already
+ * converted into UTF-8, so that further #includes of the same file just
+ * need to check whether the file was changed in the meantime. The lexer
+ * then reads the cached text like a string source.
+ *
+ * Only the file contents are cached, the preprocessing itself depends
+ * on the defines in effect at the time of the #include and is done anew
+ * every time.
+ *
+ * The cache is a hashtable of INCLUDE_CACHE_TABLE entries, hashed over
+ * the filename. A new entry replaces any older entry in its slot.
+ */
+
+/* --- struct inc_file_id_s: Identification of a file's state ---
+ */
+typedef struct inc_file_id_s
+{
+    dev_t  dev;
+    ino_t  ino;
+    off_t  size;
+    time_t mtime;
+    time_t ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    long   mtime_nsec;
+    long   ctime_nsec;
+#endif
+} inc_file_id_t;
+
+/* --- struct inc_cache_entry_s: One cached include file ---
+ */
+typedef struct inc_cache_entry_s
+{
+    string_t      * name;     /* The filename (tabled), NULL if unused */
+    hash32_t        hash;     /* The hash of .name */
+    string_t      * encoding; /* The file encoding (tabled), or NULL */
+    string_t      * text;     /* The converted file contents */
+    inc_file_id_t   id;       /* The state of the file when read */
+} inc_cache_entry_t;
+
+/* --- struct inc_capture_s: Collect the text of an include file ---
+ */
+typedef struct inc_capture_s
+{
+    string_t      * name;      /* The filename (tabled) */
+    string_t      * encoding;  /* The file encoding (tabled), or NULL */
+    inc_file_id_t   id;        /* The state of the file when opened */
+    char          * buf;       /* The text collected so far */
+    size_t          len;       /* Used length of .buf */
+    size_t          alloc_len; /* Allocated length of .buf */
+} inc_capture_t;
+
+static inc_cache_entry_t inc_cache[INCLUDE_CACHE_TABLE];
+  /* The include cache hashtable.
+   */
+
+/* Include cache statistics */
+static statcounter_t inc_cache_requests   = 0; /* Number of lookups */
+static statcounter_t inc_cache_hits       = 0; /* Number of successful lookups */
+static statcounter_t inc_cache_collisions = 0; /* Number of replaced entries */
+static uint32 inc_cache_entries = 0;           /* Number of used entries */
+static size_t inc_cache_size    = 0;           /* Size of the cached texts */
+
+#if !( (INCLUDE_CACHE_TABLE) & (INCLUDE_CACHE_TABLE)-1 )
+#define IncCacheHash(h) ((h) & ((INCLUDE_CACHE_TABLE)-1))
+#else
+#define IncCacheHash(h) ((h) % INCLUDE_CACHE_TABLE)
+#endif
+
+#endif /* INCLUDE_CACHE_TABLE */
+
 /*-------------------------------------------------------------------------*/
 
 /* The stack to save important state information when handling
@@ -2495,41 +2576,57 @@ realloc_defbuf (void)
     expandend = expandend - old_outp + outp;
 } /* realloc_defbuf() */
 
+/*-------------------------------------------------------------------------*/
+static string_t *
+get_file_encoding (const char* fname)
+
+/* Determine the encoding of the source file <fname> according to the
+ * H_FILE_ENCODING hook. Return a counted reference to the encoding name,
+ * or NULL if none was given (and the file shall be read as ASCII).
+ */
+
+{
+    if (driver_hook[H_FILE_ENCODING].type == T_STRING)
+    {
+        return ref_mstring(driver_hook[H_FILE_ENCODING].u.str);
+    }
+    else if (driver_hook[H_FILE_ENCODING].type == T_CLOSURE)
+    {
+        svalue_t *svp;
+        svalue_t master_sv = svalue_object(master_ob);
+
+        /* Setup and call the closure */
+        push_c_string(inter_sp, fname);
+        svp = secure_apply_lambda_ob(driver_hook+H_FILE_ENCODING, 1, &master_sv);
+
+        if (svp && svp->type == T_STRING)
+            return ref_mstring(svp->u.str);
+    }
+
+    return NULL;
+} /* get_file_encoding() */
+
 /*-------------------------------------------------------------------------*/
 static void
-set_input_source (int fd, const char* fname, string_t * str)
+set_input_source (int fd, string_t * encoding, string_t * str)
 
 /* Set the current input source to <fd>/<str>.
+ * If <fd> is given, <encoding> is the encoding of the file (NULL for ASCII).
  * If <str> is given, it will be referenced.
  */
 
 {
     yyin.convbuf = NULL;
     yyin.convbytes[0] = 0;
+#ifdef INCLUDE_CACHE_TABLE
+    yyin.cached = false;
+    yyin.capture = NULL;
+#endif
 
     yyin.fd = fd;
     if (fd != -1)
     {
         /* Initialize the converter. */
-        string_t *encoding = NULL;
-
-        if (driver_hook[H_FILE_ENCODING].type == T_STRING)
-        {
-            encoding = driver_hook[H_FILE_ENCODING].u.str;
-        }
-        else if (driver_hook[H_FILE_ENCODING].type == T_CLOSURE)
-        {
-            svalue_t *svp;
-            svalue_t master_sv = svalue_object(master_ob);
-
-            /* Setup and call the closure */
-            push_c_string(inter_sp, fname);
-            svp = secure_apply_lambda_ob(driver_hook+H_FILE_ENCODING, 1, &master_sv);
-
-            if (svp && svp->type == T_STRING)
-                encoding = svp->u.str;
-        }
-
         yyin.cd = iconv_open("utf-8", encoding == NULL ? "ascii" : get_txt(encoding));
         if (!iconv_valid(yyin.cd))
         {
@@ -2562,6 +2659,10 @@ set_input_source (int fd, const char* fname, string_t * str)
     yyin.current = 0;
 } /* set_input_source() */
 
+#ifdef INCLUDE_CACHE_TABLE
+static void discard_include_capture(void); /* forward */
+#endif
+
 /*-------------------------------------------------------------------------*/
 static void
 close_input_source (bool dontclosefd)
@@ -2592,9 +2693,239 @@ close_input_source (bool dontclosefd)
         free_mstring(yyin.str);
         yyin.str = NULL;
     }
+#ifdef INCLUDE_CACHE_TABLE
+    yyin.cached = false;
+    discard_include_capture();
+#endif
     yyin.current = 0;
 } /* close_input_source() */
 
+#ifdef INCLUDE_CACHE_TABLE
+/*-------------------------------------------------------------------------*/
+static void
+get_include_file_id (struct stat * st, inc_file_id_t * id)
+
+/* Fill <id> with the identifying information of the file state <st>.
+ */
+
+{
+    memset(id, 0, sizeof(*id));
+    id->dev = st->st_dev;
+    id->ino = st->st_ino;
+    id->size = st->st_size;
+    id->mtime = st->st_mtime;
+    id->ctime = st->st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    id->mtime_nsec = st->st_mtim.tv_nsec;
+    id->ctime_nsec = st->st_ctim.tv_nsec;
+#endif
+} /* get_include_file_id() */
+
+/*-------------------------------------------------------------------------*/
+static void
+free_include_cache_entry (inc_cache_entry_t * entry)
+
+/* Free the data of the cache entry <entry> and mark it as unused.
+ */
+
+{
+    if (entry->name == NULL)
+        return;
+
+    inc_cache_entries--;
+    inc_cache_size -= mstrsize(entry->text);
+
+    free_mstring(entry->name);
+    if (entry->encoding)
+        free_mstring(entry->encoding);
+    free_mstring(entry->text);
+    entry->name = NULL;
+    entry->encoding = NULL;
+    entry->text = NULL;
+} /* free_include_cache_entry() */
+
+/*-------------------------------------------------------------------------*/
+static string_t *
+lookup_include_cache (const char * name, string_t * encoding, struct stat * st)
+
+/* Look for the contents of the include file <name> in the cache. <st> is
+ * the current state of the file and <encoding> its encoding. If the file
+ * is cached and unchanged, return its contents (uncounted), otherwise
+ * return NULL. Outdated entries are removed from the cache.
+ */
+
+{
+    hash32_t hash = hashmem32(name, strlen(name));
+    inc_cache_entry_t * entry = inc_cache + IncCacheHash(hash);
+    inc_file_id_t id;
+
+    inc_cache_requests++;
+
+    if (entry->name == NULL
+     || entry->hash != hash
+     || strcmp(get_txt(entry->name), name) != 0
+       )
+        return NULL;
+
+    get_include_file_id(st, &id);
+    if (memcmp(&id, &entry->id, sizeof(id)) != 0)
+    {
+        /* The file was changed. */
+        free_include_cache_entry(entry);
+        return NULL;
+    }
+
+    if (encoding == NULL
+      ? entry->encoding != NULL
+      : (entry->encoding == NULL || !mstreq(entry->encoding, encoding))
+       )
+        return NULL;
+
+    inc_cache_hits++;
+    return entry->text;
+} /* lookup_include_cache() */
+
+/*-------------------------------------------------------------------------*/
+static void
+start_include_capture (const char * name, string_t * encoding, struct stat * st)
+
+/* The current input source is the freshly opened include file <name>
+ * with state <st> and <encoding>. Start collecting its text for the cache.
+ */
+
+{
+    inc_capture_t * capture;
+
+    capture = xalloc(sizeof(*capture));
+    if (capture == NULL)
+        return;
+
+    capture->name = new_unicode_tabled(name);
+    if (capture->name == NULL)
+    {
+        xfree(capture);
+        return;
+    }
+    capture->encoding = encoding ? make_tabled_from(encoding) : NULL;
+    get_include_file_id(st, &capture->id);
+    capture->buf = NULL;
+    capture->len = 0;
+    capture->alloc_len = 0;
+
+    yyin.capture = capture;
+} /* start_include_capture() */
+
+/*-------------------------------------------------------------------------*/
+static void
+add_include_capture (const char * text, size_t len)
+
+/* Add <len> bytes of <text> read from the current input source
+ * to the captured text. If memory runs out, the capture is abandoned.
+ */
+
+{
+    inc_capture_t * capture = yyin.capture;
+
+    if (capture->len + len > capture->alloc_len)
+    {
+        size_t new_len = capture->alloc_len ? capture->alloc_len : MAXLINE;
+        char * new_buf;
+
+        while (new_len < capture->len + len)
+            new_len *= 2;
+
+        if (capture->buf)
+            new_buf = rexalloc(capture->buf, new_len);
+        else
+            new_buf = xalloc(new_len);
+        if (new_buf == NULL)
+        {
+            discard_include_capture();
+            return;
+        }
+
+        capture->buf = new_buf;
+        capture->alloc_len = new_len;
+    }
+
+    memcpy(capture->buf + capture->len, text, len);
+    capture->len += len;
+} /* add_include_capture() */
+
+/*-------------------------------------------------------------------------*/
+static void
+discard_include_capture (void)
+
+/* Stop collecting the text of the current input source (if at all).
+ */
+
+{
+    inc_capture_t * capture = yyin.capture;
+
+    if (capture == NULL)
+        return;
+
+    free_mstring(capture->name);
+    if (capture->encoding)
+        free_mstring(capture->encoding);
+    if (capture->buf)
+        xfree(capture->buf);
+    xfree(capture);
+
+    yyin.capture = NULL;
+} /* discard_include_capture() */
+
+/*-------------------------------------------------------------------------*/
+static void
+finish_include_capture (void)
+
+/* The current input source was read completely: enter the captured text
+ * into the include cache.
+ */
+
+{
+    inc_capture_t * capture = yyin.capture;
+    inc_cache_entry_t * entry;
+    string_t * text;
+    hash32_t hash;
+
+    if (capture == NULL)
+        return;
+
+    text = new_n_mstring(capture->buf ? capture->buf : "", capture->len, STRING_BYTES);
+    if (text == NULL)
+    {
+        discard_include_capture();
+        return;
+    }
+
+    hash = hashmem32(get_txt(capture->name), mstrsize(capture->name));
+    entry = inc_cache + IncCacheHash(hash);
+
+    if (entry->name != NULL)
+    {
+        inc_cache_collisions++;
+        free_include_cache_entry(entry);
+    }
+
+    /* The references of the capture are transferred to the entry. */
+    entry->name = capture->name;
+    entry->hash = hash;
+    entry->encoding = capture->encoding;
+    entry->text = text;
+    entry->id = capture->id;
+
+    inc_cache_entries++;
+    inc_cache_size += mstrsize(text);
+
+    if (capture->buf)
+        xfree(capture->buf);
+    xfree(capture);
+    yyin.capture = NULL;
+} /* finish_include_capture() */
+
+#endif /* INCLUDE_CACHE_TABLE */
+
 /*-------------------------------------------------------------------------*/
 static void
 lexencodingerror (char* pos, char* msg)
@@ -2616,6 +2947,11 @@ lexencodingerror (char* pos, char* msg)
             linestart = p;
         }
 
+#ifdef INCLUDE_CACHE_TABLE
+    /* Don't cache a file with encoding errors. */
+    discard_include_capture();
+#endif
+
     current_loc.line += forward_lines;
     lex_error_pos = pos - linestart;
 
@@ -2774,6 +3110,16 @@ _myfilbuf (void)
         }
         else
             i = read(yyin.fd, p, MAXLINE);
+
+#ifdef INCLUDE_CACHE_TABLE
+        if (yyin.capture != NULL)
+        {
+            if (i < 0)
+                discard_include_capture();
+            else if (i > 0)
+                add_include_capture(p, (size_t)i);
+        }
+#endif
     }
     else
     {
@@ -3132,12 +3478,13 @@ handle_cond (Bool c)
 
 /*-------------------------------------------------------------------------*/
 static Bool
-start_new_include (int fd, string_t * str
+start_new_include (int fd, struct stat * st, string_t * str
                   , char * name, char * name_ext, char delim)
 
 /* The lexer is about to read data from an included source (either file
- * <fd> or string <str> which will be referenced) - handle setting up the
- * include information. <name> is the name of the file to be read, <name_ext>
+ * <fd> with status <st> or string <str> which will be referenced) - handle
+ * setting up the include information. <name> is the name of the file to
+ * be read, <name_ext>
  * is NULL or a string to add to <name> as " (<name_ext>)", <delim> is the
  * delimiter ('"', '>' or ')') of the include filename.
  *
@@ -3230,7 +3577,32 @@ start_new_include (int fd, string_t * str
     linebufstart = linebufend - MAXLINE;
     *(outp = linebufend) = '\0';
     expandend  = linebufstart;
-    set_input_source(fd, name, str);
+    if (fd != -1)
+    {
+        string_t * encoding = get_file_encoding(name);
+#ifdef INCLUDE_CACHE_TABLE
+        string_t * text = lookup_include_cache(name, encoding, st);
+
+        if (text != NULL)
+        {
+            /* Read the cached contents instead of the file. */
+            close(fd);
+            set_input_source(-1, NULL, text);
+            yyin.cached = true;
+        }
+        else
+        {
+            set_input_source(fd, encoding, NULL);
+            start_include_capture(name, encoding, st);
+        }
+#else
+        set_input_source(fd, encoding, NULL);
+#endif
+        if (encoding)
+            free_mstring(encoding);
+    }
+    else
+        set_input_source(-1, NULL, str);
     _myfilbuf();
 
     return MY_TRUE;
@@ -3291,7 +3663,7 @@ add_auto_include (const char * obj_file, const char *cur_file, Bool sys_include)
         /* The auto include string is handled like a normal include */
         if (cur_file != NULL)   /* Otherwise we already are at line 1 */
             current_loc.line++; /* Make sure to restore to line 1 */
-        (void)start_new_include(-1, auto_include_string
+        (void)start_new_include(-1, NULL, auto_include_string
                                , current_loc.file->name, "auto include", ')');
         if (cur_file == NULL)   /* Otherwise #include will increment it */
             current_loc.line++; /* Make sure to start at line 1 */
@@ -3418,14 +3790,15 @@ merge (char *name, mp_int namelen, char *deststart)
 
 /*-------------------------------------------------------------------------*/
 static int
-open_include_file (char *buf, char *name, mp_int namelen, char delim)
+open_include_file (char *buf, char *name, mp_int namelen, char delim, struct stat *pStat)
 
 /* Open the include file <name> (length <namelen>) and return the file
  * descriptor. On failure, generate an error message and return -1.
  *
  * <buf> is a buffer of size INC_OPEN_BUFSIZE, where the real
  * filename will be written to - <name> is just the name given
- * in the #include statement.
+ * in the #include statement. <pStat> receives the status of the
+ * opened file.
  *
  * <delim> is '"' for #include ""-type includes, and '>' else.
  * Relative "-includes are searched relative to the current file.
@@ -3436,7 +3809,6 @@ open_include_file (char *buf, char *name, mp_int namelen, char delim)
 {
     int fd;
     int i;
-    struct stat aStat;
 
     /* First, try to call master->include_file().
      * Since simulate::load_object() makes sure that the master has been
@@ -3498,8 +3870,8 @@ open_include_file (char *buf, char *name, mp_int namelen, char delim)
                 return -1;
             }
 
-            if (!stat(buf, &aStat)
-             && S_ISREG(aStat.st_mode)
+            if (!stat(buf, pStat)
+             && S_ISREG(pStat->st_mode)
              && (fd = ixopen(buf, O_RDONLY|O_BINARY)) >= 0 )
             {
                 strcpy(buf, cp); /* Put the UTF-8 encoded name into <buf>. */
@@ -3538,8 +3910,8 @@ open_include_file (char *buf, char *name, mp_int namelen, char delim)
         }
 
         /* Test the file and open it */
-        if (!stat(native, &aStat)
-         && S_ISREG(aStat.st_mode)
+        if (!stat(native, pStat)
+         && S_ISREG(pStat->st_mode)
          && (fd = ixopen(native, O_RDONLY|O_BINARY)) >= 0)
         {
             FCOUNT_INCL(buf);
@@ -3592,8 +3964,8 @@ open_include_file (char *buf, char *name, mp_int namelen, char delim)
                 return -1;
             }
 
-            if (!stat(native, &aStat)
-             && S_ISREG(aStat.st_mode)
+            if (!stat(native, pStat)
+             && S_ISREG(pStat->st_mode)
              && (fd = ixopen(native, O_RDONLY|O_BINARY)) >= 0 )
             {
                 FCOUNT_INCL(iname);
@@ -3640,8 +4012,8 @@ open_include_file (char *buf, char *name, mp_int namelen, char delim)
                 return -1;
             }
 
-            if (!stat(buf, &aStat)
-             && S_ISREG(aStat.st_mode)
+            if (!stat(buf, pStat)
+             && S_ISREG(pStat->st_mode)
              && (fd = ixopen(buf, O_RDONLY|O_BINARY)) >= 0 )
             {
                 strcpy(buf, cp);
@@ -3690,6 +4062,7 @@ handle_include (char *name)
     char *old_outp;  /* Save the original outp */
     Bool  in_buffer = MY_FALSE; /* True if macro was expanded */
     char  buf[INC_OPEN_BUFSIZE];
+    struct stat aStat;
 
 #if 0
     if (nbuf) {
@@ -3854,9 +4227,9 @@ handle_include (char *name)
     /* Open the include file, put the current lexer state onto
      * the incstack, and set up for the new file.
      */
-    if ((fd = open_include_file(buf, name, p - name, delim)) >= 0)
+    if ((fd = open_include_file(buf, name, p - name, delim, &aStat)) >= 0)
     {
-        if (!start_new_include(fd, NULL, buf, NULL, delim))
+        if (!start_new_include(fd, &aStat, NULL, buf, NULL, delim))
             return;
         add_auto_include(object_file, current_loc.file->name, delim != '"');
     }
@@ -5762,6 +6135,15 @@ yylex1 (void)
 
                     p = inctop;
 
+#ifdef INCLUDE_CACHE_TABLE
+                    /* Cached files count as files, and a fully read
+                     * file can be entered into the cache.
+                     */
+                    if (yyin.cached)
+                        was_string_source = MY_FALSE;
+                    finish_include_capture();
+#endif
+
                     /* End the lexing of the included file */
                     close_input_source(false);
                     nexpands = 0;
@@ -6756,6 +7138,8 @@ start_new_file (int fd, const char * fname)
  */
 
 {
+    string_t * encoding;
+
     start_lex();
 
     object_file = fname;
@@ -6763,7 +7147,10 @@ start_new_file (int fd, const char * fname)
     current_loc.file = new_source_file(fname, NULL);
     current_loc.line = 1; /* already used in first _myfilbuf() */
 
-    set_input_source(fd, object_file, NULL);
+    encoding = get_file_encoding(object_file);
+    set_input_source(fd, encoding, NULL);
+    if (encoding)
+        free_mstring(encoding);
     _myfilbuf();
 
     auto_include_hook = H_AUTO_INCLUDE;
@@ -6808,7 +7195,7 @@ start_new_string (string_t* str, int token, int auto_include_hook_expr)
     }
     current_loc.line = 1;
 
-    set_input_source(-1, object_file, str);
+    set_input_source(-1, NULL, str);
     _myfilbuf();
 
     auto_include_hook = auto_include_hook_expr;
@@ -8971,6 +9358,96 @@ show_lexer_status (strbuf_t * sbuf, Bool verbose UNUSED)
     return sum;
 } /* show_lexer_status() */
 
+/*-------------------------------------------------------------------------*/
+size_t
+include_cache_status (strbuf_t * sbuf, Bool verbose)
+
+/* Gather (and optionally print) the statistics from the include cache.
+ * Return the amount of memory used.
+ */
+
+{
+#ifdef INCLUDE_CACHE_TABLE
+    size_t size = sizeof(inc_cache) + inc_cache_size;
+
+    if (verbose)
+    {
+        statcounter_t requests = inc_cache_requests ? inc_cache_requests : 1;
+
+        strbuf_add(sbuf, "\nInclude cache status:\n");
+        strbuf_add(sbuf,   "---------------------\n");
+        strbuf_addf(sbuf, "Files in cache:        %"PRIu32" (%.1f%%)\n"
+                   , inc_cache_entries
+                   , 100.0 * (float)inc_cache_entries / INCLUDE_CACHE_TABLE);
+        strbuf_addf(sbuf, "Memory allocated:      %zu\n", size);
+        strbuf_addf(sbuf
+               , "Requests: %"PRIuSTATCOUNTER" - Found: %"PRIuSTATCOUNTER" (%.1f%%) - "
+               "Coll: %"PRIuSTATCOUNTER" (%.1f%% req)\n"
+               , inc_cache_requests, inc_cache_hits
+               , 100.0 * (float)inc_cache_hits/(float)requests
+               , inc_cache_collisions
+               , 100.0 * (float)inc_cache_collisions/(float)requests
+               );
+    }
+    else
+    {
+        strbuf_addf(sbuf, "Include cache:\t\t\t%8"PRIu32" %9zu\n"
+                   , inc_cache_entries, size);
+    }
+
+    return size;
+#else
+    return 0;
+#endif
+} /* include_cache_status() */
+
+/*-------------------------------------------------------------------------*/
+void
+include_cache_driver_info (svalue_t *svp, int value)
+
+/* Returns the include cache information for driver_info(<what>).
+ * <svp> points to the svalue for the result.
+ */
+
+{
+#ifdef INCLUDE_CACHE_TABLE
+    switch (value)
+    {
+        case DI_NUM_INCLUDE_CACHE_LOOKUPS:
+            put_number(svp, inc_cache_requests);
+            break;
+
+        case DI_NUM_INCLUDE_CACHE_LOOKUP_HITS:
+            put_number(svp, inc_cache_hits);
+            break;
+
+        case DI_NUM_INCLUDE_CACHE_LOOKUP_MISSES:
+            put_number(svp, inc_cache_requests - inc_cache_hits);
+            break;
+
+        case DI_NUM_INCLUDE_CACHE_LOOKUP_COLLISIONS:
+            put_number(svp, inc_cache_collisions);
+            break;
+
+        case DI_NUM_INCLUDE_CACHE:
+            put_number(svp, inc_cache_entries);
+            break;
+
+        case DI_NUM_INCLUDE_CACHE_TABLE_SLOTS:
+            put_number(svp, INCLUDE_CACHE_TABLE);
+            break;
+
+        case DI_SIZE_INCLUDE_CACHE:
+            put_number(svp, inc_cache_size);
+            break;
+
+        default:
+            fatal("Unknown option for include_cache_driver_info(): %d\n", value);
+            break;
+    }
+#endif
+} /* include_cache_driver_info() */
+
 /*-------------------------------------------------------------------------*/
 #ifdef GC_SUPPORT
 
@@ -9023,6 +9500,22 @@ count_lex_refs (void)
 
     if (lexpool)
         mempool_note_refs(lexpool);
+
+#ifdef INCLUDE_CACHE_TABLE
+    /* Include cache */
+    for (i = 0; i < INCLUDE_CACHE_TABLE; i++)
+    {
+        inc_cache_entry_t * entry = inc_cache + i;
+
+        if (entry->name == NULL)
+            continue;
+
+        count_ref_from_string(entry->name);
+        if (entry->encoding)
+            count_ref_from_string(entry->encoding);
+        count_ref_from_string(entry->text);
+    }
+#endif
 }
 #endif /* GC_SUPPORT */
 
@@ -324,6 +324,8 @@ extern void end_new_block();
 extern char *get_f_name(int n);
 extern void free_defines(void);
 extern size_t show_lexer_status (strbuf_t * sbuf, Bool verbose);
+extern size_t include_cache_status (strbuf_t * sbuf, Bool verbose);
+extern void include_cache_driver_info (svalue_t *svp, int value) __attribute__((nonnull(1)));
 extern void set_inc_list(vector_t *v);
 extern void remove_unknown_identifier(void);
 extern char *lex_error_context(void);
@@ -55,6 +55,7 @@
 #include "filestat.h"
 #include "gcollect.h"
 #include "interpret.h"
+#include "jit.h"
 #include "lex.h"
 #include "mapping.h"
 #include "mempools.h"
@@ -1191,6 +1192,9 @@ typedef enum OptNumber {
 #ifdef USE_PYTHON
  , cPythonScript    /* --python-script      */
 #endif
+#ifdef USE_JIT
+ , cJitThreshold    /* --jit-threshold      */
+#endif
 #ifdef DEBUG
  , cCheckRefs       /* --check-refcounts    */
  , cCheckState      /* --check-state        */
@@ -1689,6 +1693,15 @@ static Option aOptions[]
       }
 #endif /* USE_PYTHON */
 
+#ifdef USE_JIT
+    , { 0,   "jit-threshold",      cJitThreshold,   MY_TRUE
+      , "  --jit-threshold <calls>\n"
+      , "  --jit-threshold <calls>\n"
+        "    Compile LPC functions to native code after they were called\n"
+        "    <calls> times. -1 (the default) disables the compiler.\n"
+      }
+#endif /* USE_JIT */
+
     , { 0,   "wizlist-file",       cWizlistFile,    MY_TRUE
       , "  --wizlist-file <filename>\n"
       , "  --wizlist-file <filename>\n"
@@ -2011,6 +2024,9 @@ options (void)
 #ifdef USE_MCCP
                               , "MCCP supported\n"
 #endif
+#ifdef USE_JIT
+                              , "Native code compiler supported\n"
+#endif
 #ifdef USE_MYSQL
                               , "mySQL supported\n"
 #endif
@@ -2093,6 +2109,7 @@ options (void)
          "                 max number callouts:    %7d\n"
          "                 max number players:     %7d\n"
          "                 ed cmd/cmd ratio:       %7d:1\n"
+         "                 command burst:          %7d\n"
 #if defined(TRACE_CODE)
          "                 max trace length:       %7d\n"
 #endif
@@ -2111,7 +2128,7 @@ options (void)
         , MAX_BITS, MAX_ARRAY_SIZE
         , MAX_MAPPING_SIZE, MAX_MAPPING_KEYS
         , MAX_CALLOUTS, MAX_PLAYERS
-        , ALLOWED_ED_CMDS
+        , ALLOWED_ED_CMDS, MAX_COMMAND_BURST
 #ifdef TRACE_CODE
         , TOTAL_TRACE_LENGTH
 #endif
@@ -2213,6 +2230,9 @@ options (void)
          "                 apply cache:             %6d entries\n"
 #ifdef RXCACHE_TABLE
          "                 regexp cache:            %6d entries\n"
+#endif
+#ifdef INCLUDE_CACHE_TABLE
+         "                 include cache:           %6d entries\n"
 #endif
         , HTABLE_SIZE
         , OTABLE_SIZE
@@ -2220,6 +2240,9 @@ options (void)
         , 1<<APPLY_CACHE_BITS
 #ifdef RXCACHE_TABLE
         , RXCACHE_TABLE
+#endif
+#ifdef INCLUDE_CACHE_TABLE
+        , INCLUDE_CACHE_TABLE
 #endif
         );
 
@@ -2956,6 +2979,19 @@ eval_arg (int eOption, const char * pValue)
         break;
 #endif
 
+#ifdef USE_JIT
+    case cJitThreshold:
+      {
+        long val = atoi(pValue);
+
+        if (val >= JIT_THRESHOLD_OFF)
+            jit_set_threshold(val);
+        else
+            fprintf(stderr, "Illegal value for --jit-threshold '%s' ignored.\n", pValue);
+        break;
+      }
+#endif
+
 #ifdef GC_SUPPORT
     case cGcollectFD:
         if (isdigit((unsigned char)*pValue)) {
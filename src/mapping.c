@@ -71,11 +71,12 @@
  * removing the hashed part by this.
  *
  * To be compacted, a mapping has to conform to a number of conditions:
- *  - it has been at least TIME_TO_COMPACT seconds (typical 10 minutes)
- *    since the last addition or deletion of an entry
+ *  - it has been at least time_to_compact_mappings seconds (typical
+ *    10 minutes) since the last addition or deletion of an entry
  * and
- *     - it was to be at least 2*TIME_TO_COMPACT seconds (typical 20 minutes)
- *       since the last addition or deletion of an entry
+ *     - it was to be at least 2*time_to_compact_mappings seconds (typical
+ *       20 minutes) since the last addition or deletion of an entry, and
+ *       the changes are worth the effort (see below)
  *  or - the number of condensed-deleted entries is at least half the capacity
  *       of the condensed part
  *  or - the number of hashed entries exceeds the number non-deleted condensed
@@ -84,6 +85,25 @@
  * The idea is to minimize reallocations of the (potentially large) condensed
  * block, as it easily runs into fragmentation of the large block heap.
  *
+ * A compaction always rewrites the whole condensed block, so its cost is
+ * proportional to the size of the mapping, not to the number of changes.
+ * For mappings with at least COMPACT_MIN_SIZE condensed entries the
+ * time criterium therefore only applies if the hashed and deleted entries
+ * make up at least 1/COMPACT_CHANGE_RATIO of the condensed part. Giant
+ * mappings with a few changes are not rebuilt in one backend cycle every
+ * 20 minutes; the cost of the rebuild is spread over the changes that
+ * led to it.
+ *
+ * Instead, such a mapping is compacted in steps, one at each cleanup:
+ * a step moves hashed entries into the slots of deleted entries near
+ * their sorted position in the condensed part, shifting the entries in
+ * between. If there are no such slots (as in a mapping that only got
+ * new entries), a step instead merges a run of at most COMPACT_STEP_WORK
+ * hashed entries into a new, larger condensed block. The positions of
+ * the run are found by binary search, the old entries are just copied
+ * around them. Each step compares and moves a bounded number of entries,
+ * and afterwards the mapping is as valid as before.
+ *
  * A garbage collection however compacts all mappings unconditionally.
  *
  *
@@ -106,6 +126,8 @@
  *       wiz_list_t    * user;
  *       int             num_values;
  *       p_int           num_entries;
+ *       uint32_t        last_destr_check;
+ *       bool            object_keys;
  *
  *       mapping_cond_t * cond;
  *       mapping_hash_t * hash;
@@ -120,6 +142,16 @@
  *   .num_values and .num_entries give the width (excluding the key!)
  *   and number of valid entries in the mapping.
  *
+ *   .last_destr_check is the value of destructed_ob_counter at the last
+ *   check for keys referencing destructed objects. Only if objects were
+ *   destructed since, the keys have to be checked again.
+ *
+ *   .object_keys is set when a key which may reference an object is
+ *   added, and cleared again when a check of all keys doesn't find
+ *   one. Mappings without such keys don't need to be checked at all
+ *   when objects are destructed. Mappings with a condensed part of unknown
+ *   origin (like the swapper's) start out with .object_keys set.
+ *
  *   .cond and .hash are the condensed resp. hashed data blocks.
  *   .hash also serves as indicator if the mapping is 'dirty',
  *   and therefore contains all the information about the dirtyness.
@@ -204,10 +236,14 @@
  *
  *   map_chain_t {
  *       map_chain_t *next;
+ *       mp_int       hash;
  *       svalue_t data[ mapping->num_values+1 ];
  *   }
  *
  *   .next is the next struct map_chain in the hash chain (or .deleted list).
+ *   .hash is the mhash() value of the key. It is compared before the keys
+ *   themselves when searching a chain, and saves recomputing the hash
+ *   values when the hashtable grows or an entry is removed.
  *   .data holds the key and it's data values.
  *
  *---------------------------------------------------------------------------
@@ -239,9 +275,28 @@
 #include "i-svalue_cmp.h"
 #include "i-svalue_hash.h"
 
-#define TIME_TO_COMPACT (600) /* 10 Minutes */
-   /* TODO: Make this configurable.
-    * TODO:: When doing so, also implement the shrinking of the hashtable
+
+#define COMPACT_MIN_SIZE (1024)
+   /* Mappings with condensed parts smaller than this are compacted
+    * by time alone.
+    */
+
+#define COMPACT_CHANGE_RATIO (8)
+   /* Larger mappings need 1/COMPACT_CHANGE_RATIO of their condensed
+    * part changed to be compacted by time alone.
+    */
+
+#define COMPACT_STEP_WORK (1024)
+   /* The work done by one compaction step, counted in visited hashed
+    * entries and shifted condensed entries. It is also the largest
+    * number of hashed entries merged into a new condensed block by
+    * one step.
+    */
+
+#define COMPACT_MAX_SHIFT (64)
+   /* The farthest distance of a free slot from the position of a hashed
+    * entry in the condensed part, so that the entry is moved there in
+    * a compaction step.
     */
 
 /*-------------------------------------------------------------------------*/
@@ -250,6 +305,7 @@
 /* The local typedefs */
 typedef struct map_chain_s    map_chain_t;
 typedef struct walk_mapping_s walk_mapping_t;
+typedef struct mapping_iterator_s mapping_iterator_t;
 
 /* --- struct map_chain_s: one entry in a hash chain ---
  *
@@ -258,10 +314,17 @@ typedef struct walk_mapping_s walk_mapping_t;
 
 struct map_chain_s {
     map_chain_t * next;  /* next entry */
+    mp_int        hash;  /* mhash() of the key */
     svalue_t      data[1 /* +mapping->num_values */];
       /* [0]: the key, [1..]: the data */
 };
 
+#define KEY_REFERENCES_OBJECT(key) \
+    ((key)->type == T_OBJECT || (key)->type == T_CLOSURE || (key)->type == T_COROUTINE)
+  /* True if the mapping key <key> may reference an object, and could
+   * therefore become a destructed object reference.
+   */
+
 #define SIZEOF_MCH(mch, nv) ( \
     sizeof(*mch) + (nv) * sizeof(svalue_t) \
                             )
@@ -280,6 +343,32 @@ struct walk_mapping_s {
     svalue_t        pointers[1 /* + .entries-1*/];
 };
 
+/* --- struct mapping_iterator_s: the state of a foreach() over a mapping
+ *
+ * The iterator visits the entries in place, in the same order as
+ * walk_mapping(): first the condensed part, then the hash chains from
+ * the last to the first. The condensed part doesn't change during
+ * the execution, deleted entries just become T_INVALID.
+ *
+ * If the mapping has hashed entries at the start, the iterator protects
+ * the hash part and is linked into the active_iterators list. When
+ * an entry is deleted, the iterator skips it if it would have been
+ * next. Before a new entry is added to the hash part, the remaining
+ * hashed keys are copied into .keys and the protection is lifted.
+ */
+
+struct mapping_iterator_s {
+    error_handler_t      head;       /* The error handler: free_mapping_iterator */
+    mapping_t          * map;        /* The mapping (counted reference) */
+    p_int                cond_ix;    /* Next index in the condensed part */
+    p_int                chain;      /* Next hash chain to visit */
+    map_chain_t        * mc;         /* Next entry in the current chain */
+    vector_t           * keys;       /* Remaining hashed keys, or NULL */
+    p_int                keys_ix;    /* Next index in .keys */
+    bool                 protected;  /* The hash part is protected by us */
+    mapping_iterator_t * next;       /* Next protecting iterator */
+};
+
 /*-------------------------------------------------------------------------*/
 
 mp_int num_mappings = 0;
@@ -294,6 +383,35 @@ mp_int num_dirty_mappings = 0;
   /* Number of allocated mappings with a hash and a condensed part.
    */
 
+p_int time_to_compact_mappings = 600; /* 10 Minutes */
+  /* Time in seconds after the last change of a mapping until it may be
+   * compacted, see DC_MAPPING_COMPACT_TIME.
+   * TODO: Also implement the shrinking of the hashtable.
+   */
+
+statcounter_t num_mapping_compactions = 0;
+  /* Number of compactions done.
+   */
+
+statcounter_t num_mapping_compaction_steps = 0;
+  /* Number of compaction steps done.
+   */
+
+statcounter_t num_mapping_compactions_deferred = 0;
+  /* Number of large mappings whose compaction was postponed because
+   * of too few changes.
+   */
+
+statcounter_t num_mapping_compaction_entries = 0;
+  /* Total number of entries written by the compactions and moved
+   * by the compaction steps.
+   */
+
+static mapping_iterator_t *active_iterators = NULL;
+  /* List of the iterators protecting a hash part, linked through .next.
+   * The mapping functions consult it only if a hash part is protected.
+   */
+
 mapping_t *stale_mappings;
   /* During a garbage collection, this is a list of mappings with
    * keys referencing destructed objects/lambdas, linked through
@@ -426,6 +544,8 @@ get_new_hash ( mapping_t *m, mp_int hash_size)
     hm->mask = hash_size;
     hm->used = hm->cond_deleted = hm->ref = 0;
     hm->last_used = current_time;
+    hm->step_chain = 0;
+    hm->deferred = false;
 
     /* These members don't really need a default initialisation
      * but it's here to catch bogies.
@@ -524,6 +644,8 @@ get_new_mapping ( wiz_list_t * user, mp_int num_values
     // there can't be a destructed object in the mapping now, record the
     // current counter.
     m->last_destr_check = destructed_ob_counter;
+    // The caller fills the condensed part with whatever keys it has.
+    m->object_keys = (cm != NULL);
     m->ref = 1;
 
     /* Statistics */
@@ -703,6 +825,117 @@ mhash (svalue_t * svp)
     return i;
 } /* mhash() */
 
+/*-------------------------------------------------------------------------*/
+static void
+unprotect_mapping_iterator (mapping_iterator_t *it)
+
+/* Lift the protection of the hash part by iterator <it> and unlink it
+ * from the active_iterators list. If this was the last protector,
+ * the pending deleted entries are deallocated.
+ */
+
+{
+    mapping_iterator_t **itp;
+    mapping_hash_t *hm = it->map->hash;
+
+    for (itp = &active_iterators; *itp != it; itp = &(*itp)->next)
+        NOOP;
+    *itp = it->next;
+
+    it->protected = false;
+    it->chain = -1;
+    it->mc = NULL;
+
+    if (!--hm->ref)
+    {
+        /* Last ref gone: deallocate the pending deleted entries */
+
+        map_chain_t *mc, *next;
+
+        for (mc = hm->deleted; mc; mc = next)
+        {
+            next = mc->next;
+            free_map_chain(it->map, mc, MY_FALSE);
+        }
+
+        hm->deleted = NULL;
+    }
+} /* unprotect_mapping_iterator() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+copy_iterator_hash_keys (mapping_iterator_t *it, svalue_t *dest)
+
+/* Count the hashed keys the protecting iterator <it> has still to visit.
+ * If <dest> is not NULL, the keys are also copied there.
+ */
+
+{
+    mapping_hash_t *hm = it->map->hash;
+    map_chain_t *mc = it->mc;
+    p_int chain = it->chain;
+    p_int num = 0;
+
+    for (;;)
+    {
+        while (mc == NULL && chain >= 0)
+            mc = hm->chains[chain--];
+        if (mc == NULL)
+            break;
+
+        if (!destructed_object_ref(&(mc->data[0])))
+        {
+            if (dest)
+                assign_svalue_no_free(dest++, &(mc->data[0]));
+            num++;
+        }
+        mc = mc->next;
+    }
+
+    return num;
+} /* copy_iterator_hash_keys() */
+
+/*-------------------------------------------------------------------------*/
+static void
+detach_mapping_iterators (mapping_t *m)
+
+/* A new entry is about to be added to the hash part of <m>, possibly
+ * reorganizing the hash chains. All iterators over <m> copy the keys
+ * they have still to visit and lift their protection.
+ */
+
+{
+    mapping_iterator_t *it, *next;
+
+    for (it = active_iterators; it != NULL; it = next)
+    {
+        next = it->next;
+        if (it->map != m)
+            continue;
+
+        it->keys = allocate_array_unlimited(copy_iterator_hash_keys(it, NULL));
+        it->keys_ix = 0;
+        copy_iterator_hash_keys(it, it->keys->item);
+        unprotect_mapping_iterator(it);
+    }
+} /* detach_mapping_iterators() */
+
+/*-------------------------------------------------------------------------*/
+static INLINE void
+skip_deleted_entry (map_chain_t *mc)
+
+/* The hashed entry <mc> is about to be removed from its chain.
+ * Iterators which would visit it next continue with its successor.
+ */
+
+{
+    mapping_iterator_t *it;
+
+    for (it = active_iterators; it != NULL; it = it->next)
+        if (it->mc == mc)
+            it->mc = mc->next;
+} /* skip_deleted_entry() */
+
 /*-------------------------------------------------------------------------*/
 static svalue_t *
 find_map_entry ( mapping_t *m, svalue_t *map_index
@@ -825,13 +1058,14 @@ find_map_entry ( mapping_t *m, svalue_t *map_index
         mapping_hash_t *hm = m->hash;
         map_chain_t *mc;
 
-        mp_int idx = mhash(map_index) & hm->mask;
+        mp_int hash = mhash(map_index);
+        mp_int idx = hash & hm->mask;
 
         /* Look for the value in the chain determined by index */
 
         for (mc = hm->chains[idx]; mc != NULL; mc = mc->next)
         {
-            if (svalue_eq(&(mc->data[0]), map_index))
+            if (mc->hash == hash && svalue_eq(&(mc->data[0]), map_index))
             {
                 /* Found it */
                 *ppChain = mc;
@@ -945,6 +1179,10 @@ static svalue_t local_const0;
         }
     }
 
+    /* Iterators walking the hash part can't cope with new entries. */
+    if (m->hash && m->hash->ref)
+        detach_mapping_iterators(m);
+
     /* Get the new entry svalues, but don't assign the key value
      * yet - further steps might still fail.
      */
@@ -977,6 +1215,7 @@ static svalue_t local_const0;
         /* Now insert the map_chain structure into its chain */
         hm->chains[0] = mc;
         mc->next = NULL;
+        mc->hash = mhash(&real_index);
 
         if (m->cond)
             num_dirty_mappings++;
@@ -1031,7 +1270,7 @@ static svalue_t local_const0;
                 for (mc2 = *mcp2++; mc2; mc2 = next)
                 {
                     next = mc2->next;
-                    idx = mhash(&(mc2->data[0])) & mask;
+                    idx = mc2->hash & mask;
                     mc2->next = mcp[idx];
                     mcp[idx] = mc2;
                 }
@@ -1049,7 +1288,8 @@ static svalue_t local_const0;
 
         /* Finally, insert the new entry into its chain */
 
-        idx = mhash(&real_index) & hm->mask;
+        mc->hash = mhash(&real_index);
+        idx = mc->hash & hm->mask;
         mc->next = hm->chains[idx];
         hm->chains[idx] = mc;
     }
@@ -1059,6 +1299,8 @@ static svalue_t local_const0;
      */
 
     transfer_svalue_no_free(&(mc->data[0]), &real_index);
+    if (KEY_REFERENCES_OBJECT(&(mc->data[0])))
+        m->object_keys = true;
     for (idx = m->num_values, entry = &(mc->data[1]); idx > 0
         ; idx--, entry++)
         put_number(entry, 0);
@@ -1148,13 +1390,21 @@ check_map_for_destr_keys (mapping_t *m)
     p_int             num_values;
     mapping_cond_t *cm;
     mapping_hash_t *hm;
+    bool            object_keys;  /* A remaining key references an object */
 
     // If no object was destructed since the last check, there can't be a
-    // key referencing a destructed object in the mapping.
+    // key referencing a destructed object in the mapping. Neither can
+    // there be one if no key references an object at all.
     if (m->last_destr_check == destructed_ob_counter)
         return;
-    
+    if (!m->object_keys)
+    {
+        m->last_destr_check = destructed_ob_counter;
+        return;
+    }
+
     num_values = m->num_values;
+    object_keys = false;
     
     /* Scan the condensed part for destructed object references used as keys.
      */
@@ -1206,6 +1456,9 @@ check_map_for_destr_keys (mapping_t *m)
                 
                 continue;
             }
+
+            if (KEY_REFERENCES_OBJECT(entry))
+                object_keys = true;
         } /* for (all keys) */
         
     } /* if (m->cond) */
@@ -1242,6 +1495,7 @@ check_map_for_destr_keys (mapping_t *m)
                      */
                     if (hm->ref)
                     {
+                        skip_deleted_entry(mc);
                         mc->next = hm->deleted;
                         hm->deleted = mc;
                     }
@@ -1253,14 +1507,19 @@ check_map_for_destr_keys (mapping_t *m)
                     continue;
                 }
 
+                if (KEY_REFERENCES_OBJECT(entry))
+                    object_keys = true;
+
                 mcp2 = &mc->next;
                 
             } /* walk this chain */
         } /* walk all chains */
     } /* if (hash part exists) */
 
-    // finally, record the current counter of destructed objects.
+    // finally, record the current counter of destructed objects,
+    // and whether we have to look again next time.
     m->last_destr_check = destructed_ob_counter;
+    m->object_keys = object_keys;
 
 } /* check_map_for_destr_keys() */
 
@@ -1424,7 +1683,7 @@ remove_mapping (mapping_t *m, svalue_t *map_index)
             /* The key is in the hash mapping */
 
             map_chain_t *prev, *mc2;
-            mp_int idx = mhash(entry) & hm->mask;
+            mp_int idx = mc->hash & hm->mask;
 
             for ( prev = 0, mc2 = hm->chains[idx]
                 ; mc2 != NULL && mc2 != mc
@@ -1446,6 +1705,7 @@ remove_mapping (mapping_t *m, svalue_t *map_index)
              */
             if (hm->ref)
             {
+                skip_deleted_entry(mc);
                 mc->next = hm->deleted;
                 hm->deleted = mc;
             }
@@ -1533,6 +1793,7 @@ resize_mapping (mapping_t *m, mp_int new_width)
             /* NOTREACHED */
             return NULL;
         }
+        m2->object_keys = m->object_keys;
     }
 
     /* --- Copy the hash part, if existent ---
@@ -1560,6 +1821,8 @@ resize_mapping (mapping_t *m, mp_int new_width)
         hm2->cond_deleted = 0;
         hm2->deleted = NULL;
         hm2->ref = 0;
+        hm2->step_chain = 0;
+        hm2->deferred = false;
 
         /* Now copy the hash chains */
 
@@ -1605,6 +1868,7 @@ resize_mapping (mapping_t *m, mp_int new_width)
                     }
 
 
+                    mc2->hash = mc->hash;
                     mc2->next = last;
                     last = mc2;
                 }
@@ -1757,6 +2021,7 @@ add_mapping (mapping_t *m1, mapping_t *m2)
             /* NOTREACHED */
             return NULL;
         }
+        m3->object_keys = m1->object_keys || m2->object_keys;
     }
 
     /* Merge the condensed entries.
@@ -2043,6 +2308,500 @@ walk_mapping ( mapping_t *m
 
 } /* walk_mapping() */
 
+/*-------------------------------------------------------------------------*/
+static void
+free_mapping_iterator (error_handler_t *arg)
+
+/* The error handler of a mapping iterator: deallocate the iterator when
+ * the foreach() loop ends, normally or by an error.
+ */
+
+{
+    mapping_iterator_t *it = (mapping_iterator_t *)arg;
+
+    if (it->protected)
+        unprotect_mapping_iterator(it);
+    if (it->keys)
+        free_array(it->keys);
+    free_mapping(it->map);
+    xfree(it);
+} /* free_mapping_iterator() */
+
+/*-------------------------------------------------------------------------*/
+void
+put_mapping_iterator (svalue_t *dest, mapping_t *m)
+
+/* Create an iterator over mapping <m> and store it in <dest> as
+ * T_ERROR_HANDLER svalue, so that it is deallocated with the svalue.
+ *
+ * Keys referencing destructed objects are removed first, MAP_SIZE(m)
+ * is afterwards the maximum number of entries the iterator will visit.
+ */
+
+{
+    mapping_iterator_t *it;
+    mapping_hash_t *hm;
+
+    check_map_for_destr_keys(m);
+
+    it = xalloc(sizeof(*it));
+    if (!it)
+    {
+        outofmem(sizeof(*it), "mapping iterator");
+        /* NOTREACHED */
+        return;
+    }
+
+    it->map = ref_mapping(m);
+    it->cond_ix = 0;
+    it->chain = -1;
+    it->mc = NULL;
+    it->keys = NULL;
+    it->keys_ix = 0;
+    it->protected = false;
+    it->next = NULL;
+
+    /* Protect a non-empty hash part, entries added later are not
+     * visited anyway.
+     */
+    if (NULL != (hm = m->hash) && hm->used)
+    {
+        if (!hm->ref++)
+            hm->deleted = NULL;
+
+        it->protected = true;
+        it->chain = hm->mask;
+        it->next = active_iterators;
+        active_iterators = it;
+    }
+
+    it->head.fun = free_mapping_iterator;
+    dest->type = T_ERROR_HANDLER;
+    dest->u.error_handler = &(it->head);
+} /* put_mapping_iterator() */
+
+/*-------------------------------------------------------------------------*/
+bool
+is_mapping_iterator (svalue_t *sv)
+
+/* Return true if <sv> is a mapping iterator.
+ */
+
+{
+    return sv->type == T_ERROR_HANDLER
+        && sv->u.error_handler->fun == free_mapping_iterator;
+} /* is_mapping_iterator() */
+
+/*-------------------------------------------------------------------------*/
+bool
+next_mapping_iterator (svalue_t *iter, svalue_t **key, svalue_t **values)
+
+/* Advance the mapping iterator <iter> to the next entry and store
+ * pointers to its key and values in *<key> and *<values>.
+ * The key must not be modified. Entries deleted since the start
+ * of the iteration are skipped, new entries are not visited.
+ *
+ * Return false if there are no entries left.
+ */
+
+{
+    mapping_iterator_t *it = (mapping_iterator_t *)iter->u.error_handler;
+    mapping_t *m = it->map;
+    mapping_cond_t *cm;
+
+    /* The condensed part first */
+    if (NULL != (cm = m->cond))
+    {
+        while (it->cond_ix < (p_int)cm->size)
+        {
+            p_int ix = it->cond_ix++;
+            svalue_t *k = &(cm->data[ix]);
+
+            if (k->type != T_INVALID && !destructed_object_ref(k))
+            {
+                *key = k;
+                *values = COND_DATA(cm, ix, m->num_values);
+                return true;
+            }
+        }
+    }
+
+    /* Then the hash part, if we still walk it in place... */
+    if (it->protected)
+    {
+        mapping_hash_t *hm = m->hash;
+        map_chain_t *mc;
+
+        for (;;)
+        {
+            mc = it->mc;
+            while (mc == NULL && it->chain >= 0)
+                mc = hm->chains[it->chain--];
+            if (mc == NULL)
+                break;
+
+            it->mc = mc->next;
+            if (!destructed_object_ref(&(mc->data[0])))
+            {
+                *key = &(mc->data[0]);
+                *values = &(mc->data[1]);
+                return true;
+            }
+        }
+
+        unprotect_mapping_iterator(it);
+    }
+
+    /* ...or using the copied keys. */
+    else if (it->keys)
+    {
+        while (it->keys_ix < (p_int)VEC_SIZE(it->keys))
+        {
+            svalue_t *k = it->keys->item + it->keys_ix++;
+            svalue_t *data;
+
+            if (destructed_object_ref(k))
+                continue;
+
+            data = get_map_value(m, k);
+            if (data != &const0)
+            {
+                *key = k;
+                *values = data;
+                return true;
+            }
+        }
+    }
+
+    return false;
+} /* next_mapping_iterator() */
+
+/*-------------------------------------------------------------------------*/
+vector_t *
+mapping_iterator_keys (svalue_t *iter)
+
+/* Return an array with the keys the mapping iterator <iter> has still
+ * to visit. This is used to replace the iterator when it can't be kept,
+ * ie. when a coroutine is suspended inside a foreach() loop.
+ */
+
+{
+    mapping_iterator_t *it = (mapping_iterator_t *)iter->u.error_handler;
+    mapping_cond_t *cm = it->map->cond;
+    vector_t *vec;
+    svalue_t *dest;
+    p_int num, ix;
+
+    num = 0;
+    if (cm)
+    {
+        for (ix = it->cond_ix; ix < (p_int)cm->size; ix++)
+            if (cm->data[ix].type != T_INVALID
+             && !destructed_object_ref(cm->data + ix))
+                num++;
+    }
+
+    if (it->protected)
+        num += copy_iterator_hash_keys(it, NULL);
+    else if (it->keys)
+        num += (p_int)VEC_SIZE(it->keys) - it->keys_ix;
+
+    vec = allocate_array_unlimited(num);
+    dest = vec->item;
+
+    if (cm)
+    {
+        for (ix = it->cond_ix; ix < (p_int)cm->size; ix++)
+            if (cm->data[ix].type != T_INVALID
+             && !destructed_object_ref(cm->data + ix))
+                assign_svalue_no_free(dest++, cm->data + ix);
+    }
+
+    if (it->protected)
+        copy_iterator_hash_keys(it, dest);
+    else if (it->keys)
+    {
+        for (ix = it->keys_ix; ix < (p_int)VEC_SIZE(it->keys); ix++)
+            assign_svalue_no_free(dest++, it->keys->item + ix);
+    }
+
+    return vec;
+} /* mapping_iterator_keys() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+find_cond_position (mapping_cond_t *cm, svalue_t *key)
+
+/* Return the position of <key>, which is not in the condensed part <cm>,
+ * among the keys of <cm>: all valid keys before the position are smaller,
+ * all valid keys from the position on are larger than <key>.
+ */
+
+{
+    svalue_t *keys = &(cm->data[0]);
+    p_int lo = 0, hi = (p_int)cm->size;
+
+    while (lo < hi)
+    {
+        p_int mid = (lo + hi) / 2;
+        p_int k = mid;
+
+        /* Look for a valid key at or before mid. */
+        while (k >= lo && keys[k].type == T_INVALID)
+            k--;
+
+        if (k < lo || svalue_cmp(key, keys + k) > 0)
+            lo = mid + 1;
+        else
+            hi = k;
+    }
+
+    return lo;
+} /* find_cond_position() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+fill_deleted_slots (mapping_t *m)
+
+/* Move hashed entries of mapping <m>, which has a hash and a condensed
+ * part, into the slots of deleted entries near their position in the
+ * condensed part. Do at most COMPACT_STEP_WORK work, continuing where
+ * the last step stopped.
+ *
+ * Return the number of moved entries.
+ */
+
+{
+    mapping_hash_t *hm = m->hash;
+    mapping_cond_t *cm = m->cond;
+    svalue_t *keys = &(cm->data[0]);
+    p_int num_values = m->num_values;
+    p_int chain = hm->step_chain & hm->mask;
+    p_int chains_left = hm->mask + 1;
+    p_int work = 0;
+    p_int moved = 0;
+
+    while (chains_left-- > 0 && hm->used && hm->cond_deleted)
+    {
+        map_chain_t **mcp = &(hm->chains[chain]);
+
+        while (*mcp && hm->cond_deleted && work < COMPACT_STEP_WORK)
+        {
+            map_chain_t *mc = *mcp;
+            p_int pos, gap, target, i;
+
+            work++;
+            pos = find_cond_position(cm, &(mc->data[0]));
+
+            /* Look for the nearest free slot. */
+            gap = -1;
+            for (i = 0; i < COMPACT_MAX_SHIFT; i++)
+            {
+                if (pos - 1 - i >= 0 && keys[pos - 1 - i].type == T_INVALID)
+                {
+                    gap = pos - 1 - i;
+                    break;
+                }
+                if (pos + i < (p_int)cm->size && keys[pos + i].type == T_INVALID)
+                {
+                    gap = pos + i;
+                    break;
+                }
+            }
+
+            if (gap < 0)
+            {
+                /* The entry has to wait for the next full compaction. */
+                mcp = &(mc->next);
+                continue;
+            }
+
+            /* Shift the entries between the slot and the position
+             * to make room at the position.
+             */
+            if (gap < pos)
+            {
+                target = pos - 1;
+                memmove(keys + gap, keys + gap + 1
+                       , sizeof(svalue_t) * (target - gap));
+                memmove(COND_DATA(cm, gap, num_values)
+                       , COND_DATA(cm, gap + 1, num_values)
+                       , sizeof(svalue_t) * num_values * (target - gap));
+                work += target - gap;
+            }
+            else
+            {
+                target = pos;
+                memmove(keys + target + 1, keys + target
+                       , sizeof(svalue_t) * (gap - target));
+                memmove(COND_DATA(cm, target + 1, num_values)
+                       , COND_DATA(cm, target, num_values)
+                       , sizeof(svalue_t) * num_values * (gap - target));
+                work += gap - target;
+            }
+
+            /* Move the entry. The values of the free slot were zero. */
+            keys[target] = mc->data[0];
+            memcpy(COND_DATA(cm, target, num_values), &(mc->data[1])
+                  , sizeof(svalue_t) * num_values);
+
+            *mcp = mc->next;
+            free_map_chain(m, mc, MY_TRUE);
+            hm->used--;
+            hm->cond_deleted--;
+            moved++;
+        }
+
+        if (*mcp && hm->cond_deleted)
+            break; /* Continue with this chain in the next step. */
+
+        chain = (chain + 1) & hm->mask;
+    }
+
+    hm->step_chain = chain;
+    return moved;
+} /* fill_deleted_slots() */
+
+/*-------------------------------------------------------------------------*/
+static int
+compare_map_chains (const void *a, const void *b)
+
+/* qsort() comparison function: svalue_cmp() on the keys of two hashed
+ * entries.
+ */
+
+{
+    map_chain_t *left = *(map_chain_t * const *)a;
+    map_chain_t *right = *(map_chain_t * const *)b;
+
+    return svalue_cmp(&(left->data[0]), &(right->data[0]));
+} /* compare_map_chains() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+merge_hashed_run (mapping_t *m)
+
+/* Merge up to COMPACT_STEP_WORK hashed entries of mapping <m>, which has
+ * a hash and a condensed part, into a new condensed block. The deleted
+ * entries of the old block are dropped. Only the merged entries are
+ * compared, the old entries are copied as they are.
+ *
+ * Return the number of merged entries.
+ */
+
+{
+    mapping_hash_t *hm = m->hash;
+    mapping_cond_t *cm = m->cond;
+    mapping_cond_t *cm2;
+    p_int num_values = m->num_values;
+    map_chain_t **run;
+    p_int num, chain, i, src, dest;
+    size_t size;
+
+    num = hm->used < COMPACT_STEP_WORK ? hm->used : COMPACT_STEP_WORK;
+
+    run = xalloc(sizeof(*run) * num);
+    if (!run)
+        return 0;
+
+    size = sizeof(*cm2) + sizeof(svalue_t)
+                        * ((cm->size - hm->cond_deleted + num) * (num_values+1) - 1);
+    cm2 = xalloc(size);
+    if (!cm2)
+    {
+        xfree(run);
+        return 0;
+    }
+    cm2->size = cm->size - hm->cond_deleted + num;
+
+    /* Take the run from the chains, starting where the last step
+     * stopped, and sort it.
+     */
+    chain = hm->step_chain & hm->mask;
+    for (i = 0; i < num; )
+    {
+        map_chain_t *mc = hm->chains[chain];
+
+        if (mc)
+        {
+            hm->chains[chain] = mc->next;
+            run[i++] = mc;
+        }
+        else
+            chain = (chain + 1) & hm->mask;
+    }
+    hm->step_chain = chain;
+
+    qsort(run, num, sizeof(*run), compare_map_chains);
+
+    /* Copy the old entries up to the position of each entry of the run,
+     * then the entry itself.
+     */
+    for (i = 0, src = 0, dest = 0; i <= num; i++)
+    {
+        p_int end = i < num ? find_cond_position(cm, &(run[i]->data[0]))
+                            : (p_int)cm->size;
+
+        for ( ; src < end; src++)
+        {
+            if (cm->data[src].type == T_INVALID)
+                continue;
+
+            cm2->data[dest] = cm->data[src];
+            memcpy(COND_DATA(cm2, dest, num_values), COND_DATA(cm, src, num_values)
+                  , sizeof(svalue_t) * num_values);
+            dest++;
+        }
+
+        if (i < num)
+        {
+            cm2->data[dest] = run[i]->data[0];
+            memcpy(COND_DATA(cm2, dest, num_values), &(run[i]->data[1])
+                  , sizeof(svalue_t) * num_values);
+            dest++;
+            free_map_chain(m, run[i], MY_TRUE);
+        }
+    }
+
+    xfree(run);
+
+    LOG_ALLOC("merge_hashed_run - new keyblock", SIZEOF_MC(cm2, num_values), size);
+    m->user->mapping_total += SIZEOF_MC(cm2, num_values);
+    LOG_SUB("merge_hashed_run - old keyblock", SIZEOF_MC(cm, num_values));
+    m->user->mapping_total -= SIZEOF_MC(cm, num_values);
+    xfree(cm);
+
+    m->cond = cm2;
+    hm->used -= num;
+    hm->cond_deleted = 0;
+
+    return num;
+} /* merge_hashed_run() */
+
+/*-------------------------------------------------------------------------*/
+static void
+compact_mapping_step (mapping_t *m)
+
+/* Do one step of the compaction of mapping <m>, which has a hash and a
+ * condensed part: move hashed entries into nearby deleted slots, or
+ * if there are none, merge a run of them into a new condensed block.
+ */
+
+{
+    mapping_hash_t *hm = m->hash;
+    p_int moved = 0;
+
+    num_mapping_compaction_steps++;
+
+    if (hm->cond_deleted)
+        moved = fill_deleted_slots(m);
+    if (!moved && hm->used)
+        moved = merge_hashed_run(m);
+
+    num_mapping_compaction_entries += moved;
+    check_total_mapping_size();
+} /* compact_mapping_step() */
+
 /*-------------------------------------------------------------------------*/
 Bool
 compact_mapping (mapping_t *m, Bool force)
@@ -2051,9 +2810,12 @@ compact_mapping (mapping_t *m, Bool force)
  *
  * If <force> is TRUE, always compact the mapping.
  * If <force> is FALSE, the mappings is compacted if
- *   - have a .last_used time of 2*TIME_TO_COMPACT or more seconds earlier,
+ *   - have a .last_used time of 2*time_to_compact_mappings or more seconds
+ *     earlier (for large mappings only if enough entries have changed,
+ *     otherwise a compaction step is done),
  *   - or have to have at least half of their condensed entries deleted
- *     and have a .last_used time of TIME_TO_COMPACT or more seconds earlier.
+ *     and have a .last_used time of time_to_compact_mappings or more
+ *     seconds earlier.
  *
  * Return TRUE if the mapping has been freed altogether in the function
  * (ie. <m> is now invalid), or FALSE if it still exists.
@@ -2143,19 +2905,45 @@ compact_mapping (mapping_t *m, Bool force)
      * makes sure that we won't miss one.
      */
     if (!force
-     && !(   current_time - hm->last_used >= TIME_TO_COMPACT
+     && !(   current_time - hm->last_used >= time_to_compact_mappings
           && (   hm->cond_deleted * 2 >= m->num_entries - hm->used 
               || hm->used >= m->num_entries - hm->used - hm->cond_deleted
-              || current_time - hm->last_used >= 2*TIME_TO_COMPACT
+              || (   current_time - hm->last_used >= 2*time_to_compact_mappings
+                  && (   !cm
+                      || cm->size < COMPACT_MIN_SIZE
+                      || (hm->used + hm->cond_deleted) * COMPACT_CHANGE_RATIO
+                          >= (mp_int)cm->size
+                     )
+                 )
              )
          )
        )
     {
         /* This mapping doesn't qualify for compaction.
+         * If it is a large mapping with few changes, do a step instead.
          */
-        m->ref--; /* undo the ref increment from above */
-        malloc_privilege = old_malloc_privilege;
-        return MY_FALSE;
+        bool emptied = false;
+
+        if (cm && cm->size >= COMPACT_MIN_SIZE
+         && current_time - hm->last_used >= 2*time_to_compact_mappings)
+        {
+            if (!hm->deferred)
+            {
+                hm->deferred = true;
+                num_mapping_compactions_deferred++;
+            }
+
+            compact_mapping_step(m);
+            emptied = !hm->used && !hm->cond_deleted;
+        }
+
+        /* Unless the step emptied the hash part, we're done. */
+        if (!emptied)
+        {
+            m->ref--; /* undo the ref increment from above */
+            malloc_privilege = old_malloc_privilege;
+            return MY_FALSE;
+        }
     }
 
     /* Detect all keys referencing destructed keys - the compaction algorithm
@@ -2209,6 +2997,9 @@ compact_mapping (mapping_t *m, Bool force)
     m2 = get_new_mapping(m->user, num_values, 0, m->num_entries);
     cm2 = m2->cond;
 
+    num_mapping_compactions++;
+    num_mapping_compaction_entries += m->num_entries;
+
     if (cm2 != NULL)
     {
         /* --- Setup Mergesort ---
@@ -2739,6 +3530,7 @@ count_ref_in_mapping (mapping_t *m)
     mp_int size;
     mp_int num_values;
     Bool any_destructed = MY_FALSE;
+    bool object_keys = false;
 
     num_values = m->num_values;
 
@@ -2770,6 +3562,8 @@ count_ref_in_mapping (mapping_t *m)
         }
         else
         {
+            if (KEY_REFERENCES_OBJECT(key))
+                object_keys = true;
             count_ref_in_vector(key, 1);
             count_ref_in_vector(data, num_values);
         }
@@ -2797,12 +3591,20 @@ count_ref_in_mapping (mapping_t *m)
             }
             else
             {
+                if (KEY_REFERENCES_OBJECT(mc->data))
+                    object_keys = true;
                 count_ref_in_vector(mc->data, 1);
                 count_ref_in_vector(mc->data+1, num_values);
             }
         }
     }
 
+    /* The stale keys will be removed, so there is nothing to check
+     * until the next object is destructed.
+     */
+    m->last_destr_check = destructed_ob_counter;
+    m->object_keys = object_keys;
+
     /* If any stale key was found, link the mapping into the 
      * stale mapping list.
      */
@@ -3113,8 +3915,7 @@ m_indices (mapping_t *m)
  * The helper function m_indices_filter() is located in interpret.c
  * to take advantage of inlined assign_svalue_no_free().
  *
- * The function is used for efuns m_indices(), map_mapping(), and for
- * the loop construct foreach().
+ * The function is used for efuns m_indices() and map_mapping().
  */
 
 {
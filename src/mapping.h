@@ -23,6 +23,10 @@ struct mapping_s {
     p_int       num_values;        /* Number of values for a key */
     p_int       num_entries;       /* Number of valid entries */
     uint32_t    last_destr_check;  /* Last check for destr. object in keys */
+    bool        object_keys;
+      /* The keys may reference objects (see KEY_REFERENCES_OBJECT in
+       * mapping.c). If not, check_map_for_destr_keys() has nothing to do.
+       */
     struct mapping_cond_s * cond;  /* Condensed entries */
     struct mapping_hash_s * hash;  /* Hashed entries */
     mapping_t  *next;
@@ -64,6 +68,12 @@ struct mapping_hash_s {
        * pending because the they may still be used as destination for
        * a lvalue.
        */
+    p_int         step_chain;
+      /* The chain where the next compaction step starts.
+       */
+    bool          deferred;
+      /* The compaction of this mapping has been deferred.
+       */
     struct map_chain_s * chains[ 1 /* +.mask */ ];
       /* The hash chain heads ('hash buckets')
        */
@@ -183,6 +193,11 @@ static INLINE void put_ref_mapping(svalue_t * const dest, mapping_t * const map)
 extern mp_int num_mappings;
 extern mp_int num_hash_mappings;
 extern mp_int num_dirty_mappings;
+extern p_int time_to_compact_mappings;
+extern statcounter_t num_mapping_compactions;
+extern statcounter_t num_mapping_compaction_steps;
+extern statcounter_t num_mapping_compactions_deferred;
+extern statcounter_t num_mapping_compaction_entries;
 
 /* --- Prototypes --- */
 
@@ -203,6 +218,10 @@ extern mapping_t *resize_mapping(mapping_t *m, mp_int new_width);
 #define copy_mapping(m) resize_mapping((m), (m)->num_values)
 extern mapping_t *add_mapping(mapping_t *m1, mapping_t *m2);
 extern void walk_mapping(mapping_t *m, void (*func)(svalue_t *key, svalue_t *val, void *extra), void *extra);
+extern void put_mapping_iterator(svalue_t *dest, mapping_t *m);
+extern bool is_mapping_iterator(svalue_t *sv);
+extern bool next_mapping_iterator(svalue_t *iter, svalue_t **key, svalue_t **values);
+extern vector_t *mapping_iterator_keys(svalue_t *iter);
 extern Bool compact_mapping(mapping_t *m, Bool force);
 extern mp_int total_mapping_size(void);
 extern size_t mapping_overhead(mapping_t *m);
@@ -1648,6 +1648,76 @@ mstring_append_txt (string_t *left, const char *right, size_t len MTRACE_DECL)
     return tmp;
 } /* mstring_append_txt() */
 
+/*-------------------------------------------------------------------------*/
+string_t *
+mstring_extend (string_t *left, const char *right, size_t len
+               , enum unicode_type unicode MTRACE_DECL)
+
+/* Aliased to: mstr_extend(left,right,len,unicode)
+ *
+ * Return a string with the data of <left> concatenated with the <len>
+ * bytes of data in buffer <right>, which are of the given <unicode> type.
+ * The result string is untabled and has one reference, the reference
+ * of <left> is given to it.
+ *
+ * If <left> is untabled and has just one reference, it is extended
+ * in place. When its memory block is too small, it is reallocated with
+ * room for further additions, so that a string built by repeated
+ * additions is not copied each time.
+ *
+ * If memory runs out, NULL is returned and <left> is not changed.
+ */
+
+{
+    size_t lleft, needed;
+    string_t *tmp;
+
+    lleft = mstrsize(left);
+
+    if (left->info.type != STRING_UNTABLED || left->info.ref != 1)
+    {
+        tmp = mstring_alloc_string(lleft+len MTRACE_PASS);
+        if (!tmp)
+            return NULL;
+
+        memcpy(tmp->txt, left->txt, lleft);
+        memcpy(tmp->txt+lleft, right, len);
+        if (left->info.unicode == STRING_UTF8)
+            tmp->info.unicode = STRING_UTF8;
+        else
+            tmp->info.unicode = unicode;
+        free_mstring(left);
+        return tmp;
+    }
+
+    needed = sizeof(*left) + lleft + len + 1;
+    if (!has_xalloced_size() || xalloced_usable_size(left) < needed)
+    {
+        size_t alloc = needed;
+
+        /* Without the block size we can't know about the spare room. */
+        if (has_xalloced_size())
+            alloc += needed / 2;
+
+        tmp = rexalloc_pass(left, alloc);
+        if (!tmp)
+            return NULL;
+        left = tmp;
+    }
+
+    memcpy(left->txt+lleft, right, len);
+    left->size = lleft + len;
+    left->txt[left->size] = '\0';
+    left->u.tabled.hash = 0;
+    if (left->info.unicode != STRING_UTF8)
+        left->info.unicode = unicode;
+
+    mstr_used_size += len;
+    mstr_untabled_size += len;
+
+    return left;
+} /* mstring_extend() */
+
 /*-------------------------------------------------------------------------*/
 string_t *
 mstring_repeat (const string_t *base, size_t num MTRACE_DECL)
@@ -169,6 +169,7 @@
 #include "filestat.h"
 #include "interpret.h"
 #include "instrs.h"
+#include "jit.h"
 #include "lex.h"
 #include "main.h"
 #include "mapping.h"
@@ -670,6 +671,18 @@ _free_prog (program_t *progp, Bool free_all, const char * file, int line
         progp->line_numbers = NULL;
     }
 
+    /* Free the function profile. */
+    if (progp->profile)
+    {
+        xfree(progp->profile);
+        progp->profile = NULL;
+    }
+
+#ifdef USE_JIT
+    /* Free the native code. */
+    jit_free_program(progp);
+#endif
+
     /* Is it a 'real' free? Then dereference all the
      * things held by the program, too.
      */
@@ -3931,6 +3944,12 @@ move_object (void)
     lambda_t *l;
     object_t *save_command = command_giver;
 
+    /* The hook will call init() in the inventory of the destination
+     * for an interactive user, so start reading swapped objects now.
+     */
+    if (O_IS_INTERACTIVE(inter_sp[-1].u.ob))
+        prefetch_swapped_objects(inter_sp[0].u.ob);
+
     if (NULL != ( l = driver_hook[H_MOVE_OBJECT1].u.lambda) )
     {
         free_svalue(&(l->base.ob));
@@ -5225,6 +5244,8 @@ f_set_environment (svalue_t *sp)
 
     /* Now put it into its new environment (if any) */
     item->super = dest;
+    if (dest && (item->flags & O_SWAPPED))
+        dest->flags |= O_SWAPPED_INV;
     if (!dest)
     {
         item->next_inv = NULL;
@@ -76,7 +76,7 @@ struct object_s
 #define O_DESTRUCTED         0x10   /* Is it destructed ? */
 #define O_SWAPPED            0x20   /* Is it swapped to file */
 #define O_ONCE_INTERACTIVE   0x40   /* Has it ever been interactive? */
-#define O_UNUSED_80          0x80
+#define O_SWAPPED_INV        0x80   /* May its inventory contain swapped objects? */
 #define O_RESET_STATE        0x100  /* Object in a 'reset':ed state ? */
 #define O_WILL_CLEAN_UP      0x200  /* clean_up will be called next time */
 #define O_LAMBDA_REFERENCED  0x400  /* be careful with replace_program() */
@@ -47,6 +47,7 @@
 #include "pkg-mccp.h"
 
 #include "array.h"
+#include "backend.h"
 #include "comm.h"
 #include "mstrings.h"
 #include "object.h"
@@ -63,6 +64,76 @@
 
 #define UMIN(a,b) ((a) < (b) ? (a) : (b))
 
+/*-------------------------------------------------------------------------*/
+
+int mccp_default_level = 9;
+  /* The compression level for new connections,
+   * or MCCP_ADAPTIVE_LEVEL.
+   */
+
+int mccp_default_window_bits = MAX_WBITS;
+  /* The base two logarithm of the window size for new connections.
+   */
+
+int mccp_default_mem_level = 8;
+  /* The zlib memory level for new connections (8 is the zlib default).
+   */
+
+static mp_int mccp_overload_time = 0;
+  /* The last time the backend was found behind schedule.
+   */
+
+/*-------------------------------------------------------------------------*/
+static int
+mccp_wanted_level (interactive_t * ip)
+
+/* Return the compression level to use right now for <ip>.
+ */
+
+{
+    if (ip->mccp_level != MCCP_ADAPTIVE_LEVEL)
+        return ip->mccp_level;
+
+    /* If the heart beat is due while we're still busy, the backend
+     * is falling behind: trade compression ratio for CPU time.
+     */
+    if (comm_time_to_call_heart_beat)
+    {
+        mccp_overload_time = current_time;
+        return MCCP_ADAPTIVE_MIN_LEVEL;
+    }
+
+    /* Return to the higher level only when the backend kept up for
+     * a while, otherwise a backend just at its limit would make us
+     * change the level (and flush the stream) with every cycle.
+     */
+    if (current_time - mccp_overload_time < MCCP_ADAPTIVE_DELAY)
+        return MCCP_ADAPTIVE_MIN_LEVEL;
+
+    return MCCP_ADAPTIVE_MAX_LEVEL;
+} /* mccp_wanted_level() */
+
+/*-------------------------------------------------------------------------*/
+void
+mccp_adjust_level (interactive_t * ip)
+
+/* Change the compression level of the active compression on <ip> if
+ * the configuration or (in adaptive mode) the backend load calls for it.
+ *
+ * The output pointers of ip->out_compress must be set up, as zlib may
+ * need to flush data compressed with the old level.
+ */
+
+{
+    int level = mccp_wanted_level(ip);
+
+    if (level == ip->mccp_stream_level)
+        return;
+
+    if (deflateParams(ip->out_compress, level, Z_DEFAULT_STRATEGY) == Z_OK)
+        ip->mccp_stream_level = level;
+} /* mccp_adjust_level() */
+
 /*-------------------------------------------------------------------------*/
 void *
 zlib_alloc (void *opaque UNUSED, unsigned int items, unsigned int size)
@@ -105,6 +176,7 @@ start_compress (interactive_t * ip, unsigned char telopt)
 
 {
     z_stream *s;
+    int level;
     
     /* already compressing */
     if (ip->out_compress)
@@ -122,7 +194,9 @@ start_compress (interactive_t * ip, unsigned char telopt)
     s->zfree = zlib_free;
     s->opaque = NULL;
     
-    if (deflateInit (s, 9) != Z_OK)
+    level = mccp_wanted_level(ip);
+    if (deflateInit2(s, level, Z_DEFLATED, ip->mccp_window_bits
+                    , ip->mccp_mem_level, Z_DEFAULT_STRATEGY) != Z_OK)
     {
         xfree(ip->out_compress_buf);
         xfree(s);
@@ -157,6 +231,7 @@ start_compress (interactive_t * ip, unsigned char telopt)
     
     ip->compressing = telopt;
     ip->out_compress = s;
+    ip->mccp_stream_level = level;
     
     printf("%s MCCP-DEBUG: '%s' mccp started (%d)\n"
           , time_stamp(), get_txt(ip->ob->name), telopt);
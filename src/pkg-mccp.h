@@ -13,12 +13,34 @@
 
 #define COMPRESS_BUF_SIZE 8192
 
+#define MCCP_ADAPTIVE_LEVEL     (-1)
+  /* Compression level value: choose the level by the backend load.
+   */
+
+#define MCCP_ADAPTIVE_MIN_LEVEL 1
+#define MCCP_ADAPTIVE_MAX_LEVEL 6
+  /* The compression levels used in adaptive mode when the backend
+   * is overloaded resp. idle.
+   */
+
+#define MCCP_ADAPTIVE_DELAY     10
+  /* Seconds the backend has to keep up with its schedule until
+   * adaptive mode returns to the higher level.
+   */
+
+/* --- Variables --- */
+
+extern int mccp_default_level;
+extern int mccp_default_window_bits;
+extern int mccp_default_mem_level;
+
 /* --- Prototypes --- */
 
 extern void * zlib_alloc (void *opaque, unsigned int items, unsigned int size);
 extern void zlib_free (void *opaque, void *address);
 extern Bool start_compress (interactive_t * ip, unsigned char telopt);
 extern Bool end_compress (interactive_t * ip, Bool force);
+extern void mccp_adjust_level (interactive_t * ip);
 
 #endif /* USE_MCCP */
 
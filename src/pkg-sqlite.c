@@ -3,6 +3,27 @@
  *
  * Based on code written and donated 2005 by Bastian Hoyer and Gnomi.
  *---------------------------------------------------------------------------
+ * Each object can have one database open. Statements are executed either
+ * synchronously by sl_exec(), or queued by sl_exec_queued() and
+ * sl_exec_stream(). The queued statements of a database are executed one
+ * after another by sl_process_all(), which is called from the backend
+ * loop and steps through them for at most SL_QUEUE_TIME_SLICE per cycle.
+ * The results are passed to a callback closure.
+ *
+ * The driver's allocator and the path checks of the VFS (which call into
+ * the master) can't be used from another thread, so the statements are
+ * still executed by the backend; but long result sets are spread over
+ * several backend cycles. A single sqlite3_step() can't be split: an
+ * interrupt through the progress handler aborts the statement instead of
+ * suspending it, so a step which takes long blocks the backend. And a
+ * statement which is still stepping keeps its read transaction open
+ * across the backend cycles.
+ *
+ * Prepared statements are kept in a small per-database cache (LRU,
+ * keyed by the SQL text), so repeated queries don't need to be parsed
+ * again. Statements which caused a pragma privilege check are not
+ * cached, so the check is done for each execution.
+ *---------------------------------------------------------------------------
  */
 
 #include "driver.h"
@@ -10,6 +31,7 @@
 #ifdef USE_SQLITE
   
 #include <errno.h>
+#include <limits.h>
 #include <sqlite3.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -20,6 +42,9 @@
   
 #include "my-alloca.h"
 #include "array.h"
+#include "backend.h"
+#include "closure.h"
+#include "gcollect.h"
 #include "interpret.h"
 #include "mstrings.h"
 #include "simulate.h"
@@ -28,11 +53,29 @@
 #include "stdstrings.h"
 #include "xalloc.h"
 
+#include "i-current_object.h"
+#include "i-eval_cost.h"
+
+#include "../mudlib/sys/sqlite.h"
+
+/*-------------------------------------------------------------------------*/
+
+#define SL_STMT_CACHE_SIZE  16
+  /* Number of prepared statements cached per database.
+   */
+
+#define SL_QUEUE_TIME_SLICE 10000
+  /* Time in microseconds after which no further step of a queued
+   * query is started in this backend cycle.
+   */
+
 /*-------------------------------------------------------------------------*/
 /* Types */
 
 typedef struct sqlite_rows_s sqlite_rows_t;
 typedef struct sqlite_dbs_s sqlite_dbs_t;
+typedef struct sqlite_stmt_s sqlite_stmt_t;
+typedef struct sqlite_query_s sqlite_query_t;
 
 /* Since we don't know the number of rows while we retrieve the
  * rows from a query we save the data in a single-linked list first
@@ -52,11 +95,38 @@ struct sl_exec_cleanup_s
     error_handler_t head; /* push_error_handler saves the link to our
                              handler here. */
 
-    sqlite3_stmt *stmt;
+    sqlite_stmt_t *stmt;
     sqlite_rows_t *rows;
     sqlite_dbs_t *db;
 };
 
+/* A prepared statement together with the SQL text it was prepared from.
+ * While not in use, it is kept in the statement cache of its database,
+ * which is a single-linked list with the most recently used first.
+ */
+struct sqlite_stmt_s
+{
+    sqlite3_stmt * stmt;
+    sqlite_stmt_t * next;
+    bool cacheable;      /* Can be reused for the next execution */
+    size_t sql_len;
+    char sql[];          /* The SQL text (not terminated) */
+};
+
+/* A queued query. The queries of a database form
+ * a single-linked list in the order of execution.
+ */
+struct sqlite_query_s
+{
+    long id;
+    callback_t callback;
+    sqlite_stmt_t * stmt;
+    bool stream;           /* Pass each row separately */
+    sqlite_rows_t * rows;  /* Collected rows, the newest first */
+    p_int num_rows;
+    sqlite_query_t * next;
+};
+
 /* Database connections should be bound to the object which opens 
  * database file. We will store all database connections in a 
  * linked list. Also we have a busy flag to prevent reentrant
@@ -70,6 +140,13 @@ struct sqlite_dbs_s
     sqlite_dbs_t * prev;
 
     bool busy;
+    bool saw_pragma;  /* The authorizer was asked for a pragma */
+
+    sqlite_stmt_t * cache;   /* The statement cache */
+    int num_cached;
+
+    sqlite_query_t * queries;  /* The queued queries */
+    unsigned long round;       /* Last round of sl_process_all() */
 };
 
 /*-------------------------------------------------------------------------*/
@@ -79,6 +156,18 @@ struct sqlite_dbs_s
  */ 
 static sqlite_dbs_t *head = NULL;
 
+/* The number of queued queries of all databases.
+ */
+static long num_queries = 0;
+
+/* The last queued query ID.
+ */
+static long query_id = 0;
+
+/* The callback currently called by sl_process_all().
+ */
+static callback_t current_callback;
+
 /*-------------------------------------------------------------------------*/
 static sqlite_dbs_t *
 find_db (object_t * obj) 
@@ -118,6 +207,11 @@ new_db()
     tmp->next = NULL;
     tmp->prev = head;
     tmp->busy = false;
+    tmp->saw_pragma = false;
+    tmp->cache = NULL;
+    tmp->num_cached = 0;
+    tmp->queries = NULL;
+    tmp->round = 0;
     if (head)
         head->next=tmp;
     head=tmp;
@@ -153,12 +247,333 @@ remove_db(sqlite_dbs_t *db)
     pfree(db);
 } /* remove_db() */
 
+/*-------------------------------------------------------------------------*/
+static sqlite_stmt_t *
+sl_prepare (sqlite_dbs_t *db, string_t *sql, const char *efun)
+
+/* Return a prepared statement for <sql> on the database <db>, either from
+ * the statement cache or a newly prepared one. The statement is removed
+ * from the cache and has to be given back with sl_release().
+ *
+ * <db> must be marked as busy, on errors the mark is removed and an error
+ * message starting with <efun> is thrown.
+ */
+
+{
+    sqlite_stmt_t **link, *entry;
+    size_t len = mstrsize(sql);
+    int err;
+
+    for (link = &db->cache; *link != NULL; link = &(*link)->next)
+    {
+        entry = *link;
+        if (entry->sql_len == len && !memcmp(entry->sql, get_txt(sql), len))
+        {
+            *link = entry->next;
+            entry->next = NULL;
+            db->num_cached--;
+            return entry;
+        }
+    }
+
+    entry = pxalloc(sizeof(*entry) + len);
+    if (!entry)
+    {
+        db->busy = false;
+        errorf("(%s) Out of memory: (%lu bytes) for statement\n",
+            efun, (unsigned long) (sizeof(*entry) + len));
+    }
+
+    db->saw_pragma = false;
+    err = sqlite3_prepare_v2(db->db, get_txt(sql), len, &entry->stmt, NULL);
+    if (err)
+    {
+        const char* msg = sqlite3_errmsg(db->db);
+        if (entry->stmt)
+            sqlite3_finalize(entry->stmt);
+        pfree(entry);
+        db->busy = false;
+        errorf("%s: %s\n", efun, msg);
+        /* NOTREACHED */
+    }
+
+    entry->next = NULL;
+    entry->cacheable = entry->stmt != NULL && !db->saw_pragma;
+    entry->sql_len = len;
+    memcpy(entry->sql, get_txt(sql), len);
+
+    return entry;
+} /* sl_prepare() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_release (sqlite_dbs_t *db, sqlite_stmt_t *entry)
+
+/* Give the statement <entry> back to the cache of <db> after use.
+ * If it can't be cached, it is finalized.
+ */
+
+{
+    sqlite_stmt_t *other;
+
+    if (entry->cacheable)
+    {
+        /* If the same statement is cached already (because it was
+         * used twice at the same time), this one isn't needed.
+         */
+        for (other = db->cache; other != NULL; other = other->next)
+        {
+            if (other->sql_len == entry->sql_len
+             && !memcmp(other->sql, entry->sql, entry->sql_len))
+                break;
+        }
+
+        if (other == NULL)
+        {
+            sqlite3_reset(entry->stmt);
+            sqlite3_clear_bindings(entry->stmt);
+
+            entry->next = db->cache;
+            db->cache = entry;
+            db->num_cached++;
+
+            if (db->num_cached <= SL_STMT_CACHE_SIZE)
+                return;
+
+            /* Remove the least recently used entry. */
+            for (other = db->cache; other->next->next != NULL; other = other->next)
+                NOOP;
+            entry = other->next;
+            other->next = NULL;
+            db->num_cached--;
+        }
+    }
+
+    sqlite3_finalize(entry->stmt);
+    pfree(entry);
+} /* sl_release() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_bind_args (sqlite_dbs_t *db, sqlite_stmt_t *entry, svalue_t *argp, svalue_t *sp
+             , int first_arg, bool transient, const char *efun)
+
+/* Bind the arguments <argp> to <sp> to the parameters of the statement
+ * <entry>. <first_arg> is the position of <argp> in the efun call for
+ * error messages. If <transient> is true, SQLite copies the values,
+ * otherwise the arguments must stay until the statement is reset.
+ *
+ * <db> must be marked as busy, on errors the mark is removed
+ * and the statement released.
+ */
+
+{
+    sqlite3_stmt *stmt = entry->stmt;
+    int num;
+
+    for(num=1; argp <= sp; argp++, num++)
+    {
+        switch(argp->type)
+        {
+        default:
+            sl_release(db, entry);
+            db->busy = false;
+            errorf("Bad argument %d to %s(): type %s\n",
+                num + first_arg - 1, efun, sv_typename(argp));
+            break; /* NOTREACHED */
+
+        case T_FLOAT:
+            sqlite3_bind_double(stmt, num, READ_DOUBLE(argp));
+            break;
+
+        case T_NUMBER:
+            if (sizeof(argp->u.number) > 4)
+                sqlite3_bind_int64(stmt, num, argp->u.number);
+            else
+                sqlite3_bind_int(stmt, num, argp->u.number);
+            break;
+
+        case T_STRING:
+            sqlite3_bind_text(stmt, num, get_txt(argp->u.str),
+                mstrsize(argp->u.str), transient ? SQLITE_TRANSIENT : SQLITE_STATIC);
+            break;
+
+        case T_BYTES:
+            sqlite3_bind_blob(stmt, num, get_txt(argp->u.str),
+                mstrsize(argp->u.str), transient ? SQLITE_TRANSIENT : SQLITE_STATIC);
+            break;
+        }
+    }
+} /* sl_bind_args() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_fill_row (vector_t *row, sqlite3_stmt *stmt, const char *efun)
+
+/* Put the columns of the current result row of <stmt> into <row>,
+ * which must be an array of zeros with one entry per column.
+ */
+
+{
+    int col, cols = (int)VEC_SIZE(row);
+
+    for(col = 0; col < cols; col++)
+    {
+        svalue_t * entry;
+        STORE_DOUBLE_USED;
+
+        entry = row->item + col;
+
+        switch(sqlite3_column_type(stmt, col))
+        {
+        default:
+            errorf( "%s: Unknown type %d.\n"
+                  , efun, sqlite3_column_type(stmt, col));
+            break;
+
+        case SQLITE_BLOB:
+            put_bytes_buf( entry
+                         , sqlite3_column_blob(stmt, col)
+                         , sqlite3_column_bytes(stmt, col));
+            break;
+
+        case SQLITE_INTEGER:
+            if (sizeof(entry->u.number) >= 8)
+                put_number(entry, sqlite3_column_int64(stmt, col));
+            else
+                put_number(entry, sqlite3_column_int(stmt, col));
+            break;
+
+       case SQLITE_FLOAT:
+            entry->type = T_FLOAT;
+            STORE_DOUBLE(entry, sqlite3_column_double(stmt, col));
+            break;
+
+        case SQLITE_TEXT:
+            put_c_n_string( entry
+                          , (char *)sqlite3_column_text(stmt, col)
+                          , sqlite3_column_bytes(stmt, col));
+            break;
+
+        case SQLITE_NULL:
+            /* All elements from row are initialized to 0. */
+            break;
+        }
+    }
+} /* sl_fill_row() */
+
+/*-------------------------------------------------------------------------*/
+static const char *
+sl_step_error (sqlite_dbs_t *db, int err)
+
+/* Return the error message for the result <err> of sqlite3_step()
+ * on <db>, or NULL if the statement finished successfully.
+ */
+
+{
+    switch(err)
+    {
+    case SQLITE_DONE:
+        return NULL;
+
+    case SQLITE_BUSY:
+        return "Database is locked.";
+
+    case SQLITE_MISUSE:
+        return "sqlite3_step was called inappropriately.";
+
+    default:
+        return sqlite3_errmsg(db->db);
+    }
+} /* sl_step_error() */
+
+/*-------------------------------------------------------------------------*/
+static vector_t *
+sl_rows_to_array (sqlite_rows_t **rows, p_int num_rows, const char *efun)
+
+/* Move the <num_rows> rows from the list <rows> (the newest first) into
+ * an array in their original order and return it. The row entries stay
+ * in the list, but without their arrays.
+ */
+
+{
+    vector_t *result;
+    sqlite_rows_t *this_row;
+
+    result = allocate_array(num_rows);
+    if(!result)
+        errorf("(%s) Out of memory: result vector\n", efun);
+
+    this_row = *rows;
+    while(num_rows--)
+    {
+        put_array(result->item + num_rows, this_row->row);
+        this_row->row = NULL;
+        this_row = this_row->last;
+    }
+
+    return result;
+} /* sl_rows_to_array() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_free_rows (sqlite_rows_t *row)
+
+/* Free the list of rows <row>.
+ */
+
+{
+    while(row)
+    {
+        sqlite_rows_t *temp;
+
+        if(row->row)
+            free_array(row->row);
+        temp = row;
+        row = row->last;
+        pfree(temp);
+    }
+} /* sl_free_rows() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_free_query (sqlite_dbs_t *db, sqlite_query_t *query)
+
+/* Free the queued query <query> of <db>, which must already
+ * be removed from the queue.
+ */
+
+{
+    num_queries--;
+
+    if (query->stmt)
+        sl_release(db, query->stmt);
+    sl_free_rows(query->rows);
+    free_callback(&query->callback);
+    pfree(query);
+} /* sl_free_query() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_dequeue (sqlite_dbs_t *db)
+
+/* Remove the first queued query from <db> and free it.
+ */
+
+{
+    sqlite_query_t *query = db->queries;
+
+    db->queries = query->next;
+    sl_free_query(db, query);
+} /* sl_dequeue() */
+
 /*-------------------------------------------------------------------------*/
 static int
 my_sqlite3_authorizer (void * data, int what, const char* arg1, const char* arg2,
         const char* dbname, const char* view)
 
 /* Callback function for SQLite to handle authorizations.
+ * <data> is the database entry.
  */
 
 {
@@ -177,6 +592,11 @@ my_sqlite3_authorizer (void * data, int what, const char* arg1, const char* arg2
              *   arg2: value/arg
              *   dbname/view: NULL
              */
+
+            /* Don't cache this statement, so the privilege
+             * is checked again at the next execution.
+             */
+            ((sqlite_dbs_t *)data)->saw_pragma = true;
             
             error_recovery_info.rt.last = rt_context;
             error_recovery_info.rt.type = ERROR_RECOVERY_APPLY;
@@ -229,6 +649,7 @@ Bool
 sl_close (object_t *ob)
 
 /* For object <ob>, find and close the database connection.
+ * Queued queries are discarded.
  * Return TRUE on success, FALSE if there wasn't one.
  */
 
@@ -241,6 +662,19 @@ sl_close (object_t *ob)
         return MY_FALSE;
 
     db->busy = true;
+
+    while (db->queries)
+        sl_dequeue(db);
+
+    while (db->cache)
+    {
+        sqlite_stmt_t *entry = db->cache;
+
+        db->cache = entry->next;
+        sqlite3_finalize(entry->stmt);
+        pfree(entry);
+    }
+
     sqlite3_close(db->db);
     remove_db(db);
     return MY_TRUE;
@@ -295,7 +729,7 @@ f_sl_open (svalue_t *sp)
 
     /* Synchronous is damn slow. Forget it. */
     sqlite3_exec(db, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-    sqlite3_set_authorizer(db, my_sqlite3_authorizer, NULL);
+    sqlite3_set_authorizer(db, my_sqlite3_authorizer, tmp);
   
     free_string_svalue (sp);
     put_number (sp, 1);
@@ -306,25 +740,14 @@ f_sl_open (svalue_t *sp)
 static void
 sl_exec_cleanup (error_handler_t * arg)
 {
-    sqlite_rows_t *row;
     struct sl_exec_cleanup_s * data;
     
     data = (struct sl_exec_cleanup_s *)arg;
     
     if(data->stmt)
-        sqlite3_finalize(data->stmt);
+        sl_release(data->db, data->stmt);
 
-    row = data->rows;
-    while(row)
-    {
-        sqlite_rows_t *temp;
-
-        if(row->row)
-            free_array(row->row);
-        temp = row;
-        row = row->last;
-        pfree(temp);
-    }
+    sl_free_rows(data->rows);
 
     data->db->busy = false;
     xfree(data);
@@ -353,9 +776,9 @@ v_sl_exec (svalue_t * sp, int num_arg)
 {
     svalue_t *argp;
     sqlite_dbs_t *db;
-    sqlite3_stmt *stmt;
-    const char* tail;
-    int err, rows, cols, num;
+    sqlite_stmt_t *stmt;
+    const char *msg;
+    int err, rows, cols;
     struct sl_exec_cleanup_s * rec_data;
     vector_t * result;
 
@@ -370,60 +793,19 @@ v_sl_exec (svalue_t * sp, int num_arg)
         errorf("Reentrant call to the same database.\n");
 
     db->busy = true;
-    err = sqlite3_prepare(db->db, get_txt(argp->u.str), mstrsize(argp->u.str),
-        &stmt, &tail);
-    if(err)
-    {
-        const char* msg = sqlite3_errmsg(db->db);
-        if(stmt)
-            sqlite3_finalize(stmt);
-        db->busy = false;
-        errorf("sl_exec: %s\n", msg);
-        /* NOTREACHED */
-    }
+    stmt = sl_prepare(db, argp->u.str, "sl_exec");
     
     /* Now bind all parameters. */
-    for(argp++, num=1; argp <= sp; argp++, num++)
-    {
-        switch(argp->type)
-        {
-        default:
-            sqlite3_finalize(stmt);
-            db->busy = false;
-            errorf("Bad argument %d to sl_exec(): type %s\n",
-                num+1, sv_typename(argp));
-            break; /* NOTREACHED */
-
-        case T_FLOAT:
-            sqlite3_bind_double(stmt, num, READ_DOUBLE(argp));
-            break;
-
-        case T_NUMBER:
-            if (sizeof(argp->u.number) > 4)
-                sqlite3_bind_int64(stmt, num, argp->u.number);
-            else
-                sqlite3_bind_int(stmt, num, argp->u.number);
-            break;
-
-        case T_STRING:
-            sqlite3_bind_text(stmt, num, get_txt(argp->u.str),
-                mstrsize(argp->u.str), SQLITE_STATIC);
-            break;
-
-        case T_BYTES:
-            sqlite3_bind_blob(stmt, num, get_txt(argp->u.str),
-                mstrsize(argp->u.str), SQLITE_STATIC);
-            break;
-        }
-    }
+    sl_bind_args(db, stmt, argp + 1, sp, 2, false, "sl_exec");
     
     rows = 0;
-    cols = sqlite3_column_count(stmt);
+    cols = sqlite3_column_count(stmt->stmt);
 
     rec_data = xalloc(sizeof(*rec_data));
     if(!rec_data)
     {
-        sqlite3_finalize(stmt);
+        sl_release(db, stmt);
+        db->busy = false;
         errorf("(sl_exec) Out of memory: (%lu bytes) for cleanup structure\n",
             (unsigned long) sizeof(*rec_data));
     }
@@ -433,9 +815,8 @@ v_sl_exec (svalue_t * sp, int num_arg)
     
     sp = push_error_handler(sl_exec_cleanup, &(rec_data->head));
     
-    while((err = sqlite3_step(stmt)) == SQLITE_ROW)
+    while((err = sqlite3_step(stmt->stmt)) == SQLITE_ROW)
     {
-        int col;
         sqlite_rows_t *this_row;
 
         rows++;
@@ -452,106 +833,352 @@ v_sl_exec (svalue_t * sp, int num_arg)
         if(!this_row->row)
             errorf("(sl_exec) Out of memory: row vector\n");
     
-        for(col = 0; col < cols; col++)
-        {
-            svalue_t * entry;
-            STORE_DOUBLE_USED;
+        sl_fill_row(this_row->row, stmt->stmt, "sl_exec");
+    }
 
-            entry = this_row->row->item + col;
+    msg = sl_step_error(db, err);
+    if (msg)
+        errorf("sl_exec: %s\n", msg);
 
-            switch(sqlite3_column_type(stmt, col))
-            {
-            default:
-                errorf( "sl_exec: Unknown type %d.\n"
-                      , sqlite3_column_type(stmt, col));
-                break;
+    sl_release(db, stmt);
+    rec_data->stmt = NULL;
 
-            case SQLITE_BLOB:
-                put_bytes_buf( entry
-                             , sqlite3_column_blob(stmt, col)
-                             , sqlite3_column_bytes(stmt, col));
-                break;
+    if(rows)
+        result = sl_rows_to_array(&rec_data->rows, rows, "sl_exec");
+    else
+        result = NULL;
 
-            case SQLITE_INTEGER:
-                if (sizeof(entry->u.number) >= 8)
-                    put_number(entry, sqlite3_column_int64(stmt, col));
-                else
-                    put_number(entry, sqlite3_column_int(stmt, col));
-                break;
+    // Pop arguments and our error handler.
+    // Our error handler gets called and cleans the row stuff.
+    sp = pop_n_elems(num_arg + 1, sp) + 1; 
+ 
+    if(rows)
+        put_array(sp,result);
+    else
+        put_number(sp, 0);
 
-           case SQLITE_FLOAT:
-                entry->type = T_FLOAT;
-                STORE_DOUBLE(entry, sqlite3_column_double(stmt, col));
-                break;
+    return sp;
+} /* v_sl_exec() */
 
-            case SQLITE_TEXT:
-                put_c_n_string( entry
-                              , (char *)sqlite3_column_text(stmt, col)
-                              , sqlite3_column_bytes(stmt, col));
-                break;
+/*-------------------------------------------------------------------------*/
+static svalue_t *
+sl_exec_queue (svalue_t * sp, int num_arg, bool stream, const char *efun)
 
-            case SQLITE_NULL:
-                /* All elements from this_row->row are initialized to 0. */
-                break;
-            }
-        }
-    }
+/* Implementation of sl_exec_queued() and sl_exec_stream(): prepare the
+ * statement and queue it for execution by sl_process_all().
+ */
 
-    sqlite3_finalize(stmt);
-    rec_data->stmt = NULL;
-    
-    switch(err)
+{
+    svalue_t *argp;
+    sqlite_dbs_t *db;
+    sqlite_stmt_t *stmt;
+    sqlite_query_t *query, **link;
+
+    argp = sp - num_arg + 1; /* First argument: the callback */
+
+    if (current_object.type != T_OBJECT)
+        errorf("%s() without current object.\n", efun);
+    db = find_db (current_object.u.ob);
+    if (!db)
+        errorf("The current object doesn't have a database open.\n");
+    else if (db->busy)
+        errorf("Reentrant call to the same database.\n");
+
+    if (argp->x.closure_type == CLOSURE_UNBOUND_LAMBDA)
+        errorf("Bad argument 1 to %s(): unbound lambda\n", efun);
+
+    db->busy = true;
+    stmt = sl_prepare(db, argp[1].u.str, efun);
+
+    /* The arguments are gone when the statement is executed,
+     * so let SQLite copy them.
+     */
+    sl_bind_args(db, stmt, argp + 2, sp, 3, true, efun);
+
+    db->busy = false;
+
+    query = pxalloc(sizeof(*query));
+    if (!query)
     {
-    default:
-        errorf("sl_exec: Unknown return code from sqlite3_step: %d.\n", err);
-        break;
+        sl_release(db, stmt);
+        errorf("(%s) Out of memory: (%lu bytes) for query\n",
+            efun, (unsigned long) sizeof(*query));
+    }
 
-    case SQLITE_BUSY:
-        errorf("sl_exec: Database is locked.\n");
-        break;
+    query->id = ++query_id;
+    if (query_id == LONG_MAX)
+        query_id = 0;
+    query->stmt = stmt;
+    query->stream = stream;
+    query->rows = NULL;
+    query->num_rows = 0;
+    query->next = NULL;
+    setup_closure_callback(&query->callback, argp, 0, NULL);
+    put_number(argp, 0);
+
+    for (link = &db->queries; *link != NULL; link = &(*link)->next)
+        NOOP;
+    *link = query;
+    num_queries++;
+
+    sp = pop_n_elems(num_arg, sp) + 1;
+    put_number(sp, query->id);
 
-    case SQLITE_ERROR:
-        errorf("sl_exec: %s\n", sqlite3_errmsg(db->db));
-        break;
+    return sp;
+} /* sl_exec_queue() */
 
-    case SQLITE_MISUSE:
-        errorf("sl_exec: sqlite3_step was called inappropriately.\n");
-        break;
+/*-------------------------------------------------------------------------*/
+svalue_t *
+v_sl_exec_queued (svalue_t * sp, int num_arg)
 
-    case SQLITE_DONE:
-        break;
+/* EFUN sl_exec_queued()
+ *
+ *   int sl_exec_queued(closure callback, string statement, ...)
+ *
+ * Queues the SQL statement <statement> for execution in the background
+ * and returns an ID for it. When the statement has been executed,
+ * <callback> is called with all result rows.
+ */
+
+{
+    return sl_exec_queue(sp, num_arg, false, "sl_exec_queued");
+} /* v_sl_exec_queued() */
+
+/*-------------------------------------------------------------------------*/
+svalue_t *
+v_sl_exec_stream (svalue_t * sp, int num_arg)
+
+/* EFUN sl_exec_stream()
+ *
+ *   int sl_exec_stream(closure callback, string statement, ...)
+ *
+ * Queues the SQL statement <statement> for execution in the background
+ * and returns an ID for it. <callback> is called for each result row
+ * as it is retrieved, and then with the number of rows.
+ */
+
+{
+    return sl_exec_queue(sp, num_arg, true, "sl_exec_stream");
+} /* v_sl_exec_stream() */
+
+/*-------------------------------------------------------------------------*/
+static void
+sl_call_back (svalue_t *closure, long id, int type)
+
+/* Call <closure> with <type>, the value on top of the stack, and the
+ * query <id>. The closure is adopted.
+ */
+
+{
+    setup_closure_callback(&current_callback, closure, 0, NULL);
+
+    /* Move the data behind the type. */
+    inter_sp[1] = inter_sp[0];
+    put_number(inter_sp, type);
+    inter_sp++;
+    push_number(inter_sp, id);
+
+    RESET_LIMITS;
+    CLEAR_EVAL_COST;
+    mark_start_evaluation();
+    (void)backend_callback(&current_callback, 3);
+    mark_end_evaluation();
+} /* sl_call_back() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+sl_process_one (sqlite_dbs_t *db)
+
+/* Do one step of the first queued query of <db>.
+ * Return true, if a callback was called.
+ */
+
+{
+    sqlite_query_t *query = db->queries;
+    sqlite3_stmt *stmt = query->stmt->stmt;
+    long id = query->id;
+    svalue_t closure, save_ob;
+    const char *msg;
+    int err;
+
+    if (!valid_callback_object(&query->callback))
+    {
+        sl_dequeue(db);
+        return false;
     }
 
-    if(rows)
+    /* Let privilege checks know whose statement this is. */
+    save_ob = current_object;
+    set_current_object(db->obj);
+    db->busy = true;
+    err = sqlite3_step(stmt);
+    db->busy = false;
+    current_object = save_ob;
+
+    if (err == SQLITE_ROW)
     {
-        sqlite_rows_t *this_row;
+        vector_t *row = allocate_array(sqlite3_column_count(stmt));
 
-        result = allocate_array(rows);
-        if(!result)
-            errorf("(sl_exec) Out of memory: result vector\n");
+        query->num_rows++;
 
-        this_row = rec_data->rows;
-        while(rows--)
+        if (query->stream)
+        {
+            push_array(inter_sp, row);
+            sl_fill_row(row, stmt, "sl_exec_stream");
+            assign_svalue_no_free(&closure, &query->callback.function.closure);
+            sl_call_back(&closure, id, SL_ROW);
+            return true;
+        }
+        else
         {
-            put_array(result->item + rows, this_row->row);
-            this_row->row = NULL;
-            this_row = this_row->last;
+            sqlite_rows_t *this_row = pxalloc(sizeof(*this_row));
+
+            if (this_row)
+            {
+                this_row->row = row;
+                this_row->last = query->rows;
+                query->rows = this_row;
+                sl_fill_row(row, stmt, "sl_exec_queued");
+                return false;
+            }
+
+            free_array(row);
+            msg = "Out of memory.";
         }
     }
     else
-        result = NULL;
-
-    // Pop arguments and our error handler.
-    // Our error handler gets called and cleans the row stuff.
-    sp = pop_n_elems(num_arg + 1, sp) + 1; 
- 
-    if(rows)
-        put_array(sp,result);
+        msg = sl_step_error(db, err);
+
+    /* The query has finished. Push the result before the statement
+     * is released, as the error message belongs to it.
+     */
+    if (msg)
+        push_c_string(inter_sp, msg);
+    else if (query->stream)
+        push_number(inter_sp, query->num_rows);
+    else if (query->num_rows)
+        push_array(inter_sp, sl_rows_to_array(&query->rows, query->num_rows, "sl_exec_queued"));
     else
-        put_number(sp, 0);
+        push_number(inter_sp, 0);
 
-    return sp;
-} /* v_sl_exec() */
+    db->queries = query->next;
+    transfer_svalue_no_free(&closure, &query->callback.function.closure);
+    query->callback.function.closure.type = T_INVALID;
+    sl_free_query(db, query);
+
+    sl_call_back(&closure, id, msg ? SL_ERROR : SL_RESULT);
+    return true;
+} /* sl_process_one() */
+
+/*-------------------------------------------------------------------------*/
+bool
+sl_has_pending (void)
+
+/* Return true, if there are queued queries waiting for execution.
+ */
+
+{
+    return num_queries > 0;
+} /* sl_has_pending() */
+
+/*-------------------------------------------------------------------------*/
+void
+sl_process_all (void)
+
+/* Called from the get_message() loop in comm.c, this function executes
+ * the queued queries. In each round every database with
+ * queries executes one step of its first query, this is repeated until
+ * SL_QUEUE_TIME_SLICE has passed or there are no more queries.
+ */
+
+{
+    static unsigned long round = 0;
+    struct error_recovery_info error_recovery_info;
+    uint64_t start;
+
+    if (!num_queries)
+        return;
+
+    start = get_latency_time();
+
+    /* Activate the local error recovery context */
+
+    error_recovery_info.rt.last = rt_context;
+    error_recovery_info.rt.type = ERROR_RECOVERY_BACKEND;
+    rt_context = (rt_context_t *)&error_recovery_info.rt;
+
+    current_callback.is_closure = true;
+    current_callback.function.closure.type = T_INVALID;
+    current_callback.num_arg = 0;
+
+    if (setjmp(error_recovery_info.con.text))
+    {
+        /* An error occurred in a callback. The query was either
+         * finished or will be continued in the next round.
+         */
+        mark_end_evaluation();
+        clear_state();
+        debug_message("%s Error in sqlite callback.\n", time_stamp());
+        free_callback(&current_callback);
+
+        for (sqlite_dbs_t *db = head; db != NULL; db = db->prev)
+            db->busy = false;
+    }
+
+    while (num_queries && get_latency_time() - start < SL_QUEUE_TIME_SLICE)
+    {
+        sqlite_dbs_t *db;
+
+        round++;
+        db = head;
+        while (db)
+        {
+            if (db->queries && db->round != round && !db->busy)
+            {
+                db->round = round;
+                if (sl_process_one(db))
+                {
+                    /* The callback may have closed any database. */
+                    db = head;
+                    continue;
+                }
+            }
+            db = db->prev;
+        }
+    }
+
+    rt_context = error_recovery_info.rt.last;
+} /* sl_process_all() */
+
+/*-------------------------------------------------------------------------*/
+void
+sl_purge_queries (void)
+
+/* Remove all queued queries whose callback object has been destructed.
+ */
+
+{
+    sqlite_dbs_t *db;
+
+    for (db = head; db != NULL; db = db->prev)
+    {
+        sqlite_query_t **link = &db->queries;
+
+        while (*link)
+        {
+            sqlite_query_t *query = *link;
+
+            if (valid_callback_object(&query->callback))
+            {
+                link = &query->next;
+                continue;
+            }
+
+            *link = query->next;
+            sl_free_query(db, query);
+        }
+    }
+} /* sl_purge_queries() */
 
 /*-------------------------------------------------------------------------*/
 svalue_t *
@@ -609,6 +1236,60 @@ f_sl_close (svalue_t * sp)
     return sp;
 } /* f_sl_close() */
 
+#ifdef GC_SUPPORT
+
+/*-------------------------------------------------------------------------*/
+void
+sl_clear_refs (void)
+
+/* GC Support: Clear all references from the queued queries.
+ */
+
+{
+    for (sqlite_dbs_t *db = head; db != NULL; db = db->prev)
+    {
+        for (sqlite_query_t *query = db->queries; query != NULL; query = query->next)
+        {
+            clear_ref_in_callback(&query->callback);
+
+            for (sqlite_rows_t *row = query->rows; row != NULL; row = row->last)
+            {
+                svalue_t sv;
+
+                put_array(&sv, row->row);
+                clear_ref_in_vector(&sv, 1);
+            }
+        }
+    }
+} /* sl_clear_refs() */
+
+/*-------------------------------------------------------------------------*/
+void
+sl_count_refs (void)
+
+/* GC Support: Count all references from the queued queries.
+ */
+
+{
+    for (sqlite_dbs_t *db = head; db != NULL; db = db->prev)
+    {
+        for (sqlite_query_t *query = db->queries; query != NULL; query = query->next)
+        {
+            count_ref_in_callback(&query->callback);
+
+            for (sqlite_rows_t *row = query->rows; row != NULL; row = row->last)
+            {
+                svalue_t sv;
+
+                put_array(&sv, row->row);
+                count_ref_in_vector(&sv, 1);
+            }
+        }
+    }
+} /* sl_count_refs() */
+
+#endif /* GC_SUPPORT */
+
 #if defined(ALLOCATOR_WRAPPERS)
 /*-------------------------------------------------------------------------*/
 static void *
@@ -14,11 +14,21 @@
 /* --- Prototypes --- */
 
 extern Bool sl_close (object_t *ob);
+extern bool sl_has_pending (void);
+extern void sl_process_all (void);
+extern void sl_purge_queries (void);
 
 extern svalue_t * f_sl_open (svalue_t *sp);
 extern svalue_t * v_sl_exec (svalue_t * sp, int num_arg) ;
 extern svalue_t * f_sl_insert_id (svalue_t * sp);
 extern svalue_t * f_sl_close (svalue_t * sp) ;
+extern svalue_t * v_sl_exec_queued (svalue_t * sp, int num_arg);
+extern svalue_t * v_sl_exec_stream (svalue_t * sp, int num_arg);
+
+#ifdef GC_SUPPORT
+extern void sl_clear_refs (void);
+extern void sl_count_refs (void);
+#endif /* GC_SUPPORT */
 
 extern void pkg_sqlite_init ();
 
@@ -946,6 +946,10 @@ struct inline_closure_s
     mp_uint length;
       /* Length of the compiled code.
        */
+    mp_uint body_start;
+      /* While compiling the closure: start address of the function body
+       * in A_PROGRAM (behind the header and the default values).
+       */
     mp_uint li_start;
       /* While compiling the closure: start address of the data in
        * A_LINENUMBERS.
@@ -3787,6 +3791,64 @@ ins_f_code_buf (unsigned int b, bytecode_p buf)
     return pos;
 } /* ins_f_code_buf() */
 
+/*-------------------------------------------------------------------------*/
+static void
+ins_binary_op_code (unsigned int b, lpctype_t *t1, lpctype_t *t2)
+
+/* Add the code for the binary operator <b> (F_ADD, F_SUBTRACT, F_MULTIPLY,
+ * F_DIVIDE, F_LT, F_LE, F_GT, F_GE or F_INDEX) with operands of the
+ * types <t1> and <t2>.
+ *
+ * If the types are specific enough, a type-specialized instruction
+ * is used instead of <b>. The types are not guaranteed at runtime
+ * (not even with rtt_checks, think of references), therefore these
+ * instructions check the operands themselves and fall back to <b>.
+ */
+
+{
+    switch (b)
+    {
+    case F_ADD:
+    case F_SUBTRACT:
+    case F_LT:
+    case F_LE:
+    case F_GT:
+    case F_GE:
+        if (t1 == lpctype_int && t2 == lpctype_int)
+        {
+            ins_f_code(F_INT_OP);
+            ins_byte(b);
+            return;
+        }
+        /* FALLTHROUGH */
+
+    case F_MULTIPLY:
+    case F_DIVIDE:
+        if (t1 == lpctype_float && t2 == lpctype_float)
+        {
+            ins_f_code(F_FLOAT_OP);
+            ins_byte(b);
+            return;
+        }
+        break;
+
+    case F_INDEX:
+        if (t1 != NULL && t1->t_class == TCLASS_ARRAY && t2 == lpctype_int)
+        {
+            ins_f_code(F_INDEX_ARRAY);
+            return;
+        }
+        if (t1 == lpctype_mapping && t2 == lpctype_string)
+        {
+            ins_f_code(F_INDEX_MAPPING);
+            return;
+        }
+        break;
+    }
+
+    ins_f_code(b);
+} /* ins_binary_op_code() */
+
 /*-------------------------------------------------------------------------*/
 static void
 ins_short (long l)
@@ -6302,6 +6364,375 @@ def_function_check_return (fulltype_t returntype, struct statement_s statements)
     }
 } /* def_function_check_return() */
 
+/*-------------------------------------------------------------------------*/
+/* Flags for the code map used by thread_function_branches().
+ */
+#define THREAD_INSTRUCTION  0x01  /* An instruction starts at this byte */
+#define THREAD_PROTECTED    0x02  /* The instruction must not be changed */
+
+#define THREAD_MAX_CHAIN    16    /* Max number of branches to follow */
+
+int
+instruction_length (bytecode_p p)
+
+/* Return the length of the instruction at <p> including its operands,
+ * or -1 if the instruction can't be handled by thread_function_branches().
+ * These are instructions with embedded tables (switch), absolute jumps
+ * and instructions that occur only in lambda closures.
+ *
+ * The function is also used by the native code compiler (jit.c).
+ */
+
+{
+    switch (GET_CODE(p))
+    {
+    case F_ILLEGAL:
+    case F_SWITCH:
+    case F_BREAK_CONTINUE:
+    case F_BREAKN_CONTINUE:
+    case F_JUMP:
+    case F_CONTEXT_LAMBDA:
+    case F_LAMBDA_CCONSTANT:
+    case F_LAMBDA_CONSTANT:
+    case F_LAMBDA_TYPE_CHECK:
+        return -1;
+
+    case F_EFUN0:
+    case F_EFUN1:
+    case F_EFUN2:
+    case F_EFUN3:
+    case F_EFUN4:
+    case F_EFUNV:
+    case F_IDENTIFIER:
+    case F_CSTRING0:
+    case F_CSTRING1:
+    case F_CSTRING2:
+    case F_CSTRING3:
+    case F_CLIT:
+    case F_NCLIT:
+    case F_LOCAL:
+    case F_CONTEXT_IDENTIFIER:
+    case F_PUSH_CONTEXT_LVALUE:
+    case F_PUSH_CONTEXT_VLVALUE:
+    case F_PUSH_IDENTIFIER_LVALUE:
+    case F_PUSH_IDENTIFIER_VLVALUE:
+    case F_VIRTUAL_VARIABLE:
+    case F_PUSH_VIRTUAL_VARIABLE_LVALUE:
+    case F_PUSH_VIRTUAL_VARIABLE_VLVALUE:
+    case F_PUSH_LOCAL_VARIABLE_LVALUE:
+    case F_PUSH_LOCAL_VARIABLE_VLVALUE:
+    case F_MOVE_VALUE:
+    case F_POP_N:
+    case F_BRANCH:
+    case F_BRANCH_WHEN_ZERO:
+    case F_BRANCH_WHEN_NON_ZERO:
+    case F_BBRANCH_WHEN_ZERO:
+    case F_BBRANCH_WHEN_NON_ZERO:
+    case F_LAND:
+    case F_LOR:
+    case F_INT_OP:
+    case F_FLOAT_OP:
+        return 2;
+
+    case F_STRING:
+    case F_IDENTIFIER16:
+    case F_PUSH_IDENTIFIER16_LVALUE:
+    case F_PUSH_IDENTIFIER16_VLVALUE:
+    case F_CONTEXT_IDENTIFIER16:
+    case F_PUSH_CONTEXT16_LVALUE:
+    case F_CALL_FUNCTION:
+    case F_SIMUL_EFUN:
+#ifdef USE_PYTHON
+    case F_PYTHON_EFUN:
+#endif
+    case F_CALL_OTHER_CACHED:
+    case F_CALL_STRICT_CACHED:
+    case F_AGGREGATE:
+    case F_ARRAY0:
+    case F_PUSH_TYPE:
+    case F_CLEAR_LOCALS:
+    case F_DUP_N:
+    case F_M_CAGGREGATE:
+    case F_CATCH:
+    case F_LBRANCH:
+    case F_LBRANCH_WHEN_ZERO:
+    case F_LBRANCH_WHEN_NON_ZERO:
+        return 3;
+
+    case F_SYMBOL:
+    case F_PUT_ARRAY_ELEMENT:
+    case F_TYPE_CHECK:
+    case F_S_AGGREGATE:
+    case F_FOREACH:
+    case F_FOREACH_REF:
+    case F_FOREACH_RANGE:
+        return 4;
+
+    case F_CALL_INHERITED:
+    case F_CALL_INHERITED_NOARGS:
+    case F_M_AGGREGATE:
+    case F_CLOSURE:
+    case F_FOREACH_NEXT:
+    case F_FBRANCH:
+        return 5;
+
+    case F_CONTEXT_CLOSURE:
+        return 8;
+
+    case F_S_M_AGGREGATE:
+        return 4 + GET_UINT8(p+3);
+
+    case F_TRANSFORM_TO_COROUTINE:
+    case F_AWAIT:
+    case F_YIELD_TO_COROUTINE:
+    case F_YIELD_RETURN:
+        /* Followed by the local variable names. */
+        return 2 + 2 * GET_UINT8(p+1);
+
+    case F_NUMBER:
+        return 1 + sizeof(p_int);
+
+    case F_FLOAT:
+#ifdef FLOAT_FORMAT_2
+        return 1 + sizeof(double);
+#else
+        return 1 + sizeof(uint32_t) + sizeof(uint16_t);
+#endif
+
+    default:
+        return 1;
+    }
+} /* instruction_length() */
+
+/*-------------------------------------------------------------------------*/
+static p_int
+branch_destination (p_int pc)
+
+/* Return the program address the instruction at <pc> may continue at
+ * besides the next instruction, or -1 if it doesn't branch.
+ */
+
+{
+    bytecode_p p = PROGRAM_BLOCK + pc;
+
+    switch (GET_CODE(p))
+    {
+    case F_BRANCH:
+    case F_BRANCH_WHEN_ZERO:
+    case F_BRANCH_WHEN_NON_ZERO:
+    case F_LAND:
+    case F_LOR:
+        return pc + 2 + GET_UINT8(p+1);
+
+    case F_BBRANCH_WHEN_ZERO:
+    case F_BBRANCH_WHEN_NON_ZERO:
+        return pc + 1 - GET_UINT8(p+1);
+
+    case F_LBRANCH:
+    case F_LBRANCH_WHEN_ZERO:
+    case F_LBRANCH_WHEN_NON_ZERO:
+        return pc + 1 + get_bc_shortoffset(p+1);
+
+    case F_FBRANCH:
+        return pc + 1 + get_bc_offset(p+1);
+
+    case F_CATCH:
+        return pc + 3 + GET_UINT8(p+2);
+
+    case F_FOREACH:
+    case F_FOREACH_REF:
+    case F_FOREACH_RANGE:
+        return pc + 4 + (unsigned short)get_short(p+2);
+
+    case F_FOREACH_NEXT:
+        return pc + 5 - (unsigned short)get_short(p+3);
+
+    default:
+        return -1;
+    }
+} /* branch_destination() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+set_branch_destination (p_int pc, p_int dest)
+
+/* Let the branch instruction at <pc> continue at <dest> instead.
+ * Return false if the new offset can't be encoded in the instruction.
+ */
+
+{
+    bytecode_p p = PROGRAM_BLOCK + pc;
+    p_int offset;
+
+    switch (GET_CODE(p))
+    {
+    case F_BRANCH:
+    case F_BRANCH_WHEN_ZERO:
+    case F_BRANCH_WHEN_NON_ZERO:
+    case F_LAND:
+    case F_LOR:
+        offset = dest - (pc + 2);
+        if (offset < 0 || offset > 0xff)
+            return false;
+        PUT_UINT8(p+1, offset);
+        return true;
+
+    case F_BBRANCH_WHEN_ZERO:
+    case F_BBRANCH_WHEN_NON_ZERO:
+        offset = pc + 1 - dest;
+        if (offset < 0 || offset > 0xff)
+            return false;
+        PUT_UINT8(p+1, offset);
+        return true;
+
+    case F_LBRANCH:
+    case F_LBRANCH_WHEN_ZERO:
+    case F_LBRANCH_WHEN_NON_ZERO:
+        offset = dest - (pc + 1);
+        if (offset < SHRT_MIN || offset > SHRT_MAX)
+            return false;
+        put_bc_shortoffset(p+1, offset);
+        return true;
+
+    case F_FBRANCH:
+        put_bc_offset(p+1, dest - (pc + 1));
+        return true;
+
+    default:
+        return false;
+    }
+} /* set_branch_destination() */
+
+/*-------------------------------------------------------------------------*/
+static void
+thread_function_branches (p_int start, p_int end)
+
+/* Thread the branches in the code of the function just compiled
+ * at PROGRAM_BLOCK[<start>..<end>[:
+ *  - a branch to an unconditional branch is redirected to the final
+ *    destination, if its encoding allows that offset;
+ *  - an unconditional branch to a return is replaced by the return
+ *    (the remaining bytes are filled with the same return instruction,
+ *    they are never executed).
+ *
+ * Nothing else is optimized. As the code is never moved or shortened,
+ * the line number information, the offsets in the function headers
+ * and pending relocations stay valid.
+ *
+ * Functions containing instructions that can't be decoded linearly
+ * (i.e. switch) are left untouched, as are branches that are part
+ * of a catch() construct, the error handling looks for these.
+ */
+
+{
+    bytecode_p code = PROGRAM_BLOCK;
+    char *map;
+    p_int pc;
+
+    if (end <= start)
+        return;
+
+    map = xalloc(end - start);
+    if (!map)
+        return;
+    memset(map, 0, end - start);
+
+    /* Find the instruction boundaries. */
+    for (pc = start; pc < end; )
+    {
+        int len = instruction_length(code + pc);
+
+        if (len < 0)
+        {
+            xfree(map);
+            return;
+        }
+        map[pc - start] = THREAD_INSTRUCTION;
+        pc += len;
+    }
+
+    if (pc != end)
+    {
+        xfree(map);
+        return;
+    }
+
+    /* All destinations must be instructions of this function.
+     * Mark the continuation addresses of catch() as protected.
+     */
+    for (pc = start; pc < end; pc++)
+    {
+        p_int dest;
+
+        if (!(map[pc - start] & THREAD_INSTRUCTION))
+            continue;
+
+        dest = branch_destination(pc);
+        if (dest < 0)
+            continue;
+
+        if (dest < start || dest > end
+         || (dest < end && !(map[dest - start] & THREAD_INSTRUCTION)))
+        {
+            xfree(map);
+            return;
+        }
+
+        if (GET_CODE(code + pc) == F_CATCH && dest < end)
+            map[dest - start] |= THREAD_PROTECTED;
+    }
+
+    for (pc = start; pc < end; pc++)
+    {
+        p_int dest, final;
+        int instr, i;
+
+        if (map[pc - start] != THREAD_INSTRUCTION)
+            continue;
+
+        instr = GET_CODE(code + pc);
+        if (instr == F_CATCH
+         || instr == F_FOREACH || instr == F_FOREACH_REF
+         || instr == F_FOREACH_RANGE || instr == F_FOREACH_NEXT)
+            continue;
+
+        dest = branch_destination(pc);
+        if (dest < 0)
+            continue;
+
+        /* Follow the chain of unconditional branches. */
+        final = dest;
+        for (i = 0; i < THREAD_MAX_CHAIN && final < end && final != pc; i++)
+        {
+            int next = GET_CODE(code + final);
+
+            if (next != F_BRANCH && next != F_LBRANCH && next != F_FBRANCH)
+                break;
+
+            final = branch_destination(final);
+            if (final != dest && set_branch_destination(pc, final))
+                dest = final;
+        }
+
+        /* An unconditional branch to a return is the return. */
+        if ((instr == F_BRANCH || instr == F_LBRANCH || instr == F_FBRANCH)
+         && final < end
+         && (GET_CODE(code + final) == F_RETURN0 || GET_CODE(code + final) == F_RETURN))
+        {
+            bytecode_t ret = GET_CODE(code + final);
+            int len = instruction_length(code + pc);
+
+            for (i = 0; i < len; i++)
+            {
+                PUT_CODE(code + pc + i, ret);
+                map[pc - start + i] |= THREAD_INSTRUCTION;
+            }
+        }
+    }
+
+    xfree(map);
+} /* thread_function_branches() */
+
 /*-------------------------------------------------------------------------*/
 static void
 def_function_complete (bool has_code, p_uint body_start, bool is_inline)
@@ -8038,6 +8469,7 @@ printf("DEBUG:   program size: %"PRIuMPINT" align to %"PRIuMPINT"\n",
     if (realloc_a_program(FUNCTION_HDR_SIZE))
     {
         CURRENT_PROGRAM_SIZE += FUNCTION_HDR_SIZE;
+        current_inline->body_start = CURRENT_PROGRAM_SIZE;
     }
     else
     {
@@ -8102,6 +8534,7 @@ printf("DEBUG:           current depth: %d: %d\n", block_depth, block_scope[bloc
         int fnum = current_inline->ident->u.global.function;
         FUNCTION(fnum)->num_opt_arg = current_inline->num_opt_args;
 
+        thread_function_branches(current_inline->body_start, CURRENT_PROGRAM_SIZE);
         def_function_complete(true, start, true);
     }
 
@@ -9826,7 +10259,10 @@ function_def:
           }
 
           if ($8.has_code)
+          {
               def_function_check_return(def_function_returntype, $8.statements);
+              thread_function_branches($8.address + FUNCTION_HDR_SIZE, CURRENT_PROGRAM_SIZE);
+          }
           def_function_complete($8.has_code, offset, false);
 
           insert_pending_inline_closures();
@@ -10035,7 +10471,10 @@ printf("DEBUG: After inline_opt_context: program size %"PRIuMPINT"\n", CURRENT_P
           if (!$<number>$)
               $5.num_opt = 0;
           else
+          {
               current_inline->num_opt_args = $5.num_opt;
+              current_inline->body_start += $<number>$;
+          }
 
           if ($1)
           {
@@ -13862,12 +14301,12 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
+          ins_binary_op_code(F_GT, $1.type.t_type, $3.type.t_type);
+
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
           free_lvalue_block($1.lvalue);
-
-          ins_f_code(F_GT);
       }
     | expr0 L_GE  expr0
       {
@@ -13886,12 +14325,12 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
+          ins_binary_op_code(F_GE, $1.type.t_type, $3.type.t_type);
+
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
           free_lvalue_block($1.lvalue);
-
-          ins_f_code(F_GE);
       }
     | expr0 '<'  expr0
       {
@@ -13910,12 +14349,12 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
+          ins_binary_op_code(F_LT, $1.type.t_type, $3.type.t_type);
+
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
           free_lvalue_block($1.lvalue);
-
-          ins_f_code(F_LT);
       }
     | expr0 L_LE  expr0
       {
@@ -13934,12 +14373,12 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
+          ins_binary_op_code(F_LE, $1.type.t_type, $3.type.t_type);
+
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
           free_lvalue_block($1.lvalue);
-
-          ins_f_code(F_LE);
       }
 
     /*- - - - - - - - - - - - - - - - - - - - - - - - - - - - -*/
@@ -14118,7 +14557,7 @@ expr0:
                                     lpctype_mixed, NULL, false);
               $$.type = get_fulltype(result);
 
-              ins_f_code(F_ADD);
+              ins_binary_op_code(F_ADD, $1.type.t_type, $4.type.t_type);
           }
 
           $$.name = NULL;
@@ -14152,7 +14591,7 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
-          ins_f_code(F_SUBTRACT);
+          ins_binary_op_code(F_SUBTRACT, $1.type.t_type, $3.type.t_type);
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
@@ -14176,7 +14615,7 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
-          ins_f_code(F_MULTIPLY);
+          ins_binary_op_code(F_MULTIPLY, $1.type.t_type, $3.type.t_type);
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
@@ -14223,7 +14662,7 @@ expr0:
           use_variable($1.name, VAR_USAGE_READ);
           use_variable($3.name, VAR_USAGE_READ);
 
-          ins_f_code(F_DIVIDE);
+          ins_binary_op_code(F_DIVIDE, $1.type.t_type, $3.type.t_type);
           free_fulltype($1.type);
           free_fulltype($3.type);
           free_lvalue_block($3.lvalue);
@@ -15481,7 +15920,7 @@ expr4:
               $$.lvalue = compose_lvalue_block((lvalue_block_t) {0, 0}, 0, $1.start, $2.lvalue_inst);
           }
 
-          ins_f_code($2.rvalue_inst);
+          ins_binary_op_code($2.rvalue_inst, $1.type.t_type, $2.type1.t_type);
 
           /* Check and compute the types */
           $$.type = get_fulltype(get_index_result_type($1.type.t_type, $2.type1, $2.rvalue_inst, lpctype_mixed));
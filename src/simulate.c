@@ -3456,6 +3456,7 @@ status_parse (strbuf_t * sbuf, char * buff)
         tot += total_mapping_size();
         tot += total_struct_size(sbuf, verbose);
         tot += rxcache_status(sbuf, verbose);
+        tot += include_cache_status(sbuf, verbose);
         if (verbose)
         {
             strbuf_add(sbuf, "\nOther:\n");
@@ -69,6 +69,15 @@
  *   until the free blocks occupy only 1/4th of the swap file - then
  *   the swapper switches back to immediate extension.
  *
+ * Swapping in is done synchronously when an object is needed. To hide
+ * some of the latency, the driver announces objects which are likely to
+ * be needed soon with prefetch_swapped_objects(): the surroundings of
+ * users whose input arrived, before any of the commands of that cycle
+ * are executed, and the inventory of a room an interactive user is moved
+ * into. The swapper passes their blocks as a hint to the operating system
+ * (posix_fadvise()), so that the reads for all of them are queued at once
+ * and can proceed while the driver is busy with other commands.
+ *
  *---------------------------------------------------------------------------
  */
 
@@ -78,6 +87,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdio.h>
 
@@ -89,6 +99,7 @@
 #include "comm.h"
 #include "gcollect.h"
 #include "interpret.h"
+#include "jit.h"
 #include "main.h"
 #include "mapping.h"
 #include "mempools.h"
@@ -115,6 +126,7 @@
 typedef struct swap_block_s swap_block_t;
 typedef struct varblock_s   varblock_t;
 typedef struct free_swapped_mapping_locals_s free_swapped_mapping_locals_t;
+typedef struct swapped_profile_s swapped_profile_t;
 
 
 /* --- struct swap_block_s
@@ -162,6 +174,27 @@ struct free_swapped_mapping_locals_s
 };
 
 
+/* --- struct swapped_profile_s
+ *
+ * The function profile of a swapped program is not written to the
+ * swapfile, as it changes with every call of the program. Instead it
+ * stays in memory in one of these structures, hashed by the swap number
+ * of the program, and is given back to the program when it is swapped in.
+ */
+
+struct swapped_profile_s
+{
+    swapped_profile_t  *next;     /* Next structure in the hash chain */
+    p_int               swap_num; /* Swap number of the program */
+    function_profile_t *profile;  /* The profile of the program */
+};
+
+#define SWAPPED_PROFILE_TABLE_SIZE (251)
+  /* Number of hash chains for the swapped profiles, a prime as the
+   * swap numbers are file offsets.
+   */
+
+
 #define LOW_WATER_MARK  (swapfile_size >> 2)
 #define HIGH_WATER_MARK (swapfile_size >> 1)
   /* The two limits for non-compact swapping.
@@ -169,6 +202,12 @@ struct free_swapped_mapping_locals_s
 
 #define SWAP_ABS(a) ((a)>0 ? (a) : (-a))
 
+#define SWAP_PREFETCH_SIZE  (16 * 1024)
+  /* Number of bytes to announce for reading when prefetching
+   * a swapped block. The real size of the block is not known
+   * without reading it.
+   */
+
 /*-------------------------------------------------------------------------*/
 
 Bool swap_compact_mode = MY_FALSE;
@@ -229,6 +268,11 @@ static char *last_changed_swapped_svalue;
    * free_swapped_svalues() had to change.
    */
 
+static swapped_profile_t *swapped_profiles[SWAPPED_PROFILE_TABLE_SIZE];
+  /* The function profiles of swapped programs, hashed by
+   * their swap number.
+   */
+
 
 /* Statistics (some are accessed directly from the outside) */
 
@@ -272,6 +316,10 @@ static mp_int total_swap_reused = 0;
   /* Size of bytes reused from previously freed blocks.
    */
 
+static statcounter_t swap_num_prefetches = 0;
+  /* Number of swapped blocks announced for prefetching.
+   */
+
 static statcounter_t swap_num_searches;
   /* Number of searches for a free block to allocate (as opposed to
    * simply allocating it).
@@ -682,6 +730,109 @@ store_swap_block2 ( void * buffer1, mp_int size1
     return offset;
 } /* store_swap_block2() */
 
+/*-------------------------------------------------------------------------*/
+static function_profile_t *
+take_swapped_profile (p_int swap_num)
+
+/* Remove the function profile of the swapped program <swap_num> from
+ * the swapped profiles and return it, or NULL if there is none.
+ */
+
+{
+    swapped_profile_t **chain, *entry;
+    function_profile_t *profile;
+
+    chain = &swapped_profiles[(p_uint)swap_num % SWAPPED_PROFILE_TABLE_SIZE];
+    for (; (entry = *chain) != NULL; chain = &entry->next)
+    {
+        if (entry->swap_num == swap_num)
+            break;
+    }
+
+    if (!entry)
+        return NULL;
+
+    *chain = entry->next;
+    profile = entry->profile;
+    xfree(entry);
+
+    return profile;
+} /* take_swapped_profile() */
+
+/*-------------------------------------------------------------------------*/
+static void
+keep_swapped_profile (swapped_profile_t *entry, p_int swap_num)
+
+/* Keep the function profile in <entry> for the program with <swap_num>,
+ * which is being swapped out.
+ */
+
+{
+    swapped_profile_t **chain;
+
+    chain = &swapped_profiles[(p_uint)swap_num % SWAPPED_PROFILE_TABLE_SIZE];
+    entry->swap_num = swap_num;
+    entry->next = *chain;
+    *chain = entry;
+} /* keep_swapped_profile() */
+
+/*-------------------------------------------------------------------------*/
+Bool
+has_swapped_profile (object_t *ob)
+
+/* Return TRUE if the swapped program of <ob> has a function profile.
+ */
+
+{
+    p_int swap_num = (p_int)ob->prog & ~1;
+    swapped_profile_t *entry;
+
+    entry = swapped_profiles[(p_uint)swap_num % SWAPPED_PROFILE_TABLE_SIZE];
+    for (; entry != NULL; entry = entry->next)
+    {
+        if (entry->swap_num == swap_num)
+            return MY_TRUE;
+    }
+
+    return MY_FALSE;
+} /* has_swapped_profile() */
+
+/*-------------------------------------------------------------------------*/
+void
+free_swapped_profiles (void)
+
+/* Free the function profiles of all swapped programs. This is done when
+ * the function profiler is started anew and the profiles are stale.
+ */
+
+{
+    for (int i = 0; i < SWAPPED_PROFILE_TABLE_SIZE; i++)
+    {
+        while (swapped_profiles[i])
+        {
+            swapped_profile_t *entry = swapped_profiles[i];
+
+            swapped_profiles[i] = entry->next;
+            xfree(entry->profile);
+            xfree(entry);
+        }
+    }
+} /* free_swapped_profiles() */
+
+/*-------------------------------------------------------------------------*/
+static INLINE void
+mark_swapped (object_t *ob)
+
+/* Mark <ob> as (at least partially) swapped out, and its environment
+ * as containing swapped objects for prefetch_swapped_objects().
+ */
+
+{
+    ob->flags |= O_SWAPPED;
+    if (ob->super)
+        ob->super->flags |= O_SWAPPED_INV;
+} /* mark_swapped() */
+
 /*-------------------------------------------------------------------------*/
 Bool
 swap_program (object_t *ob)
@@ -695,6 +846,7 @@ swap_program (object_t *ob)
 {
     program_t *prog;
     p_int swap_num;
+    swapped_profile_t *saved_profile = NULL;
 
     if (d_flag > 1)
     {
@@ -716,17 +868,48 @@ swap_program (object_t *ob)
         return MY_FALSE;
     }
 
+    /* The function profile is not swapped, it stays in memory until
+     * the program is swapped in again. A stale profile of an earlier
+     * run of the profiler is freed.
+     */
+    if (prog->profile)
+    {
+        if (prog->profile_generation != function_profile_generation)
+        {
+            xfree(prog->profile);
+            prog->profile = NULL;
+        }
+        else
+        {
+            saved_profile = xalloc(sizeof(*saved_profile));
+            if (!saved_profile)
+                return MY_FALSE;
+            saved_profile->profile = prog->profile;
+            prog->profile = NULL;
+        }
+    }
+
+#ifdef USE_JIT
+    /* The native code is not swapped, it is compiled again when
+     * the functions are called often enough.
+     */
+    jit_free_program(prog);
+#endif
+
     /* Has this object already been swapped, and read in again ?
      * Then it is very easy to swap it out again.
      */
     if (prog->swap_num >= 0)
     {
+        if (saved_profile)
+            keep_swapped_profile(saved_profile, prog->swap_num);
+
         total_bytes_unswapped -= prog->total_size;
         if (prog->line_numbers)
             total_bytes_unswapped -= prog->line_numbers->size;
         ob->prog = (program_t *)(prog->swap_num | 1);
         free_prog(prog, MY_FALSE);  /* Do not free the strings or blueprint */
-        ob->flags |= O_SWAPPED;
+        mark_swapped(ob);
         num_unswapped--;
         return MY_TRUE;
     }
@@ -738,9 +921,17 @@ swap_program (object_t *ob)
     if (swap_num == -1)
     {
         locate_in(prog);
+        if (saved_profile)
+        {
+            prog->profile = saved_profile->profile;
+            xfree(saved_profile);
+        }
         return MY_FALSE;
     }
 
+    if (saved_profile)
+        keep_swapped_profile(saved_profile, swap_num);
+
     total_bytes_swapped += prog->total_size + prog->line_numbers->size;
     num_swapped++;
 
@@ -749,7 +940,7 @@ swap_program (object_t *ob)
 
     /* Mark the program as swapped */
     ob->prog = (program_t *)(swap_num | 1);
-    ob->flags |= O_SWAPPED;
+    mark_swapped(ob);
 
     return MY_TRUE;
 } /* swap_program() */
@@ -1689,7 +1880,7 @@ swap_variables (object_t *ob)
         mb_free(mbSwap);
         xfree(ob->variables);
         ob->variables = (svalue_t *)(last_variable_swap_num | 1);
-        ob->flags |= O_SWAPPED;
+        mark_swapped(ob);
 
 #ifdef CHECK_OBJECT_STAT
         if (check_object_stat)
@@ -1792,7 +1983,7 @@ swap_variables (object_t *ob)
 
     /* Mark the variables as swapped */
     ob->variables = (svalue_t *)(swap_num | 1);
-    ob->flags |= O_SWAPPED;
+    mark_swapped(ob);
     return MY_TRUE;
 
 #undef VARBLOCK_STARTSIZE
@@ -2236,6 +2427,8 @@ load_ob_from_swap (object_t *ob)
         ob->prog = prog;
         locate_in (prog); /* relocate the internal pointers */
         prog->line_numbers = NULL;
+        prog->profile = take_swapped_profile(swap_num);
+        prog->profile_generation = function_profile_generation;
 
         /* The reference count will already be 1 ! */
 
@@ -2465,6 +2658,11 @@ remove_prog_swap (program_t *prog, Bool load_line_numbers)
         total_bytes_swapped -= prog->line_numbers->size;
     }
 
+    /* The swap number may be used again, so it mustn't have
+     * a profile any more.
+     */
+    xfree(take_swapped_profile(swap_num));
+
     swap_free(prog->swap_num);
     total_bytes_unswapped -= prog->total_size;
     total_bytes_swapped -= prog->total_size;
@@ -2473,6 +2671,83 @@ remove_prog_swap (program_t *prog, Bool load_line_numbers)
     prog->swap_num = -1;
 } /* remove_prog_swap() */
 
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+/*-------------------------------------------------------------------------*/
+static void
+prefetch_swap_block (p_int swap_num)
+
+/* Tell the operating system that the swap block at <swap_num> will be
+ * read soon.
+ */
+
+{
+    swap_num &= ~1;
+    if (swap_num >= swapfile_size)
+        return;
+
+    if (posix_fadvise(fileno(swap_file), swap_num, SWAP_PREFETCH_SIZE
+                     , POSIX_FADV_WILLNEED) == 0)
+        swap_num_prefetches++;
+} /* prefetch_swap_block() */
+#endif /* HAVE_POSIX_FADVISE */
+
+/*-------------------------------------------------------------------------*/
+void
+prefetch_swapped_objects (object_t *env)
+
+/* The objects in <env> (and <env> itself) are likely to be swapped in
+ * soon - announce all their swapped blocks to the operating system,
+ * so that the following synchronous swap-ins can be served from the
+ * file cache.
+ *
+ * The inventory is only searched if it is flagged with O_SWAPPED_INV,
+ * which is set whenever an object in it is swapped out or a swapped
+ * object is moved into it, and cleared here when nothing swapped is
+ * found any more.
+ */
+
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+    object_t *ob;
+    Bool flushed = MY_FALSE;
+    Bool found = MY_FALSE;
+
+    if (swap_file == NULL || env->flags & O_DESTRUCTED)
+        return;
+
+    /* Only walk inventories that may contain swapped objects. */
+    if (!(env->flags & (O_SWAPPED|O_SWAPPED_INV)))
+        return;
+
+    for (ob = env; ob != NULL; ob = (ob == env) ? env->contains : ob->next_inv)
+    {
+        if (!(ob->flags & O_SWAPPED))
+            continue;
+
+        if (ob != env)
+            found = MY_TRUE;
+
+        /* Make sure that everything written so far is visible to the
+         * operating system before it starts reading ahead.
+         */
+        if (!flushed)
+        {
+            fflush(swap_file);
+            flushed = MY_TRUE;
+        }
+
+        if (O_PROG_SWAPPED(ob))
+            prefetch_swap_block((p_int)ob->prog);
+        if (O_VAR_SWAPPED(ob))
+            prefetch_swap_block((p_int)ob->variables);
+    }
+
+    /* The inventory was swapped in since, don't look again. */
+    if (!found)
+        env->flags &= ~O_SWAPPED_INV;
+#endif
+} /* prefetch_swapped_objects() */
+
 /*-------------------------------------------------------------------------*/
 void
 name_swap_file (const char *name)
@@ -2499,6 +2774,29 @@ unlink_swap_file (void)
     fclose(swap_file);
 } /* unlink_swap_file() */
 
+#ifdef GC_SUPPORT
+/*-------------------------------------------------------------------------*/
+void
+count_swap_refs (void)
+
+/* GC support: Mark the function profiles of the swapped programs.
+ */
+
+{
+    for (int i = 0; i < SWAPPED_PROFILE_TABLE_SIZE; i++)
+    {
+        swapped_profile_t *entry;
+
+        for (entry = swapped_profiles[i]; entry != NULL; entry = entry->next)
+        {
+            note_malloced_block_ref(entry);
+            note_malloced_block_ref(entry->profile);
+        }
+    }
+} /* count_swap_refs() */
+
+#endif /* GC_SUPPORT */
+
 /*-------------------------------------------------------------------------*/
 size_t
 swap_overhead (void)
@@ -2531,8 +2829,10 @@ swap_status (strbuf_t *sbuf)
                 , num_swapfree, total_bytes_swapfree
                 , swapfile_size
     );
-    strbuf_addf(sbuf, "Total reused space:%26"PRIdMPINT" bytes\n\n"
+    strbuf_addf(sbuf, "Total reused space:%26"PRIdMPINT" bytes\n"
                     , total_swap_reused);
+    strbuf_addf(sbuf, "Blocks prefetched:%27"PRIuSTATCOUNTER"\n\n"
+                    , swap_num_prefetches);
     strbuf_addf(sbuf
                , "Swap: searches: %10"PRIuSTATCOUNTER" average search length: %3.1f\n"
                  "Free: searches: %10"PRIuSTATCOUNTER" average search length: %3.1f\n"
@@ -2603,6 +2903,10 @@ swap_driver_info (svalue_t *svp, int value)
             put_number(svp, recycle_free_space);
             break;
 
+        case DI_NUM_SWAP_PREFETCHES:
+            put_number(svp, swap_num_prefetches);
+            break;
+
         default:
             fatal("Unknown option for swap_driver_info(): %d\n", value);
             break;
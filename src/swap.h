@@ -22,10 +22,17 @@ extern Bool swap(object_t *ob, int mode);
 extern int load_ob_from_swap(object_t *ob);
 extern Bool load_line_numbers_from_swap(program_t *prog);
 extern void remove_prog_swap(program_t *prog, Bool load_line_numbers);
+extern Bool has_swapped_profile(object_t *ob);
+extern void free_swapped_profiles(void);
+extern void prefetch_swapped_objects(object_t *env);
 extern void name_swap_file(const char *name);
 extern void unlink_swap_file(void);
 extern size_t swap_overhead (void);
 extern void swap_status(strbuf_t *sbuf);
 extern void swap_driver_info(svalue_t *svp, int value) __attribute__((nonnull(1)));
 
+#ifdef GC_SUPPORT
+extern void count_swap_refs(void);
+#endif /* GC_SUPPORT */
+
 #endif  /* SWAP_H__ */
@@ -27,11 +27,14 @@ typedef enum efun_override_e      efun_override_t;    /* lex.h */
 typedef struct error_handler_s    error_handler_t;    /* interpret.h */
 typedef struct fulltype_s         fulltype_t;         /* types.h */
 typedef struct function_s         function_t;         /* exec.h */
+typedef struct function_profile_s function_profile_t; /* exec.h */
 typedef struct ident_s            ident_t;            /* lex.h */
 typedef struct identifier_closure_s identifier_closure_t; /* closure.h */
 typedef struct include_s          include_t;          /* exec.h */
 typedef struct inherit_s          inherit_t;          /* exec.h */
 typedef struct interactive_s      interactive_t;      /* comm.h */
+typedef struct jit_function_s     jit_function_t;     /* jit.h */
+typedef struct jit_program_s      jit_program_t;      /* jit.c */
 typedef struct input_s            input_t;            /* comm.h */
 typedef struct instr_s            instr_t;            /* exec.h */
 typedef struct lambda_s           lambda_t;           /* closure.h */
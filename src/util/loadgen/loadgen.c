@@ -0,0 +1,870 @@
+/*---------------------------------------------------------------------------
+ * Synthetic Client Load Generator
+ *
+ *---------------------------------------------------------------------------
+ * This program opens many telnet connections to a running driver, sends
+ * commands on each of them at a given rate and measures the time until
+ * the response to each command has arrived. It is meant to benchmark the
+ * communication layer of the driver (get_message(), the write buffers,
+ * telnet_neg() and MCCP) on a single machine, usually together with the
+ * mudlib in test/loadgen/.
+ *
+ * The end of a response is recognized by the prompt the driver sends
+ * after each command: a response is complete when the prompt appears at
+ * the beginning of a line while a command is outstanding. Therefore the
+ * mudlib has to answer each command with some lines followed by a prompt
+ * (which is the default behaviour of the driver).
+ *
+ * The generator speaks just enough telnet to get along: it refuses all
+ * options except TELOPT_COMPRESS2 (MCCP v2), which it accepts if asked to
+ * do so. Compressed data is inflated with zlib.
+ *
+ * All connections are handled by one process with poll(). At the end
+ * statistics about the connections, the transferred data and the
+ * percentiles of the response latencies are printed.
+ *---------------------------------------------------------------------------
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#ifdef USE_MCCP
+#    include <zlib.h>
+#endif
+
+/*-------------------------------------------------------------------------*/
+
+/* Telnet codes (RFC 854) */
+
+#define IAC    255
+#define DONT   254
+#define DO     253
+#define WONT   252
+#define WILL   251
+#define SB     250
+#define SE     240
+
+#define TELOPT_COMPRESS2  86  /* MCCP v2 */
+
+#define BUFFER_SIZE  16384
+  /* Size of the read buffer and of the inflate buffer.
+   */
+
+#define MAX_PENDING  64
+  /* Maximum number of outstanding commands per connection. If a
+   * connection falls that far behind, it won't send more commands
+   * until responses arrive.
+   */
+
+/*-------------------------------------------------------------------------*/
+
+/* --- Telnet parser states --- */
+
+enum telnet_state
+{
+    TS_DATA,  /* Normal data */
+    TS_IAC,   /* Got IAC */
+    TS_WILL,  /* Got IAC WILL */
+    TS_WONT,  /* Got IAC WONT */
+    TS_DO,    /* Got IAC DO */
+    TS_DONT,  /* Got IAC DONT */
+    TS_SB,    /* In a subnegotiation */
+    TS_SB_IAC /* Got IAC in a subnegotiation */
+};
+
+/* --- struct conn_s: one connection ---
+ */
+
+typedef struct conn_s
+{
+    int fd;                  /* The socket, -1 if closed */
+    bool connected;          /* Connection is established */
+    enum telnet_state tn_state;
+    unsigned char sb_opt;    /* Option of the current subnegotiation */
+    int sb_len;              /* Length of the current subnegotiation */
+
+    bool line_start;         /* The next data character starts a line */
+    int prompt_matched;      /* Number of prompt characters seen */
+
+    uint64_t next_send;      /* Time of the next command */
+    int script_pos;          /* Next line of the script */
+
+    uint64_t pending[MAX_PENDING];
+      /* Send times of the outstanding commands as a ring buffer */
+    int pending_first, pending_count;
+
+#ifdef USE_MCCP
+    bool compressing;        /* Incoming data is compressed */
+    z_stream zs;             /* The inflate state */
+#endif
+} conn_t;
+
+/*-------------------------------------------------------------------------*/
+
+/* Options */
+static const char *host = "127.0.0.1";
+static int port = 0;
+static int num_conns = 100;
+static double rate = 1.0;         /* Commands per second per connection */
+static int connect_rate = 500;    /* New connections per second */
+static int duration = 10;         /* Seconds to send commands */
+static bool use_mccp = false;
+static const char *prompt = "> ";
+static int prompt_len;
+static bool verbose = false;
+
+/* The script */
+static char **script = NULL;
+static int script_lines = 0;
+
+/* The connections */
+static conn_t *conns;
+static struct pollfd *pollfds;
+static int num_opened = 0;
+
+/* Statistics */
+static long stat_connected = 0;
+static long stat_failed = 0;
+static long stat_closed = 0;
+static long stat_sent = 0;
+static long stat_responses = 0;
+static long stat_mccp = 0;
+static uint64_t stat_bytes_out = 0;
+static uint64_t stat_bytes_in = 0;      /* As received from the network */
+static uint64_t stat_bytes_data = 0;    /* After decompression */
+
+/* All measured latencies in microseconds */
+static uint32_t *latencies = NULL;
+static size_t num_latencies = 0, max_latencies = 0;
+
+static volatile sig_atomic_t interrupted = 0;
+
+/*-------------------------------------------------------------------------*/
+static uint64_t
+get_time (void)
+
+/* Return the current monotonic time in microseconds.
+ */
+
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+} /* get_time() */
+
+/*-------------------------------------------------------------------------*/
+static void
+fatal (const char *fmt, ...)
+
+/* Print an error message and exit.
+ */
+
+{
+    va_list va;
+
+    va_start(va, fmt);
+    fprintf(stderr, "loadgen: ");
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+    exit(1);
+} /* fatal() */
+
+/*-------------------------------------------------------------------------*/
+static void
+add_latency (uint64_t us)
+
+/* Record a measured latency of <us> microseconds.
+ */
+
+{
+    if (num_latencies == max_latencies)
+    {
+        max_latencies = max_latencies ? 2 * max_latencies : 65536;
+        latencies = realloc(latencies, max_latencies * sizeof(*latencies));
+        if (!latencies)
+            fatal("Out of memory.\n");
+    }
+
+    latencies[num_latencies++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+} /* add_latency() */
+
+/*-------------------------------------------------------------------------*/
+static int
+cmp_latency (const void *a, const void *b)
+
+/* qsort() comparison function for latencies.
+ */
+
+{
+    uint32_t la = *(const uint32_t *)a, lb = *(const uint32_t *)b;
+
+    return la < lb ? -1 : la > lb;
+} /* cmp_latency() */
+
+/*-------------------------------------------------------------------------*/
+static void
+read_script (const char *fname)
+
+/* Read the commands to send from <fname>, one per line. Empty lines
+ * are ignored.
+ */
+
+{
+    FILE *f;
+    char line[1024];
+
+    f = fopen(fname, "r");
+    if (!f)
+        fatal("Can't open script '%s': %s\n", fname, strerror(errno));
+
+    while (fgets(line, sizeof(line), f))
+    {
+        size_t len = strcspn(line, "\r\n");
+
+        if (!len)
+            continue;
+
+        script = realloc(script, (script_lines + 1) * sizeof(*script));
+        if (!script || !(script[script_lines] = malloc(len + 2)))
+            fatal("Out of memory.\n");
+
+        memcpy(script[script_lines], line, len);
+        strcpy(script[script_lines] + len, "\n");
+        script_lines++;
+    }
+
+    fclose(f);
+
+    if (!script_lines)
+        fatal("Script '%s' is empty.\n", fname);
+} /* read_script() */
+
+/*-------------------------------------------------------------------------*/
+static void
+close_conn (conn_t *c, const char *reason)
+
+/* Close the connection <c>, <reason> is printed in verbose mode.
+ */
+
+{
+    if (c->fd < 0)
+        return;
+
+    if (verbose && reason)
+        fprintf(stderr, "loadgen: Connection %d closed: %s\n"
+                      , (int)(c - conns), reason);
+
+    close(c->fd);
+    c->fd = -1;
+    pollfds[c - conns].fd = -1;
+
+    if (c->connected)
+        stat_closed++;
+    else
+        stat_failed++;
+    c->connected = false;
+
+#ifdef USE_MCCP
+    if (c->compressing)
+        inflateEnd(&c->zs);
+    c->compressing = false;
+#endif
+} /* close_conn() */
+
+/*-------------------------------------------------------------------------*/
+static bool
+send_data (conn_t *c, const void *data, size_t len)
+
+/* Send <len> bytes of <data> over <c>. As we send only small amounts,
+ * a partial write is treated as an overload and closes the connection.
+ * Return false if the connection was closed.
+ */
+
+{
+    ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL);
+
+    if (n != (ssize_t)len)
+    {
+        close_conn(c, n < 0 ? strerror(errno) : "Send buffer full");
+        return false;
+    }
+
+    stat_bytes_out += len;
+    return true;
+} /* send_data() */
+
+/*-------------------------------------------------------------------------*/
+static void
+open_conn (conn_t *c, const struct sockaddr_in *addr)
+
+/* Start a non-blocking connect for <c> to <addr>.
+ */
+
+{
+    int one = 1;
+
+    memset(c, 0, sizeof(*c));
+    c->line_start = true;
+    c->script_pos = rand() % script_lines;
+
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0)
+    {
+        if (verbose)
+            fprintf(stderr, "loadgen: socket(): %s\n", strerror(errno));
+        stat_failed++;
+        return;
+    }
+
+    fcntl(c->fd, F_SETFL, O_NONBLOCK);
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(c->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0
+     && errno != EINPROGRESS)
+    {
+        close_conn(c, strerror(errno));
+        return;
+    }
+
+    pollfds[c - conns].fd = c->fd;
+    pollfds[c - conns].events = POLLOUT;
+} /* open_conn() */
+
+/*-------------------------------------------------------------------------*/
+static void
+check_connect (conn_t *c, uint64_t now)
+
+/* The connect of <c> finished, check its result.
+ */
+
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err)
+    {
+        close_conn(c, strerror(err));
+        return;
+    }
+
+    c->connected = true;
+    stat_connected++;
+
+    /* Spread the commands of all connections evenly. */
+    c->next_send = now + (uint64_t)(1000000.0 / rate * (rand() / (RAND_MAX + 1.0)));
+
+    pollfds[c - conns].events = POLLIN;
+} /* check_connect() */
+
+/*-------------------------------------------------------------------------*/
+static void
+handle_option (conn_t *c, unsigned char cmd, unsigned char opt)
+
+/* Answer the negotiation IAC <cmd> <opt>: everything is refused, only
+ * MCCP is accepted if enabled. Refusals are not answered to avoid loops.
+ */
+
+{
+    unsigned char reply[3] = { IAC, 0, opt };
+
+    switch (cmd)
+    {
+    case WILL:
+        reply[1] = (opt == TELOPT_COMPRESS2 && use_mccp) ? DO : DONT;
+        break;
+
+    case DO:
+        reply[1] = WONT;
+        break;
+
+    default:
+        return;
+    }
+
+    send_data(c, reply, sizeof(reply));
+} /* handle_option() */
+
+/*-------------------------------------------------------------------------*/
+static void
+handle_char (conn_t *c, unsigned char ch, uint64_t now)
+
+/* Process the data character <ch> received on <c>: look for the prompt
+ * at the beginning of a line.
+ */
+
+{
+    if (ch == '\n' || ch == '\r')
+    {
+        c->line_start = true;
+        c->prompt_matched = 0;
+        return;
+    }
+
+    if (c->line_start && ch == (unsigned char)prompt[c->prompt_matched])
+    {
+        if (++c->prompt_matched < prompt_len)
+            return;
+
+        /* We've got a prompt. */
+        if (c->pending_count)
+        {
+            add_latency(now - c->pending[c->pending_first]);
+            c->pending_first = (c->pending_first + 1) % MAX_PENDING;
+            c->pending_count--;
+            stat_responses++;
+        }
+    }
+
+    c->line_start = false;
+    c->prompt_matched = 0;
+} /* handle_char() */
+
+/*-------------------------------------------------------------------------*/
+static size_t
+handle_telnet (conn_t *c, const unsigned char *buf, size_t len, uint64_t now)
+
+/* Run the telnet machine of <c> over the <len> bytes in <buf>.
+ * Return the number of bytes processed: if compression starts in the
+ * middle of <buf>, this is the length of the uncompressed part.
+ */
+
+{
+    size_t i;
+
+    for (i = 0; i < len && c->fd >= 0; i++)
+    {
+        unsigned char ch = buf[i];
+
+        switch (c->tn_state)
+        {
+        case TS_DATA:
+            if (ch == IAC)
+                c->tn_state = TS_IAC;
+            else
+                handle_char(c, ch, now);
+            break;
+
+        case TS_IAC:
+            switch (ch)
+            {
+            case IAC:  handle_char(c, ch, now); c->tn_state = TS_DATA; break;
+            case WILL: c->tn_state = TS_WILL; break;
+            case WONT: c->tn_state = TS_WONT; break;
+            case DO:   c->tn_state = TS_DO; break;
+            case DONT: c->tn_state = TS_DONT; break;
+            case SB:   c->tn_state = TS_SB; c->sb_len = 0; break;
+            default:   c->tn_state = TS_DATA; break;
+            }
+            break;
+
+        case TS_WILL:
+            handle_option(c, WILL, ch);
+            c->tn_state = TS_DATA;
+            break;
+
+        case TS_DO:
+            handle_option(c, DO, ch);
+            c->tn_state = TS_DATA;
+            break;
+
+        case TS_WONT:
+        case TS_DONT:
+            c->tn_state = TS_DATA;
+            break;
+
+        case TS_SB:
+            if (ch == IAC)
+                c->tn_state = TS_SB_IAC;
+            else if (!c->sb_len++)
+                c->sb_opt = ch;
+            break;
+
+        case TS_SB_IAC:
+            if (ch != SE)
+            {
+                c->tn_state = TS_SB;
+                break;
+            }
+
+            c->tn_state = TS_DATA;
+            if (c->sb_opt == TELOPT_COMPRESS2 && c->sb_len == 1)
+            {
+#ifdef USE_MCCP
+                /* Everything after this is compressed. */
+                memset(&c->zs, 0, sizeof(c->zs));
+                if (inflateInit(&c->zs) != Z_OK)
+                {
+                    close_conn(c, "inflateInit() failed");
+                    return len;
+                }
+                c->compressing = true;
+                stat_mccp++;
+                return i + 1;
+#else
+                close_conn(c, "MCCP is not supported");
+                return len;
+#endif
+            }
+            break;
+        }
+    }
+
+    return len;
+} /* handle_telnet() */
+
+/*-------------------------------------------------------------------------*/
+static void
+handle_input (conn_t *c, uint64_t now)
+
+/* Read data from <c> and process it.
+ */
+
+{
+    unsigned char buf[BUFFER_SIZE];
+    ssize_t n;
+    size_t pos = 0;
+
+    n = recv(c->fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+    {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        close_conn(c, n < 0 ? strerror(errno) : "Closed by the server");
+        return;
+    }
+
+    stat_bytes_in += n;
+
+    while (pos < (size_t)n && c->fd >= 0)
+    {
+#ifdef USE_MCCP
+        if (c->compressing)
+        {
+            unsigned char out[BUFFER_SIZE];
+            int rc;
+
+            c->zs.next_in = buf + pos;
+            c->zs.avail_in = n - pos;
+
+            do
+            {
+                c->zs.next_out = out;
+                c->zs.avail_out = sizeof(out);
+                rc = inflate(&c->zs, Z_SYNC_FLUSH);
+
+                if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+                {
+                    close_conn(c, "Corrupt compressed data");
+                    return;
+                }
+
+                stat_bytes_data += sizeof(out) - c->zs.avail_out;
+                handle_telnet(c, out, sizeof(out) - c->zs.avail_out, now);
+            } while (rc == Z_OK && c->zs.avail_out == 0 && c->fd >= 0);
+
+            pos = n - c->zs.avail_in;
+
+            if (rc == Z_STREAM_END)
+            {
+                /* The server ended the compression, the rest is plain. */
+                inflateEnd(&c->zs);
+                c->compressing = false;
+                continue;
+            }
+            break;
+        }
+#endif
+        {
+            size_t done = handle_telnet(c, buf + pos, n - pos, now);
+
+            stat_bytes_data += done;
+            pos += done;
+        }
+    }
+} /* handle_input() */
+
+/*-------------------------------------------------------------------------*/
+static void
+send_command (conn_t *c, uint64_t now)
+
+/* Send the next command of the script over <c>.
+ */
+
+{
+    const char *cmd = script[c->script_pos];
+
+    c->next_send += (uint64_t)(1000000.0 / rate);
+    if (c->next_send < now)
+        c->next_send = now; /* Don't try to catch up after a stall. */
+
+    if (c->pending_count == MAX_PENDING)
+        return;
+
+    if (!send_data(c, cmd, strlen(cmd)))
+        return;
+
+    c->pending[(c->pending_first + c->pending_count) % MAX_PENDING] = now;
+    c->pending_count++;
+    c->script_pos = (c->script_pos + 1) % script_lines;
+    stat_sent++;
+} /* send_command() */
+
+/*-------------------------------------------------------------------------*/
+static void
+print_stats (double seconds)
+
+/* Print the statistics of a run over <seconds>.
+ */
+
+{
+    printf("Connections: %ld established, %ld failed, %ld closed by the server\n"
+          , stat_connected, stat_failed, stat_closed);
+    if (use_mccp)
+        printf("MCCP:        %ld connections compressed\n", stat_mccp);
+    printf("Commands:    %ld sent, %ld answered (%.1f/s)\n"
+          , stat_sent, stat_responses, stat_responses / seconds);
+    printf("Traffic:     %llu bytes out, %llu bytes in, %llu bytes after inflating\n"
+          , (unsigned long long)stat_bytes_out
+          , (unsigned long long)stat_bytes_in
+          , (unsigned long long)stat_bytes_data);
+
+    if (num_latencies)
+    {
+        static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+        uint64_t sum = 0;
+
+        qsort(latencies, num_latencies, sizeof(*latencies), cmp_latency);
+        for (size_t i = 0; i < num_latencies; i++)
+            sum += latencies[i];
+
+        printf("Latency:     avg %.3f ms", sum / 1000.0 / num_latencies);
+        for (size_t i = 0; i < sizeof(percentiles)/sizeof(*percentiles); i++)
+        {
+            size_t ix = (size_t)(percentiles[i] / 100.0 * num_latencies);
+
+            if (ix >= num_latencies)
+                ix = num_latencies - 1;
+            printf(", p%g %.3f ms", percentiles[i], latencies[ix] / 1000.0);
+        }
+        printf(", max %.3f ms\n", latencies[num_latencies-1] / 1000.0);
+    }
+} /* print_stats() */
+
+/*-------------------------------------------------------------------------*/
+static void
+on_signal (int sig)
+
+/* SIGINT handler: stop the run and print the statistics.
+ */
+
+{
+    interrupted = sig;
+} /* on_signal() */
+
+/*-------------------------------------------------------------------------*/
+static void
+usage (void)
+
+{
+    fprintf(stderr,
+"Usage: loadgen [options] <port>\n"
+"\n"
+"Opens many telnet connections to the driver on <port> and sends commands\n"
+"on them at a fixed rate, measuring the time until each prompt arrives.\n"
+"\n"
+"Options:\n"
+"  -H <host>    Address of the driver (default: 127.0.0.1).\n"
+"  -c <num>     Number of connections (default: 100).\n"
+"  -C <num>     New connections per second (default: 500).\n"
+"  -r <rate>    Commands per second per connection (default: 1).\n"
+"  -t <secs>    Duration of the run after all connects (default: 10).\n"
+"  -s <file>    Script with commands to send, one per line\n"
+"               (default: a single 'echo' command).\n"
+"  -p <prompt>  Prompt that ends a response (default: '> ').\n"
+"  -m           Accept MCCP v2 compression.\n"
+"  -v           Report failed and closed connections.\n"
+    );
+    exit(1);
+} /* usage() */
+
+/*-------------------------------------------------------------------------*/
+int
+main (int argc, char **argv)
+
+{
+    struct sockaddr_in addr;
+    uint64_t start, connect_start, end, now;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "H:c:C:r:t:s:p:mv")) != -1)
+    {
+        switch (opt)
+        {
+        case 'H': host = optarg; break;
+        case 'c': num_conns = atoi(optarg); break;
+        case 'C': connect_rate = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 't': duration = atoi(optarg); break;
+        case 's': read_script(optarg); break;
+        case 'p': prompt = optarg; break;
+        case 'm': use_mccp = true; break;
+        case 'v': verbose = true; break;
+        default:  usage();
+        }
+    }
+
+    if (optind != argc - 1)
+        usage();
+    port = atoi(argv[optind]);
+
+    if (port <= 0 || num_conns <= 0 || connect_rate <= 0 || rate <= 0
+     || duration <= 0 || !*prompt)
+        usage();
+
+#ifndef USE_MCCP
+    if (use_mccp)
+        fatal("The load generator was compiled without MCCP support.\n");
+#endif
+
+    if (!script_lines)
+    {
+        static char *default_script[] = { "echo The quick brown fox jumps over the lazy dog.\n" };
+
+        script = default_script;
+        script_lines = 1;
+    }
+
+    prompt_len = strlen(prompt);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+        fatal("Invalid address '%s'.\n", host);
+
+    conns = calloc(num_conns, sizeof(*conns));
+    pollfds = calloc(num_conns, sizeof(*pollfds));
+    if (!conns || !pollfds)
+        fatal("Out of memory.\n");
+    for (int i = 0; i < num_conns; i++)
+    {
+        conns[i].fd = -1;
+        pollfds[i].fd = -1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(NULL));
+
+    connect_start = get_time();
+    start = 0;
+    end = 0;
+
+    while (!interrupted)
+    {
+        int timeout = 100, rc;
+
+        now = get_time();
+
+        /* Open new connections according to the connect rate. */
+        while (num_opened < num_conns
+            && (uint64_t)num_opened * 1000000 / connect_rate <= now - connect_start)
+        {
+            open_conn(conns + num_opened, &addr);
+            num_opened++;
+        }
+
+        /* The measurement starts once all connections are established. */
+        if (!start && num_opened == num_conns
+         && stat_connected + stat_failed >= num_conns)
+        {
+            start = now;
+            end = start + (uint64_t)duration * 1000000;
+            num_latencies = 0;
+            stat_sent = stat_responses = 0;
+            stat_bytes_out = stat_bytes_in = stat_bytes_data = 0;
+            printf("%ld connections established in %.2f s, starting measurement.\n"
+                  , stat_connected, (now - connect_start) / 1000000.0);
+            fflush(stdout);
+        }
+
+        if (end && now >= end)
+            break;
+
+        /* Send the commands that are due. */
+        for (int i = 0; i < num_opened; i++)
+        {
+            conn_t *c = conns + i;
+
+            if (!c->connected)
+                continue;
+
+            if (c->next_send <= now)
+                send_command(c, now);
+
+            if (c->connected && c->next_send > now
+             && (c->next_send - now) / 1000 < (uint64_t)timeout)
+                timeout = (int)((c->next_send - now) / 1000);
+        }
+
+        if (num_opened < num_conns)
+            timeout = 1;
+
+        rc = poll(pollfds, num_opened, timeout);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fatal("poll(): %s\n", strerror(errno));
+        }
+
+        now = get_time();
+        for (int i = 0; i < num_opened && rc > 0; i++)
+        {
+            conn_t *c = conns + i;
+
+            if (c->fd < 0 || !pollfds[i].revents)
+                continue;
+            rc--;
+
+            if (!c->connected)
+                check_connect(c, now);
+            else if (pollfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                handle_input(c, now);
+        }
+
+        if (!stat_connected && stat_failed >= num_conns)
+            fatal("No connection could be established.\n");
+    }
+
+    now = get_time();
+    if (!start)
+        start = now;
+    print_stats((now - start) / 1000000.0 > 0 ? (now - start) / 1000000.0 : 1.0);
+
+    for (int i = 0; i < num_opened; i++)
+        close_conn(conns + i, NULL);
+
+    return 0;
+} /* main() */
+
+/***************************************************************************/
@@ -0,0 +1,86 @@
+#! /bin/sh
+
+if [ ! -x ${DRIVER:=../src/ldmud} ]
+then
+    echo "Did not find the driver."
+    echo "Please specify via DRIVER environment variable."
+    exit 1
+fi
+
+OUTPUT=
+REPETITIONS=5
+TIME=200
+
+# Like the defaults of run.sh, but without the costly consistency checks.
+DRIVER_DEFAULTS="-u-1 -E 0 --no-compat -e -N --cleanup-time -1 --reset-time -1
+    --max-array 0 --max-callouts 0 --max-bytes 0 --max-file 0 -s-1
+    -sv-1 --hard-malloc-limit unlimited --min-malloc 0 -ru0 -rm0 -rs0
+    --no-strict-euids --alarm-time 1 --heart-interval 1
+    --no-wizlist-file --access-file none --access-log none -f bench"
+
+while [ $# -gt 0 ]
+do
+    case "$1" in
+        -h | --help)
+            echo "Usage: $0 [-h] [-o FILE] [-r REPS] [-t MS] [WORKLOAD ...]"
+            echo ""
+            echo "Run the LPC benchmarks of the LDMud driver."
+            echo ""
+            echo "Optional arguments:"
+            echo "  -h, --help      Show this help message and exit."
+            echo "  -o FILE         Write the JSON results to FILE (default: stdout)."
+            echo "  -r REPS         Number of measurements per workload (default: 5)."
+            echo "  -t MS           Target duration of a measurement in ms (default: 200)."
+            echo ""
+            echo "Positional arguments:"
+            echo "  WORKLOAD        Workload to run, the name of bench/b-WORKLOAD.c"
+            echo "                  (If none is given all workloads are executed.)"
+            exit
+            ;;
+
+        -o)
+            OUTPUT="$2"
+            shift 2
+            continue
+            ;;
+
+        -r)
+            REPETITIONS="$2"
+            shift 2
+            continue
+            ;;
+
+        -t)
+            TIME="$2"
+            shift 2
+            continue
+            ;;
+    esac
+
+    break
+done
+
+mkdir -p log
+rm -f bench/results.json
+
+${DRIVER} ${DRIVER_DEFAULTS} -Mmaster -mbench \
+    -DBENCH_REPETITIONS=${REPETITIONS} -DBENCH_TIME=${TIME} \
+    ${@:+"-DBENCH_WORKLOADS=\"$*\""} 65400 \
+    --debug-file ../log/result.bench.log >&2 \
+    || { echo "Benchmarks FAILED." >&2; RESULT=1; }
+
+if [ ! -e bench/results.json ]
+then
+    echo "No results were written." >&2
+    exit 1
+fi
+
+if [ -n "${OUTPUT}" ]
+then
+    mv bench/results.json "${OUTPUT}"
+else
+    cat bench/results.json
+    rm bench/results.json
+fi
+
+exit ${RESULT:-0}
@@ -0,0 +1,25 @@
+/* call_other() heavy code: calls into another object, calls to
+ * this_object() and calls with the arrow operator by name.
+ */
+
+object other;
+
+int add(int a, int b)
+{
+    return a + b;
+}
+
+void run(int iterations)
+{
+    int sum;
+
+    if (!other)
+        other = clone_object(this_object());
+
+    for (int i = 0; i < iterations; i++)
+    {
+        sum = other->add(sum, i);
+        sum = call_other(this_object(), "add", sum, 1);
+        sum = other.add(sum, -1);
+    }
+}
@@ -0,0 +1,28 @@
+/* call_out() scheduling: schedules a batch of call_outs and measures
+ * the time until the last one was executed.
+ */
+
+#include "/bench.inc"
+
+#define NUM_CALL_OUTS 10000
+
+int remaining, start;
+closure done;
+
+void tick()
+{
+    if (--remaining)
+        return;
+
+    funcall(done, NUM_CALL_OUTS, utime_us() - start);
+}
+
+void run_async(closure cb)
+{
+    done = cb;
+    remaining = NUM_CALL_OUTS;
+    start = utime_us();
+
+    for (int i = 0; i < NUM_CALL_OUTS; i++)
+        call_out(#'tick, 0);
+}
@@ -0,0 +1,53 @@
+/* Command parsing: a living in a room with many items defining
+ * actions executes commands.
+ */
+
+#include "/sys/configuration.h"
+
+#define NUM_ITEMS 50
+#define NUM_VERBS 10
+
+object room, player;
+
+void do_nothing(string arg)
+{
+}
+
+int action(string arg)
+{
+    return 1;
+}
+
+/* Called in the items. */
+void init()
+{
+    if (!clonep() || !environment())
+        return;
+
+    for (int i = 0; i < NUM_VERBS; i++)
+        add_action("action", "verb" + i);
+}
+
+/* Called in the player. */
+void setup_player()
+{
+    configure_object(this_object(), OC_COMMANDS_ENABLED, 1);
+}
+
+void run(int iterations)
+{
+    if (!player)
+    {
+        room = clone_object(this_object());
+        player = clone_object(this_object());
+        player->setup_player();
+
+        for (int i = 0; i < NUM_ITEMS; i++)
+            move_object(clone_object(this_object()), room);
+        move_object(player, room);
+    }
+
+    for (int i = 0; i < iterations; i++)
+        if (!command("verb" + (i % NUM_VERBS) + " something", player))
+            raise_error("Command failed.\n");
+}
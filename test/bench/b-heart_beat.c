@@ -0,0 +1,81 @@
+/* Heart beats: runs a few backend cycles with many objects having
+ * a heart beat and measures the time spent in the heart beat phase.
+ */
+
+#include "/sys/configuration.h"
+#include "/sys/driver_info.h"
+
+#define NUM_OBJECTS 100000
+#define NUM_CYCLES  2
+
+object *clones;
+int hb_count;
+int start_cycles, start_sum;
+closure done;
+
+int query_count();
+
+void heart_beat()
+{
+    if (!clonep())
+        return;
+
+    hb_count++;
+}
+
+void finish()
+{
+    int *latency = driver_info(DI_LATENCY_HEART_BEAT);
+    int cycles = driver_info(DI_NUM_HEARTBEAT_TOTAL_CYCLES) - start_cycles;
+    int count;
+
+    if (cycles < NUM_CYCLES)
+    {
+        call_out(#'finish, 1);
+        return;
+    }
+
+    count = query_count();
+
+    foreach (object ob : clones)
+        destruct(ob);
+    clones = 0;
+
+    funcall(done, count, latency[DIL_SUM] - start_sum);
+}
+
+int query_count()
+{
+    int result = 0;
+
+    foreach (object ob : clones)
+        result += ob->query_hb_count();
+
+    return result;
+}
+
+int query_hb_count()
+{
+    return hb_count;
+}
+
+void run_async(closure cb)
+{
+    done = cb;
+
+    clones = allocate(NUM_OBJECTS);
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        clones[i] = clone_object(this_object());
+        clones[i]->start();
+    }
+
+    start_cycles = driver_info(DI_NUM_HEARTBEAT_TOTAL_CYCLES);
+    start_sum = driver_info(DI_LATENCY_HEART_BEAT)[DIL_SUM];
+    call_out(#'finish, 1);
+}
+
+void start()
+{
+    configure_object(this_object(), OC_HEART_BEAT, 1);
+}
@@ -0,0 +1,30 @@
+/* Mapping and array churn: building, updating and shrinking
+ * mappings, and adding and subtracting arrays.
+ */
+
+#define SIZE 32
+
+void run(int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        mapping m = ([]);
+        int *a = ({});
+
+        for (int j = 0; j < SIZE; j++)
+        {
+            m[j] = j;
+            m["key" + j] = ({ j });
+            a += ({ j });
+        }
+
+        foreach (mixed key, mixed value : m)
+            if (intp(value))
+                m[key] = value + 1;
+
+        m -= ([ 0, 1, 2 ]);
+        a -= ({ 3, 5, 7 });
+        a = m_indices(m) & a;
+        m = filter(m, (: intp($1) :));
+    }
+}
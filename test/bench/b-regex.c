@@ -0,0 +1,20 @@
+/* Regular expressions: matching, replacing and exploding. */
+
+string *lines = ({
+    "The quick brown fox jumps over the lazy dog.",
+    "get sword from chest",
+    "tell bob Hello there, how are you?",
+    "2024-05-10 12:34:56 connection from 127.0.0.1",
+});
+
+void run(int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        regexp(lines, "^(get|take) ");
+        regreplace(lines[0], "o", "0", 1);
+        regreplace(lines[3], "([0-9]+)\\.([0-9]+)", "\\2.\\1", 1);
+        regexplode(lines[2], " +");
+        regmatch(lines[3], "[0-9]+:[0-9]+:[0-9]+");
+    }
+}
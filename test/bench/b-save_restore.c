@@ -0,0 +1,31 @@
+/* Saving and restoring of values and object variables. */
+
+mapping inventory;
+mixed *history;
+string name;
+int level;
+
+void create()
+{
+    name = "benchmark";
+    level = 42;
+    history = map(allocate(50, 0), (: ({ $2, "event " + $2, $2 * 1.5 }) :), 0);
+    inventory = ([]);
+    for (int i = 0; i < 50; i++)
+        inventory["item" + i] = ([ "weight": i, "value": i * 10, "tags": ({ "a", "b" }) ]);
+}
+
+void run(int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        string saved = save_value(inventory);
+        string object_data;
+
+        if (sizeof(restore_value(saved)) != sizeof(inventory))
+            raise_error("Restored wrong value.\n");
+
+        object_data = save_object();
+        restore_object(object_data);
+    }
+}
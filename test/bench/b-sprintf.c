@@ -0,0 +1,15 @@
+/* sprintf() with typical formats of a mudlib. */
+
+mixed *data = ({ 42, "text", 3.1415, ({ 1, 2, 3 }), ([ "a": 1 ]) });
+
+void run(int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        sprintf("%d %s %5.2f", i, "abc", 1.5);
+        sprintf("%-20s|%20s|%|20s", "left", "right", "center");
+        sprintf("%O", data);
+        sprintf("%=-40s", "A longer text that will be wrapped into a column of forty characters.");
+        sprintf("%-#60s", "one\ntwo\nthree\nfour\nfive\nsix\nseven\neight");
+    }
+}
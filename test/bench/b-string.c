@@ -0,0 +1,20 @@
+/* String building: concatenation, implode() and explode(),
+ * and string ranges.
+ */
+
+void run(int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        string s = "";
+        string *words;
+
+        for (int j = 0; j < 20; j++)
+            s += "word" + j + " ";
+
+        words = explode(s, " ");
+        s = implode(words, ",");
+        s = upper_case(s[5..<5]) + lower_case(s[0..4]);
+        s = sprintf("%s%s", s, s);
+    }
+}
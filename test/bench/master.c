@@ -0,0 +1,221 @@
+/* Master of the LPC benchmark suite.
+ *
+ * Runs the workloads b-*.c in this directory (or those listed in
+ * BENCH_WORKLOADS) one after another and writes the results as JSON
+ * into /results.json. It is started by ../bench.sh, which also sets
+ * the parameters below with -D.
+ *
+ * A workload either defines
+ *
+ *     void run(int iterations)
+ *
+ * which shall do <iterations> operations synchronously, or
+ *
+ *     void run_async(closure done)
+ *
+ * which starts a workload spanning several backend cycles and calls
+ * funcall(done, <operations>, <microseconds>) when it is finished.
+ */
+
+#include "/inc/base.inc"
+#include "/bench.inc"
+
+#include "/sys/driver_hook.h"
+#include "/sys/driver_info.h"
+#include "/sys/rtlimits.h"
+
+#ifndef BENCH_WORKLOADS
+#define BENCH_WORKLOADS 0     /* Space separated names, 0 for all */
+#endif
+
+#ifndef BENCH_REPETITIONS
+#define BENCH_REPETITIONS 5   /* Number of measurements per workload */
+#endif
+
+#ifndef BENCH_TIME
+#define BENCH_TIME 200        /* Target milliseconds per measurement */
+#endif
+
+#define RESULT_FILE "/results.json"
+
+string *workloads;      /* Names of the workloads still to run */
+string *results = ({}); /* The JSON objects of the finished workloads */
+int failed;
+
+/* Measure one synchronous run of <ob> with <iterations> operations,
+ * return ({ microseconds, eval ticks }).
+ */
+int *measure(object ob, int iterations)
+{
+    return limited(function int*()
+    {
+        int ticks = get_eval_cost();
+        int start = utime_us();
+
+        ob->run(iterations);
+
+        return ({ utime_us() - start, ticks - get_eval_cost() });
+    }, ({ LIMIT_UNLIMITED }));
+}
+
+/* Add the JSON result for <name>. <ops_per_sec> are the results of all
+ * repetitions, <ticks_per_op> is -1 if unknown.
+ */
+void add_result(string name, int iterations, float *ops_per_sec, float ticks_per_op)
+{
+    float *sorted = sort_array(ops_per_sec, #'>);
+    int *ru = rusage();
+
+    results += ({ sprintf(
+        "    {\"name\": \"%s\", \"iterations\": %d, \"repetitions\": %d, "
+        "\"ops_per_sec\": %.1f, \"ops_per_sec_min\": %.1f, \"ops_per_sec_max\": %.1f, "
+        "\"ticks_per_op\": %s, \"memory_used\": %d, \"max_rss_kb\": %d}",
+        name, iterations, sizeof(sorted),
+        sorted[sizeof(sorted)/2], sorted[0], sorted[<1],
+        ticks_per_op < 0 ? "null" : sprintf("%.2f", ticks_per_op),
+        driver_info(DI_SIZE_MEMORY_USED), ru[2]) });
+
+    msg("%-16s %12.1f ops/sec\n", name, sorted[sizeof(sorted)/2]);
+}
+
+void add_error(string name, string err)
+{
+    failed = 1;
+    results += ({ sprintf("    {\"name\": \"%s\", \"error\": %Q}", name, err[0..<2]) });
+    msg("%-16s FAILED: %s", name, err);
+}
+
+void finish()
+{
+    write_file(RESULT_FILE, sprintf(
+        "{\n  \"driver\": \"%s\",\n  \"repetitions\": %d,\n  \"target_ms\": %d,\n"
+        "  \"benchmarks\": [\n%s\n  ]\n}\n",
+        __VERSION__, BENCH_REPETITIONS, BENCH_TIME,
+        implode(results, ",\n")), 1);
+
+    shutdown(failed);
+}
+
+void run_sync(string name, object ob)
+{
+    int iterations = 1, *m;
+    float *ops_per_sec = ({});
+    int ticks;
+
+    /* Find the number of iterations for the target time. */
+    while ((m = measure(ob, iterations))[0] < BENCH_TIME * 100)
+        iterations *= 2;
+    iterations = max(1, to_int(iterations * (BENCH_TIME * 1000.0) / max(1, m[0])));
+
+    for (int i = 0; i < BENCH_REPETITIONS; i++)
+    {
+        m = measure(ob, iterations);
+        ops_per_sec += ({ iterations * 1000000.0 / max(1, m[0]) });
+        ticks = m[1];
+    }
+
+    add_result(name, iterations, ops_per_sec, to_float(ticks) / iterations);
+}
+
+void next_workload();
+
+/* Start the next measurement of an asynchronous workload, <ops> and <us>
+ * are the results of the last one (<ops> is -1 at the start).
+ */
+void run_async(string name, object ob, float *ops_per_sec, int ops, int us)
+{
+    if (ops >= 0)
+        ops_per_sec += ({ ops * 1000000.0 / max(1, us) });
+
+    if (sizeof(ops_per_sec) == BENCH_REPETITIONS)
+    {
+        add_result(name, ops, ops_per_sec, -1.0);
+        call_out(#'next_workload, 0);
+        return;
+    }
+
+    if (catch(ob->run_async(
+            function void(int o, int u) { run_async(name, ob, ops_per_sec, o, u); })))
+    {
+        add_error(name, "Error in run_async().\n");
+        call_out(#'next_workload, 0);
+    }
+}
+
+void next_workload()
+{
+    string name, err;
+    object ob;
+
+    if (!sizeof(workloads))
+    {
+        finish();
+        return;
+    }
+
+    name = workloads[0];
+    workloads = workloads[1..];
+
+    if ((err = catch(ob = load_object("/b-" + name))))
+    {
+        add_error(name, err);
+        call_out(#'next_workload, 0);
+        return;
+    }
+
+    if (function_exists("run_async", ob))
+    {
+        run_async(name, ob, ({}), -1, 0);
+        return;
+    }
+
+    if ((err = catch(run_sync(name, ob))))
+        add_error(name, err);
+
+    call_out(#'next_workload, 0);
+}
+
+/* A minimal move_object() for the workloads: the moved object and the
+ * objects in the destination get each other's actions.
+ */
+void move_hook(object item, object dest)
+{
+    object pl = this_player();
+
+    efun::set_environment(item, dest);
+
+    foreach (object ob : all_inventory(dest) - ({ item }))
+    {
+        if (living(item))
+        {
+            efun::set_this_player(item);
+            ob->init();
+        }
+        if (living(ob))
+        {
+            efun::set_this_player(ob);
+            item->init();
+        }
+    }
+
+    if (pl)
+        efun::set_this_player(pl);
+}
+
+string *epilog(int eflag)
+{
+    set_driver_hook(H_MOVE_OBJECT0, unbound_lambda(({'item, 'dest}),
+        ({#'call_other, this_object(), "move_hook", 'item, 'dest})));
+
+    if (stringp(BENCH_WORKLOADS))
+        workloads = explode(BENCH_WORKLOADS, " ") - ({ "" });
+    else
+        workloads = map(sort_array(get_dir("/b-*.c"), #'>), (: $1[2..<3] :));
+
+    msg("\nRunning the LPC benchmarks:\n"
+          "---------------------------\n");
+
+    /* Wait until the backend is running. */
+    call_out(#'next_workload, 0);
+    return 0;
+}
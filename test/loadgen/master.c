@@ -0,0 +1,34 @@
+/* Master of the mudlib for the load generator (src/util/loadgen).
+ *
+ * Start the driver with this mudlib, for example from the test
+ * directory:
+ *
+ *     ../src/ldmud -Mmaster -mloadgen -u-1 -E 0 --no-compat -e -N \
+ *         --no-strict-euids --max-callouts 0 --max-array 0 \
+ *         --access-file none --access-log none 4242
+ *
+ * and then run the load generator against it:
+ *
+ *     ../src/util/loadgen/loadgen -c 1000 -r 2 -t 30 4242
+ *
+ * Each connection gets a clone of /player, which answers the commands
+ * of the generator.
+ *
+ * Note that the driver accepts only MAX_PLAYERS connections (see
+ * configure --with-max-players), all others are closed right away.
+ * As comm.c uses select(), the number of descriptors is also limited
+ * by FD_SETSIZE (usually 1024).
+ */
+
+#include "/inc/base.inc"
+
+object connect()
+{
+    return clone_object("/player");
+}
+
+string *epilog(int eflag)
+{
+    msg("Mudlib for the load generator is ready.\n");
+    return 0;
+}
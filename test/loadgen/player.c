@@ -0,0 +1,65 @@
+/* A player object for the load generator.
+ *
+ * It understands the following commands, every other input is
+ * answered with an error message:
+ *
+ *     echo <text>    Sends <text> back.
+ *     say <text>     Sends <text> to all other players.
+ *     spam <n>       Sends <n> lines of text back.
+ *     quit           Closes the connection.
+ *
+ * If the driver supports MCCP, the compression is offered
+ * to the client at login.
+ */
+
+#include "/sys/commands.h"
+#include "/sys/configuration.h"
+#include "/sys/telnet.h"
+
+int do_command(string arg)
+{
+    string verb = query_verb();
+
+    arg ||= "";
+
+    switch (verb)
+    {
+        case "echo":
+            write(arg + "\n");
+            break;
+
+        case "say":
+            foreach (object ob : users() - ({ this_object() }))
+                tell_object(ob, object_name() + " says: " + arg + "\n");
+            write("You say: " + arg + "\n");
+            break;
+
+        case "spam":
+            for (int i = to_int(arg); i > 0; i--)
+                write(sprintf("%4d: The quick brown fox jumps over the lazy dog.\n", i));
+            break;
+
+        case "quit":
+            destruct(this_object());
+            break;
+
+        default:
+            write("Unknown command '" + verb + "'.\n");
+            break;
+    }
+
+    return 1;
+}
+
+int logon(int flag)
+{
+    configure_object(this_object(), OC_COMMANDS_ENABLED, 1);
+    add_action("do_command", "", AA_SHORT);
+
+#ifdef __MCCP__
+    binary_message(({ IAC, WILL, TELOPT_COMPRESS2 }));
+#endif
+
+    write("Welcome, " + object_name() + ".\n");
+    return 1;
+}
@@ -26,13 +26,14 @@ while [ $# -gt 0 ]
 do
     case "$1" in
         -h | --help)
-            echo "Usage: $0 [-h] [-v] [TEST ...]"
+            echo "Usage: $0 [-h] [-v] [-j] [TEST ...]"
             echo ""
             echo "Run test cases for the LDMud driver."
             echo ""
             echo "Optional arguments:"
             echo "  -h, --help      Show this help message and exit."
             echo "  -v, --valgrind  Run the tests with Valgrind memcheck."
+            echo "  -j, --jit       Compile all functions to native code on their first call."
             echo ""
             echo "Positional arguments:"
             echo "  TEST            Test case to run, either a directory or a single .c file."
@@ -45,6 +46,12 @@ do
             shift
             continue
             ;;
+
+        -j | --jit)
+            DRIVER_DEFAULTS="$DRIVER_DEFAULTS --jit-threshold 0"
+            shift
+            continue
+            ;;
     esac
 
     break
@@ -0,0 +1,159 @@
+/* Test the prefetching of swapped objects.
+ *
+ * The swapped objects around an interactive user are announced to the
+ * operating system when the user is moved into their room, and again
+ * when input of the user arrives, before the command is executed.
+ *
+ * The items are swapped out by the backend after a short swap time.
+ * This is run by t-swap-prefetch.sh without --check-refcounts, which
+ * would swap in all objects in every backend cycle.
+ */
+#include "/inc/base.inc"
+#include "/inc/client.inc"
+
+#include "/sys/configuration.h"
+#include "/sys/driver_hook.h"
+#include "/sys/driver_info.h"
+#include "/sys/object_info.h"
+
+#define OBJECT    "/dummy-swap-prefetch"
+#define ROOM      "/dummy-swap-prefetch-room"
+#define NUM_ITEMS 3
+
+object room, *items;
+int prefetches;
+
+void finish(int errors)
+{
+    for (int i = 0; i < NUM_ITEMS; i++)
+        rm(OBJECT + i + ".c");
+    rm(ROOM ".c");
+
+    shutdown(errors);
+}
+
+/* Return 1 if all items are swapped out completely. */
+int items_swapped()
+{
+    foreach (object item: items)
+        if (!object_info(item, OI_PROG_SWAPPED)
+         || !object_info(item, OI_VAR_SWAPPED))
+            return 0;
+
+    return 1;
+}
+
+/* This is the MUD object */
+void receive_line(string str)
+{
+    msg("Running Test prefetch on input...");
+    if (driver_info(DI_NUM_SWAP_PREFETCHES) < prefetches + 2 * NUM_ITEMS)
+    {
+        msg(" FAILURE! (No prefetch.)\n");
+        finish(1);
+        return;
+    }
+
+    msg(" Success.\n");
+    write("done\n");
+}
+
+void swapped()
+{
+    msg("Running Test prefetch on moving...");
+    prefetches = driver_info(DI_NUM_SWAP_PREFETCHES);
+    move_object(this_object(), room);
+    if (driver_info(DI_NUM_SWAP_PREFETCHES) < prefetches + 2 * NUM_ITEMS)
+    {
+        msg(" FAILURE! (No prefetch.)\n");
+        finish(1);
+        return;
+    }
+    msg(" Success.\n");
+
+    /* The prefetch doesn't swap them in. */
+    if (!items_swapped())
+    {
+        msg("Failed: Items were swapped in.\n");
+        finish(1);
+        return;
+    }
+
+    prefetches = driver_info(DI_NUM_SWAP_PREFETCHES);
+    input_to("receive_line");
+    write("ready\n");
+}
+
+/* Wait until the backend swapped out the items. */
+void wait_for_swap(int tries)
+{
+    if (items_swapped())
+        swapped();
+    else if (tries <= 0)
+    {
+        msg("Failed: The items were not swapped out.\n");
+        finish(1);
+    }
+    else
+        call_out(#'wait_for_swap, 1, tries - 1);
+}
+
+void run_server()
+{
+    set_driver_hook(H_MOVE_OBJECT0,
+        unbound_lambda(({'item, 'dest}), ({#'set_environment, 'item, 'dest})));
+
+    /* Programs are only swapped when no clones share them, so the
+     * room itself is never swapped: it has no variables.
+     */
+    write_file(ROOM ".c", "void create() {}\n", 1);
+    room = clone_object(ROOM);
+    items = allocate(NUM_ITEMS);
+    for (int i = 0; i < NUM_ITEMS; i++)
+    {
+        write_file(OBJECT + i + ".c", "int value = 1;\n", 1);
+        items[i] = load_object(OBJECT + i);
+        move_object(items[i], room);
+    }
+
+    configure_driver(DC_SWAP_TIME, 1);
+    configure_driver(DC_SWAP_VAR_TIME, 1);
+    wait_for_swap(10);
+}
+
+/* This is the object simulating a player. */
+void receive(string str)
+{
+    if (str == "ready")
+    {
+        write("look\n");
+        input_to("receive");
+    }
+    else if (str == "done")
+        finish(0);
+    else
+    {
+        msg("Failed: Received %Q.\n", str);
+        finish(1);
+    }
+}
+
+void run_client()
+{
+    call_out(#'shutdown, 30, 1); // If something goes wrong.
+    input_to("receive");
+}
+
+void run_test()
+{
+    msg("\nRunning test for the swap prefetch:\n"
+          "-----------------------------------\n");
+
+    connect_self("run_server", "run_client");
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
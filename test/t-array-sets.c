@@ -0,0 +1,163 @@
+/* Test the array set operations on large arrays.
+ *
+ * Arrays above a certain size are matched through a hash table, the
+ * results are compared with a straightforward implementation. Arrays
+ * with closures are still matched the old way, they are tested as well.
+ */
+#include "/inc/base.inc"
+#include "/inc/deep_eq.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#define SIZE 200
+
+mixed *left, *right;
+
+int fun() { return 1; }
+
+void remove() { destruct(this_object()); }
+
+/* Return an array of <num> values of different types, with duplicates.
+ * The strings are created at runtime, so equal strings are not
+ * necessarily the same string.
+ */
+mixed *values(int num, int offset)
+{
+    mixed *result = allocate(num);
+
+    for (int i = 0; i < num; i++)
+    {
+        int val = (i * 7 + offset) % (num / 2);
+
+        switch (i % 5)
+        {
+            case 0: result[i] = val; break;
+            case 1: result[i] = "s" + val; break;
+            case 2: result[i] = to_float(val) / 4; break;
+            case 3: result[i] = to_bytes(({ val % 256 })); break;
+            case 4: result[i] = (val & 1) ? this_object() : val; break;
+        }
+    }
+
+    return result;
+}
+
+mixed *naive_sub(mixed *a, mixed *b)
+{
+    return filter(a, (: member($2, $1) < 0 :), b);
+}
+
+mixed *naive_and(mixed *a, mixed *b)
+{
+    return filter(a, (: member($2, $1) >= 0 :), b);
+}
+
+/* Return the distinct elements of <a> in the order of their first occurrence. */
+mixed *distinct(mixed *a)
+{
+    mixed *result = ({});
+
+    foreach (mixed x: a)
+        if (member(result, x) < 0)
+            result += ({ x });
+
+    return result;
+}
+
+mixed *tests = ({
+    ({ "Subtraction", 0,
+        (: deep_eq(left - right, naive_sub(left, right)) :) }),
+    ({ "Intersection", 0,
+        (: deep_eq(left & right, naive_and(left, right)) :) }),
+    ({ "Union", 0,
+        (: deep_eq(left | right, left + naive_sub(right, left)) :) }),
+    ({ "Symmetric difference", 0,
+        (: deep_eq(left ^ right, naive_sub(left, right) + naive_sub(right, left)) :) }),
+    ({ "Small and large arrays", 0,
+        (:
+            mixed *small = ({ 3, "s4", 1.25, 1000 });
+
+            return deep_eq(left - small, naive_sub(left, small))
+                && deep_eq(small & left, naive_and(small, left))
+                && deep_eq(small - left, naive_sub(small, left));
+        :)
+    }),
+    ({ "Arrays with closures", 0,
+        (:
+            mixed *a = left + ({ #'fun, #'fun, (: 1 :) });
+            mixed *b = right + ({ #'fun });
+
+            return deep_eq(a - b, naive_sub(a, b))
+                && deep_eq(a & b, naive_and(a, b));
+        :)
+    }),
+    ({ "Assignment operators", 0,
+        (:
+            mixed *a = left;
+            mixed *b = left;
+
+            a -= right;
+            b &= right;
+            return deep_eq(a, naive_sub(left, right))
+                && deep_eq(b, naive_and(left, right));
+        :)
+    }),
+    ({ "unique_array", 0,
+        (:
+            object *obs = map(allocate(SIZE), (: clone_object(this_object()) :));
+            /* unique_array() doesn't group floats. */
+            mapping marker = mkmapping(obs,
+                map(values(SIZE, 3), (: floatp($1) ? to_int($1 * 4) : $1 :)));
+            mixed *groups = unique_array(obs, (: $2[$1] :), marker, 1);
+            mixed *keys = ({});
+            int num;
+
+            /* Each group shall contain exactly the objects with equal
+             * markers, except for the skipped ones.
+             */
+            foreach (object *group: groups)
+            {
+                mixed key = marker[group[0]];
+
+                if (key == 1 || member(keys, key) >= 0)
+                    return 0;
+                if (sizeof(group ^ filter(obs, (: $2[$1] == $3 :), marker, key)))
+                    return 0;
+
+                keys += ({ key });
+                num += sizeof(group);
+            }
+
+            num += sizeof(filter(obs, (: $2[$1] == 1 :), marker));
+            keys ^= naive_sub(distinct(m_values(marker)), ({ 1 }));
+            obs->remove();
+
+            return num == SIZE && !sizeof(keys);
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for array set operations:\n"
+          "--------------------------------------\n");
+
+    left = values(SIZE, 0);
+    right = values(SIZE, 11);
+
+    run_array(tests,
+        (:
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,106 @@
+/* Test the command burst budget of interactives.
+ *
+ * The client sends a block of lines at once, the server shall receive
+ * all of them in the right order, regardless of its burst setting.
+ * Up to the burst size of them shall be handled in the same cycle
+ * of the backend.
+ */
+#include "/inc/base.inc"
+#include "/inc/client.inc"
+
+#include "/sys/configuration.h"
+#include "/sys/driver_info.h"
+
+#define NUM_LINES 50
+#define BURST     4
+
+int received;
+mapping cycles = ([]); /* Input cycle -> number of lines received in it. */
+
+/* This is the MUD object */
+void receive_line(string str)
+{
+    if (str != to_string(received))
+    {
+        msg("Failed: Received %Q instead of line %d.\n", str, received);
+        shutdown(1);
+        return;
+    }
+
+    cycles[driver_info(DI_NUM_INPUT_CYCLES)]++;
+    received++;
+    if (received < NUM_LINES)
+        input_to("receive_line");
+    else if (max(m_values(cycles)) > BURST)
+    {
+        msg("Failed: More than %d lines in one cycle.\n", BURST);
+        shutdown(1);
+    }
+    else if (max(m_values(cycles)) < 2)
+    {
+        msg("Failed: Only one line per cycle.\n");
+        shutdown(1);
+    }
+    else
+        write("done\n");
+}
+
+void run_server()
+{
+    if (!catch(configure_interactive(this_object(), IC_MAX_COMMAND_BURST, 0); nolog))
+    {
+        msg("Failed: Burst size 0 was accepted.\n");
+        shutdown(1);
+        return;
+    }
+
+    configure_interactive(this_object(), IC_MAX_COMMAND_BURST, BURST);
+    if (interactive_info(this_object(), IC_MAX_COMMAND_BURST) != BURST)
+    {
+        msg("Failed: Burst size was not set.\n");
+        shutdown(1);
+        return;
+    }
+
+    input_to("receive_line");
+}
+
+/* This is the object simulating a player. */
+void receive(string str)
+{
+    if (str != "done")
+    {
+        msg("Failed: Received %Q.\n", str);
+        shutdown(1);
+        return;
+    }
+
+    msg("Success.\n");
+    shutdown(0);
+}
+
+void run_client()
+{
+    string lines = "";
+
+    for (int i = 0; i < NUM_LINES; i++)
+        lines += i + "\n";
+
+    write(lines);
+    call_out(#'shutdown, 10, 1); // If something goes wrong.
+    input_to("receive");
+}
+
+void run_test()
+{
+    msg("\nRunning test for the command burst:\n"
+          "-----------------------------------\n");
+
+    connect_self("run_server", "run_client");
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
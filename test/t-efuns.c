@@ -895,6 +895,44 @@ mixed *tests =
             return interactive_info(0, IC_ENCODING) == "ASCII";
         :)
     }),
+#ifdef __MCCP__
+    ({ "configure_interactive (MCCP parameters)", 0,
+       (:
+            int level = interactive_info(0, IC_MCCP_LEVEL);
+            int window_bits = interactive_info(0, IC_MCCP_WINDOW_BITS);
+            int mem_level = interactive_info(0, IC_MCCP_MEM_LEVEL);
+            int result;
+
+            configure_interactive(0, IC_MCCP_LEVEL, -1);
+            configure_interactive(0, IC_MCCP_WINDOW_BITS, 12);
+            configure_interactive(0, IC_MCCP_MEM_LEVEL, 5);
+
+            result = interactive_info(0, IC_MCCP_LEVEL) == -1
+                  && interactive_info(0, IC_MCCP_WINDOW_BITS) == 12
+                  && interactive_info(0, IC_MCCP_MEM_LEVEL) == 5;
+
+            /* Restore the defaults for new connections. */
+            configure_interactive(0, IC_MCCP_LEVEL, level);
+            configure_interactive(0, IC_MCCP_WINDOW_BITS, window_bits);
+            configure_interactive(0, IC_MCCP_MEM_LEVEL, mem_level);
+
+            return result
+                && interactive_info(0, IC_MCCP_LEVEL) == level
+                && interactive_info(0, IC_MCCP_WINDOW_BITS) == window_bits
+                && interactive_info(0, IC_MCCP_MEM_LEVEL) == mem_level;
+        :)
+    }),
+    ({ "configure_interactive (illegal MCCP level)", TF_ERROR,
+       (:
+            configure_interactive(0, IC_MCCP_LEVEL, 10);
+       :)
+    }),
+    ({ "configure_interactive (illegal MCCP window bits)", TF_ERROR,
+       (:
+            configure_interactive(0, IC_MCCP_WINDOW_BITS, 16);
+       :)
+    }),
+#endif
     ({ "get_type_info(int,0)", 0, (: get_type_info(10,              0) == T_NUMBER       :) }),
     ({ "get_type_info(str,0)", 0, (: get_type_info("10",            0) == T_STRING       :) }),
     ({ "get_type_info(str,1)", 0, (: get_type_info("10",            1) == 0              :) }), /* Shared string */
@@ -0,0 +1,263 @@
+/* Test foreach() over mappings.
+ *
+ * The loops walk the mappings in place, the tests modify the mappings
+ * while doing so. They are run twice: first with mappings that have
+ * only a hash part, and after a garbage collection, which compacts
+ * the base mapping, with mappings that have a condensed part as well.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#define SIZE 1000
+
+mapping base = ([:1]);
+
+/* Return a copy of the base mapping with another 100 entries,
+ * that will be in the hash part.
+ */
+mapping fresh()
+{
+    mapping m = copy(base);
+
+    for (int i = SIZE; i < SIZE + 100; i++)
+        m[i] = 2*i;
+
+    return m;
+}
+
+/* Return a coroutine, that will stop in the middle of a foreach(). */
+coroutine suspended_loop()
+{
+    coroutine cr = async function int()
+    {
+        mapping m = fresh();
+        int sum, num;
+
+        foreach (int key, int val: m)
+        {
+            if (num++ == 500)
+            {
+                yield(1);
+                m_delete(m, key + 1);
+            }
+            sum += val;
+        }
+
+        return (num == SIZE + 100 || num == SIZE + 99) && sum;
+    };
+
+    call_coroutine(cr);
+    return cr;
+}
+
+mixed *tests = ({
+    ({ "All entries", 0,
+        (:
+            mapping m = fresh();
+            mapping seen = ([:0]);
+            int sum;
+
+            foreach (int key, int val: m)
+            {
+                if (member(seen, key) || val != 2*key)
+                    return 0;
+                m_add(seen, key);
+                sum += key;
+            }
+
+            return sizeof(seen) == SIZE + 100
+                && sum == (SIZE + 100) * (SIZE + 99) / 2;
+        :)
+    }),
+    ({ "Deleting the current entry", 0,
+        (:
+            mapping m = fresh();
+            int num;
+
+            foreach (int key: m)
+            {
+                m_delete(m, key);
+                num++;
+            }
+
+            return num == SIZE + 100 && !sizeof(m);
+        :)
+    }),
+    ({ "Deleting the remaining entries", 0,
+        (:
+            mapping m = fresh();
+            int num;
+
+            foreach (int key: m)
+            {
+                num++;
+                foreach (int other: m_indices(m))
+                    if (other != key)
+                        m_delete(m, other);
+            }
+
+            return num == 1 && sizeof(m) == 1;
+        :)
+    }),
+    ({ "Deleting and adding entries", 0,
+        (:
+            mapping m = fresh();
+            int num;
+
+            foreach (int key: m)
+            {
+                if (key < 0)
+                    return 0;
+
+                m_delete(m, key ^ 1);
+                m[-key-1] = 1;
+                num++;
+            }
+
+            return num == (SIZE + 100) / 2 && sizeof(m) == SIZE + 100;
+        :)
+    }),
+    ({ "Adding entries", 0,
+        (:
+            mapping m = fresh();
+            int num;
+
+            foreach (int key: m)
+            {
+                if (key >= 10 * SIZE)
+                    return 0;
+                m[key + 10 * SIZE] = key;
+                num++;
+            }
+
+            return num == SIZE + 100 && sizeof(m) == 2 * (SIZE + 100);
+        :)
+    }),
+    ({ "Mapping without values", 0,
+        (:
+            mapping m = mkmapping(m_indices(fresh()));
+            int sum;
+
+            foreach (int key: m)
+                sum += key;
+
+            return sum == (SIZE + 100) * (SIZE + 99) / 2;
+        :)
+    }),
+    ({ "Mapping with several values", 0,
+        (:
+            mapping m = ([ "a": 1; 2; 3, "b": 4; 5; 6 ]);
+            string keys = "";
+            int sum;
+
+            foreach (string key, int a, int b: m)
+            {
+                keys += key;
+                sum += a * b;
+            }
+
+            return sizeof(keys) == 2 && sum == 2 + 20;
+        :)
+    }),
+    ({ "References to the values", 0,
+        (:
+            mapping m = fresh();
+
+            foreach (int key, int val: &m)
+                val = key;
+
+            foreach (int key, int val: m)
+                if (val != key)
+                    return 0;
+
+            return 1;
+        :)
+    }),
+    ({ "Break and errors", 0,
+        (:
+            mapping m = fresh();
+
+            foreach (int key: m)
+                break;
+
+            catch(funcall(function void()
+            {
+                foreach (int key: m)
+                    raise_error("Stop\n");
+            }); nolog);
+
+            /* The loops shall have released the mapping. */
+            foreach (int key: m)
+                m_delete(m, key);
+            m[0] = 1;
+
+            return sizeof(m) == 1;
+        :)
+    }),
+    ({ "Nested loops", 0,
+        (:
+            mapping m = ([ 1: 1, 2: 2, 3: 3 ]);
+            int num;
+
+            foreach (int a: m)
+                foreach (int b: m)
+                {
+                    m_delete(m, 4 - a);
+                    num++;
+                }
+
+            return num > 0 && num <= 9 && sizeof(m) < 3;
+        :)
+    }),
+    ({ "Suspending in a coroutine", 0,
+        (:
+            coroutine cr = suspended_loop();
+
+            return call_coroutine(cr) != 0;
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for foreach() over mappings:\n"
+          "----------------------------------------\n");
+
+    for (int i = 0; i < SIZE; i++)
+        base[i] = 2*i;
+
+    run_array(tests,
+        function int(int error)
+        {
+            if (error)
+            {
+                shutdown(1);
+                return 0;
+            }
+
+            start_gc(function void(int gc_error)
+            {
+                if (gc_error)
+                    shutdown(1);
+                else
+                    run_array(tests,
+                        (:
+                            if($1)
+                                shutdown(1);
+                            else
+                                start_gc(#'shutdown);
+
+                            return 0;
+                        :));
+            });
+
+            return 0;
+        });
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,214 @@
+/* Test the function profiler.
+ *
+ * A few functions are called with the profiler enabled, their calls
+ * and ticks shall show up in the result of function_profile().
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#include "/sys/configuration.h"
+#include "/sys/function_profile.h"
+#include "/sys/object_info.h"
+
+#define OBJECT "/dummy-function-profile"
+
+int leaf(int n)
+{
+    int x;
+
+    for (int i = 0; i < n; i++)
+        x += i;
+
+    return x;
+}
+
+int outer()
+{
+    int x;
+
+    for (int i = 0; i < 10; i++)
+        x += leaf(100);
+
+    return x;
+}
+
+int failing()
+{
+    leaf(100);
+    raise_error("Failing.\n");
+    return 0;
+}
+
+mixed *find_entry(string fun, varargs mixed *ob)
+{
+    foreach (mixed *entry : function_profile(sizeof(ob) ? ob[0] : this_object()))
+    {
+        if (entry[FP_FUNCTION] == fun)
+            return entry;
+    }
+
+    return 0;
+}
+
+/* Return the calls of the lfun <fun> in OBJECT in the profile
+ * of all programs.
+ */
+int count_calls(string fun)
+{
+    foreach (mixed *entry : function_profile())
+    {
+        if (entry[FP_PROGRAM] == OBJECT ".c" && entry[FP_FUNCTION] == fun)
+            return entry[FP_CALLS];
+    }
+
+    return 0;
+}
+
+mixed *tests = ({
+    ({ "Profiler is disabled by default", 0,
+        (:
+            return driver_info(DC_FUNCTION_PROFILING) == 0
+                && function_profile() == ({});
+        :)
+    }),
+    ({ "Profiling calls", 0,
+        (:
+            mixed *o, *l;
+
+            configure_driver(DC_FUNCTION_PROFILING, 1);
+            if (driver_info(DC_FUNCTION_PROFILING) != 1)
+                return 0;
+
+            outer();
+            outer();
+            configure_driver(DC_FUNCTION_PROFILING, 0);
+
+            o = find_entry("outer");
+            l = find_entry("leaf");
+
+            return o && l
+                && sizeof(o) == FP_SIZE
+                && o[FP_PROGRAM] == program_name()
+                && o[FP_CALLS] == 2 && l[FP_CALLS] == 20
+                && l[FP_SELF_TICKS] > 0
+                && l[FP_TOTAL_TICKS] == l[FP_SELF_TICKS]
+                && o[FP_TOTAL_TICKS] >= o[FP_SELF_TICKS] + l[FP_TOTAL_TICKS]
+                && o[FP_TOTAL_TIME] >= o[FP_SELF_TIME] + l[FP_TOTAL_TIME]
+                && l[FP_SELF_TIME] > 0;
+        :)
+    }),
+    ({ "Profile is kept after stopping", 0,
+        (:
+            outer();
+
+            return find_entry("outer")[FP_CALLS] == 2
+                && sizeof(function_profile()) >= 2;
+        :)
+    }),
+    ({ "Profile is reset when starting", 0,
+        (:
+            configure_driver(DC_FUNCTION_PROFILING, 1);
+            leaf(10);
+            configure_driver(DC_FUNCTION_PROFILING, 0);
+
+            return !find_entry("outer")
+                && find_entry("leaf")[FP_CALLS] == 1;
+        :)
+    }),
+    ({ "Destructed object", 0,
+        (:
+            return function_profile(0) == ({});
+        :)
+    }),
+    ({ "Calls aborted by an error", 0,
+        (:
+            mixed *f, *l;
+
+            configure_driver(DC_FUNCTION_PROFILING, 1);
+            catch(failing(); nolog);
+            configure_driver(DC_FUNCTION_PROFILING, 0);
+
+            f = find_entry("failing");
+            l = find_entry("leaf");
+
+            return f && l
+                && f[FP_CALLS] == 1 && l[FP_CALLS] == 1
+                && f[FP_TOTAL_TICKS] >= f[FP_SELF_TICKS] + l[FP_TOTAL_TICKS]
+                && f[FP_SELF_TICKS] > 0;
+        :)
+    }),
+#if __EFUN_DEFINED__(swap)
+    ({ "Stale profile is dropped when swapping", 0,
+        (:
+            object ob;
+            int result;
+
+            write_file(OBJECT ".c", "int fun() { return 1; }\n", 1);
+            ob = load_object(OBJECT);
+
+            configure_driver(DC_FUNCTION_PROFILING, 1);
+            ob->fun();
+            configure_driver(DC_FUNCTION_PROFILING, 1);
+            swap(ob, 1);
+            result = object_info(ob, OI_PROG_SWAPPED)
+                  && !count_calls("fun")
+                  && object_info(ob, OI_PROG_SWAPPED)
+                  && function_profile(ob) == ({});
+            configure_driver(DC_FUNCTION_PROFILING, 0);
+
+            destruct(ob);
+            rm(OBJECT ".c");
+            return result;
+        :)
+    }),
+    ({ "Profile is kept across swapping", 0,
+        (:
+            object ob;
+            int result;
+
+            write_file(OBJECT ".c", "int fun() { return 1; }\n", 1);
+            ob = load_object(OBJECT);
+
+            configure_driver(DC_FUNCTION_PROFILING, 1);
+            ob->fun();
+            ob->fun();
+            swap(ob, 1);
+            result = object_info(ob, OI_PROG_SWAPPED)
+                  && count_calls("fun") == 2
+                  && !object_info(ob, OI_PROG_SWAPPED);
+            ob->fun();
+            swap(ob, 1);
+            result = result && find_entry("fun", ob)[FP_CALLS] == 3;
+            configure_driver(DC_FUNCTION_PROFILING, 0);
+
+            /* Leave the profile swapped for the garbage collection. */
+            swap(ob, 1);
+            rm(OBJECT ".c");
+            return result && object_info(ob, OI_PROG_SWAPPED);
+        :)
+    }),
+#endif
+});
+
+void run_test()
+{
+    msg("\nRunning test for the function profiler:\n"
+          "---------------------------------------\n");
+
+    run_array(tests,
+        (:
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* Test the include file cache of the preprocessor.
+ *
+ * Repeated includes of an unchanged file shall be read from the cache,
+ * changes to the file shall be noticed.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#include "/sys/driver_info.h"
+
+#define HEADER "/dummy-include-cache.h"
+#define OBJECT "/dummy-include-cache-ob"
+
+int compile_value()
+{
+    object ob = find_object(OBJECT);
+    if (ob)
+        destruct(ob);
+
+    return load_object(OBJECT)->value();
+}
+
+void write_header(string content)
+{
+    rm(HEADER);
+    write_file(HEADER, content);
+}
+
+mixed *tests = ({
+    ({ "Initial compilation", 0,
+        (:
+            write_header("#define VALUE 1\n");
+            return compile_value() == 1;
+        :)
+    }),
+#if __EFUN_DEFINED__(driver_info) && defined(DI_NUM_INCLUDE_CACHE_LOOKUP_HITS)
+    ({ "Repeated include is found in the cache", 0,
+        (:
+            int hits = driver_info(DI_NUM_INCLUDE_CACHE_LOOKUP_HITS);
+            if (driver_info(DI_NUM_INCLUDE_CACHE_TABLE_SLOTS) == 0)
+                return 1; /* Cache is disabled. */
+            return compile_value() == 1
+                && driver_info(DI_NUM_INCLUDE_CACHE_LOOKUP_HITS) == hits + 1;
+        :)
+    }),
+#endif
+    ({ "Changed include file (different size)", 0,
+        (:
+            write_header("#define VALUE 22\n");
+            return compile_value() == 22;
+        :)
+    }),
+    ({ "Changed include file (same size)", 0,
+        (:
+            write_header("#define VALUE 33\n");
+            return compile_value() == 33;
+        :)
+    }),
+    ({ "Include file with changing defines", 0,
+        (:
+            write_header("#ifdef FIRST\n#define VALUE 4\n#else\n#define VALUE 5\n#define FIRST\n#endif\n");
+            rm(OBJECT ".c");
+            write_file(OBJECT ".c",
+                "#include \"" HEADER "\"\n"
+                "#undef VALUE\n"
+                "#include \"" HEADER "\"\n"
+                "int value() { return VALUE; }\n");
+            if (compile_value() != 4)
+                return 0;
+            return compile_value() == 4;
+        :)
+    }),
+    ({ "Line numbers after cached include", 0,
+        (:
+            write_header("#define VALUE __LINE__\n");
+            rm(OBJECT ".c");
+            write_file(OBJECT ".c",
+                "#include \"" HEADER "\"\n"
+                "int value() { return __LINE__; }\n");
+            if (compile_value() != 2)
+                return 0;
+            return compile_value() == 2;
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for the include cache:\n"
+          "-----------------------------------\n");
+
+    rm(OBJECT ".c");
+    write_file(OBJECT ".c",
+        "#include \"" HEADER "\"\n"
+        "int value() { return VALUE; }\n");
+
+    run_array(tests,
+        (:
+            object ob = find_object(OBJECT);
+            if (ob)
+                destruct(ob);
+            rm(HEADER);
+            rm(OBJECT ".c");
+
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
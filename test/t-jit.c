@@ -0,0 +1,213 @@
+/* Test the native code compiler.
+ *
+ * The functions are run with the compiler switched off and on,
+ * both runs shall give the same results, errors and eval costs.
+ * Drivers without the compiler just interpret both runs.
+ */
+#include "/inc/base.inc"
+#include "/inc/deep_eq.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#include "/sys/configuration.h"
+
+#define OBJECT "/dummy-jit-ob"
+
+int counter;
+
+int sum(int n)
+{
+    int x;
+
+    for (int i = 0; i < n; i++)
+        x += i * 3 - 1;
+
+    return x;
+}
+
+int collatz(int n)
+{
+    int steps;
+
+    while (n != 1)
+    {
+        if (n & 1)
+            n = 3 * n + 1;
+        else
+            n >>= 1;
+        steps++;
+    }
+
+    return steps;
+}
+
+int count_global(int n)
+{
+    while (n-- > 0 && counter >= 0)
+        counter++;
+
+    return counter;
+}
+
+int compare(int a, int b)
+{
+    return (a < b) + (a <= b) * 2 + (a > b) * 4 + (a >= b) * 8
+         + (a == b) * 16 + (a != b) * 32 + !a * 64;
+}
+
+mixed untyped_add(mixed a, mixed b, int n)
+{
+    mixed x = a;
+
+    while (n--)
+        x += b;
+
+    return x;
+}
+
+int overflow(int n)
+{
+    int x = 1;
+
+    while (n--)
+        x *= 2;
+
+    return x;
+}
+
+void endless()
+{
+    int i;
+
+    while (1)
+        i++;
+}
+
+mixed *run_all()
+{
+    counter = 0;
+
+    return ({ sum(1000), collatz(27), count_global(100), counter,
+              compare(1, 2), compare(2, 2), compare(0, -1),
+              untyped_add(1, 2, 5), untyped_add("a", "b", 3),
+              untyped_add(1, "b", 2), untyped_add(1.5, 1, 2),
+              catch(overflow(70); nolog),
+              catch(limited(#'endless, ({ 10000 })); nolog) });
+}
+
+/* Run <fun> with the compiler at <threshold>, return the result and
+ * the eval cost spent.
+ */
+mixed *run_with(int threshold, closure fun)
+{
+    int old = driver_info(DC_JIT_THRESHOLD);
+    int cost;
+    mixed result;
+
+    catch(configure_driver(DC_JIT_THRESHOLD, threshold); nolog);
+    cost = get_eval_cost();
+    result = funcall(fun);
+    cost -= get_eval_cost();
+    catch(configure_driver(DC_JIT_THRESHOLD, old); nolog);
+
+    return ({ result, cost });
+}
+
+/* Compile a new program with a hot loop, run it and destruct it again,
+ * so that the native code of many programs is allocated and freed.
+ */
+int run_program(int num)
+{
+    object ob;
+    int result;
+
+    rm(OBJECT ".c");
+    write_file(OBJECT ".c", sprintf(
+        "int loop(int n) { int x; while (n--) x += %d; return x; }\n", num));
+    ob = load_object(OBJECT);
+    result = ob->loop(10) + ob->loop(100);
+    destruct(ob);
+
+    return result;
+}
+
+mixed *tests = ({
+    ({ "Setting the threshold", 0,
+        (:
+            int old = driver_info(DC_JIT_THRESHOLD);
+            int result;
+
+            if (catch(configure_driver(DC_JIT_THRESHOLD, 5); nolog))
+                return old == -1;
+
+            result = driver_info(DC_JIT_THRESHOLD) == 5;
+            configure_driver(DC_JIT_THRESHOLD, old);
+
+            return result;
+        :)
+    }),
+    ({ "Illegal threshold", TF_ERROR,
+        (:
+            configure_driver(DC_JIT_THRESHOLD, -2);
+            return 0;
+        :)
+    }),
+    ({ "Same results as the interpreter", 0,
+        (:
+            mixed *interpreted = run_with(-1, #'run_all)[0];
+            mixed *compiled = run_with(0, #'run_all)[0];
+
+            return deep_eq(interpreted, compiled)
+                && interpreted[0] == 1497500 && interpreted[1] == 111
+                && interpreted[2] == 100 && interpreted[3] == 100
+                && interpreted[7] == 11 && interpreted[8] == "abbb"
+                && interpreted[9] == "1bb" && interpreted[10] == 3.5
+                && strstr(interpreted[11], "Numeric overflow") >= 0
+                && strstr(interpreted[12], "Too long evaluation") >= 0;
+        :)
+    }),
+    ({ "Same eval cost as the interpreter", 0,
+        (:
+            /* The first compiled run compiles the functions. */
+            run_with(0, (: sum(10) + collatz(27) :));
+
+            return run_with(-1, (: sum(1000) + collatz(27) :))[1]
+                == run_with(0, (: sum(1000) + collatz(27) :))[1];
+        :)
+    }),
+    ({ "Many compiled programs", 0,
+        (:
+            for (int i = 0; i < 100; i++)
+            {
+                if (run_with(0, (: run_program(i) :))[0] != 110 * i)
+                    return 0;
+            }
+
+            return 1;
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for the native code compiler:\n"
+          "------------------------------------------\n");
+
+    run_array(tests,
+        (:
+            rm(OBJECT ".c");
+
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,129 @@
+/* Code shapes touched by the branch threading after code generation:
+ * branches to branches and branches to returns.
+ */
+
+string log;
+
+void add(string str)
+{
+    log += str;
+}
+
+/* The end of the inner if branches to the branch over the outer else. */
+int nested_if(int a, int b)
+{
+    int res;
+
+    if (a)
+    {
+        if (b)
+            res = 1;
+        else
+            res = 2;
+    }
+    else
+        res = 3;
+
+    return res;
+}
+
+/* All branches end in the RETURN0 at the end of the function. */
+void void_if(int a, int b)
+{
+    if (a)
+    {
+        if (b)
+            add("ab");
+        else
+            add("a");
+    }
+    else if (b)
+        add("b");
+    else
+        add("-");
+}
+
+int loop_break(int n)
+{
+    int i, sum;
+
+    while (1)
+    {
+        if (i >= n)
+            break;
+        else if (i % 2)
+            sum += i;
+        else
+            sum -= i;
+
+        i++;
+    }
+
+    return sum;
+}
+
+int loop_continue(int *arr)
+{
+    int sum;
+
+    foreach (int x: arr)
+    {
+        if (x < 0)
+        {
+            if (x < -10)
+                continue;
+            sum -= x;
+        }
+        else
+            sum += x;
+    }
+
+    return sum;
+}
+
+/* The guarded code is longer than 256 bytes. */
+mixed long_catch(int a)
+{
+    if (a)
+    {
+        return catch(
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            add("1234567890"), add("1234567890"), add("1234567890"),
+            a > 1 ? throw("error") : 0
+        );
+    }
+    else
+        return -1;
+}
+
+int ternary(int a, int b)
+{
+    return a ? (b ? 1 : 2) : (b ? 3 : 4);
+}
+
+int run_test()
+{
+    log = "";
+    void_if(1, 1);
+    void_if(1, 0);
+    void_if(0, 1);
+    void_if(0, 0);
+
+    return nested_if(1, 1) == 1 && nested_if(1, 0) == 2 && nested_if(0, 1) == 3
+        && log == "abab-"
+        && loop_break(10) == 5
+        && loop_continue(({ 1, -2, 3, -20, 5 })) == 11
+        && long_catch(0) == -1
+        && long_catch(1) == 0
+        && long_catch(2) == "error"
+        && ternary(1, 1) == 1 && ternary(1, 0) == 2
+        && ternary(0, 1) == 3 && ternary(0, 0) == 4
+        && funcall(function int(int x) { if (x) { if (x > 1) x = 5; else x = 6; } else x = 7; return x; }, 2) == 5;
+}
@@ -0,0 +1,73 @@
+/* Operators with operands of known types use type-specialized
+ * instructions. When the values don't match their declared types,
+ * the generic operators take over.
+ */
+
+#pragma strong_types, no_rtt_checks
+
+int add(int a, int b) { return a + b; }
+int sub(int a, int b) { return a - b; }
+int lt(int a, int b) { return a < b; }
+int le(int a, int b) { return a <= b; }
+int gt(int a, int b) { return a > b; }
+int ge(int a, int b) { return a >= b; }
+
+float fadd(float a, float b) { return a + b; }
+float fsub(float a, float b) { return a - b; }
+float fmul(float a, float b) { return a * b; }
+float fdiv(float a, float b) { return a / b; }
+int flt(float a, float b) { return a < b; }
+int fge(float a, float b) { return a >= b; }
+
+mixed aidx(int* arr, int i) { return arr[i]; }
+mixed midx(mapping m, string key) { return m[key]; }
+
+/* Call <fun> with values that don't fit its declared argument types. */
+mixed untyped(string fun, varargs mixed* args)
+{
+    return apply(symbol_function(fun, this_object()), args);
+}
+
+int run_test()
+{
+    object ob = clone_object(this_object());
+    object* obs = ({ ob });
+    mapping m0 = m_allocate(0, 0);
+
+    destruct(ob);
+
+    return add(3, 4) == 7 && sub(3, 4) == -1
+        && lt(1, 2) && !lt(2, 2) && le(2, 2) && !le(3, 2)
+        && gt(3, 2) && !gt(2, 2) && ge(2, 2) && !ge(1, 2)
+        && fadd(1.5, 2.0) == 3.5 && fsub(1.5, 2.0) == -0.5
+        && fmul(1.5, 2.0) == 3.0 && fdiv(3.0, 2.0) == 1.5
+        && flt(1.0, 1.5) && !flt(1.5, 1.5) && fge(1.5, 1.5)
+        && aidx(({ 10, 20, 30 }), 2) == 30
+        && midx(([ "a": 1, "b": 2 ]), "b") == 2 && midx(([ "a": 1 ]), "c") == 0
+        && obs[0] == 0
+
+        /* Fallbacks to the generic operators. */
+        && untyped("add", "a", 1) == "a1"
+        && untyped("add", 1.5, 1) == 2.5
+        && untyped("sub", ({ 1, 2 }), ({ 2 }))[0] == 1
+        && untyped("lt", "a", "b")
+        && untyped("ge", 2.0, 1)
+        && untyped("fadd", 1, 2) == 3
+        && untyped("fmul", 2, 1.5) == 3.0
+        && untyped("flt", "a", "b")
+        && untyped("aidx", "abc", 1) == 'b'
+        && untyped("aidx", ([ 1: 2 ]), 1) == 2
+        && untyped("midx", ([ 1: 2 ]), 1) == 2
+        && untyped("midx", ({ 1, 2 }), 1) == 2
+
+        /* Errors are still raised with the operator's name. */
+        && strstr(catch(add(__INT_MAX__, 1); nolog), "Numeric overflow") >= 0
+        && strstr(catch(sub(-__INT_MAX__ - 1, 1); nolog), "Numeric overflow") >= 0
+        && strstr(catch(untyped("lt", 1, "a"); nolog), "to <") >= 0
+        && strstr(catch(fdiv(1.0, 0.0); nolog), "Division by zero") >= 0
+        && strstr(catch(fmul(__FLOAT_MAX__, 2.0); nolog), "Numeric overflow") >= 0
+        && strstr(catch(untyped("fsub", "a", 1.0); nolog), "to -") >= 0
+        && strstr(catch(aidx(({ 1 }), 1); nolog), "out of bounds") >= 0
+        && strstr(catch(aidx(({ 1 }), -1); nolog), "not a positive number") >= 0
+        && strstr(catch(midx(m0, "a"); nolog), "width 0") >= 0;
+}
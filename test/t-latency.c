@@ -0,0 +1,145 @@
+/* Test the latency histograms of the backend.
+ *
+ * The client sends a few commands to the server, afterwards the
+ * histograms shall contain consistent data and be written into
+ * the metrics file.
+ */
+#include "/inc/base.inc"
+#include "/inc/client.inc"
+
+#include "/sys/configuration.h"
+#include "/sys/driver_info.h"
+
+#define METRICS_FILE "latency-metrics.txt"
+#define NUM_LINES 5
+
+int received;
+
+int check_histogram(int what, int min_count)
+{
+    mixed *hist = driver_info(what);
+    int count;
+
+    if (sizeof(hist) != DIL_MAX || hist[DIL_COUNT] < min_count)
+        return 0;
+
+    if (hist[DIL_P50] > hist[DIL_P90] || hist[DIL_P90] > hist[DIL_P99]
+     || hist[DIL_P99] > hist[DIL_P999] || hist[DIL_P999] > hist[DIL_HIGHEST])
+        return 0;
+
+    foreach (int *bucket : hist[DIL_BUCKETS])
+        count += bucket[1];
+
+    return count == hist[DIL_COUNT] && hist[DIL_SUM] <= hist[DIL_COUNT] * hist[DIL_HIGHEST];
+}
+
+void check_results()
+{
+    string metrics = read_file("/" METRICS_FILE);
+
+    rm("/" METRICS_FILE);
+    configure_driver(DC_METRICS_FILE, 0);
+
+    foreach (int what : ({ DI_LATENCY_MESSAGE, DI_LATENCY_HEART_BEAT,
+                           DI_LATENCY_CALL_OUT, DI_LATENCY_PROCESS_OBJECTS,
+                           DI_LATENCY_CLEANUP }))
+    {
+        if (!check_histogram(what, 1))
+        {
+            msg("Failed: Histogram %d is inconsistent: %O\n", what, driver_info(what));
+            shutdown(1);
+            return;
+        }
+    }
+
+    if (!check_histogram(DI_LATENCY_COMMAND, NUM_LINES)
+     || !check_histogram(DI_LATENCY_COMMAND_ROUND_TRIP, NUM_LINES))
+    {
+        msg("Failed: Commands were not measured: %O %O\n",
+            driver_info(DI_LATENCY_COMMAND), driver_info(DI_LATENCY_COMMAND_ROUND_TRIP));
+        shutdown(1);
+        return;
+    }
+
+    if (!metrics
+     || strstr(metrics, "# TYPE ldmud_latency_seconds histogram") < 0
+     || strstr(metrics, "ldmud_latency_seconds_count{phase=\"command_round_trip\"}") < 0
+     || strstr(metrics, "ldmud_latency_seconds_bucket{phase=\"heart_beat\",le=\"+Inf\"}") < 0)
+    {
+        msg("Failed: Metrics file is incomplete: %O\n", metrics);
+        shutdown(1);
+        return;
+    }
+
+    msg("Success.\n");
+    shutdown(0);
+}
+
+/* This is the MUD object */
+void receive_line(string str)
+{
+    received++;
+    if (received < NUM_LINES)
+        input_to("receive_line");
+    else
+        write("done\n");
+}
+
+void run_server()
+{
+    input_to("receive_line");
+}
+
+/* This is the object simulating a player. */
+void receive(string str)
+{
+    if (str != "done")
+    {
+        msg("Failed: Received %Q.\n", str);
+        shutdown(1);
+        return;
+    }
+
+    /* Give the backend time for a few cycles and the metrics file. */
+    call_out(#'call_other, 4, blueprint(), "check_results");
+}
+
+void run_client()
+{
+    for (int i = 0; i < NUM_LINES; i++)
+        write(i + "\n");
+
+    call_out(#'shutdown, 20, 1); // If something goes wrong.
+    input_to("receive");
+}
+
+void run_test()
+{
+    msg("\nRunning test for the latency histograms:\n"
+          "----------------------------------------\n");
+
+    if (!catch(configure_driver(DC_METRICS_INTERVAL, 0); nolog)
+     || driver_info(DC_METRICS_FILE) != 0)
+    {
+        msg("Failed: Bad defaults or no error for an invalid interval.\n");
+        shutdown(1);
+        return;
+    }
+
+    configure_driver(DC_METRICS_INTERVAL, 1);
+    configure_driver(DC_METRICS_FILE, METRICS_FILE);
+    if (driver_info(DC_METRICS_FILE) != METRICS_FILE)
+    {
+        msg("Failed: Metrics file was not set: %O\n", driver_info(DC_METRICS_FILE));
+        shutdown(1);
+        return;
+    }
+
+    connect_self("run_server", "run_client");
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
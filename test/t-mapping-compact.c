@@ -0,0 +1,257 @@
+/* Test the compaction of mappings during the data cleanup.
+ *
+ * A new mapping is compacted completely. After a few changes a large
+ * mapping is compacted in steps instead, which move the added entries
+ * into the slots of deleted entries. The postponed compaction is counted
+ * only once, however many steps there are.
+ *
+ * A large mapping that only gets new entries has no deleted slots. Its
+ * steps merge the new entries into a larger condensed block, at most
+ * COMPACT_STEP_WORK entries per step.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/sys/configuration.h"
+#include "/sys/driver_info.h"
+#include "/sys/rtlimits.h"
+
+#define SIZE    4096
+#define CHANGES 40
+
+#define BIG_SIZE   100000
+#define BIG_ADDED  4096
+#define STEP_WORK  1024  /* COMPACT_STEP_WORK */
+
+#define BIG_LIMITS ({ LIMIT_KEEP, LIMIT_KEEP, LIMIT_UNLIMITED, LIMIT_UNLIMITED })
+
+mapping data;     /* The mapping, only in the holder. */
+mapping expected; /* Its contents, in the test object. */
+object holder;
+int old_clean_time, old_compact_time;
+int num_deferred, num_compactions, num_entries, num_steps;
+
+void set_data(mapping m) { data = m; }
+mapping query_data() { return data; }
+
+void finish(int errors)
+{
+    configure_driver(DC_DATA_CLEAN_TIME, old_clean_time);
+    configure_driver(DC_MAPPING_COMPACT_TIME, old_compact_time);
+    destruct(holder);
+
+    if (errors)
+        shutdown(1);
+    else
+        start_gc(#'shutdown);
+}
+
+int check_data()
+{
+    mapping m = holder->query_data();
+
+    if (sizeof(m) != sizeof(expected))
+        return 0;
+
+    foreach (mixed key, mixed val: expected)
+        if (!member(m, key) || m[key] != val)
+            return 0;
+
+    foreach (mixed key, mixed val: m)
+        if (!member(expected, key))
+            return 0;
+
+    return 1;
+}
+
+/* Call <next> when the driver_info() counter <what> exceeds <limit>. */
+void wait_for(int what, int limit, closure next, int tries)
+{
+    if (driver_info(what) > limit)
+    {
+        if (check_data())
+        {
+            msg(" Success.\n");
+            funcall(next);
+        }
+        else
+        {
+            msg(" FAILURE! (Wrong contents.)\n");
+            finish(1);
+        }
+    }
+    else if (tries <= 0)
+    {
+        msg(" FAILURE! (No compaction.)\n");
+        finish(1);
+    }
+    else
+        call_out(#'wait_for, 1, what, limit, next, tries - 1);
+}
+
+void big_steps(int tries)
+{
+    int steps = driver_info(DI_NUM_MAPPING_COMPACTION_STEPS) - num_steps;
+    int entries = driver_info(DI_NUM_MAPPING_COMPACTION_ENTRIES) - num_entries;
+
+    if (driver_info(DI_NUM_MAPPING_COMPACTIONS) != num_compactions)
+    {
+        msg(" FAILURE! (Compacted completely.)\n");
+        finish(1);
+    }
+    else if (entries > steps * STEP_WORK)
+    {
+        msg(" FAILURE! (%d entries merged by %d steps.)\n", entries, steps);
+        finish(1);
+    }
+    else if (entries == BIG_ADDED)
+    {
+        if (check_data())
+        {
+            msg(" Success.\n");
+            finish(0);
+        }
+        else
+        {
+            msg(" FAILURE! (Wrong contents.)\n");
+            finish(1);
+        }
+    }
+    else if (tries <= 0)
+    {
+        msg(" FAILURE! (Only %d entries merged.)\n", entries);
+        finish(1);
+    }
+    else
+        call_out(#'big_steps, 1, tries - 1);
+}
+
+void add_big()
+{
+    mapping m = holder->query_data();
+
+    /* Only add entries, spread over the whole mapping. */
+    for (int i = 0; i < BIG_ADDED; i++)
+    {
+        int key = i * (BIG_SIZE * 2 / BIG_ADDED) + 1;
+
+        m[key] = key;
+        expected[key] = key;
+    }
+}
+
+void big_compacted()
+{
+    limited(#'add_big, BIG_LIMITS);
+
+    num_compactions = driver_info(DI_NUM_MAPPING_COMPACTIONS);
+    num_entries = driver_info(DI_NUM_MAPPING_COMPACTION_ENTRIES);
+    num_steps = driver_info(DI_NUM_MAPPING_COMPACTION_STEPS);
+    msg("Running Test compaction steps of an insert-only mapping...");
+    big_steps(10 + 2 * BIG_ADDED / STEP_WORK);
+}
+
+void build_big()
+{
+    mapping m = ([]);
+
+    for (int i = 0; i < BIG_SIZE; i++)
+        m[i * 2] = i * 2;
+    expected = copy(m);
+    holder->set_data(m);
+}
+
+void start_big()
+{
+    limited(#'build_big, BIG_LIMITS);
+
+    msg("Running Test full compaction of a large mapping...");
+    wait_for(DI_NUM_MAPPING_COMPACTIONS,
+        driver_info(DI_NUM_MAPPING_COMPACTIONS), #'big_compacted, 10);
+}
+
+void steps_done()
+{
+    msg("Running Test no full compaction...");
+    if (driver_info(DI_NUM_MAPPING_COMPACTIONS) != num_compactions)
+    {
+        msg(" FAILURE! (Compacted completely.)\n");
+        finish(1);
+        return;
+    }
+    msg(" Success.\n");
+
+    msg("Running Test deferred compaction counted once...");
+    if (driver_info(DI_NUM_MAPPING_COMPACTIONS_DEFERRED) == num_deferred + 1)
+    {
+        msg(" Success.\n");
+        start_big();
+    }
+    else
+    {
+        msg(" FAILURE! (Counted %d times.)\n",
+            driver_info(DI_NUM_MAPPING_COMPACTIONS_DEFERRED) - num_deferred);
+        finish(1);
+    }
+}
+
+void compacted()
+{
+    mapping m = holder->query_data();
+
+    /* Delete some entries and add others near them, too few changes
+     * for a full compaction. The entry before all others has no
+     * deleted slot nearby, it is merged into a new condensed block
+     * when the deleted slots are used up.
+     */
+    for (int i = 0; i < CHANGES; i++)
+    {
+        int key = (SIZE / 2 + i) * 2;
+
+        m_delete(m, key);
+        m_delete(expected, key);
+        m[key + 21] = "value " + (key + 21);
+        expected[key + 21] = "value " + (key + 21);
+    }
+    m[-1] = "first";
+    expected[-1] = "first";
+    m = 0;
+
+    num_deferred = driver_info(DI_NUM_MAPPING_COMPACTIONS_DEFERRED);
+    num_compactions = driver_info(DI_NUM_MAPPING_COMPACTIONS);
+    num_entries = driver_info(DI_NUM_MAPPING_COMPACTION_ENTRIES);
+    msg("Running Test compaction steps...");
+    wait_for(DI_NUM_MAPPING_COMPACTION_ENTRIES, num_entries + CHANGES,
+        #'steps_done, 15);
+}
+
+void run_test()
+{
+    mapping m = ([]);
+
+    msg("\nRunning test for mapping compaction:\n"
+          "------------------------------------\n");
+
+    old_clean_time = driver_info(DC_DATA_CLEAN_TIME);
+    old_compact_time = driver_info(DC_MAPPING_COMPACT_TIME);
+    configure_driver(DC_DATA_CLEAN_TIME, 1);
+    configure_driver(DC_MAPPING_COMPACT_TIME, 0);
+
+    /* Cloned now, so it is cleaned up every second. */
+    holder = clone_object(this_object());
+
+    for (int i = 0; i < SIZE; i++)
+        m[i * 2] = "value " + (i * 2);
+    expected = copy(m);
+    holder->set_data(m);
+    m = 0;
+
+    msg("Running Test full compaction...");
+    wait_for(DI_NUM_MAPPING_COMPACTIONS,
+        driver_info(DI_NUM_MAPPING_COMPACTIONS), #'compacted, 10);
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
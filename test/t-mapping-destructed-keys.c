@@ -0,0 +1,113 @@
+/* Test the removal of mapping keys referencing destructed objects.
+ *
+ * Mappings remember whether they have keys referencing objects at all,
+ * the tests check that such keys are found in every case. They are run
+ * before and after a garbage collection, which compacts the mappings.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+mapping plain = ([ 1: 1, "a": 2 ]);
+mapping with_object;
+
+int fun() { return 1; }
+
+mixed *tests = ({
+    ({ "Object key added after a check", 0,
+        (:
+            mapping m = ([ 1: 1 ]);
+            object ob = clone_object(this_object());
+
+            /* Checks the mapping. */
+            destruct(clone_object(this_object()));
+            if (sizeof(m) != 1)
+                return 0;
+
+            m[ob] = 2;
+            destruct(ob);
+            return sizeof(m) == 1 && m[1] == 1;
+        :)
+    }),
+    ({ "Closure key", 0,
+        (:
+            mapping m = ([ 1: 1 ]);
+            object ob = clone_object(this_object());
+
+            m[symbol_function("fun", ob)] = 2;
+            destruct(ob);
+            return sizeof(m) == 1;
+        :)
+    }),
+    ({ "Copied mappings", 0,
+        (:
+            object ob = clone_object(this_object());
+            mapping m = ([ ob: 1 ]);
+            mapping sum = plain + m;
+            mapping wide = m_reallocate(m, 2);
+
+            destruct(ob);
+            return sizeof(m) == 0 && sizeof(sum) == 2 && sizeof(wide) == 0;
+        :)
+    }),
+    ({ "Global mapping", 0,
+        (:
+            object ob = with_object[0];
+
+            if (sizeof(with_object) != 3)
+                return 0;
+
+            destruct(ob);
+            return sizeof(with_object) == 2 && sizeof(plain) == 2;
+        :)
+    }),
+});
+
+void setup()
+{
+    object ob = clone_object(this_object());
+
+    with_object = ([ 0: ob, ob: 1, "b": 2 ]);
+}
+
+void run_test()
+{
+    msg("\nRunning test for destructed mapping keys:\n"
+          "-----------------------------------------\n");
+
+    setup();
+    run_array(tests,
+        function int(int error)
+        {
+            if (error)
+            {
+                shutdown(1);
+                return 0;
+            }
+
+            setup();
+            start_gc(function void(int gc_error)
+            {
+                if (gc_error)
+                    shutdown(1);
+                else
+                    run_array(tests,
+                        (:
+                            if($1)
+                                shutdown(1);
+                            else
+                                start_gc(#'shutdown);
+
+                            return 0;
+                        :));
+            });
+
+            return 0;
+        });
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,240 @@
+/* Test the hashed part of mappings.
+ *
+ * New keys are stored in hash chains, which remember the hash value
+ * of their key. The tests add enough keys for the hashtable to grow
+ * several times, delete some of them again and check that every key
+ * is still found (and deleted keys are not).
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#define SIZE 3000
+
+/* The keys of the different types, filled by run_test(). */
+string *strings;
+int *numbers;
+float *floats;
+object *objects;
+mixed *arrays;
+closure *closures;
+mixed *mixed_keys;
+
+/* Build a mapping from <keys> to their position in <keys>. */
+mapping build(mixed *keys)
+{
+    mapping m = ([]);
+
+    for (int i = 0; i < sizeof(keys); i++)
+        m[keys[i]] = i;
+
+    return m;
+}
+
+/* Check that <m> contains exactly the keys in <keys> for which
+ * <present> returns true, with their position as the value.
+ */
+int check(mapping m, mixed *keys, closure present)
+{
+    int num;
+
+    for (int i = 0; i < sizeof(keys); i++)
+    {
+        if (funcall(present, i))
+        {
+            if (!member(m, keys[i]) || m[keys[i]] != i)
+                return 0;
+            num++;
+        }
+        else if (member(m, keys[i]))
+            return 0;
+    }
+
+    return sizeof(m) == num;
+}
+
+/* Grow a mapping with <keys>, delete every third key, check the rest,
+ * then add the deleted keys again.
+ */
+int grow_and_delete(mixed *keys)
+{
+    mapping m = build(keys);
+
+    if (!check(m, keys, (: 1 :)))
+        return 0;
+
+    for (int i = 0; i < sizeof(keys); i += 3)
+        m_delete(m, keys[i]);
+
+    if (!check(m, keys, (: $1 % 3 :)))
+        return 0;
+
+    for (int i = 0; i < sizeof(keys); i += 3)
+        m[keys[i]] = i;
+
+    return check(m, keys, (: 1 :));
+}
+
+mixed *tests = ({
+    ({ "String keys", 0, (: grow_and_delete(strings) :) }),
+    ({ "Number keys", 0, (: grow_and_delete(numbers) :) }),
+    ({ "Float keys", 0, (: grow_and_delete(floats) :) }),
+    ({ "Object keys", 0, (: grow_and_delete(objects) :) }),
+    ({ "Array keys", 0, (: grow_and_delete(arrays) :) }),
+    ({ "Closure keys", 0, (: grow_and_delete(closures) :) }),
+    ({ "Mixed keys", 0, (: grow_and_delete(mixed_keys) :) }),
+    ({ "Keys in the same chain", 0,
+        (:
+            /* These all end up in the same chains of the smaller
+             * hashtables.
+             */
+            return grow_and_delete(map(numbers, (: $1 << 16 :)));
+        :)
+    }),
+    ({ "Equal strings", 0,
+        (:
+            /* Look up with strings that are not the same as the keys. */
+            mapping m = build(strings);
+
+            for (int i = 0; i < SIZE; i++)
+            {
+                string key = "str" + to_string(i);
+
+                if (m[key] != i)
+                    return 0;
+                m_delete(m, key);
+            }
+
+            return sizeof(m) == 0;
+        :)
+    }),
+    ({ "Deleting all keys", 0,
+        (:
+            mapping m = build(mixed_keys);
+
+            foreach (mixed key: mixed_keys)
+                m_delete(m, key);
+
+            return sizeof(m) == 0 && check(m + build(strings), strings, (: 1 :));
+        :)
+    }),
+    ({ "Deleting while iterating", 0,
+        (:
+            mapping m = build(mixed_keys);
+
+            foreach (mixed key, int val: m)
+                if (val % 2)
+                    m_delete(m, key);
+
+            return check(m, mixed_keys, (: !($1 % 2) :));
+        :)
+    }),
+    ({ "Adding while walking", 0,
+        (:
+            mapping m = build(strings[0..SIZE/2-1]);
+
+            walk_mapping(m,
+                function void(string key, int val)
+                {
+                    m[strings[val + SIZE/2]] = val + SIZE/2;
+                });
+
+            return check(m, strings, (: 1 :));
+        :)
+    }),
+    ({ "Copying", 0,
+        (:
+            mapping m = build(mixed_keys);
+            mapping m2 = copy(m);
+
+            m_delete(m, mixed_keys[0]);
+            return check(m2, mixed_keys, (: 1 :))
+                && check(m, mixed_keys, (: $1 :));
+        :)
+    }),
+    ({ "Changing the width", 0,
+        (:
+            mapping m = build(mixed_keys);
+
+            m = m_reallocate(m, 3);
+            for (int i = 0; i < sizeof(mixed_keys); i += 3)
+                m_delete(m, mixed_keys[i]);
+            return widthof(m) == 3 && check(m, mixed_keys, (: $1 % 3 :));
+        :)
+    }),
+    ({ "Adding to literal mappings", 0,
+        (:
+            /* The literal keys are in the condensed part. */
+            mapping m = ([ strings[0]: 0, numbers[1]: 1, floats[2]: 2 ]);
+            mixed *keys = ({ strings[0], numbers[1], floats[2] }) + mixed_keys[3..];
+
+            for (int i = 3; i < sizeof(keys); i++)
+                m[keys[i]] = i;
+            for (int i = 0; i < sizeof(keys); i += 2)
+                m_delete(m, keys[i]);
+
+            return check(m, keys, (: $1 % 2 :));
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for hashed mappings:\n"
+          "---------------------------------\n");
+
+    strings = allocate(SIZE);
+    numbers = allocate(SIZE);
+    floats = allocate(SIZE);
+    objects = allocate(SIZE / 6 + 1);
+    arrays = allocate(SIZE);
+    closures = allocate(SIZE);
+    mixed_keys = allocate(SIZE);
+
+    for (int i = 0; i < SIZE; i++)
+    {
+        strings[i] = "str" + i;
+        numbers[i] = (i % 2) ? i : -i * 7919;
+        floats[i] = i / 3.0;
+        arrays[i] = ({ i });
+        closures[i] = lambda(0, i);
+    }
+
+    for (int i = 0; i < sizeof(objects); i++)
+        objects[i] = clone_object(this_object());
+
+    for (int i = 0; i < SIZE; i++)
+    {
+        switch (i % 6)
+        {
+            case 0: mixed_keys[i] = strings[i]; break;
+            case 1: mixed_keys[i] = numbers[i]; break;
+            case 2: mixed_keys[i] = floats[i]; break;
+            case 3: mixed_keys[i] = objects[i / 6]; break;
+            case 4: mixed_keys[i] = arrays[i]; break;
+            case 5: mixed_keys[i] = to_bytes(strings[i], "ASCII"); break;
+        }
+    }
+
+    run_array(tests,
+        (:
+            objects->remove();
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+void remove()
+{
+    destruct(this_object());
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
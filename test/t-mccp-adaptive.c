@@ -0,0 +1,137 @@
+/* Test the adaptive MCCP compression level.
+ *
+ * The server side of a connection compresses its output in adaptive
+ * mode. A call_out then keeps the backend busy beyond the next alarm,
+ * so the following output must use level 1. The level must stay there
+ * while the backend keeps up for less than 10 seconds, and return to
+ * level 6 afterwards.
+ */
+#include "/inc/base.inc"
+#include "/inc/client.inc"
+
+#include "/sys/configuration.h"
+#include "/sys/interactive_info.h"
+
+#define MIN_LEVEL  1
+#define MAX_LEVEL  6
+#define DELAY      10  /* MCCP_ADAPTIVE_DELAY */
+
+int overload_time;
+
+void fail(string reason)
+{
+    msg(" FAILURE! (%s)\n", reason);
+    shutdown(1);
+}
+
+int level()
+{
+    return interactive_info(this_object(), II_MCCP_STREAM_LEVEL);
+}
+
+void overload()
+{
+    int *start = utime();
+    int *now;
+
+    if (level() != MAX_LEVEL)
+    {
+        fail(sprintf("Started with level %d instead of %d", level(), MAX_LEVEL));
+        return;
+    }
+
+    /* Stay busy until the next alarm is surely overdue. */
+    do
+    {
+        now = utime();
+    } while ((now[0] - start[0]) * 1000000 + now[1] - start[1]
+             < (__ALARM_TIME__ + 1) * 1000000);
+
+    /* This is written while the heart beat is still due. */
+    overload_time = time();
+    write("busy\n");
+    call_out("check_level", 1);
+}
+
+void check_level()
+{
+    int lvl = level();
+
+    if (lvl == MAX_LEVEL)
+    {
+        if (time() - overload_time < DELAY)
+        {
+            fail(sprintf("Returned to level %d after %d seconds",
+                MAX_LEVEL, time() - overload_time));
+            return;
+        }
+
+        msg(" Success.\n");
+        shutdown(0);
+        return;
+    }
+
+    if (lvl != MIN_LEVEL)
+    {
+        fail(sprintf("Level %d instead of %d", lvl, MIN_LEVEL));
+        return;
+    }
+
+    if (time() - overload_time > DELAY + 5)
+    {
+        fail(sprintf("Still at level %d after %d seconds",
+            MIN_LEVEL, time() - overload_time));
+        return;
+    }
+
+    /* The level is changed only when there is output. */
+    write("idle\n");
+    call_out("check_level", 1);
+}
+
+void run_server()
+{
+    configure_interactive(this_object(), IC_MCCP_LEVEL, -1);
+    configure_interactive(this_object(), IC_MCCP, 1);
+
+    call_out("overload", 1);
+}
+
+void run_client()
+{
+    input_to("client_input");
+    call_out("end_client", 30);
+}
+
+void client_input(string str)
+{
+    /* Just ignore the compressed data. */
+    input_to("client_input");
+}
+
+void end_client()
+{
+    msg(" FAILURE! (Timeout)\n");
+    shutdown(1);
+}
+
+void run_test()
+{
+    msg("\nRunning test for the adaptive MCCP level:\n"
+          "-----------------------------------------\n");
+
+    msg("Running Test overloaded backend...");
+
+#ifdef __MCCP__
+    connect_self("run_server", "run_client");
+#else
+    msg(" Success.\n");
+    shutdown(0);
+#endif
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
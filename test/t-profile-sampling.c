@@ -0,0 +1,132 @@
+/* Test the sampling profiler.
+ *
+ * A busy function is run with the profiler enabled, its call stack
+ * shall show up in the collapsed stacks.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#include "/sys/driver_info.h"
+#include "/sys/rtlimits.h"
+
+#define NUM_SAMPLES      5
+#define NUM_MANY_SAMPLES 1100
+
+int busy_loop(int num)
+{
+    int start = driver_info(DI_NUM_PROFILE_SAMPLES);
+    int end = time() + 15;
+    int x;
+
+    while (driver_info(DI_NUM_PROFILE_SAMPLES) < start + num
+        && time() < end)
+    {
+        for (int i = 0; i < 1000; i++)
+            x += i;
+    }
+
+    return driver_info(DI_NUM_PROFILE_SAMPLES) >= start + num;
+}
+
+int run_profiled(int num)
+{
+    return busy_loop(num);
+}
+
+/* Return the total number of samples in the collapsed stacks. */
+int count_samples()
+{
+    int total;
+
+    foreach (string line : explode(driver_info(DI_PROFILE_SAMPLES_AS_STRING), "\n") - ({""}))
+    {
+        string stack;
+        int count;
+
+        if (sscanf(line, "%s %d", stack, count) != 2 || count <= 0)
+            return -1;
+        total += count;
+    }
+
+    return total;
+}
+
+mixed *tests = ({
+    ({ "Profiler is disabled by default", 0,
+        (:
+            return driver_info(DC_PROFILE_SAMPLE_INTERVAL) == 0
+                && driver_info(DI_PROFILE_SAMPLES_AS_STRING) == "";
+        :)
+    }),
+    ({ "Negative interval", TF_ERROR,
+        (:
+            configure_driver(DC_PROFILE_SAMPLE_INTERVAL, -1);
+            return 0;
+        :)
+    }),
+    ({ "Taking samples", 0,
+        (:
+            int result;
+
+            configure_driver(DC_PROFILE_SAMPLE_INTERVAL, 1000);
+            if (driver_info(DC_PROFILE_SAMPLE_INTERVAL) != 1000)
+                return 0;
+
+            result = limited(#'run_profiled, ({ LIMIT_UNLIMITED }), NUM_SAMPLES);
+            configure_driver(DC_PROFILE_SAMPLE_INTERVAL, 0);
+
+            return result;
+        :)
+    }),
+    ({ "Collapsed stacks", 0,
+        (:
+            string *lines = explode(driver_info(DI_PROFILE_SAMPLES_AS_STRING), "\n") - ({""});
+
+            return count_samples() >= NUM_SAMPLES
+                && sizeof(regexp(lines, "t-profile-sampling.c:run_profiled;t-profile-sampling.c:busy_loop "));
+        :)
+    }),
+    ({ "Samples are kept after stopping", 0,
+        (:
+            return driver_info(DC_PROFILE_SAMPLE_INTERVAL) == 0
+                && driver_info(DI_PROFILE_SAMPLES_AS_STRING) != "";
+        :)
+    }),
+    ({ "All samples are counted", 0,
+        (:
+            int start, result;
+
+            /* Restarting discards the old samples. */
+            configure_driver(DC_PROFILE_SAMPLE_INTERVAL, 100);
+            start = driver_info(DI_NUM_PROFILE_SAMPLES);
+            result = limited(#'run_profiled, ({ LIMIT_UNLIMITED }), NUM_MANY_SAMPLES);
+            configure_driver(DC_PROFILE_SAMPLE_INTERVAL, 0);
+
+            return result
+                && count_samples() == driver_info(DI_NUM_PROFILE_SAMPLES) - start;
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for the sampling profiler:\n"
+          "---------------------------------------\n");
+
+    run_array(tests,
+        (:
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
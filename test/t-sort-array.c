@@ -0,0 +1,172 @@
+/* Test the native sorting in sort_array() and sort_array_by().
+ *
+ * The results are compared with sort_array() using an inline closure,
+ * which is called for each comparison.
+ */
+#include "/inc/base.inc"
+#include "/inc/deep_eq.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+#define SIZE 1000
+
+int *numbers;
+string *strings;
+mixed *pairs;
+int calls;
+
+int key_fun(mixed *pair, int idx) { return pair[idx]; }
+
+mixed *tests = ({
+    ({ "sort_array with #'>", 0,
+        (: deep_eq(sort_array(numbers, #'>), sort_array(numbers, (: $1 > $2 :))) :) }),
+    ({ "sort_array with #'<", 0,
+        (: deep_eq(sort_array(numbers, #'<), sort_array(numbers, (: $1 < $2 :))) :) }),
+    ({ "sort_array with strings", 0,
+        (:
+            return deep_eq(sort_array(strings, #'>), sort_array(strings, (: $1 > $2 :)))
+                && deep_eq(sort_array(strings, #'<), sort_array(strings, (: $1 < $2 :)));
+        :)
+    }),
+    ({ "sort_array with extreme numbers", 0,
+        (:
+            int *arr = ({ __INT_MAX__, 0, __INT_MIN__, -1, 1, __INT_MIN__ + 1 });
+
+            return deep_eq(sort_array(arr, #'>),
+                           ({ __INT_MIN__, __INT_MIN__ + 1, -1, 0, 1, __INT_MAX__ }));
+        :)
+    }),
+    ({ "sort_array with mixed types", TF_ERROR,
+        (: sort_array(({ 1, "a", 2 }), #'>) :) }),
+    ({ "sort_array in place", 0,
+        (:
+            int *arr = copy(numbers);
+            int *orig = arr;
+
+            sort_array(&arr, #'<);
+            return arr == orig && deep_eq(arr, sort_array(numbers, (: $1 < $2 :)));
+        :)
+    }),
+    ({ "sort_array_by numbers", 0,
+        (:
+            /* Equal keys shall keep their order. */
+            return deep_eq(sort_array_by(pairs, (: $1[0] :)),
+                           sort_array(pairs, (: $1[0] > $2[0] :)));
+        :)
+    }),
+    ({ "sort_array_by floats", 0,
+        (:
+            float *arr = map(numbers, (: $1 / 7.0 :)) + ({ 0.0, -0.0, 0.0 });
+
+            return deep_eq(sort_array_by(arr, (: $1 :)), sort_array(arr, (: $1 > $2 :)));
+        :)
+    }),
+    ({ "sort_array_by numbers and floats", 0,
+        (:
+            mixed *arr = map(numbers, (: ($1 & 1) ? $1 / 3.0 : $1 :));
+
+            return deep_eq(sort_array_by(arr, (: $1 :)), sort_array(arr, (: $1 > $2 :)));
+        :)
+    }),
+    ({ "sort_array_by strings", 0,
+        (:
+            return deep_eq(sort_array_by(pairs, (: $1[1] :)),
+                           sort_array(pairs, (: $1[1] > $2[1] :)));
+        :)
+    }),
+    ({ "sort_array_by bytes", 0,
+        (:
+            bytes *arr = map(strings, #'to_bytes, "UTF-8");
+
+            return deep_eq(sort_array_by(arr, (: $1 :)), sort_array(arr, (: $1 > $2 :)));
+        :)
+    }),
+    ({ "sort_array_by with extra arguments", 0,
+        (:
+            return deep_eq(sort_array_by(pairs, #'key_fun, 0),
+                           sort_array(pairs, (: $1[0] > $2[0] :)))
+                && deep_eq(sort_array_by(pairs, "key_fun", this_object(), 0),
+                           sort_array(pairs, (: $1[0] > $2[0] :)));
+        :)
+    }),
+    ({ "sort_array_by calls once per element", 0,
+        (:
+            calls = 0;
+            sort_array_by(numbers, function int(int n) { calls++; return n; });
+            return calls == SIZE;
+        :)
+    }),
+    ({ "sort_array_by with mixed keys", TF_ERROR,
+        (: sort_array_by(({ 1, "a", 2 }), (: $1 :)) :) }),
+    ({ "sort_array_by with bad keys", TF_ERROR,
+        (: sort_array_by(({ 1, 2 }), (: ({ $1 }) :)) :) }),
+    ({ "sort_array_by in place", 0,
+        (:
+            mixed *arr = copy(pairs);
+            mixed *orig = arr;
+
+            sort_array_by(&arr, (: $1[0] :));
+            return arr == orig
+                && deep_eq(arr, sort_array(pairs, (: $1[0] > $2[0] :)));
+        :)
+    }),
+    ({ "sort_array_by range", 0,
+        (:
+            int *arr = ({ 5,1,7,4,8,3,0 });
+            mixed result = sort_array_by(&(arr[1..5]), (: -$1 :));
+
+            return deep_eq(arr, ({ 5,8,7,4,3,1,0 }))
+                && deep_eq(result, ({ 8,7,4,3,1 }));
+        :)
+    }),
+    ({ "sort_array_by mapping range", 0,
+        (:
+            mapping m = ([ "K": 5;1;7;4;8;3;0 ]);
+            mixed result = sort_array_by(&(m["K",1..5]), (: $1 :));
+
+            return deep_eq(m, ([ "K": 5;1;3;4;7;8;0 ]))
+                && deep_eq(result, ({ 1,3,4,7,8 }));
+        :)
+    }),
+    ({ "sort_array_by vanishing mapping entry", 0,
+        (:
+            mapping m = ([ "K": 5;1;7;4;8;3;0 ]);
+
+            sort_array_by(&(m["K",1..5]), (: m_delete(m, "K"); return $1; :));
+            return sizeof(m) == 0;
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for native sorting:\n"
+          "--------------------------------\n");
+
+    numbers = allocate(SIZE);
+    strings = allocate(SIZE);
+    pairs = allocate(SIZE);
+    for (int i = 0; i < SIZE; i++)
+    {
+        numbers[i] = (i % 10) ? random(200) - 100
+                              : random(__INT_MAX__) - __INT_MAX__/2;
+        strings[i] = "s" + numbers[i];
+        pairs[i] = ({ numbers[i] % 10, strings[i % 100], i });
+    }
+
+    run_array(tests,
+        (:
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,209 @@
+/* Test the queued SQLite efuns and the statement cache.
+ *
+ * Several queries are queued with sl_exec_queued() and sl_exec_stream(),
+ * their callbacks record the results, which are checked after all
+ * of them have been called.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/deep_eq.inc"
+#include "/inc/testarray.inc"
+
+#ifdef __SQLITE__
+
+#include "/sys/sqlite.h"
+
+#define DB_FILE "/t-sqlite-queued.db"
+
+mapping results = ([]); /* id: ({ ({type, data}), ... }) */
+int *expected;          /* The IDs whose results we are waiting for */
+
+void on_result(int type, mixed data, int id)
+{
+    results[id] = (results[id] || ({})) + ({ ({ type, data }) });
+
+    if (type != SL_ROW)
+        expected -= ({ id });
+
+    if (!sizeof(expected))
+    {
+        remove_call_out("timeout");
+        call_out("check_results", 0);
+    }
+}
+
+int q_all, q_stream, q_error, q_empty, q_update, q_after, q_destructed;
+
+mixed *tests = ({
+    ({ "Statement cache", 0,
+        (:
+            sl_exec("CREATE TABLE t (n INTEGER PRIMARY KEY, s TEXT)");
+            for (int i = 1; i <= 20; i++)
+                sl_exec("INSERT INTO t (n, s) VALUES (?, ?)", i, "x" + i);
+
+            return deep_eq(sl_exec("SELECT count(*), sum(n) FROM t"), ({ ({ 20, 210 }) }))
+                && deep_eq(sl_exec("SELECT s FROM t WHERE n = ?", 7), ({ ({ "x7" }) }))
+                && deep_eq(sl_exec("SELECT s FROM t WHERE n = ?", 8), ({ ({ "x8" }) }));
+        :)
+    }),
+    ({ "Cached statement after an error", 0,
+        (:
+            if (!catch(sl_exec("INSERT INTO t (n, s) VALUES (?, ?)", 1, "dup")))
+                return 0;
+            sl_exec("INSERT INTO t (n, s) VALUES (?, ?)", 21, "x21");
+            sl_exec("DELETE FROM t WHERE n = ?", 21);
+            return deep_eq(sl_exec("SELECT count(*) FROM t"), ({ ({ 20 }) }));
+        :)
+    }),
+    ({ "sl_exec_queued with a bad argument", TF_ERROR,
+        (:
+            return sl_exec_queued(#'on_result, "SELECT ?", ({}));
+        :)
+    }),
+    ({ "sl_exec_queued with a syntax error", TF_ERROR,
+        (:
+            return sl_exec_queued(#'on_result, "SELEKT 1");
+        :)
+    }),
+    ({ "Queueing queries", 0,
+        (:
+            q_all = sl_exec_queued(#'on_result, "SELECT n, s FROM t ORDER BY n");
+            q_stream = sl_exec_stream(#'on_result, "SELECT n FROM t WHERE n < ? ORDER BY n", 5);
+            q_error = sl_exec_queued(#'on_result, "INSERT INTO t (n, s) VALUES (?, ?)", 1, "dup");
+            q_empty = sl_exec_queued(#'on_result, "SELECT n FROM t WHERE n > 100");
+            q_update = sl_exec_queued(#'on_result, "UPDATE t SET s = ? WHERE n = ?", "new", 1);
+            q_after = sl_exec_stream(#'on_result, "SELECT s FROM t WHERE n = 1");
+
+            expected = ({ q_all, q_stream, q_error, q_empty, q_update, q_after });
+            return sizeof(expected - ({ 0 })) == 6
+                && sizeof(mkmapping(expected)) == 6;
+        :)
+    }),
+    ({ "Query with a destructed callback object", 0,
+        (:
+            object ob = clone_object(this_object());
+            q_destructed = sl_exec_queued(symbol_function("on_result", ob), "SELECT n FROM t");
+            destruct(ob);
+            return q_destructed != 0;
+        :)
+    }),
+    ({ "No results before the backend", 0,
+        (:
+            return !sizeof(results);
+        :)
+    }),
+    ({ "Synchronous query while queries are pending", 0,
+        (:
+            return deep_eq(sl_exec("SELECT n, s FROM t ORDER BY n")[0], ({ 1, "x1" }));
+        :)
+    }),
+});
+
+mixed *queued_tests = ({
+    ({ "sl_exec_queued result", 0,
+        (:
+            mixed *res = results[q_all];
+            return sizeof(res) == 1 && res[0][0] == SL_RESULT
+                && sizeof(res[0][1]) == 20
+                && deep_eq(res[0][1][0], ({ 1, "x1" }))
+                && deep_eq(res[0][1][19], ({ 20, "x20" }));
+        :)
+    }),
+    ({ "sl_exec_stream rows", 0,
+        (:
+            return deep_eq(results[q_stream], ({
+                ({ SL_ROW, ({ 1 }) }), ({ SL_ROW, ({ 2 }) }),
+                ({ SL_ROW, ({ 3 }) }), ({ SL_ROW, ({ 4 }) }),
+                ({ SL_RESULT, 4 }) }));
+        :)
+    }),
+    ({ "Error result", 0,
+        (:
+            mixed *res = results[q_error];
+            return sizeof(res) == 1 && res[0][0] == SL_ERROR && stringp(res[0][1]);
+        :)
+    }),
+    ({ "Empty result", 0,
+        (:
+            return deep_eq(results[q_empty], ({ ({ SL_RESULT, 0 }) }));
+        :)
+    }),
+    ({ "Queries are executed in order", 0,
+        (:
+            return deep_eq(results[q_after], ({ ({ SL_ROW, ({ "new" }) }), ({ SL_RESULT, 1 }) }));
+        :)
+    }),
+    ({ "Destructed callback object wasn't called", 0,
+        (:
+            return !member(results, q_destructed);
+        :)
+    }),
+    ({ "Destructing an object with pending queries", 0,
+        (:
+            object ob = clone_object(this_object());
+            ob->queue_and_destruct();
+            return !ob;
+        :)
+    }),
+});
+
+void queue_and_destruct()
+{
+    sl_open(DB_FILE);
+    sl_exec_stream(#'on_result, "SELECT n FROM t");
+    destruct(this_object());
+}
+
+void finish(int errors)
+{
+    sl_close();
+    rm(DB_FILE);
+
+    if (errors)
+        shutdown(1);
+    else
+        start_gc(#'shutdown);
+}
+
+void check_results()
+{
+    finish(run_array_without_callback(queued_tests));
+}
+
+void timeout()
+{
+    msg("FAILURE! Missing results for queries %O.\n", expected);
+    finish(1);
+}
+
+void run_test()
+{
+    msg("\nRunning test for queued SQLite queries:\n"
+          "---------------------------------------\n");
+
+    rm(DB_FILE);
+    sl_open(DB_FILE);
+
+    if (run_array_without_callback(tests))
+    {
+        finish(1);
+        return;
+    }
+
+    call_out("timeout", 5);
+}
+
+#else
+
+void run_test()
+{
+    shutdown(0);
+}
+
+#endif
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
@@ -0,0 +1,153 @@
+/* Test the addition to strings with +=.
+ *
+ * Strings with just one reference are extended in place, the tests
+ * check that other references to the string don't see the change.
+ */
+#include "/inc/base.inc"
+#include "/inc/gc.inc"
+#include "/inc/testarray.inc"
+
+string global = "";
+
+mixed *tests = ({
+    ({ "Building a string", 0,
+        (:
+            string s = "";
+            string *parts = ({});
+
+            for (int i = 0; i < 2000; i++)
+            {
+                s += "line " + i + "\n";
+                parts += ({ "line " + i });
+            }
+
+            return s == implode(parts, "\n") + "\n";
+        :)
+    }),
+    ({ "Numbers and floats", 0,
+        (:
+            string s = "x";
+
+            for (int i = 0; i < 100; i++)
+            {
+                s += i;
+                s += 0.5;
+            }
+
+            return sizeof(s) == 1 + 190 + 100 * 3 && s[0..4] == "x00.5";
+        :)
+    }),
+    ({ "Other references", 0,
+        (:
+            string s = "abc" + "def";
+            string *copies = ({});
+
+            for (int i = 0; i < 100; i++)
+            {
+                copies += ({ s });
+                s += "g";
+            }
+
+            for (int i = 0; i < 100; i++)
+                if (sizeof(copies[i]) != 6 + i)
+                    return 0;
+
+            return sizeof(s) == 106;
+        :)
+    }),
+    ({ "Appending itself", 0,
+        (:
+            string s = "ab" + "c";
+
+            for (int i = 0; i < 5; i++)
+                s += s;
+
+            return sizeof(s) == 3 * 32 && s[<3..] == "abc";
+        :)
+    }),
+    ({ "Mapping keys", 0,
+        (:
+            string s = "key" + 1;
+            mapping m = ([]);
+
+            s += "a";
+            m[s] = 1;
+            s += "b";
+            m[s] = 2;
+
+            return m["key1a"] == 1 && m["key1ab"] == 2 && sizeof(m) == 2;
+        :)
+    }),
+    ({ "Unicode", 0,
+        (:
+            string s = "a" + "b";
+
+            s += "\u00e4";
+            s += "c";
+            s += 1;
+
+            return sizeof(s) == 5 && s[2] == 0xe4 && s[3] == 'c'
+                && to_bytes(s, "UTF-8") == to_bytes("ab\u00e4c1", "UTF-8");
+        :)
+    }),
+    ({ "Bytes", 0,
+        (:
+            bytes b = to_bytes(({ 1, 2 }));
+
+            for (int i = 0; i < 100; i++)
+                b += to_bytes(({ i }));
+
+            return sizeof(b) == 102 && b[101] == 99;
+        :)
+    }),
+    ({ "Char references", 0,
+        (:
+            string s = "abc" + "def";
+            mixed c = 0 || &(s[0]);
+
+            s += "g";
+            c = 'x';
+
+            return s == "xbcdefg" || s == "abcdefg";
+        :)
+    }),
+    ({ "Global variables", 0,
+        (:
+            for (int i = 0; i < 100; i++)
+                global += "x";
+
+            return sizeof(global) == 100 && global[99] == 'x';
+        :)
+    }),
+    ({ "Value of the assignment", 0,
+        (:
+            string s = "a" + "b";
+            string t = (s += "c");
+
+            s += "d";
+            return t == "abc" && s == "abcd";
+        :)
+    }),
+});
+
+void run_test()
+{
+    msg("\nRunning test for string additions:\n"
+          "----------------------------------\n");
+
+    run_array(tests,
+        (:
+            if($1)
+                shutdown(1);
+            else
+                start_gc(#'shutdown);
+
+            return 0;
+        :));
+}
+
+string *epilog(int eflag)
+{
+    run_test();
+    return 0;
+}
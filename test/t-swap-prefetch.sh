@@ -0,0 +1,14 @@
+#! /bin/sh
+
+ulimit -c 0
+OPTIONS=""
+# filter --check-refcounts, it swaps in all objects in each cycle
+for option in ${DRIVER_DEFAULTS}; do
+    case ${option} in
+    --check-refcounts) ;;
+    *)  OPTIONS="${OPTIONS} ${option}" ;;
+    esac
+done
+
+${DRIVER} ${OPTIONS} -mswap-prefetch -Mmaster.c ${PORT} \
+    --debug-file .${TEST_LOGFILE} > "${TEST_OUTPUTFILE}"